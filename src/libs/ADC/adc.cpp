@@ -4,6 +4,7 @@
  */
 #include "mbed.h"
 #include "adc.h"
+#include "Perf.h"
 
 using namespace mbed;
 
@@ -92,7 +93,9 @@ ADC::ADC(int sample_rate, int cclk_div)
 
 void ADC::_adcisr(void)
 {
+    PERF_START(cycles);
     instance->adcisr();
+    PERF_ISR(ADC_SAMPLE, cycles);
 }
 
 
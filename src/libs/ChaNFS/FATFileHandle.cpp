@@ -9,6 +9,10 @@
 #include "ff.h"
 #include "FATFileSystem.h"
 
+// initial and maximum number of items in the cluster link map table of a file, each fragment of the file takes two
+#define CLMT_INITIAL_SIZE 32
+#define CLMT_MAX_SIZE     256
+
 namespace mbed {
 
 #if FFSDEBUG_ENABLED
@@ -32,11 +36,48 @@ static const char *FR_ERRORS[] = {
 
 FATFileHandle::FATFileHandle(FIL_t fh) {
     _fh = fh;
+    // fast seek can not extend the cluster chain so is only used for files opened read only,
+    // the link map is made on the first seek into the middle of the file as most files are only read through
+    _linkmap_pending = !(_fh.flag & FA_WRITE);
+}
+
+// build the cluster link map table so seeks do not have to follow the FAT chain from the start of the file
+void FATFileHandle::create_linkmap() {
+#if _USE_FASTSEEK
+    _fh.cltbl = NULL;
+    if(_fh.sclust == 0) return; // empty file
+
+    DWORD size = CLMT_INITIAL_SIZE;
+    for(;;) {
+        DWORD *tbl = (DWORD *)malloc(size * sizeof(DWORD));
+        if(tbl == NULL) break;
+        tbl[0] = size;
+        _fh.cltbl = tbl;
+        FRESULT res = f_lseek(&_fh, CREATE_LINKMAP);
+        if(res == FR_OK) {
+            FFSDEBUG("create_linkmap: %d items\n", tbl[0]);
+            return;
+        }
+
+        // on FR_NOT_ENOUGH_CORE the first item is the size that is needed
+        DWORD needed = tbl[0];
+        _fh.cltbl = NULL;
+        free(tbl);
+        if(res != FR_NOT_ENOUGH_CORE || needed > CLMT_MAX_SIZE) break;
+        size = needed;
+    }
+
+    // too fragmented or out of memory, use normal seeks
+    FFSDEBUG("create_linkmap failed\n");
+#endif
 }
-    
+
 int FATFileHandle::close() {
     FFSDEBUG("close\n");
     int retval = f_close(&_fh);
+#if _USE_FASTSEEK
+    if(_fh.cltbl != NULL) free(_fh.cltbl);
+#endif
     delete this;
     return retval;
 }
@@ -74,6 +115,13 @@ off_t FATFileHandle::lseek(off_t position, int whence) {
     } else if(whence==SEEK_CUR) {
         position += _fh.fptr;
     }
+#if _USE_FASTSEEK
+    // finding the position or size of the file, or rewinding it, does not need the link map
+    if(_linkmap_pending && position != 0 && (DWORD)position != _fh.fptr && (DWORD)position < _fh.fsize) {
+        _linkmap_pending = false;
+        create_linkmap();
+    }
+#endif
     FRESULT res = f_lseek(&_fh, position);
     if(res) {
         FFSDEBUG("lseek failed (%d, %s)\n", res, FR_ERRORS[res]);
@@ -24,7 +24,10 @@ public:
 
 protected:
 
+    void create_linkmap();
+
     FIL_t _fh;
+    bool _linkmap_pending;
 
 };
 
@@ -142,4 +142,23 @@ int FATFileSystem::mkdir(const char *name, mode_t mode) {
     return res == 0 ? 0 : -1;
 }
 
+// block devices that can stream several sectors in one transfer override these
+int FATFileSystem::disk_read_multi(char *buffer, int sector, int count) {
+    for(int s = sector; s < sector + count; s++) {
+        int res = disk_read(buffer, s);
+        if(res) return res;
+        buffer += 512;
+    }
+    return 0;
+}
+
+int FATFileSystem::disk_write_multi(const char *buffer, int sector, int count) {
+    for(int s = sector; s < sector + count; s++) {
+        int res = disk_write(buffer, s);
+        if(res) return res;
+        buffer += 512;
+    }
+    return 0;
+}
+
 } // namespace mbed
@@ -52,6 +52,8 @@ public:
     virtual int disk_status() { return 0; }
     virtual int disk_read(char *buffer, int sector) = 0;
     virtual int disk_write(const char *buffer, int sector) = 0;
+    virtual int disk_read_multi(char *buffer, int sector, int count);
+    virtual int disk_write_multi(const char *buffer, int sector, int count);
     virtual int disk_sync() { return 0; }
     virtual int disk_sectors() = 0;
 
@@ -20,12 +20,14 @@ using namespace std;
 #include "libs/ConfigSources/FileConfigSource.h"
 #include "libs/ConfigSources/FirmConfigSource.h"
 #include "StreamOutputPool.h"
+#include "us_ticker_api.h"
 
 // Add various config sources. Config can be fetched from several places.
 // All values are read into a cache, that is then used by modules to read their configuration
 Config::Config()
 {
     this->config_cache = NULL;
+    this->boot_stats_saved = false;
 
     // Config source for firm config found in src/config.default
     this->config_sources.push_back( new FirmConfigSource("firm") );
@@ -51,6 +53,7 @@ Config::Config()
 Config::Config(ConfigSource *cs)
 {
     this->config_cache = NULL;
+    this->boot_stats_saved = false;
     this->config_sources.push_back( cs );
 }
 
@@ -74,6 +77,7 @@ void Config::config_cache_load(bool parse)
     // First clear the cache
     this->config_cache_clear();
 
+    uint32_t start = us_ticker_read();
     this->config_cache= new ConfigCache;
     if(parse) {
         // For each ConfigSource in our stack
@@ -81,11 +85,21 @@ void Config::config_cache_load(bool parse)
             source->transfer_values_to_cache(this->config_cache);
         }
     }
+
+    this->stats = {us_ticker_read() - start, (uint32_t)this->config_cache->size(), 0, 0, 0};
+    this->config_cache->reset_probes(); // only count the lookups
 }
 
 // Command to clear the config cache after init
 void Config::config_cache_clear()
 {
+    if(this->config_cache != NULL) {
+        this->stats.probes = this->config_cache->get_probes();
+        if(!this->boot_stats_saved) {
+            this->boot_stats = this->stats;
+            this->boot_stats_saved = true;
+        }
+    }
     delete this->config_cache;
     this->config_cache= NULL;
 }
@@ -113,7 +127,10 @@ ConfigValue *Config::value(uint16_t check_sums[])
         return NULL;
     }
 
+    uint32_t start = us_ticker_read();
     ConfigValue *result = this->config_cache->lookup(check_sums);
+    this->stats.lookup_us += us_ticker_read() - start;
+    this->stats.lookups++;
 
     if(result == NULL) {
         // create a dummy value for this to play with, each call requires it's own value not a shared one
@@ -12,6 +12,7 @@
 using namespace std;
 #include <vector>
 #include <string>
+#include <stdint.h>
 
 class ConfigValue;
 class ConfigSource;
@@ -33,11 +34,27 @@ class Config  {
         void get_module_list(vector<uint16_t>* list, uint16_t family);
         bool is_config_cache_loaded() { return config_cache != NULL; };    // Whether or not the cache is currently popluated
 
+        // how long the config cache took to load and how much it was used before it was cleared
+        struct cache_stats_t {
+            uint32_t load_us;
+            uint32_t entries;
+            uint32_t lookups;
+            uint32_t lookup_us;
+            uint32_t probes;
+        };
+        // the first cache is the one loaded at boot
+        const cache_stats_t& get_boot_cache_stats() const { return boot_stats; }
+        bool has_boot_cache_stats() const { return boot_stats_saved; }
+
         friend class  Configurator;
 
     private:
         bool   has_characters(uint16_t check_sum, string str );
 
+        cache_stats_t stats;
+        cache_stats_t boot_stats;
+        bool boot_stats_saved;
+
         ConfigCache* config_cache;            // A cache in which ConfigValues are kept
         vector<ConfigSource*> config_sources; // A list of all possible coniguration sources
 };
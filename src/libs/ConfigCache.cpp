@@ -3,8 +3,13 @@
 
 #include "libs/StreamOutput.h"
 
+#include <string.h>
+
 ConfigCache::ConfigCache()
 {
+    index= nullptr;
+    index_bits= 0;
+    probes= 0;
 }
 
 ConfigCache::~ConfigCache()
@@ -19,11 +24,51 @@ void ConfigCache::clear()
     }
     store.clear();
     storage_t().swap(store);   //  makes sure the vector releases its memory
+    delete [] index;
+    index= nullptr;
+    index_bits= 0;
+}
+
+static inline uint32_t hash_check_sums(const uint16_t *check_sums)
+{
+    return ((check_sums[0] | ((uint32_t)check_sums[1] << 16)) ^ (check_sums[2] * 0x9E3779B1U)) * 0x9E3779B1U;
+}
+
+// returns the slot holding the entry with these checksums, or the empty slot where it would go
+int ConfigCache::find_slot(const uint16_t *check_sums) const
+{
+    uint32_t mask= (1 << index_bits) - 1;
+    uint32_t i= hash_check_sums(check_sums) >> (32 - index_bits);
+    while(true) {
+        ++probes;
+        uint16_t e= index[i];
+        if(e == EMPTY || memcmp(check_sums, store[e]->check_sums, sizeof(store[e]->check_sums)) == 0) return i;
+        i= (i + 1) & mask;
+    }
+}
+
+// make a new index of 2^bits slots and put everything in store back into it
+void ConfigCache::rebuild_index(uint8_t bits)
+{
+    delete [] index;
+    index_bits= bits;
+    index= new uint16_t[1 << bits];
+    memset(index, 0xFF, sizeof(uint16_t) << bits);
+    for (size_t n = 0; n < store.size(); ++n) {
+        int i= find_slot(store[n]->check_sums);
+        // if there are duplicates the first one is the one that is found
+        if(index[i] == EMPTY) index[i]= n;
+    }
 }
 
 void ConfigCache::add(ConfigValue *v)
 {
+    if(index == nullptr || (store.size() + 1) * 2 > (1U << index_bits)) {
+        rebuild_index(index == nullptr ? 6 : index_bits + 1);
+    }
     store.push_back(v);
+    int i= find_slot(v->check_sums);
+    if(index[i] == EMPTY) index[i]= store.size() - 1;
 }
 
 void ConfigCache::pop()
@@ -31,16 +76,18 @@ void ConfigCache::pop()
     auto cv= store.back();
     store.pop_back();
     delete cv;
+    // only happens for include lines so just build the index again
+    rebuild_index(index_bits);
 }
 
 // If we find an existing value, replace it, otherwise, push it at the back of the list
 void ConfigCache::replace_or_push_back(ConfigValue *new_value)
 {
-    // For each already existing element
-    for(auto &cv : store) {
-        // If this configvalue matches the checksum
-        if(memcmp(new_value->check_sums, cv->check_sums, sizeof(cv->check_sums)) == 0) {
+    if(index != nullptr) {
+        int i= find_slot(new_value->check_sums);
+        if(index[i] != EMPTY) {
             // Replace with the provided value
+            ConfigValue *&cv= store[index[i]];
             delete cv; // free up old one
             cv =  new_value;
             printf("WARNING: duplicate config line replaced\n");
@@ -49,17 +96,15 @@ void ConfigCache::replace_or_push_back(ConfigValue *new_value)
     }
 
     // Value does not already exists, add to the list
-    store.push_back(new_value);
+    add(new_value);
 }
 
 ConfigValue *ConfigCache::lookup(const uint16_t *check_sums) const
 {
-    for( auto &cv : store) {
-        if(memcmp(check_sums, cv->check_sums, sizeof(cv->check_sums)) == 0)
-            return cv;
-    }
+    if(index == nullptr) return NULL;
 
-    return NULL;
+    uint16_t e= index[find_slot(check_sums)];
+    return e == EMPTY ? NULL : store[e];
 }
 
 void ConfigCache::collect(uint16_t family, uint16_t cs, vector<uint16_t> *list)
@@ -37,9 +37,22 @@ class ConfigCache {
         // used for debugging, dumps the cache to a stream
         void dump(StreamOutput *stream);
 
+        size_t size() const { return store.size(); }
+        uint32_t get_probes() const { return probes; }
+        void reset_probes() { probes= 0; }
+
     private:
+        int find_slot(const uint16_t *check_sums) const;
+        void rebuild_index(uint8_t bits);
+
         typedef vector<ConfigValue*> storage_t;
         storage_t store;
+
+        // open addressing hash index of positions in store keyed on the checksums, linear probing and kept at most half full
+        static const uint16_t EMPTY= 0xFFFF;
+        uint16_t *index;
+        uint8_t index_bits;
+        mutable uint32_t probes; // slots looked at by all searches, for the boot profile
 };
 
 
@@ -16,14 +16,57 @@
 using namespace std;
 #include <string>
 #include <string.h>
+#include <algorithm>
 
 #define include_checksum     CHECKSUM("include")
 
+// The parsed values of a config on the sdcard are saved next to it as a binary image, which is loaded instead
+// of parsing the text on the next boot if the config and the files it includes hash the same as when it was made
+//
+// header: magic, version, number of files, number of entries, offset of the file table
+// entries: 3 x uint16_t checksums, uint8_t length, value
+// file table: uint32_t hash, uint8_t length, file name, for the config first and then each included file
+#define IMAGE_MAGIC    0x49434D53 // SMCI
+#define IMAGE_VERSION  1
+#define IMAGE_SUFFIX   ".cache"
+
+struct image_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t files;
+    uint32_t entries;
+    uint32_t table;
+};
+
+// The index is kept next to it, the offset of the first line for each key in the config file (not the includes) sorted
+// on the checksums, followed by the keys config-set has appended since, unsorted.
+// It is made along with the image and is good for as long as the config hashes the same, the size of the config is
+// kept too so a key that is not in the index can be checked against a config that was edited while we were running
+#define INDEX_MAGIC    0x58434D53 // SMCX
+#define INDEX_VERSION  2
+#define INDEX_SUFFIX   ".index"
+
+struct index_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t unused;
+    uint32_t sorted;
+    uint32_t total;
+    uint32_t hash;
+    uint32_t size;
+};
+
 FileConfigSource::FileConfigSource(string config_file, const char *name)
 {
     this->name_checksum = get_checksum(name);
     this->config_file = config_file;
     this->config_file_found = false;
+    this->image_fp = NULL;
+    this->image_entries = 0;
+    this->image_ok = false;
+    this->config_hash = 0;
+    this->index_entries = NULL;
+    this->index_valid = false;
 }
 
 bool FileConfigSource::readLine(string& line, int lineno, FILE *fp)
@@ -55,7 +98,293 @@ void FileConfigSource::transfer_values_to_cache( ConfigCache *cache )
     if( !this->has_config_file() ) {
         return;
     }
-    transfer_values_to_cache( cache, this->get_config_file().c_str());
+
+    string file_name = this->get_config_file();
+    if(file_name.compare(0, 4, "/sd/") != 0) {
+        // only the sdcard can hold an image
+        transfer_values_to_cache( cache, file_name.c_str());
+        return;
+    }
+
+    string image_file = file_name + IMAGE_SUFFIX;
+    string index_file = file_name + INDEX_SUFFIX;
+    if(load_image(cache, image_file)) {
+        // the index is normally made along with the image, but it may have been lost,
+        // parsing again replaces the values just loaded with the same ones
+        this->index_valid = check_index(index_file);
+        if(this->index_valid) return;
+    }
+
+    // parse the text, and make a new image and index while doing so
+    this->index_entries = new vector<index_entry_t>;
+    start_image(image_file);
+    transfer_values_to_cache( cache, file_name.c_str());
+    finish_image(image_file);
+    write_index(index_file);
+    delete this->index_entries;
+    this->index_entries = NULL;
+}
+
+// FNV-1a hash of the whole file, 0 if it can not be read
+uint32_t FileConfigSource::hash_file(const char *file_name)
+{
+    FILE *fp = fopen(file_name, "r");
+    if(fp == NULL) return 0;
+
+    uint32_t hash = 2166136261U;
+    uint8_t buf[256];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            hash = (hash ^ buf[i]) * 16777619U;
+        }
+    }
+    fclose(fp);
+    return hash == 0 ? 1 : hash;
+}
+
+// load the values from the image if it matches the config files, returns false if it has to be parsed instead
+bool FileConfigSource::load_image(ConfigCache *cache, const string& image_file)
+{
+    FILE *fp = fopen(image_file.c_str(), "r");
+    if(fp == NULL) return false;
+
+    image_header_t h;
+    bool ok = fread(&h, sizeof(h), 1, fp) == 1 && h.magic == IMAGE_MAGIC && h.version == IMAGE_VERSION && h.files > 0;
+
+    // check every file that went into it is unchanged
+    if(ok && fseek(fp, h.table, SEEK_SET) == 0) {
+        for (int i = 0; ok && i < h.files; ++i) {
+            uint32_t hash;
+            uint8_t len;
+            char name[256];
+            ok = fread(&hash, sizeof(hash), 1, fp) == 1 && fread(&len, 1, 1, fp) == 1 && fread(name, 1, len, fp) == len;
+            if(!ok) break;
+            name[len] = '\0';
+            // the first one must be this config, and a missing include is never trusted as it may have appeared since
+            if(i == 0 && this->get_config_file() != name) ok = false;
+            else if(hash == 0 || hash_file(name) != hash) ok = false;
+            else if(i == 0) this->config_hash = hash;
+        }
+    } else {
+        ok = false;
+    }
+
+    if(ok && fseek(fp, sizeof(h), SEEK_SET) == 0) {
+        for (uint32_t i = 0; i < h.entries; ++i) {
+            uint16_t cs[3];
+            uint8_t len;
+            char value[256];
+            if(fread(cs, sizeof(cs), 1, fp) != 1 || fread(&len, 1, 1, fp) != 1 || fread(value, 1, len, fp) != len) {
+                // parsing the text will replace whatever was loaded so far with the same values
+                ok = false;
+                break;
+            }
+            ConfigValue *cv = new ConfigValue(cs);
+            cv->found = true;
+            cv->value.assign(value, len);
+            cache->replace_or_push_back(cv);
+        }
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+void FileConfigSource::start_image(const string& image_file)
+{
+    this->image_entries = 0;
+    this->image_files.clear();
+    this->image_fp = fopen(image_file.c_str(), "w");
+    this->image_ok = this->image_fp != NULL;
+    if(!this->image_ok) return;
+
+    // the header is written last so an image that was not finished is never loaded
+    image_header_t h = {0, 0, 0, 0, 0};
+    this->image_ok = fwrite(&h, sizeof(h), 1, this->image_fp) == 1;
+}
+
+void FileConfigSource::record_image(const ConfigValue *cv)
+{
+    if(!this->image_ok) return;
+    if(cv->value.size() > 255) {
+        this->image_ok = false;
+        return;
+    }
+    uint8_t len = cv->value.size();
+    this->image_ok = fwrite(cv->check_sums, sizeof(cv->check_sums), 1, this->image_fp) == 1 &&
+                     fwrite(&len, 1, 1, this->image_fp) == 1 &&
+                     fwrite(cv->value.data(), 1, len, this->image_fp) == len;
+    this->image_entries++;
+}
+
+void FileConfigSource::finish_image(const string& image_file)
+{
+    if(this->image_fp == NULL) return;
+
+    image_header_t h = {IMAGE_MAGIC, IMAGE_VERSION, (uint16_t)this->image_files.size(), this->image_entries, 0};
+    if(this->image_ok) {
+        h.table = ftell(this->image_fp);
+        for(auto& f : this->image_files) {
+            // a missing include is recorded with a hash of 0
+            uint32_t hash = f[0] == '?' ? 0 : hash_file(f.c_str());
+            if(&f == &this->image_files.front()) this->config_hash = hash;
+            const char *name = f[0] == '?' ? f.c_str() + 1 : f.c_str();
+            uint8_t len = strlen(name);
+            if(fwrite(&hash, sizeof(hash), 1, this->image_fp) != 1 || fwrite(&len, 1, 1, this->image_fp) != 1 || fwrite(name, 1, len, this->image_fp) != len) {
+                this->image_ok = false;
+                break;
+            }
+        }
+    }
+    if(this->image_ok) {
+        this->image_ok = fseek(this->image_fp, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, this->image_fp) == 1;
+    }
+    if(fclose(this->image_fp) != 0) this->image_ok = false;
+    this->image_fp = NULL;
+    this->image_files.clear();
+
+    if(!this->image_ok) remove(image_file.c_str());
+}
+
+// the size of a file, or -1 if it can not be opened
+long FileConfigSource::file_size(const char *file_name)
+{
+    FILE *fp = fopen(file_name, "r");
+    if(fp == NULL) return -1;
+    long size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    fclose(fp);
+    return size;
+}
+
+// true if the index on the sdcard was made from the config as it is now
+bool FileConfigSource::check_index(const string& index_file)
+{
+    FILE *fp = fopen(index_file.c_str(), "r");
+    if(fp == NULL) return false;
+    index_header_t h;
+    bool ok = fread(&h, sizeof(h), 1, fp) == 1 && h.magic == INDEX_MAGIC && h.version == INDEX_VERSION && h.hash == this->config_hash && this->config_hash != 0;
+    fclose(fp);
+    return ok;
+}
+
+void FileConfigSource::write_index(const string& index_file)
+{
+    this->index_valid = false;
+    if(this->config_hash == 0) {
+        // there is no image so nothing to say the config has not changed since
+        remove(index_file.c_str());
+        return;
+    }
+
+    // sort on the checksums and keep only the first line of each key, as that is the one read() would find
+    vector<index_entry_t>& v = *this->index_entries;
+    std::sort(v.begin(), v.end(), [](const index_entry_t& a, const index_entry_t& b) {
+        int r = memcmp(a.check_sums, b.check_sums, sizeof(a.check_sums));
+        return r < 0 || (r == 0 && a.offset < b.offset);
+    });
+    size_t n = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        if(n == 0 || memcmp(v[i].check_sums, v[n - 1].check_sums, sizeof(v[i].check_sums)) != 0) v[n++] = v[i];
+    }
+
+    long size = file_size(this->get_config_file().c_str());
+    if(size < 0) return;
+    FILE *fp = fopen(index_file.c_str(), "w");
+    if(fp == NULL) return;
+    index_header_t h = {INDEX_MAGIC, INDEX_VERSION, 0, (uint32_t)n, (uint32_t)n, this->config_hash, (uint32_t)size};
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 && (n == 0 || fwrite(&v[0], sizeof(index_entry_t), n, fp) == n);
+    if(fclose(fp) != 0) ok = false;
+    if(ok) this->index_valid = true;
+    else remove(index_file.c_str());
+}
+
+// look the key up in the index and read its line, returns false if the index can not answer
+bool FileConfigSource::read_indexed(uint16_t check_sums[3], string& value)
+{
+    FILE *fp = fopen((this->get_config_file() + INDEX_SUFFIX).c_str(), "r");
+    if(fp == NULL) {
+        this->index_valid = false;
+        return false;
+    }
+
+    index_header_t h;
+    if(fread(&h, sizeof(h), 1, fp) != 1 || h.magic != INDEX_MAGIC || h.version != INDEX_VERSION) {
+        fclose(fp);
+        this->index_valid = false;
+        return false;
+    }
+
+    // binary search the sorted part, then look through the keys appended since
+    bool found = false;
+    index_entry_t e;
+    uint32_t lo = 0, hi = h.sorted;
+    while(lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if(fseek(fp, sizeof(h) + mid * sizeof(e), SEEK_SET) != 0 || fread(&e, sizeof(e), 1, fp) != 1) break;
+        int r = memcmp(check_sums, e.check_sums, sizeof(e.check_sums));
+        if(r == 0) {
+            found = true;
+            break;
+        }
+        if(r < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    if(!found && h.total > h.sorted && fseek(fp, sizeof(h) + h.sorted * sizeof(e), SEEK_SET) == 0) {
+        for (uint32_t i = h.sorted; i < h.total && fread(&e, sizeof(e), 1, fp) == 1; ++i) {
+            if(memcmp(check_sums, e.check_sums, sizeof(e.check_sums)) == 0) {
+                found = true;
+                break;
+            }
+        }
+    }
+    fclose(fp);
+
+    value = "";
+    if(!found) {
+        // only trust the miss if the config is the size it was when the index was last brought up to date
+        if(file_size(this->get_config_file().c_str()) != (long)h.size) {
+            this->index_valid = false;
+            return false;
+        }
+        return true;
+    }
+
+    FILE *lp = fopen(this->get_config_file().c_str(), "r");
+    if(lp == NULL) return false;
+    string line;
+    if(fseek(lp, e.offset, SEEK_SET) == 0 && readLine(line, 0, lp)) {
+        value = process_line_from_ascii_config(line, check_sums);
+    }
+    fclose(lp);
+
+    if(value.empty()) {
+        // the line is not where it was, the file must have been changed behind our back
+        this->index_valid = false;
+        return false;
+    }
+    return true;
+}
+
+// config-set appended a new key to the config
+void FileConfigSource::append_index(uint16_t check_sums[3], uint32_t offset)
+{
+    string index_file = this->get_config_file() + INDEX_SUFFIX;
+    long size = file_size(this->get_config_file().c_str());
+    FILE *fp = fopen(index_file.c_str(), "r+");
+    index_header_t h;
+    index_entry_t e;
+    memcpy(e.check_sums, check_sums, sizeof(e.check_sums));
+    e.offset = offset;
+    bool ok = size >= 0 && fp != NULL && fread(&h, sizeof(h), 1, fp) == 1 && h.magic == INDEX_MAGIC &&
+              fseek(fp, sizeof(h) + h.total * sizeof(e), SEEK_SET) == 0 && fwrite(&e, sizeof(e), 1, fp) == 1;
+    if(ok) {
+        h.total++;
+        h.size = size;
+        ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, fp) == 1;
+    }
+    if(fp != NULL && fclose(fp) != 0) ok = false;
+    if(!ok) this->index_valid = false;
 }
 
 void FileConfigSource::transfer_values_to_cache( ConfigCache *cache, const char * file_name )
@@ -66,17 +395,25 @@ void FileConfigSource::transfer_values_to_cache( ConfigCache *cache, const char
 
     // Open the config file ( find it if we haven't already found it )
     FILE *lp = fopen(file_name, "r");
+    if(this->image_fp != NULL) this->image_files.push_back(file_name);
+    // only the lines of the config itself are indexed, read() does not look in the includes
+    bool indexing = this->index_entries != NULL && this->get_config_file() == file_name;
 
     int ln= 1;
     // For each line
     while(!feof(lp)) {
         string line;
+        long bol = indexing ? ftell(lp) : 0;
         if(readLine(line, ln++, lp)) {
             // process the config line and store the value in cache
             ConfigValue* cv = process_line_from_ascii_config(line, cache);
 
             if(cv == nullptr) continue;
 
+            if(indexing) this->index_entries->push_back({{cv->check_sums[0], cv->check_sums[1], cv->check_sums[2]}, (uint32_t)bol});
+
+            if(cv->check_sums[0] != include_checksum && this->image_fp != NULL) record_image(cv);
+
             // if this line is an include directive then attempt to read the included file
             if(cv->check_sums[0] == include_checksum) {
                 string inc_file_name = cv->value.c_str();
@@ -110,6 +447,7 @@ void FileConfigSource::transfer_values_to_cache( ConfigCache *cache, const char
                     fsetpos(lp, &pos);
                 }else{
                     printf("Unable to find included config file: %s\n", inc_file_name.c_str());
+                    if(this->image_fp != NULL) this->image_files.push_back("?" + inc_file_name);
                 }
             }
 
@@ -169,6 +507,8 @@ bool FileConfigSource::write( string setting, string value )
     }
 
     // not found so append the new value
+    fseek(lp, 0, SEEK_END);
+    long eof = ftell(lp);
     fclose(lp);
     lp = fopen(this->get_config_file().c_str(), "a");
     fputs("\n", lp);
@@ -177,6 +517,7 @@ bool FileConfigSource::write( string setting, string value )
     fputs(value.c_str(), lp);
     fputs("         # added\n", lp);
     fclose(lp);
+    if(this->index_valid) append_index(setting_checksums, eof + 1); // after the newline
 
     return true;
 }
@@ -190,6 +531,11 @@ string FileConfigSource::read( uint16_t check_sums[3] )
         return value;
     }
 
+    // go straight to the line if we know where it is
+    if(this->index_valid && read_indexed(check_sums, value)) {
+        return value;
+    }
+
     // Open the config file ( find it if we haven't already found it )
     FILE *lp = fopen(this->get_config_file().c_str(), "r");
     // For each line
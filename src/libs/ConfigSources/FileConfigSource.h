@@ -14,6 +14,7 @@ class ConfigCache;
 
 using namespace std;
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 class FileConfigSource : public ConfigSource
@@ -31,8 +32,34 @@ public:
 
 private:
     bool readLine(string& line, int lineno, FILE *fp);
+    bool load_image(ConfigCache *cache, const string& image_file);
+    void start_image(const string& image_file);
+    void record_image(const ConfigValue *cv);
+    void finish_image(const string& image_file);
+    static uint32_t hash_file(const char *file_name);
+    static long file_size(const char *file_name);
+    bool check_index(const string& index_file);
+    void write_index(const string& index_file);
+    bool read_indexed(uint16_t check_sums[3], string& value);
+    void append_index(uint16_t check_sums[3], uint32_t offset);
+
     string config_file;         // Path to the config file
     bool   config_file_found;   // Wether or not the config file's location is known
+
+    // the binary image of the parsed config being written while the text is parsed
+    FILE *image_fp;
+    uint32_t image_entries;
+    vector<string> image_files; // the config file and everything it included
+    bool image_ok;
+    uint32_t config_hash;       // hash of the config file when it was last parsed or its image loaded
+
+    // where each key is in the config file, so read() can go straight to its line
+    struct index_entry_t {
+        uint16_t check_sums[3];
+        uint32_t offset;
+    } __attribute__ ((packed));
+    vector<index_entry_t> *index_entries; // being collected while the text is parsed
+    bool index_valid;
 };
 
 
@@ -0,0 +1,170 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DiskCache.h"
+#include "platform_memory.h"
+
+#include <string.h>
+
+#define SECTOR_SIZE 512
+#define NO_BLOCK 0xFFFFFFFF
+
+
+DiskCache::DiskCache(MSD_Disk *disk)
+{
+    this->disk = disk;
+    buf = nullptr;
+    use_count = 0;
+    hits = misses = 0;
+    setup_done = false;
+    in_use = false;
+    flush_pending = false;
+    for (int i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        tag[i] = NO_BLOCK;
+        last_used[i] = 0;
+    }
+}
+
+// the cache memory is allocated on first use, in AHB SRAM so the sd card can DMA straight into it
+bool DiskCache::setup()
+{
+    if(!setup_done) {
+        setup_done = true;
+        buf = (char *)AHB1.alloc(DISK_CACHE_SECTORS * SECTOR_SIZE);
+        if(buf == nullptr) buf = (char *)AHB0.alloc(DISK_CACHE_SECTORS * SECTOR_SIZE);
+    }
+    return buf != nullptr;
+}
+
+// USBMSD calls the disk from the USB interrupt, if that happens while the main loop is in the cache the interrupt goes straight to the disk,
+// a write done that way marks the cache to be flushed once the main loop is done with it
+void DiskCache::leave()
+{
+    in_use = false;
+    if(flush_pending) invalidate();
+}
+
+void DiskCache::invalidate()
+{
+    flush_pending = false;
+    for (int i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        tag[i] = NO_BLOCK;
+    }
+}
+
+int DiskCache::find(uint32_t block)
+{
+    for (int i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        if(tag[i] == block) return i;
+    }
+    return -1;
+}
+
+int DiskCache::least_recently_used()
+{
+    int lru = 0;
+    for (int i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        if(tag[i] == NO_BLOCK) return i;
+        if(last_used[i] < last_used[lru]) lru = i;
+    }
+    return lru;
+}
+
+// refresh any cached copies of sectors that have just been written
+void DiskCache::update(const char *data, uint32_t block, uint32_t count)
+{
+    for (int i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        if(tag[i] != NO_BLOCK && tag[i] >= block && tag[i] < block + count) {
+            memcpy(&buf[i * SECTOR_SIZE], data + (tag[i] - block) * SECTOR_SIZE, SECTOR_SIZE);
+        }
+    }
+}
+
+int DiskCache::disk_initialize()
+{
+    invalidate();
+    return disk->disk_initialize();
+}
+
+int DiskCache::disk_read(char *data, uint32_t block)
+{
+    if(in_use || !setup()) return disk->disk_read(data, block);
+
+    in_use = true;
+
+    int i = find(block);
+    int r = 0;
+    if(i >= 0) {
+        hits++;
+
+    } else {
+        misses++;
+        i = least_recently_used();
+        tag[i] = NO_BLOCK;
+        r = disk->disk_read(&buf[i * SECTOR_SIZE], block);
+        if(r == 0) tag[i] = block;
+    }
+
+    if(r == 0) {
+        last_used[i] = ++use_count;
+        memcpy(data, &buf[i * SECTOR_SIZE], SECTOR_SIZE);
+    }
+
+    leave();
+    return r;
+}
+
+int DiskCache::disk_write(const char *data, uint32_t block)
+{
+    if(in_use || !setup()) {
+        flush_pending = true;
+        return disk->disk_write(data, block);
+    }
+
+    in_use = true;
+
+    // write through
+    int r = disk->disk_write(data, block);
+    if(r == 0) {
+        update(data, block, 1);
+    } else {
+        invalidate();
+    }
+
+    leave();
+    return r;
+}
+
+int DiskCache::disk_read_multi(char *data, uint32_t block, uint32_t count)
+{
+    if(count == 1) return disk_read(data, block);
+
+    // nothing is ever dirty in the cache so this can go straight to the disk
+    return disk->disk_read_multi(data, block, count);
+}
+
+int DiskCache::disk_write_multi(const char *data, uint32_t block, uint32_t count)
+{
+    if(count == 1) return disk_write(data, block);
+
+    if(in_use || !setup()) {
+        flush_pending = true;
+        return disk->disk_write_multi(data, block, count);
+    }
+
+    in_use = true;
+
+    int r = disk->disk_write_multi(data, block, count);
+    if(r == 0) {
+        update(data, block, count);
+    } else {
+        invalidate();
+    }
+
+    leave();
+    return r;
+}
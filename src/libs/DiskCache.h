@@ -0,0 +1,57 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "disk.h"
+
+// number of 512 byte sectors kept in the cache
+#define DISK_CACHE_SECTORS 4
+
+// A small write through LRU sector cache that sits between a disk and its users (FatFs and USBMSD)
+// Only single sector reads are cached, these are mostly FAT and directory sectors, multi sector reads of file data go straight to the disk
+class DiskCache : public MSD_Disk {
+public:
+    DiskCache(MSD_Disk *disk);
+
+    virtual int disk_initialize();
+    virtual int disk_read(char *data, uint32_t block);
+    virtual int disk_write(const char *data, uint32_t block);
+    virtual int disk_read_multi(char *data, uint32_t block, uint32_t count);
+    virtual int disk_write_multi(const char *data, uint32_t block, uint32_t count);
+    virtual uint32_t disk_sectors() { return disk->disk_sectors(); }
+    virtual uint64_t disk_size() { return disk->disk_size(); }
+    virtual uint32_t disk_blocksize() { return disk->disk_blocksize(); }
+    virtual int disk_status() { return disk->disk_status(); }
+    virtual bool disk_canDMA() { return disk->disk_canDMA(); }
+    virtual int disk_sync() { return disk->disk_sync(); }
+    virtual bool busy() { return disk->busy(); }
+
+    void invalidate();
+    uint32_t get_hits() const { return hits; }
+    uint32_t get_misses() const { return misses; }
+    void reset_stats() { hits = misses = 0; }
+
+private:
+    bool setup();
+    void leave();
+    int find(uint32_t block);
+    int least_recently_used();
+    void update(const char *data, uint32_t block, uint32_t count);
+
+    MSD_Disk *disk;
+    char *buf;
+    uint32_t tag[DISK_CACHE_SECTORS];
+    uint32_t last_used[DISK_CACHE_SECTORS];
+    uint32_t use_count;
+    uint32_t hits, misses;
+
+    // not bitfields as flush_pending is set from the USB interrupt
+    bool setup_done;
+    volatile bool in_use;
+    volatile bool flush_pending;
+};
@@ -0,0 +1,107 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GPDMA.h"
+
+#include "LPC17xx.h"
+
+#define CHANNEL(ch) ((LPC_GPDMACH_TypeDef *)(LPC_GPDMACH0_BASE + (ch) * 0x20))
+
+#define AHBSRAM_START 0x2007C000
+#define AHBSRAM_END   0x20084000
+
+GPDMA::handler_t GPDMA::handlers[8];
+uint8_t GPDMA::allocated= 0;
+
+void GPDMA::init()
+{
+    LPC_SC->PCONP |= (1 << 29);     // Power GPDMA ON
+    LPC_GPDMA->DMACIntTCClear = 0xFF;
+    LPC_GPDMA->DMACIntErrClr = 0xFF;
+    LPC_GPDMA->DMACConfig = 1;      // enable, little endian
+    while(!(LPC_GPDMA->DMACConfig & 1)) ;
+    // below the step tickers so completions do not delay step pulses, but above USB as USBMSD waits on SPI DMA from the USB interrupt
+    NVIC_SetPriority(DMA_IRQn, 4);
+    NVIC_EnableIRQ(DMA_IRQn);
+}
+
+int GPDMA::alloc_channel(handler_t handler)
+{
+    if(allocated == 0) init();
+
+    for (int ch = 0; ch < 8; ++ch) {
+        if(!(allocated & (1 << ch))) {
+            allocated |= (1 << ch);
+            handlers[ch]= handler;
+            return ch;
+        }
+    }
+    return -1;
+}
+
+void GPDMA::free_channel(int ch)
+{
+    stop(ch);
+    handlers[ch]= nullptr;
+    allocated &= ~(1 << ch);
+}
+
+void GPDMA::start(int ch, const volatile void *src, volatile void *dst, uint32_t control, uint32_t config, const LLI *next)
+{
+    LPC_GPDMACH_TypeDef *c= CHANNEL(ch);
+    LPC_GPDMA->DMACIntTCClear = (1 << ch);
+    LPC_GPDMA->DMACIntErrClr = (1 << ch);
+    c->DMACCSrcAddr = (uint32_t)src;
+    c->DMACCDestAddr = (uint32_t)dst;
+    c->DMACCLLI = (uint32_t)next;
+    c->DMACCControl = control;
+    c->DMACCConfig = config | 1; // enable
+}
+
+void GPDMA::stop(int ch)
+{
+    LPC_GPDMACH_TypeDef *c= CHANNEL(ch);
+    c->DMACCConfig &= ~1;
+    LPC_GPDMA->DMACIntTCClear = (1 << ch);
+    LPC_GPDMA->DMACIntErrClr = (1 << ch);
+}
+
+bool GPDMA::is_active(int ch)
+{
+    return (LPC_GPDMA->DMACEnbldChns & (1 << ch)) != 0;
+}
+
+uint32_t GPDMA::get_dst(int ch)
+{
+    return CHANNEL(ch)->DMACCDestAddr;
+}
+
+bool GPDMA::is_dma_memory(const void *p, uint32_t len)
+{
+    uint32_t a= (uint32_t)p;
+    return a >= AHBSRAM_START && a + len <= AHBSRAM_END;
+}
+
+void GPDMA::irq()
+{
+    uint32_t tc = LPC_GPDMA->DMACIntTCStat;
+    uint32_t err = LPC_GPDMA->DMACIntErrStat;
+    LPC_GPDMA->DMACIntTCClear = tc;
+    LPC_GPDMA->DMACIntErrClr = err;
+
+    for (int ch = 0; ch < 8; ++ch) {
+        uint32_t b= (1 << ch);
+        if(((tc | err) & b) && handlers[ch]) {
+            handlers[ch]((err & b) == 0);
+        }
+    }
+}
+
+extern "C" void DMA_IRQHandler(void)
+{
+    GPDMA::irq();
+}
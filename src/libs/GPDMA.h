@@ -0,0 +1,68 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// Hands out the eight LPC17xx general purpose DMA channels and dispatches their interrupts
+// NOTE the GPDMA can only reach the AHB SRAM banks (AHBSRAM0/AHBSRAM1, the AHB0/AHB1 pools) and peripherals, not the main SRAM
+class GPDMA {
+    public:
+        // DMA request lines
+        enum PERIPHERAL {
+            SSP0_TX= 0, SSP0_RX= 1, SSP1_TX= 2, SSP1_RX= 3,
+            UART0_TX= 8, UART0_RX= 9, UART1_TX= 10, UART1_RX= 11,
+            UART2_TX= 12, UART2_RX= 13, UART3_TX= 14, UART3_RX= 15
+        };
+
+        // channel control register fields
+        static const uint32_t CONTROL_SIZE_MAX= 0x0FFF;  // transfer size is 12 bits
+        static const uint32_t CONTROL_SBSIZE_1= (0 << 12), CONTROL_SBSIZE_4= (1 << 12);
+        static const uint32_t CONTROL_DBSIZE_1= (0 << 15), CONTROL_DBSIZE_4= (1 << 15);
+        static const uint32_t CONTROL_SWIDTH_BYTE= (0 << 18), CONTROL_DWIDTH_BYTE= (0 << 21);
+        static const uint32_t CONTROL_SI= (1 << 26);     // source increment
+        static const uint32_t CONTROL_DI= (1 << 27);     // destination increment
+        static const uint32_t CONTROL_I= (1 << 31);      // terminal count interrupt
+
+        // channel config register fields
+        static uint32_t config_m2p(PERIPHERAL p) { return (p << 6) | (1 << 11); }
+        static uint32_t config_p2m(PERIPHERAL p) { return (p << 1) | (2 << 11); }
+        static const uint32_t CONFIG_IE= (1 << 14);      // error interrupt
+        static const uint32_t CONFIG_ITC= (1 << 15);     // terminal count interrupt
+
+        // a linked list item, the controller loads the next one when the current one finishes
+        struct LLI {
+            uint32_t src;
+            uint32_t dst;
+            uint32_t next;
+            uint32_t control;
+        };
+
+        // the handler is called from the DMA interrupt with true on terminal count, false on error
+        using handler_t= std::function<void(bool)>;
+
+        // returns a channel number, or -1 if none are free, lower numbered channels have higher priority
+        static int alloc_channel(handler_t handler);
+        static void free_channel(int ch);
+
+        static void start(int ch, const volatile void *src, volatile void *dst, uint32_t control, uint32_t config, const LLI *next= nullptr);
+        static void stop(int ch);
+        static bool is_active(int ch);
+        static uint32_t get_dst(int ch);
+
+        // true if the DMA controller can access this memory
+        static bool is_dma_memory(const void *p, uint32_t len);
+
+        static void irq();
+
+    private:
+        static void init();
+        static handler_t handlers[8];
+        static uint8_t allocated;
+};
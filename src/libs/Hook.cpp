@@ -5,4 +5,4 @@ extern "C"{
 
 // Hook is just a glorified FPointer
 
-Hook::Hook(){}
+Hook::Hook(){ frequency= 1; interval= 0; remainder= 0; error= 0; due= 0; }
@@ -7,8 +7,11 @@
 class Hook : public FPointer {
     public:
         Hook();
-        int     interval;
-        int     countdown;
+        uint32_t frequency;
+        uint32_t interval;  // whole timer counts between calls
+        uint32_t remainder; // the fraction of a count left over, spread across calls so the frequency is exact
+        uint32_t error;
+        uint32_t due;       // timer count this is next due at
 };
 
 #endif
@@ -9,15 +9,18 @@
 #include "libs/Module.h"
 #include "libs/Config.h"
 #include "libs/nuts_bolts.h"
+#include "libs/utils.h"
 #include "libs/SlowTicker.h"
 #include "libs/Adc.h"
 #include "libs/StreamOutputPool.h"
 #include <mri.h>
+#include "us_ticker_api.h"
 #include "checksumm.h"
 #include "ConfigValue.h"
 
 #include "libs/StepTicker.h"
 #include "libs/PublicData.h"
+#include "libs/Trace.h"
 #include "modules/communication/SerialConsole.h"
 #include "modules/communication/GcodeDispatch.h"
 #include "modules/robot/Planner.h"
@@ -56,10 +59,19 @@ Kernel* Kernel::instance;
 // The kernel is the central point in Smoothie : it stores modules, and handles event calls
 Kernel::Kernel()
 {
+#ifdef ENABLE_PERF
+    Perf::init();
+#endif
     halted = false;
     feed_hold = false;
     enable_feed_hold = false;
     bad_mcu= true;
+    query_mpos_valid= false;
+    task_child_us= 0;
+    deferred_stats= {0, 0};
+    ready= false;
+    ready_us= 0;
+    uint32_t t= us_ticker_read(); // this starts the us ticker so boot times are from here
 
     instance = this; // setup the Singleton instance of the kernel
 
@@ -71,7 +83,9 @@ Kernel::Kernel()
     this->config = new Config();
 
     // Pre-load the config cache, do after setting up serial so we can report errors to serial
+    t= us_ticker_read();
     this->config->config_cache_load();
+    boot_step("config load", t);
 
     // now config is loaded we can do normal setup for serial based on config
     delete this->serial;
@@ -120,10 +134,10 @@ Kernel::Kernel()
     // we expect ok per line now not per G code, setting this to false will return to the old (incorrect) way of ok per G code
     this->ok_per_line = this->config->value( ok_per_line_checksum )->by_default(true)->as_bool();
 
-    this->add_module( this->serial );
+    this->add_module( this->serial, "serial console" );
 
     // HAL stuff
-    add_module( this->slow_ticker = new SlowTicker());
+    add_module( this->slow_ticker = new SlowTicker(), "slow ticker" );
 
     this->step_ticker = new StepTicker();
     this->adc = new Adc();
@@ -163,159 +177,330 @@ Kernel::Kernel()
     this->step_ticker->set_unstep_time( microseconds_per_step_pulse );
 
     // Core modules
-    this->add_module( this->conveyor       = new Conveyor()      );
-    this->add_module( this->gcode_dispatch = new GcodeDispatch() );
-    this->add_module( this->robot          = new Robot()         );
-    this->add_module( this->simpleshell    = new SimpleShell()   );
+    this->add_module( this->conveyor       = new Conveyor()      , "conveyor" );
+    this->add_module( this->gcode_dispatch = new GcodeDispatch() , "gcode dispatch" );
+    this->add_module( this->robot          = new Robot()         , "robot" );
+    this->add_module( this->simpleshell    = new SimpleShell()   , "simpleshell" );
 
+    t= us_ticker_read();
     this->planner = new Planner();
     this->configurator = new Configurator();
+    boot_step("planner", t);
 }
 
-// return a GRBL-like query string for serial ?
-std::string Kernel::get_query_string()
+// write a GRBL-like query string for serial ? into buf, returns its length
+// this is polled often by hosts so it is built without any allocation or printf
+size_t Kernel::get_query_string(char *buf, size_t size)
 {
-    std::string str;
+    if(size == 0) return 0;
+    size_t n= 0;
+    auto add= [&](const char *s) { while(*s && n < size - 1) buf[n++]= *s++; };
+    auto addf= [&](float v, int decimals) { n += format_fixed(&buf[n], size - n, v, decimals); };
+
     bool homing;
     bool ok = PublicData::get_value(endstops_checksum, get_homing_status_checksum, 0, &homing);
     if(!ok) homing = false;
     bool running = false;
 
-    str.append("<");
+    add("<");
     if(halted) {
-        str.append("Alarm");
+        add("Alarm");
     } else if(homing) {
         running = true;
-        str.append("Home");
+        add("Home");
     } else if(feed_hold) {
-        str.append("Hold");
+        add("Hold");
     } else if(this->conveyor->is_idle()) {
-        str.append("Idle");
+        add("Idle");
     } else {
         running = true;
-        str.append("Run");
+        add("Run");
     }
 
     if(running) {
-        float mpos[3];
-        robot->get_current_machine_position(mpos);
-        // current_position/mpos includes the compensation transform so we need to get the inverse to get actual position
-        if(robot->compensationTransform) robot->compensationTransform(mpos, true); // get inverse compensation transform
+        // the FK and inverse compensation are only redone when the actuators have moved since the last query
+        bool moved= false;
+        for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+            int32_t steps= robot->actuators[i]->get_current_step();
+            if(steps != query_steps[i]) {
+                query_steps[i]= steps;
+                moved= true;
+            }
+        }
+        if(moved || !query_mpos_valid) {
+            robot->get_current_machine_position(query_mpos);
+            // current_position/mpos includes the compensation transform so we need to get the inverse to get actual position
+            if(robot->compensationTransform) robot->compensationTransform(query_mpos, true); // get inverse compensation transform
+            query_mpos_valid= true;
+        }
+        float mpos[3]= {query_mpos[0], query_mpos[1], query_mpos[2]};
 
-        char buf[128];
         // machine position
-        size_t n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(mpos[0]), robot->from_millimeters(mpos[1]), robot->from_millimeters(mpos[2]));
-        if(n > sizeof(buf)) n= sizeof(buf);
-
-        str.append("|MPos:").append(buf, n);
+        add("|MPos:");
+        addf(robot->from_millimeters(mpos[0]), 4); add(",");
+        addf(robot->from_millimeters(mpos[1]), 4); add(",");
+        addf(robot->from_millimeters(mpos[2]), 4);
 
 #if MAX_ROBOT_ACTUATORS > 3
         // deal with the ABC axis (E will be A)
         for (int i = A_AXIS; i < robot->get_number_registered_motors(); ++i) {
             // current actuator position
-            n = snprintf(buf, sizeof(buf), ",%1.4f", robot->actuators[i]->get_current_position());
-            if(n > sizeof(buf)) n= sizeof(buf);
-            str.append(buf, n);
+            add(",");
+            addf(robot->actuators[i]->get_current_position(), 4);
         }
 #endif
 
         // work space position
         Robot::wcs_t pos = robot->mcs2wcs(mpos);
-        n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(std::get<X_AXIS>(pos)), robot->from_millimeters(std::get<Y_AXIS>(pos)), robot->from_millimeters(std::get<Z_AXIS>(pos)));
-        if(n > sizeof(buf)) n= sizeof(buf);
-
-        str.append("|WPos:").append(buf, n);
+        add("|WPos:");
+        addf(robot->from_millimeters(std::get<X_AXIS>(pos)), 4); add(",");
+        addf(robot->from_millimeters(std::get<Y_AXIS>(pos)), 4); add(",");
+        addf(robot->from_millimeters(std::get<Z_AXIS>(pos)), 4);
 
         // current feedrate and requested fr and override
         float fr= robot->from_millimeters(conveyor->get_current_feedrate()*60.0F);
         float frr= robot->from_millimeters(robot->get_feed_rate());
         float fro= 6000.0F / robot->get_seconds_per_minute();
-        n = snprintf(buf, sizeof(buf), "|F:%1.1f,%1.1f,%1.1f", fr, frr,fro);
-        if(n > sizeof(buf)) n= sizeof(buf);
-        str.append(buf, n);
-
+        add("|F:");
+        addf(fr, 1); add(",");
+        addf(frr, 1); add(",");
+        addf(fro, 1);
 
         // current Laser power
         #ifndef NO_TOOLS_LASER
             Laser *plaser= nullptr;
             if(PublicData::get_value(laser_checksum, (void *)&plaser) && plaser != nullptr) {
-                float lp= plaser->get_current_power();
-                n = snprintf(buf, sizeof(buf), "|L:%1.4f", lp);
-                if(n > sizeof(buf)) n= sizeof(buf);
-                str.append(buf, n);
-                float sr= robot->get_s_value();
-                n = snprintf(buf, sizeof(buf), "|S:%1.4f", sr);
-                if(n > sizeof(buf)) n= sizeof(buf);
-                str.append(buf, n);
+                add("|L:");
+                addf(plaser->get_current_power(), 4);
+                add("|S:");
+                addf(robot->get_s_value(), 4);
             }
         #endif
 
     } else {
         // return the last milestone if idle
-        char buf[128];
         // machine position
         Robot::wcs_t mpos = robot->get_axis_position();
-        size_t n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(std::get<X_AXIS>(mpos)), robot->from_millimeters(std::get<Y_AXIS>(mpos)), robot->from_millimeters(std::get<Z_AXIS>(mpos)));
-        if(n > sizeof(buf)) n= sizeof(buf);
-
-        str.append("|MPos:").append(buf, n);
+        add("|MPos:");
+        addf(robot->from_millimeters(std::get<X_AXIS>(mpos)), 4); add(",");
+        addf(robot->from_millimeters(std::get<Y_AXIS>(mpos)), 4); add(",");
+        addf(robot->from_millimeters(std::get<Z_AXIS>(mpos)), 4);
 
 #if MAX_ROBOT_ACTUATORS > 3
         // deal with the ABC axis (E will be A)
         for (int i = A_AXIS; i < robot->get_number_registered_motors(); ++i) {
             // current actuator position
-            n = snprintf(buf, sizeof(buf), ",%1.4f", robot->actuators[i]->get_current_position());
-            if(n > sizeof(buf)) n= sizeof(buf);
-            str.append(buf, n);
+            add(",");
+            addf(robot->actuators[i]->get_current_position(), 4);
         }
 #endif
 
         // work space position
         Robot::wcs_t pos = robot->mcs2wcs(mpos);
-        n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(std::get<X_AXIS>(pos)), robot->from_millimeters(std::get<Y_AXIS>(pos)), robot->from_millimeters(std::get<Z_AXIS>(pos)));
-        if(n > sizeof(buf)) n= sizeof(buf);
-        str.append("|WPos:").append(buf, n);
+        add("|WPos:");
+        addf(robot->from_millimeters(std::get<X_AXIS>(pos)), 4); add(",");
+        addf(robot->from_millimeters(std::get<Y_AXIS>(pos)), 4); add(",");
+        addf(robot->from_millimeters(std::get<Z_AXIS>(pos)), 4);
 
         // requested framerate, and override
         float fr= robot->from_millimeters(robot->get_feed_rate());
         float fro= 6000.0F / robot->get_seconds_per_minute();
-        n = snprintf(buf, sizeof(buf), "|F:%1.1f,%1.1f", fr, fro);
-        if(n > sizeof(buf)) n= sizeof(buf);
-        str.append(buf, n);
+        add("|F:");
+        addf(fr, 1); add(",");
+        addf(fro, 1);
     }
 
     // if not grbl mode get temperatures
     if(!is_grbl_mode()) {
-        struct pad_temperature temp;
         // scan all temperature controls
         std::vector<struct pad_temperature> controllers;
         bool ok = PublicData::get_value(temperature_control_checksum, poll_controls_checksum, &controllers);
         if (ok) {
-            char buf[32];
             for (auto &c : controllers) {
-                size_t n= snprintf(buf, sizeof(buf), "|%s:%1.1f,%1.1f", c.designator.c_str(), c.current_temperature, c.target_temperature);
-                if(n > sizeof(buf)) n= sizeof(buf);
-                str.append(buf, n);
+                add("|");
+                add(c.designator.c_str());
+                add(":");
+                addf(c.current_temperature, 1); add(",");
+                addf(c.target_temperature, 1);
             }
         }
     }
 
-    str.append(">\n");
-    return str;
+    add(">\n");
+    buf[n]= '\0';
+    return n;
 }
 
 // Add a module to Kernel. We don't actually hold a list of modules we just call its on_module_loaded
-void Kernel::add_module(Module* module)
+// NOTE the module may delete itself in on_module_loaded
+void Kernel::add_module(Module* module, const char *name)
 {
+    uint32_t t= us_ticker_read();
+    if(name != nullptr) module->set_module_name(name);
     module->on_module_loaded();
+    if(name != nullptr) boot_step(name, t);
+}
+
+// record how long a step of the boot took, start_us is when it started
+void Kernel::boot_step(const char *name, uint32_t start_us, bool late)
+{
+    boot_step_t s;
+    s.name= name;
+    s.start_us= start_us;
+    s.us= us_ticker_read() - start_us;
+    s.late= late;
+    boot_steps.push_back(s);
+}
+
+void Kernel::boot_ready()
+{
+    ready_us= us_ticker_read();
+    ready= true;
+}
+
+// run the next of the inits the modules left until after the machine was ready
+void Kernel::run_late_init()
+{
+    late_init_t l= late_inits.front();
+    late_inits.erase(late_inits.begin());
+    uint32_t t= us_ticker_read();
+    l.fnc(l.obj, 0);
+    boot_step(l.name, t, true);
+    if(late_inits.empty()) late_inits.shrink_to_fit();
 }
 
 // Adds a hook for a given module and event
-void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod)
+// ON_MAIN_LOOP and ON_IDLE hooks may be given a period and a time budget in us, 0 means run every time
+void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod, uint32_t period_us, uint32_t budget_us, bool at_yield)
 {
     this->hooks[id_event].push_back(mod);
+#ifdef ENABLE_PERF
+    perf_counter_t pc;
+    pc.reset();
+    this->hook_perf[id_event].push_back(pc);
+#endif
+    if(id_event == ON_MAIN_LOOP || id_event == ON_IDLE) {
+        task_t t;
+        t.module= mod;
+        t.period_us= period_us;
+        t.budget_us= budget_us;
+        t.next_run= us_ticker_read();
+        t.calls= 0;
+        t.total_us= 0;
+        t.max_us= 0;
+        t.overruns= 0;
+        t.running= false;
+        t.at_yield= at_yield;
+#ifdef ENABLE_PERF
+        t.perf.reset();
+#endif
+        tasks[id_event == ON_IDLE ? 1 : 0].push_back(t);
+    }
+}
+
+// run each task in the list that is due and not already running further up the stack
+void Kernel::run_tasks(std::vector<task_t> &list, _EVENT_ENUM id_event, void *argument, bool yielding)
+{
+    // index rather than iterator as a task may register or unregister tasks when it is called
+    for (size_t i = 0; i < list.size(); ++i) {
+        if(list[i].running || (yielding && !list[i].at_yield)) continue;
+
+        uint32_t start= us_ticker_read();
+        if((int32_t)(start - list[i].next_run) < 0) continue; // not due yet
+
+        Module *m= list[i].module;
+        list[i].running= true;
+        uint32_t saved_child_us= task_child_us;
+        task_child_us= 0;
+
+        PERF_START(cycles);
+        (m->*kernel_callback_functions[id_event])(argument);
+
+        uint32_t elapsed= us_ticker_read() - start;
+        uint32_t own= elapsed > task_child_us ? elapsed - task_child_us : 0;
+        task_child_us= saved_child_us + elapsed;
+
+        // the list may have changed under us
+        if(i >= list.size() || list[i].module != m) {
+            size_t j;
+            for (j = 0; j < list.size() && list[j].module != m; ++j) ;
+            if(j == list.size()) {
+                // it unregistered itself, whatever moved into its slot is next
+                --i;
+                continue;
+            }
+            i= j;
+        }
+
+        task_t &t= list[i];
+        PERF_END(t.perf, cycles);
+        t.running= false;
+        t.calls++;
+        t.total_us += own;
+        if(own > t.max_us) t.max_us= own;
+        t.next_run= start + t.period_us;
+        if(t.budget_us != 0 && own > t.budget_us) {
+            // give everything else a chance by delaying this task by the amount it overran
+            t.overruns++;
+            t.next_run= start + t.period_us + (own - t.budget_us);
+        }
+    }
+}
+
+// May be called from an ISR of any priority, the first raise wins until the call has been run
+void Kernel::PendingCall::raise(uint32_t arg)
+{
+    if(state.load() != 0) return;
+    raised_us= us_ticker_read();
+    uint32_t expected= 0;
+    state.compare_exchange_strong(expected, RAISED | arg);
+}
+
+// run the pending calls that have been raised
+void Kernel::run_deferred()
+{
+    // index as a call may make another pending call
+    for (size_t i = 0; i < pending_calls.size(); ++i) {
+        PendingCall *p= pending_calls[i];
+        uint32_t s= p->state.load();
+        if(s == 0) continue;
+        uint32_t latency= us_ticker_read() - p->raised_us;
+        // cleared before the call so a raise while it is running runs it again next time
+        s= p->state.exchange(0);
+        if(latency > deferred_stats.max_latency_us) deferred_stats.max_latency_us= latency;
+        deferred_stats.calls++;
+        p->fnc(p->obj, s & ~PendingCall::RAISED);
+    }
+}
+
+void Kernel::reset_task_stats()
+{
+    deferred_stats.calls= 0;
+    deferred_stats.max_latency_us= 0;
+
+    for(auto &l : tasks) {
+        for(auto &t : l) {
+            t.calls= 0;
+            t.total_us= 0;
+            t.max_us= 0;
+            t.overruns= 0;
+        }
+    }
 }
 
+#ifdef ENABLE_PERF
+void Kernel::reset_perf()
+{
+    Perf::reset();
+    for(auto &l : hook_perf) {
+        for(auto &c : l) c.reset();
+    }
+    for(auto &l : tasks) {
+        for(auto &t : l) t.perf.reset();
+    }
+}
+#endif
+
 // This will stop the que and stop further commands, and stop motors
 // Optionally used before on_halt() is sent to do a quick stop
 // May be called from an ISR
@@ -334,11 +519,28 @@ void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
         this->halted = (argument == nullptr);
         if(!this->halted && this->feed_hold) this->feed_hold= false; // also clear feed hold
         was_idle = conveyor->is_idle(); // see if we were doing anything like printing
+        Trace::record(Trace::HALT, this->halted ? 1 : 0);
     }
 
-    // send to all registered modules
-    for (auto m : hooks[id_event]) {
-        (m->*kernel_callback_functions[id_event])(argument);
+    if(id_event == ON_IDLE) run_deferred();
+    else if(id_event == ON_MAIN_LOOP && ready && !late_inits.empty()) run_late_init();
+
+    if(id_event == ON_MAIN_LOOP || id_event == ON_IDLE) {
+        run_tasks(tasks[id_event == ON_IDLE ? 1 : 0], id_event, argument);
+
+    } else {
+        // send to all registered modules
+#ifdef ENABLE_PERF
+        for (size_t i = 0; i < hooks[id_event].size(); ++i) {
+            PERF_START(cycles);
+            (hooks[id_event][i]->*kernel_callback_functions[id_event])(argument);
+            if(i < hook_perf[id_event].size()) PERF_END(hook_perf[id_event][i], cycles);
+        }
+#else
+        for (auto m : hooks[id_event]) {
+            (m->*kernel_callback_functions[id_event])(argument);
+        }
+#endif
     }
 
     if(id_event == ON_HALT) {
@@ -351,6 +553,12 @@ void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
     }
 }
 
+void Kernel::yield()
+{
+    run_deferred();
+    run_tasks(tasks[1], ON_IDLE, nullptr, true);
+}
+
 // These are used by tests to test for various things. basically mocks
 bool Kernel::kernel_has_event(_EVENT_ENUM id_event, Module *mod)
 {
@@ -364,8 +572,21 @@ void Kernel::unregister_for_event(_EVENT_ENUM id_event, Module *mod)
 {
     for (auto i = hooks[id_event].begin(); i != hooks[id_event].end(); ++i) {
         if(*i == mod) {
+#ifdef ENABLE_PERF
+            hook_perf[id_event].erase(hook_perf[id_event].begin() + (i - hooks[id_event].begin()));
+#endif
             hooks[id_event].erase(i);
-            return;
+            break;
+        }
+    }
+
+    if(id_event == ON_MAIN_LOOP || id_event == ON_IDLE) {
+        std::vector<task_t> &list= tasks[id_event == ON_IDLE ? 1 : 0];
+        for (auto i = list.begin(); i != list.end(); ++i) {
+            if(i->module == mod) {
+                list.erase(i);
+                return;
+            }
         }
     }
 }
@@ -13,9 +13,12 @@
 #define THEROBOT THEKERNEL->robot
 
 #include "Module.h"
+#include "Perf.h"
 #include <array>
 #include <vector>
 #include <string>
+#include <stdint.h>
+#include <atomic>
 
 //Module manager
 class Config;
@@ -39,9 +42,13 @@ class Kernel {
         static Kernel* instance; // the Singleton instance of Kernel usable anywhere
         const char* config_override_filename(){ return "/sd/config-override"; }
 
-        void add_module(Module* module);
-        void register_for_event(_EVENT_ENUM id_event, Module *module);
+        // a module given a name is known by it in the reports, and has the time its on_module_loaded took recorded in the boot times
+        void add_module(Module* module, const char *name= nullptr);
+        void register_for_event(_EVENT_ENUM id_event, Module *module, uint32_t period_us= 0, uint32_t budget_us= 0, bool at_yield= true);
         void call_event(_EVENT_ENUM id_event, void * argument= nullptr);
+        // the yield point for anything that has to wait for something, runs the pending calls and the ON_IDLE tasks that
+        // are not already running, leaving out the ones registered as not to be run from inside another module's wait
+        void yield();
 
         bool kernel_has_event(_EVENT_ENUM id_event, Module *module);
         void unregister_for_event(_EVENT_ENUM id_event, Module *module);
@@ -58,7 +65,79 @@ class Kernel {
         bool is_bad_mcu() const { return bad_mcu; }
         void immediate_halt();
 
-        std::string get_query_string();
+        // ON_MAIN_LOOP and ON_IDLE handlers are run as tasks by a cooperative scheduler
+        // a task with a period is only called when it is due, a task that takes longer than its budget is pushed back by the overrun
+        // a task is never called while it is already running, so a handler that yields does not get re-entered,
+        // and an ON_IDLE task that starts new work of its own can ask to only be run from the main loop and not from yield()
+        struct task_t {
+            Module *module;
+            uint32_t period_us;
+            uint32_t budget_us;
+            uint32_t next_run;
+            uint32_t calls;
+            uint64_t total_us; // time spent in the task itself, not counting any tasks it yielded to
+            uint32_t max_us;
+            uint32_t overruns;
+            bool running;
+            bool at_yield;
+#ifdef ENABLE_PERF
+            perf_counter_t perf;
+#endif
+        };
+        const std::vector<task_t>& get_tasks(_EVENT_ENUM id_event) const { return tasks[id_event == ON_IDLE ? 1 : 0]; }
+        void reset_task_stats();
+#ifdef ENABLE_PERF
+        // cycles spent in each module for the other events, in the same order as the hooks
+        const std::vector<Module*>& get_hooks(_EVENT_ENUM id_event) const { return hooks[id_event]; }
+        const std::vector<perf_counter_t>& get_hook_perf(_EVENT_ENUM id_event) const { return hook_perf[id_event]; }
+        void reset_perf();
+#endif
+
+        // pending calls let an interrupt hand work to the main loop instead of setting a flag for an on_idle to poll, eg a halt,
+        // a limit hit or a query. The raised ones are run from ON_IDLE, they can't be lost, raising one again before it has run
+        // only runs it once, with the arg it was first raised with (31 bits). It is made from the main loop and raised from an ISR of any priority
+        // eg halt_call= THEKERNEL->pending_call<SerialConsole, &SerialConsole::handle_halt>(this); then halt_call->raise();
+        class PendingCall {
+            public:
+                void raise(uint32_t arg= 0);
+            private:
+                friend class Kernel;
+                PendingCall(void (*fnc)(void *, uint32_t), void *obj) : fnc(fnc), obj(obj), state(0), raised_us(0) {}
+                static const uint32_t RAISED= 0x80000000;
+                void (*fnc)(void *, uint32_t);
+                void *obj;
+                std::atomic<uint32_t> state; // 0 or RAISED | arg
+                volatile uint32_t raised_us;
+        };
+        template<typename T, void (T::*fnc)(uint32_t)> PendingCall *pending_call(T *obj) { return add_pending_call(new PendingCall(&call_deferred<T, fnc>, obj)); }
+
+        struct deferred_stats_t {
+            uint32_t calls;
+            uint32_t max_latency_us;
+        };
+        const deferred_stats_t& get_deferred_stats() const { return deferred_stats; }
+
+        // boot profiling, each phase of init and each named module is timed, all times are from when the kernel was created
+        struct boot_step_t {
+            const char *name;
+            uint32_t start_us;
+            uint32_t us;
+            bool late; // done after the machine was ready
+        };
+        void boot_step(const char *name, uint32_t start_us, bool late= false);
+        const std::vector<boot_step_t>& get_boot_steps() const { return boot_steps; }
+        uint32_t get_ready_us() const { return ready_us; }
+        // called at the end of init, the late inits start on the next main loop
+        void boot_ready();
+        bool is_ready() const { return ready; }
+
+        // modules that are not needed for motion can leave the slow part of their setup until after the machine is ready
+        // one is run per pass of the main loop once boot_ready has been called, so config must be read before then
+        // eg THEKERNEL->late_init<Network, &Network::start>(this, "network start");
+        template<typename T, void (T::*fnc)(uint32_t)> void late_init(T *obj, const char *name) { late_inits.push_back({&call_deferred<T, fnc>, obj, name}); }
+
+        size_t get_query_string(char *buf, size_t size);
+        static const size_t QUERY_STRING_SIZE= 256; // big enough for any query string
 
         // These modules are available to all other modules
         SerialConsole*    serial;
@@ -80,6 +159,29 @@ class Kernel {
     private:
         // When a module asks to be called for a specific event ( a hook ), this is where that request is remembered
         std::array<std::vector<Module*>, NUMBER_OF_DEFINED_EVENTS> hooks;
+        // the ON_MAIN_LOOP and ON_IDLE hooks are also kept here with their schedule and stats
+        std::array<std::vector<task_t>, 2> tasks;
+#ifdef ENABLE_PERF
+        std::array<std::vector<perf_counter_t>, NUMBER_OF_DEFINED_EVENTS> hook_perf;
+#endif
+        void run_tasks(std::vector<task_t> &list, _EVENT_ENUM id_event, void *argument, bool yielding= false);
+        uint32_t task_child_us; // time spent in nested tasks, so the caller is not charged for it
+
+        template<typename T, void (T::*fnc)(uint32_t)> static void call_deferred(void *obj, uint32_t arg) { (static_cast<T*>(obj)->*fnc)(arg); }
+        void run_deferred();
+        PendingCall *add_pending_call(PendingCall *p) { pending_calls.push_back(p); return p; }
+        std::vector<PendingCall*> pending_calls;
+
+        struct late_init_t {
+            void (*fnc)(void *, uint32_t);
+            void *obj;
+            const char *name;
+        };
+        void run_late_init();
+        std::vector<late_init_t> late_inits;
+        std::vector<boot_step_t> boot_steps;
+        uint32_t ready_us;
+        deferred_stats_t deferred_stats;
         struct {
             bool use_leds:1;
             bool halted:1;
@@ -88,8 +190,14 @@ class Kernel {
             bool ok_per_line:1;
             bool enable_feed_hold:1;
             bool bad_mcu:1;
+            bool query_mpos_valid:1;
+            bool ready:1;
         };
 
+        // the realtime machine position last reported by get_query_string, and the actuator steps it was worked out from
+        int32_t query_steps[3];
+        float query_mpos[3];
+
 };
 
 #endif
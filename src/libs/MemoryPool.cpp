@@ -27,24 +27,49 @@ void  operator delete(void* p)
 
 
 #define offset(x) ((uint32_t)(((uint8_t*) x) - ((uint8_t*) this->base)))
+#define region(o) ((_poolregion*) (((uint8_t*) this->base) + (o)))
 
+// every block starts with its own size and the size of the block before it, so neighbours are found without walking the pool
 typedef struct __attribute__ ((packed))
 {
-    uint32_t next :31;
-    uint32_t used :1;
+    uint16_t size;      // including the header, bit 0 is set when the block is used
+    uint16_t prev_size; // 0 for the first block
 
-    uint8_t data[];
+    // a free block is linked into the list for its size class, as offsets from the start of the pool
+    // these are where the data is in a used block, so they are not part of the header
+    uint16_t next_free;
+    uint16_t prev_free;
 } _poolregion;
 
+#define HEADER_SIZE 4
+#define USED 1
+
 MemoryPool* MemoryPool::first = NULL;
 
 MemoryPool::MemoryPool(void* base, uint16_t size)
 {
-    this->base = base;
-    this->size = size;
-
-    ((_poolregion*) base)->used = 0;
-    ((_poolregion*) base)->next = size;
+    // blocks must be word aligned
+    uint32_t pad = (4 - ((uintptr_t) base & 3)) & 3;
+    if (pad > size) pad = size;
+    this->base = ((uint8_t*) base) + pad;
+    this->size = (size - pad) & ~3;
+
+    fl_bitmap = 0;
+    for (int i = 0; i < FL_COUNT; i++) {
+        sl_bitmap[i] = 0;
+        for (int j = 0; j < SL_COUNT; j++)
+            heads[i][j] = NONE;
+    }
+    free_bytes = 0;
+    high_water = 0;
+
+    // the whole pool starts as one free block
+    if (this->size >= MIN_BLOCK) {
+        _poolregion* p = (_poolregion*) this->base;
+        p->size = this->size;
+        p->prev_size = 0;
+        insert_free(p);
+    }
 
     // insert ourselves into head of LL
     next = first;
@@ -75,135 +100,204 @@ MemoryPool::~MemoryPool()
     }
 }
 
+// find the first and second level class a block of this size goes in
+void MemoryPool::mapping(uint32_t size, uint32_t& fl, uint32_t& sl)
+{
+    if (size < SMALL_SIZE) {
+        fl = 0;
+        sl = size >> 2;
+    } else {
+        uint32_t l = 31 - __builtin_clz(size);
+        fl = l - (SL_BITS + 2) + 1;
+        sl = (size >> (l - SL_BITS)) & (SL_COUNT - 1);
+    }
+}
+
+// the first free block in this class or the next larger one that has any
+void* MemoryPool::find_free(uint32_t fl, uint32_t sl)
+{
+    if (fl >= FL_COUNT)
+        return NULL;
+
+    uint32_t sl_map = sl_bitmap[fl] & (~0U << sl);
+    if (sl_map == 0) {
+        uint32_t fl_map = fl_bitmap & (~0U << (fl + 1));
+        if (fl_map == 0)
+            return NULL;
+        fl = __builtin_ctz(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    return region(heads[fl][sl]);
+}
+
+void MemoryPool::insert_free(void* b)
+{
+    _poolregion* p = (_poolregion*) b;
+    uint32_t fl, sl;
+    mapping(p->size, fl, sl);
+
+    p->next_free = heads[fl][sl];
+    p->prev_free = NONE;
+    if (p->next_free != NONE)
+        region(p->next_free)->prev_free = offset(p);
+    heads[fl][sl] = offset(p);
+
+    fl_bitmap |= 1 << fl;
+    sl_bitmap[fl] |= 1 << sl;
+    free_bytes += p->size;
+}
+
+void MemoryPool::remove_free(void* b)
+{
+    _poolregion* p = (_poolregion*) b;
+    uint32_t fl, sl;
+    mapping(p->size, fl, sl);
+
+    if (p->next_free != NONE)
+        region(p->next_free)->prev_free = p->prev_free;
+    if (p->prev_free != NONE) {
+        region(p->prev_free)->next_free = p->next_free;
+    } else {
+        heads[fl][sl] = p->next_free;
+        if (p->next_free == NONE) {
+            sl_bitmap[fl] &= ~(1 << sl);
+            if (sl_bitmap[fl] == 0)
+                fl_bitmap &= ~(1 << fl);
+        }
+    }
+    free_bytes -= p->size;
+}
+
 void* MemoryPool::alloc(size_t nbytes)
 {
     // nbytes = ceil(nbytes / 4) * 4
     if (nbytes & 3)
         nbytes += 4 - (nbytes & 3);
 
-    // start at the start
-    _poolregion* p = ((_poolregion*) base);
-
     // find the allocation size including our metadata
-    uint16_t nsize = nbytes + sizeof(_poolregion);
-
-    MDEBUG("\tallocate %d bytes from %p\n", nsize, base);
-
-    // now we walk the list, looking for a sufficiently large free block
-    do {
-        MDEBUG("\t\tchecking %p (%s, %db)\n", p, (p->used?"used":"free"), p->next);
-        if ((p->used == 0) && (p->next >= nsize))
-        {   // we found a free space that's big enough
-            MDEBUG("\t\tFOUND free block at %p (%+d) with %d bytes\n", p, offset(p), p->next);
-            // mark it as used
-            p->used = 1;
-
-            // if there's free space at the end of this block
-            if (p->next > nsize)
-            {
-                // q = p->next
-                _poolregion* q = (_poolregion*) (((uint8_t*) p) + nsize);
-
-                MDEBUG("\t\twriting header to %p (%+d) (%d)\n", q, offset(q), p->next - nsize);
-                // write a new block header into q
-                q->used = 0;
-                q->next = p->next - nsize;
-
-                // set our next to point to it
-                p->next = nsize;
-
-                // sanity check
-                if (offset(q) >= size)
-                {
-                    // captain, we have a problem!
-                    // this can only happen if something has corrupted our heap, since we should simply fail to find a free block if it's full
-                    __debugbreak();
+    uint32_t nsize = nbytes + HEADER_SIZE;
+    if (nsize < MIN_BLOCK)
+        nsize = MIN_BLOCK;
+    if (nsize > size)
+        return NULL;
+
+    MDEBUG("\tallocate %lu bytes from %p\n", nsize, base);
+
+    // round up to the next class so any block on the list we find is big enough
+    uint32_t search = nsize;
+    if (search >= SMALL_SIZE)
+        search += (1 << (31 - __builtin_clz(search) - SL_BITS)) - 1;
+
+    uint32_t fl, sl;
+    mapping(search, fl, sl);
+    _poolregion* p = (_poolregion*) find_free(fl, sl);
+
+    if (p == NULL) {
+        // the only blocks left that may fit are in the same class as the request, this only happens when the pool is nearly full
+        mapping(nsize, fl, sl);
+        if (fl < FL_COUNT) {
+            for (uint16_t o = heads[fl][sl]; o != NONE; o = region(o)->next_free) {
+                if (region(o)->size >= nsize) {
+                    p = region(o);
+                    break;
                 }
             }
-
-            // then return the data region for the block
-            return &p->data;
         }
+        if (p == NULL) {
+            MDEBUG("\t\tno free block of %lu bytes\n", nsize);
+            return NULL;
+        }
+    }
+
+    MDEBUG("\t\tFOUND free block at %p (%+d) with %d bytes\n", p, offset(p), p->size);
+    remove_free(p);
+
+    // if there's enough free space at the end of this block, make it a free block of its own
+    if (p->size - nsize >= MIN_BLOCK)
+    {
+        _poolregion* q = (_poolregion*) (((uint8_t*) p) + nsize);
+        q->size = p->size - nsize;
+        q->prev_size = nsize;
+        p->size = nsize;
+
+        if (offset(q) + q->size < size)
+            region(offset(q) + q->size)->prev_size = q->size;
+        insert_free(q);
+    }
 
-        // p = p->next
-        p = (_poolregion*) (((uint8_t*) p) + p->next);
+    // mark it as used
+    p->size |= USED;
 
-        // make sure we don't walk off the end
-    } while (p < (_poolregion*) (((uint8_t*)base) + size));
+    uint32_t used = size - free_bytes;
+    if (used > high_water)
+        high_water = used;
 
-    // fell off the end of the region!
-    return NULL;
+    // then return the data region for the block
+    return ((uint8_t*) p) + HEADER_SIZE;
 }
 
 void MemoryPool::dealloc(void* d)
 {
-    _poolregion* p = (_poolregion*) (((uint8_t*) d) - sizeof(_poolregion));
-    p->used = 0;
+    _poolregion* p = (_poolregion*) (((uint8_t*) d) - HEADER_SIZE);
 
-    MDEBUG("\tdeallocating %p (%+d, %db)\n", p, offset(p), p->next);
+    MDEBUG("\tdeallocating %p (%+d, %db)\n", p, offset(p), p->size);
 
-    // combine next block if it's free
-    _poolregion* q = (_poolregion*) (((uint8_t*) p) + p->next);
-    if(q >= (_poolregion*) (((uint8_t*) base) + size)) {
-        // we are beyond the end of the pool, ie last block
+    if ((p->size & USED) == 0 || offset(p) + (p->size & ~USED) > size)
+    {
+        // captain, we have a problem!
+        // this can only happen if the block was already freed or something has corrupted our heap
+        __debugbreak();
         return;
     }
+    p->size &= ~USED;
 
-    if (q->used == 0)
+    // combine next block if it's free
+    if (offset(p) + p->size < size)
     {
-        MDEBUG("\t\tCombining with next free region at %p, new size is %d\n", q, p->next + q->next);
-
-        // sanity check
-        if (offset(q) > size)
+        _poolregion* q = region(offset(p) + p->size);
+        if ((q->size & USED) == 0)
         {
-            // captain, we have a problem!
-            // this can only happen if something has corrupted our heap, since we should simply fail to find a free block if it's full
-            __debugbreak();
+            MDEBUG("\t\tCombining with next free region at %p, new size is %d\n", q, p->size + q->size);
+            remove_free(q);
+            p->size += q->size;
         }
-
-        p->next += q->next;
     }
 
-    // walk the list to find previous block
-    q = (_poolregion*) base;
-    do {
-        // check if q is the previous block
-        if ((((uint8_t*) q) + q->next) == (uint8_t*) p) {
-            // q is the previous block.
-            if (q->used == 0)
-            { // if q is free
-                MDEBUG("\t\tCombining with previous free region at %p, new size is %d\n", q, p->next + q->next);
-
-                // combine!
-                q->next += p->next;
-
-                // sanity check
-                if ((offset(p) + p->next) > size)
-                {
-                    // captain, we have a problem!
-                    // this can only happen if something has corrupted our heap, since we should simply fail to find a free block if it's full
-                    __debugbreak();
-                }
-            }
-
-            // we found previous block, return
-            return;
+    // combine previous block if it's free
+    if (p->prev_size != 0)
+    {
+        _poolregion* q = region(offset(p) - p->prev_size);
+        if ((q->size & USED) == 0)
+        {
+            MDEBUG("\t\tCombining with previous free region at %p, new size is %d\n", q, p->size + q->size);
+            remove_free(q);
+            q->size += p->size;
+            p = q;
         }
+    }
 
-        // return if last block
-        if (offset(q) + q->next >= size)
-            return;
-
-        // q = q->next
-        q = (_poolregion*) (((uint8_t*) q) + q->next);
+    if (offset(p) + p->size < size)
+        region(offset(p) + p->size)->prev_size = p->size;
 
-        // if some idiot deallocates our memory region while we're using it, strange things can happen.
-        // avoid an infinite loop in that case, however we'll still leak memory and may corrupt things
-        if (q->next == 0)
-            return;
+    insert_free(p);
+}
 
-        // make sure we don't walk off the end
-    } while (q < (_poolregion*) (((uint8_t*) base) + size));
+// the largest block is in the highest non empty class, but not necessarily first on its list
+uint32_t MemoryPool::largest_free()
+{
+    if (fl_bitmap == 0)
+        return 0;
+
+    uint32_t fl = 31 - __builtin_clz(fl_bitmap);
+    uint32_t sl = 31 - __builtin_clz(sl_bitmap[fl]);
+    uint32_t largest = 0;
+    for (uint16_t o = heads[fl][sl]; o != NONE; o = region(o)->next_free) {
+        if (region(o)->size > largest)
+            largest = region(o)->size;
+    }
+    return largest;
 }
 
 void MemoryPool::debug(StreamOutput* str)
@@ -212,18 +306,19 @@ void MemoryPool::debug(StreamOutput* str)
     uint32_t tot = 0;
     uint32_t free = 0;
     str->printf("Start: %ub MemoryPool at %p\n", size, p);
-    do {
-        str->printf("\tChunk at %p (%4lu): %s, %lu bytes\n", p, offset(p), (p->used?"used":"free"), p->next);
-        tot += p->next;
-        if (p->used == 0)
-            free += p->next;
-        if ((offset(p) + p->next >= size) || (p->next <= sizeof(_poolregion)))
-        {
-            str->printf("End: total %lub, free: %lub\n", tot, free);
-            return;
-        }
-        p = (_poolregion*) (((uint8_t*) p) + p->next);
-    } while (1);
+    while (offset(p) < size && p->size >= MIN_BLOCK) {
+        uint32_t s = p->size & ~USED;
+        str->printf("\tChunk at %p (%4lu): %s, %lu bytes\n", p, offset(p), ((p->size & USED)?"used":"free"), s);
+        tot += s;
+        if ((p->size & USED) == 0)
+            free += s;
+        p = (_poolregion*) (((uint8_t*) p) + s);
+    }
+
+    // how much of the free memory can't be had in one piece
+    uint32_t largest = largest_free();
+    str->printf("End: total %lub, free: %lub, largest free: %lub, fragmentation: %lu%%, high water: %lub\n",
+        tot, free, largest, free ? (free - largest) * 100 / free : 0, high_water);
 }
 
 bool MemoryPool::has(void* p)
@@ -233,17 +328,5 @@ bool MemoryPool::has(void* p)
 
 uint32_t MemoryPool::free()
 {
-    uint32_t free = 0;
-
-    _poolregion* p = (_poolregion*) base;
-
-    do {
-        if (p->used == 0)
-            free += p->next;
-        if (offset(p) + p->next >= size)
-            return free;
-        if (p->next <= sizeof(_poolregion))
-            return free;
-        p = (_poolregion*) (((uint8_t*) p) + p->next);
-    } while (1);
+    return free_bytes;
 }
@@ -17,6 +17,10 @@ class StreamOutput;
  * with MUCH thanks to http://www.parashift.com/c++-faq-lite/memory-pools.html
  *
  * test framework at https://gist.github.com/triffid/5563987
+ *
+ * The free blocks are kept in segregated lists by size class, as in TLSF (http://www.gii.upv.es/tlsf/),
+ * a first level per power of two split into SL_COUNT second level classes, with a bitmap of the non empty lists,
+ * so alloc and dealloc take the same time however many blocks are in the pool
  */
 
 class MemoryPool
@@ -33,14 +37,35 @@ public:
     bool  has(void*);
 
     uint32_t free(void);
+    uint32_t largest_free(void);
+    uint32_t get_high_water() const { return high_water; }
 
     MemoryPool* next;
 
     static MemoryPool* first;
 
 private:
+    enum {
+        SL_BITS    = 3,
+        SL_COUNT   = 1 << SL_BITS,       // second level classes in each power of two
+        SMALL_SIZE = SL_COUNT * 4,       // blocks smaller than this have a class for each multiple of 4
+        FL_COUNT   = 16 - SL_BITS - 1,   // enough first level classes for a 64K pool
+        MIN_BLOCK  = 8,                  // room for the header and the free list links
+        NONE       = 0xFFFF
+    };
+
+    static void mapping(uint32_t size, uint32_t& fl, uint32_t& sl);
+    void* find_free(uint32_t fl, uint32_t sl);
+    void  insert_free(void* p);
+    void  remove_free(void* p);
+
     void* base;
     uint16_t size;
+    uint16_t fl_bitmap;
+    uint8_t sl_bitmap[FL_COUNT];
+    uint16_t heads[FL_COUNT][SL_COUNT]; // offsets of the first free block in each class
+    uint32_t free_bytes;
+    uint32_t high_water;
 };
 
 // this overloads "placement new"
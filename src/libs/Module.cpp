@@ -8,7 +8,7 @@
 #include "libs/Module.h"
 #include "libs/Kernel.h"
 
-Module::Module(){}
+Module::Module() : module_name(nullptr) {}
 Module::~Module(){}
 
 // this is used to callback the specific method in the Module instance, there must be one for each _EVENT_ENUM and in the same order
@@ -32,3 +32,7 @@ void Module::register_for_event(_EVENT_ENUM event_id){
     // You add things to Smoothie by making a new class that inherits the Module class. See http://smoothieware.org/moduleexample for a crude introduction
     THEKERNEL->register_for_event(event_id, this);
 }
+
+void Module::register_for_event(_EVENT_ENUM event_id, uint32_t period_us, uint32_t budget_us, bool at_yield){
+    THEKERNEL->register_for_event(event_id, this, period_us, budget_us, at_yield);
+}
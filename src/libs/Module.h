@@ -8,6 +8,8 @@
 #ifndef MODULE_H
 #define MODULE_H
 
+#include <stdint.h>
+
 // See : http://smoothieware.org/listofevents
 // When adding a new event the virtual method needs to be defined in class Module and the method pointer need to be defined in
 // Module.cpp:16 in the same order
@@ -36,8 +38,14 @@ public:
     Module();
     virtual ~Module();
     virtual void on_module_loaded() {};
+    // the name it was added to the kernel with, used to tell the modules apart in the tasks and perf reports
+    void set_module_name(const char *name) { module_name= name; }
+    const char *get_module_name() const { return module_name != nullptr ? module_name : "unnamed"; }
 
     void register_for_event(_EVENT_ENUM event_id);
+    // for ON_MAIN_LOOP and ON_IDLE, only call this module every period_us and back it off if it takes longer than budget_us
+    // an ON_IDLE handler that should not be run from inside another module's wait passes at_yield false
+    void register_for_event(_EVENT_ENUM event_id, uint32_t period_us, uint32_t budget_us= 0, bool at_yield= true);
 
     // event callbacks, not every module will implement all of these
     // there should be one for each _EVENT_ENUM
@@ -51,6 +59,8 @@ public:
     virtual void on_halt(void *) {};
     virtual void on_enable(void *) {};
 
+private:
+    const char *module_name;
 };
 
 #endif
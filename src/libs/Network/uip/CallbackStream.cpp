@@ -40,7 +40,7 @@ int CallbackStream::puts(const char *s)
         }else if(n == 0) {
             // if output queue is full
             // call idle until we can output more
-            THEKERNEL->call_event(ON_IDLE);
+            THEKERNEL->yield();
         }
     } while(n == 0);
 
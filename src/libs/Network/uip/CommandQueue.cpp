@@ -16,6 +16,14 @@ CommandQueue::CommandQueue()
 {
     command_queue_instance = this;
     null_stream= &(StreamOutput::NullStream);
+    arena= new char[ARENA_SIZE];
+    head= tail= 0;
+    count= 0;
+}
+
+CommandQueue::~CommandQueue()
+{
+    delete [] arena;
 }
 
 CommandQueue* CommandQueue::getInstance()
@@ -27,35 +35,98 @@ CommandQueue* CommandQueue::getInstance()
 extern "C" {
     int network_add_command(const char *cmd, void *pstream)
     {
-        return command_queue_instance->add(cmd, (StreamOutput*)pstream);
+        return command_queue_instance->add(cmd, (StreamOutput*)pstream) ? 1 : 0;
+    }
+
+    int network_command_queue_full()
+    {
+        return command_queue_instance->is_full() ? 1 : 0;
     }
+
+    int network_command_queue_has_room()
+    {
+        return command_queue_instance->has_room() ? 1 : 0;
+    }
+}
+
+// copy into the arena at head, wrapping around the end if needed
+void CommandQueue::put(const void *src, size_t n)
+{
+    size_t i= head & (ARENA_SIZE - 1);
+    size_t n1= ARENA_SIZE - i;
+    if(n1 > n) n1= n;
+    memcpy(&arena[i], src, n1);
+    memcpy(arena, (const char *)src + n1, n - n1);
+    head += n;
 }
 
-int CommandQueue::add(const char *cmd, StreamOutput *pstream)
+// copy out of the arena at tail, wrapping around the end if needed
+void CommandQueue::get(void *dst, size_t n)
 {
-    cmd_t c= {strdup(cmd), pstream==NULL?null_stream:pstream};
-    q.push(c);
+    size_t i= tail & (ARENA_SIZE - 1);
+    size_t n1= ARENA_SIZE - i;
+    if(n1 > n) n1= n;
+    memcpy(dst, &arena[i], n1);
+    memcpy((char *)dst + n1, arena, n - n1);
+    tail += n;
+}
+
+// the largest receive window, in whole segments, where every segment but the last can be queued without reaching
+// is_full(), so the connection is never stopped with data still in flight. Each received byte takes at most
+// (sizeof(header_t) + 1) / 2 bytes of the arena, when it is all one character lines
+size_t CommandQueue::receive_window(size_t mss, size_t max) const
+{
+    size_t s= space();
+    if(s <= HEADROOM) return mss;
+
+    size_t w= mss + (s - HEADROOM) * 2 / (sizeof(header_t) + 1);
+    w -= w % mss;
+    return w > max ? max : w;
+}
+
+bool CommandQueue::add(const char *cmd, StreamOutput *pstream)
+{
+    header_t h= {pstream==NULL?null_stream:pstream, (uint16_t)strlen(cmd)};
+    if(sizeof(h) + h.len > space()) {
+        // the connections should have been stopped well before this, the caller has to report the lost line
+        return false;
+    }
+
+    put(&h, sizeof(h));
+    put(cmd, h.len);
+    count++;
+
     if(pstream != NULL) {
         // count how many times this is on the queue
         CallbackStream *s= static_cast<CallbackStream *>(pstream);
         s->inc();
     }
-    return q.size();
+    return true;
 }
 
 // pops the next command off the queue and submits it.
 bool CommandQueue::pop()
 {
-    if (q.size() == 0) return false;
+    if (count == 0) return false;
 
-    cmd_t c= q.pop();
-    char *cmd= c.str;
+    header_t h;
+    get(&h, sizeof(h));
 
+    // the line goes straight from the arena into the message, that is the only copy made after it was received
     struct SerialMessage message;
-    message.message = cmd;
-    message.stream = c.pstream;
+    message.stream = h.pstream;
+    size_t i= tail & (ARENA_SIZE - 1);
+    size_t n1= ARENA_SIZE - i;
+    if(n1 >= h.len) {
+        message.message.assign(&arena[i], h.len);
+    } else {
+        message.message.reserve(h.len);
+        message.message.assign(&arena[i], n1);
+        message.message.append(arena, h.len - n1);
+    }
+    tail += h.len;
+    count--;
 
-    free(cmd);
     THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
 
     if(message.stream != null_stream) {
@@ -3,31 +3,51 @@
 
 #ifdef __cplusplus
 
-#include "fifo.h"
-#include <string>
+#include <stdint.h>
+#include <stddef.h>
 
 class StreamOutput;
 
+// Lines received from the network wait here until the main loop hands them to GcodeDispatch.
+// They are packed into one fixed ring allocated at startup, rather than a strdup and a list node per line,
+// and when it fills up the connections are stopped so the TCP receive window closes until there is room again
 class CommandQueue
 {
 public:
     CommandQueue();
     ~CommandQueue();
     bool pop();
-    int add(const char* cmd, StreamOutput *pstream);
-    int size() {return q.size();}
+    bool add(const char* cmd, StreamOutput *pstream);
+    int size() const { return count; }
+    size_t space() const { return ARENA_SIZE - (head - tail); }
+    // stop reading when a whole receive segment of short lines may not fit, and restart once it has drained a bit
+    bool is_full() const { return space() < HEADROOM; }
+    bool has_room() const { return space() >= HEADROOM + 512; }
+    size_t receive_window(size_t mss, size_t max) const;
     static CommandQueue* getInstance();
 
 private:
-    typedef struct {char* str; StreamOutput *pstream; } cmd_t;
-    Fifo<cmd_t> q;
+    // each entry is a header followed by the characters of the line, it may wrap around the end of the arena
+    typedef struct { StreamOutput *pstream; uint16_t len; } __attribute__ ((packed)) header_t;
+    static const size_t ARENA_SIZE= 4096; // must be a power of 2
+    // the worst case for one 536 byte (UIP_TCP_MSS) segment is all one character lines, empty lines are not queued
+    static const size_t HEADROOM= (536 / 2) * (sizeof(header_t) + 1);
+
+    void put(const void *src, size_t n);
+    void get(void *dst, size_t n);
+
     static CommandQueue *instance;
     StreamOutput *null_stream;
+    char *arena;
+    uint32_t head, tail; // free running, masked when indexing the arena
+    int count;
 };
 
 #else
 
 extern int network_add_command(const char * cmd, void *pstream);
+extern int network_command_queue_full();
+extern int network_command_queue_has_room();
 #endif
 
 #endif
@@ -29,6 +29,7 @@
 #endif
 
 #include <mri.h>
+#include "us_ticker_api.h"
 
 #define BUF ((struct uip_eth_hdr *)&uip_buf[0])
 
@@ -57,6 +58,7 @@ Network::Network()
     sftpd= NULL;
     hostname = NULL;
     plan9_enabled= false;
+    dhcp_start_us= 0;
     command_q= CommandQueue::getInstance();
 }
 
@@ -188,14 +190,21 @@ void Network::on_module_loaded()
         }
     }
 
-    THEKERNEL->add_module( ethernet );
     THEKERNEL->slow_ticker->attach( 100, this, &Network::tick );
 
-    // Register for events
+    // Register for events, nothing is received until the interface is up
     this->register_for_event(ON_IDLE);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_GET_PUBLIC_DATA);
 
+    // resetting the phy and starting the stack is not needed for motion so it is left until the machine is ready
+    THEKERNEL->late_init<Network, &Network::start>(this, "network start");
+}
+
+void Network::start(uint32_t)
+{
+    ethernet->set_module_name("ethernet");
+    THEKERNEL->add_module( ethernet );
     this->init();
 }
 
@@ -235,12 +244,17 @@ void Network::on_idle(void *argument)
 {
     if (!ethernet->isUp()) return;
 
-    int len= sizeof(uip_buf); // set maximum size
-    if (ethernet->_receive_frame(uip_buf, &len)) {
+    // take all the frames the driver is holding, with a receive window of several segments they can arrive back to back
+    bool received= false;
+    for (int i = 0; i < LPC17XX_RXBUFS; i++) {
+        int len= sizeof(uip_buf); // set maximum size
+        if (!ethernet->_receive_frame(uip_buf, &len)) break;
         uip_len = len;
         this->handlePacket();
+        received= true;
+    }
 
-    } else {
+    if (!received) {
 
         if (timer_expired(&periodic_timer)) { /* no packet but periodic_timer time out (0.1s)*/
             timer_reset(&periodic_timer);
@@ -348,6 +362,12 @@ void Network::dhcpc_configured(uint32_t ipaddr, uint32_t ipmask, uint32_t ipgw)
     uip_setdraddr((u16_t*)this->ipgw);
 
     setup_servers();
+
+    if(dhcp_start_us != 0) {
+        // how long the first lease took goes in the boot times
+        THEKERNEL->boot_step("network dhcp", dhcp_start_us, true);
+        dhcp_start_us= 0;
+    }
 }
 
 void Network::init(void)
@@ -379,6 +399,7 @@ void Network::init(void)
     }else{
     #if UIP_CONF_UDP
         dhcpc_init(mac_address, sizeof(mac_address), hostname);
+        dhcp_start_us= us_ticker_read();
         dhcpc_request();
         printf("Getting IP address....\n");
     #endif
@@ -399,7 +420,9 @@ void Network::on_main_loop(void *argument)
 
 extern "C" const char *get_query_string()
 {
-    return THEKERNEL->get_query_string().c_str();
+    static char buf[Kernel::QUERY_STRING_SIZE];
+    THEKERNEL->get_query_string(buf, sizeof(buf));
+    return buf;
 }
 
 // select between webserver and telnetd server
@@ -435,6 +458,26 @@ extern "C" void app_select_appcall(void)
     }
 }
 
+// the receive window advertised on a connection, the connections feeding the command queue only get more than one
+// segment while it can take all of it, as anything arriving after they have been stopped is dropped by uIP
+extern "C" uint16_t app_receive_window(struct uip_conn *conn)
+{
+    switch (conn->lport) {
+        case HTONS(80): {
+            // only a POST to /command, uploads and pages do not go through the queue
+            struct httpd_state *s = (struct httpd_state *)conn->appstate;
+            if(s == NULL || !s->command_post) return 3 * UIP_TCP_MSS;
+            return CommandQueue::getInstance()->receive_window(UIP_TCP_MSS, 3 * UIP_TCP_MSS);
+        }
+
+        case HTONS(23):
+            return CommandQueue::getInstance()->receive_window(UIP_TCP_MSS, 3 * UIP_TCP_MSS);
+
+        default:
+            return 3 * UIP_TCP_MSS;
+    }
+}
+
 void Network::tapdev_send(void *pPacket, unsigned int size)
 {
     memcpy(ethernet->request_packet_buffer(), pPacket, size);
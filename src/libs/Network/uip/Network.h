@@ -32,6 +32,7 @@ public:
 
 private:
     void init();
+    void start(uint32_t);
     void setup_servers();
     uint32_t tick(uint32_t dummy);
     void handlePacket();
@@ -42,6 +43,7 @@ private:
     struct timer periodic_timer, arp_timer;
     char *hostname;
     volatile uint32_t tickcnt;
+    uint32_t dhcp_start_us;
     uint8_t mac_address[6];
     uint8_t ipaddr[4];
     uint8_t ipmask[4];
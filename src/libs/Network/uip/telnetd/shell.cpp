@@ -83,7 +83,9 @@ static void help(char *str, Shell *sh)
 
 static void query(char *str, Shell *sh)
 {
-    sh->output(THEKERNEL->get_query_string().c_str());
+    char buf[Kernel::QUERY_STRING_SIZE];
+    THEKERNEL->get_query_string(buf, sizeof(buf));
+    sh->output(buf);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -188,7 +190,9 @@ static void unknown(char *str, Shell *sh)
 {
     // its some other command, so queue it for mainloop to find
     if (strlen(str) > 0) {
-        CommandQueue::getInstance()->add(str, sh->getStream());
+        if(!CommandQueue::getInstance()->add(str, sh->getStream())) {
+            sh->output("error: command queue full, line dropped\n");
+        }
     }
 }
 /*---------------------------------------------------------------------------*/
@@ -241,6 +245,14 @@ int Shell::queue_size()
 {
     return CommandQueue::getInstance()->size();
 }
+bool Shell::queue_full()
+{
+    return CommandQueue::getInstance()->is_full();
+}
+bool Shell::queue_has_room()
+{
+    return CommandQueue::getInstance()->has_room();
+}
 /*---------------------------------------------------------------------------*/
 void Shell::input(char *cmd)
 {
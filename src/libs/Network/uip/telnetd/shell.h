@@ -87,6 +87,8 @@ public:
     void prompt(const char *prompt);
 
     int queue_size();
+    bool queue_full();
+    bool queue_has_room();
     int can_output();
     static int command_result(const char *str, void *ti);
     StreamOutput *getStream() { return pstream; }
@@ -205,7 +205,9 @@ void Telnetd::get_char(u8_t c)
     }
 
     if(c == '?') {
-        this->output(THEKERNEL->get_query_string().c_str());
+        char buf[Kernel::QUERY_STRING_SIZE];
+        THEKERNEL->get_query_string(buf, sizeof(buf));
+        this->output(buf);
         return;
     }
 
@@ -326,8 +328,8 @@ void Telnetd::newdata(void)
         }
     }
 
-    // if the command queue is getting too big we stop TCP
-    if(shell->queue_size() > 20) {
+    // if the command queue is getting full we stop TCP, which closes the receive window until it drains
+    if(shell->queue_full()) {
         DEBUG_PRINTF("Telnet: stopped: %d\n", shell->queue_size());
         uip_stop();
     }
@@ -411,7 +413,7 @@ void Telnetd::appcall(void)
         instance->senddata();
     }
 
-    if(uip_poll() && uip_stopped(uip_conn) && instance->shell->queue_size() < 5) {
+    if(uip_poll() && uip_stopped(uip_conn) && instance->shell->queue_has_room()) {
         DEBUG_PRINTF("restarted %d - %p\n", instance->shell->queue_size(), instance);
         uip_restart();
     }
@@ -102,9 +102,30 @@ typedef unsigned short uip_stats_t;
 /**
  * uIP buffer size.
  *
+ * 590 gives the classic 536 byte MSS and still fits the 600 byte
+ * frame buffers of the ethernet driver.
+ *
+ * \hideinitializer
+ */
+#define UIP_CONF_BUFFER_SIZE     590
+
+/**
+ * The TCP receive window advertised.
+ *
+ * Several segments so the host can have more than one in flight
+ * towards us, the ethernet driver holds up to 4 received frames
+ * and Network::on_idle takes them all each time round. It is worked
+ * out per connection as it is sent, see app_receive_window().
+ *
  * \hideinitializer
  */
-#define UIP_CONF_BUFFER_SIZE     400
+struct uip_conn;
+#ifdef __cplusplus
+extern "C" uint16_t app_receive_window(struct uip_conn *conn);
+#else
+extern uint16_t app_receive_window(struct uip_conn *conn);
+#endif
+#define UIP_CONF_RECEIVE_WINDOW  app_receive_window(uip_connr)
 
 #define UIP_CONF_BROADCAST 1
 
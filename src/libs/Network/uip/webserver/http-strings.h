@@ -4,13 +4,13 @@ extern const char http_options[9];
 extern const char http_10[9];
 extern const char http_11[9];
 extern const char http_content_length[17];
-extern const char http_cache_control[16];
-extern const char http_no_cache[9];
+extern const char http_if_none_match[16];
+extern const char http_if_modified_since[20];
 extern const char http_index_html[12];
 extern const char http_404_html[10];
-extern const char http_header_preflight[141];
+extern const char http_header_preflight[153];
 extern const char http_header_200[18];
-extern const char http_header_304[116];
+extern const char http_header_304[28];
 extern const char http_header_404[25];
 extern const char http_header_503[22];
 extern const char http_header_all[69];
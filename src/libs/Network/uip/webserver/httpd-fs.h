@@ -40,6 +40,9 @@
 struct httpd_fs_file {
   char *data;
   int len;
+  const char *headers;
+  const char *etag;
+  const char *modified;
 };
 
 /* file must be allocated by caller and will be filled in
@@ -47,6 +47,9 @@ struct httpd_fsdata_file {
   const unsigned char *name;
   const unsigned char *data;
   const int len;
+  const char *headers;  /* Content-Type, Content-Encoding, ETag etc. ending with the blank line */
+  const char *etag;
+  const char *modified;
 #ifdef HTTPD_FS_STATISTICS
 #if HTTPD_FS_STATISTICS == 1
   u16_t count;
@@ -59,6 +62,9 @@ struct httpd_fsdata_file_noconst {
   char *name;
   char *data;
   int len;
+  const char *headers;
+  const char *etag;
+  const char *modified;
 #ifdef HTTPD_FS_STATISTICS
 #if HTTPD_FS_STATISTICS == 1
   u16_t count;
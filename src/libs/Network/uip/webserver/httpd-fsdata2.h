@@ -1,2096 +1,527 @@
-static const unsigned char data_index_html[] = {
-	/* /index.html */
-	0x2f, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
-	0x3c, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0xa, 0x3c, 0x68, 0x65, 
-	0x61, 0x64, 0x3e, 0xa, 0x9, 0x3c, 0x6d, 0x65, 0x74, 0x61, 
-	0x20, 0x63, 0x68, 0x61, 0x72, 0x73, 0x65, 0x74, 0x3d, 0x22, 
-	0x75, 0x74, 0x66, 0x2d, 0x38, 0x22, 0x3e, 0xa, 0x9, 0x3c, 
-	0x74, 0x69, 0x74, 0x6c, 0x65, 0x3e, 0x53, 0x6d, 0x6f, 0x6f, 
-	0x74, 0x68, 0x69, 0x65, 0x20, 0x57, 0x65, 0x62, 0x3c, 0x2f, 
-	0x74, 0x69, 0x74, 0x6c, 0x65, 0x3e, 0xa, 0x9, 0x3c, 0x73, 
-	0x63, 0x72, 0x69, 0x70, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 
-	0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x2f, 0x6a, 0x61, 0x76, 
-	0x61, 0x73, 0x63, 0x72, 0x69, 0x70, 0x74, 0x22, 0x20, 0x73, 
-	0x72, 0x63, 0x3d, 0x22, 0x68, 0x74, 0x74, 0x70, 0x3a, 0x2f, 
-	0x2f, 0x63, 0x6f, 0x64, 0x65, 0x2e, 0x6a, 0x71, 0x75, 0x65, 
-	0x72, 0x79, 0x2e, 0x63, 0x6f, 0x6d, 0x2f, 0x6a, 0x71, 0x75, 
-	0x65, 0x72, 0x79, 0x2d, 0x31, 0x2e, 0x39, 0x2e, 0x31, 0x2e, 
-	0x6a, 0x73, 0x22, 0x3e, 0x3c, 0x2f, 0x73, 0x63, 0x72, 0x69, 
-	0x70, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x3c, 0x73, 0x63, 0x72, 
-	0x69, 0x70, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 
-	0x74, 0x65, 0x78, 0x74, 0x2f, 0x6a, 0x61, 0x76, 0x61, 0x73, 
-	0x63, 0x72, 0x69, 0x70, 0x74, 0x22, 0x20, 0x73, 0x72, 0x63, 
-	0x3d, 0x22, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
-	0x73, 0x2e, 0x6a, 0x73, 0x22, 0x3e, 0x3c, 0x2f, 0x73, 0x63, 
-	0x72, 0x69, 0x70, 0x74, 0x3e, 0xa, 0x3c, 0x2f, 0x68, 0x65, 
-	0x61, 0x64, 0x3e, 0xa, 0xa, 0x3c, 0x62, 0x6f, 0x64, 0x79, 
-	0x3e, 0xa, 0xa, 0x3c, 0x68, 0x31, 0x3e, 0x57, 0x65, 0x6c, 
-	0x63, 0x6f, 0x6d, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x53, 0x6d, 
-	0x6f, 0x6f, 0x74, 0x68, 0x69, 0x65, 0x3c, 0x2f, 0x68, 0x31, 
-	0x3e, 0xa, 0xa, 0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x74, 0x6f, 0x72, 
-	0x73, 0x5f, 0x6f, 0x66, 0x66, 0x22, 0x20, 0x6f, 0x6e, 0x63, 
-	0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 0x6d, 0x6f, 0x74, 0x6f, 
-	0x72, 0x73, 0x4f, 0x66, 0x66, 0x28, 0x65, 0x76, 0x65, 0x6e, 
-	0x74, 0x29, 0x22, 0x3e, 0x4d, 0x6f, 0x74, 0x6f, 0x72, 0x73, 
-	0x20, 0x4f, 0x66, 0x66, 0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 
-	0x6f, 0x6e, 0x3e, 0xa, 0xa, 0x58, 0x59, 0x3a, 0x3c, 0x69, 
-	0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 
-	0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x78, 0x79, 0x5f, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
-	0x74, 0x79, 0x22, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x3d, 0x34, 
-	0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x33, 0x30, 0x30, 
-	0x30, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x3d, 0x22, 0x77, 
-	0x69, 0x64, 0x74, 0x68, 0x3a, 0x35, 0x30, 0x70, 0x78, 0x22, 
-	0x20, 0x2f, 0x3e, 0x6d, 0x6d, 0x2f, 0x6d, 0x69, 0x6e, 0xa, 
-	0xa, 0x5a, 0x3a, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 
-	0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 
-	0x22, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x7a, 0x5f, 0x76, 0x65, 
-	0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x22, 0x20, 0x73, 0x69, 
-	0x7a, 0x65, 0x3d, 0x33, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 
-	0x3d, 0x32, 0x30, 0x30, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 
-	0x3d, 0x22, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 0x34, 0x30, 
-	0x70, 0x78, 0x22, 0x3e, 0xa, 0x3c, 0x62, 0x72, 0x2f, 0x3e, 
-	0xa, 0xa, 0x20, 0x20, 0x3c, 0x73, 0x76, 0x67, 0x20, 0x77, 
-	0x69, 0x64, 0x74, 0x68, 0x3d, 0x22, 0x33, 0x32, 0x30, 0x22, 
-	0x20, 0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 0x32, 
-	0x36, 0x30, 0x22, 0x20, 0x78, 0x6d, 0x6c, 0x6e, 0x73, 0x3d, 
-	0x22, 0x68, 0x74, 0x74, 0x70, 0x3a, 0x2f, 0x2f, 0x77, 0x77, 
-	0x77, 0x2e, 0x77, 0x33, 0x2e, 0x6f, 0x72, 0x67, 0x2f, 0x32, 
-	0x30, 0x30, 0x30, 0x2f, 0x73, 0x76, 0x67, 0x22, 0x20, 0x76, 
-	0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x3d, 0x22, 0x31, 0x2e, 
-	0x31, 0x22, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x64, 0x65, 0x66, 0x73, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x74, 0x79, 0x6c, 
-	0x65, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 0x74, 0x65, 
-	0x78, 0x74, 0x2f, 0x63, 0x73, 0x73, 0x22, 0x3e, 0x3c, 0x21, 
-	0x5b, 0x43, 0x44, 0x41, 0x54, 0x41, 0x5b, 0xa, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x74, 0x65, 0x78, 0x74, 0x20, 0x7b, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x66, 0x6f, 
-	0x6e, 0x74, 0x2d, 0x66, 0x61, 0x6d, 0x69, 0x6c, 0x79, 0x3a, 
-	0x20, 0x68, 0x65, 0x6c, 0x76, 0x65, 0x74, 0x69, 0x63, 0x61, 
-	0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 0x3a, 0x20, 0x62, 0x6c, 
-	0x61, 0x63, 0x6b, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 0x2d, 
-	0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 0x20, 0x31, 0x3b, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x66, 0x69, 
-	0x6c, 0x6c, 0x3a, 0x20, 0x62, 0x6c, 0x61, 0x63, 0x6b, 0x3b, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x7d, 0xa, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x74, 0x65, 0x78, 0x74, 0x2e, 0x68, 0x6f, 0x6d, 
-	0x65, 0x20, 0x7b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x66, 0x61, 0x6d, 
-	0x69, 0x6c, 0x79, 0x3a, 0x20, 0x68, 0x65, 0x6c, 0x76, 0x65, 
-	0x74, 0x69, 0x63, 0x61, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 
-	0x3a, 0x20, 0x62, 0x6c, 0x61, 0x63, 0x6b, 0x3b, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 
-	0x6f, 0x6b, 0x65, 0x2d, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 
-	0x20, 0x31, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3a, 0x20, 0x62, 0x6c, 
-	0x61, 0x63, 0x6b, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x77, 0x65, 
-	0x69, 0x67, 0x68, 0x74, 0x3a, 0x20, 0x39, 0x30, 0x30, 0x3b, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x66, 
-	0x6f, 0x6e, 0x74, 0x2d, 0x73, 0x69, 0x7a, 0x65, 0x3a, 0x20, 
-	0x31, 0x36, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x2d, 
-	0x65, 0x76, 0x65, 0x6e, 0x74, 0x73, 0x3a, 0x20, 0x6e, 0x6f, 
-	0x6e, 0x65, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x7d, 0xa, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x74, 0x65, 0x78, 0x74, 0x2e, 
-	0x73, 0x63, 0x6c, 0x20, 0x7b, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x66, 
-	0x61, 0x6d, 0x69, 0x6c, 0x79, 0x3a, 0x20, 0x68, 0x65, 0x6c, 
-	0x76, 0x65, 0x74, 0x69, 0x63, 0x61, 0x3b, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 
-	0x6b, 0x65, 0x3a, 0x20, 0x77, 0x68, 0x69, 0x74, 0x65, 0x3b, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x73, 
-	0x74, 0x72, 0x6f, 0x6b, 0x65, 0x2d, 0x77, 0x69, 0x64, 0x74, 
-	0x68, 0x3a, 0x20, 0x31, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3a, 0x20, 
-	0x77, 0x68, 0x69, 0x74, 0x65, 0x3b, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 
-	0x65, 0x72, 0x2d, 0x65, 0x76, 0x65, 0x6e, 0x74, 0x73, 0x3a, 
-	0x20, 0x6e, 0x6f, 0x6e, 0x65, 0x3b, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0xa, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x63, 0x69, 0x72, 0x63, 0x6c, 0x65, 0x2e, 0x73, 
-	0x63, 0x6c, 0x20, 0x7b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3a, 0x20, 0x62, 
-	0x6c, 0x61, 0x63, 0x6b, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x2d, 0x6f, 
-	0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 0x3a, 0x20, 0x30, 0x2e, 
-	0x35, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 0x3a, 0x20, 0x72, 
-	0x65, 0x64, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 0x2d, 0x77, 
-	0x69, 0x64, 0x74, 0x68, 0x3a, 0x20, 0x33, 0x3b, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x66, 0x69, 0x6c, 
-	0x74, 0x65, 0x72, 0x3a, 0x20, 0x75, 0x72, 0x6c, 0x28, 0x23, 
-	0x66, 0x31, 0x29, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x65, 0x72, 
-	0x2d, 0x65, 0x76, 0x65, 0x6e, 0x74, 0x73, 0x3a, 0x20, 0x6e, 
-	0x6f, 0x6e, 0x65, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x7d, 0xa, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x70, 0x61, 0x74, 0x68, 0x2e, 
-	0x68, 0x6f, 0x6d, 0x65, 0x20, 0x7b, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 
-	0x65, 0x3a, 0x20, 0x62, 0x6c, 0x61, 0x63, 0x6b, 0x3b, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0xa, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x70, 0x61, 0x74, 0x68, 0x2e, 
-	0x73, 0x74, 0x64, 0x20, 0x7b, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 
-	0x3a, 0x20, 0x62, 0x6c, 0x61, 0x63, 0x6b, 0x3b, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 
-	0x6f, 0x6b, 0x65, 0x2d, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 
-	0x20, 0x31, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x66, 0x69, 0x6c, 0x74, 0x65, 0x72, 0x3a, 0x20, 
-	0x75, 0x72, 0x6c, 0x28, 0x23, 0x66, 0x31, 0x29, 0x3b, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0xa, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x72, 0x65, 0x63, 0x74, 0x2e, 
-	0x73, 0x74, 0x64, 0x20, 0x7b, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 
-	0x3a, 0x20, 0x62, 0x6c, 0x61, 0x63, 0x6b, 0x3b, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x73, 0x74, 0x72, 
-	0x6f, 0x6b, 0x65, 0x2d, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 
-	0x20, 0x31, 0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x66, 0x69, 0x6c, 0x74, 0x65, 0x72, 0x3a, 0x20, 
-	0x75, 0x72, 0x6c, 0x28, 0x23, 0x66, 0x31, 0x29, 0x3b, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0xa, 
-	0xa, 0x20, 0x20, 0x5d, 0x5d, 0x3e, 0x3c, 0x2f, 0x73, 0x74, 
-	0x79, 0x6c, 0x65, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x66, 0x69, 0x6c, 0x74, 0x65, 
-	0x72, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x66, 0x31, 0x22, 0x20, 
-	0x78, 0x3d, 0x22, 0x2d, 0x31, 0x22, 0x20, 0x79, 0x3d, 0x22, 
-	0x2d, 0x31, 0x22, 0x20, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3d, 
-	0x22, 0x33, 0x30, 0x30, 0x25, 0x22, 0x20, 0x68, 0x65, 0x69, 
-	0x67, 0x68, 0x74, 0x3d, 0x22, 0x33, 0x30, 0x30, 0x25, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x66, 0x65, 0x4f, 0x66, 0x66, 
-	0x73, 0x65, 0x74, 0x20, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 
-	0x3d, 0x22, 0x6f, 0x66, 0x66, 0x4f, 0x75, 0x74, 0x22, 0x20, 
-	0x69, 0x6e, 0x3d, 0x22, 0x53, 0x6f, 0x75, 0x72, 0x63, 0x65, 
-	0x41, 0x6c, 0x70, 0x68, 0x61, 0x22, 0x20, 0x64, 0x78, 0x3d, 
-	0x22, 0x33, 0x22, 0x20, 0x64, 0x79, 0x3d, 0x22, 0x33, 0x22, 
-	0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x66, 0x65, 0x47, 0x61, 
-	0x75, 0x73, 0x73, 0x69, 0x61, 0x6e, 0x42, 0x6c, 0x75, 0x72, 
-	0x20, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x3d, 0x22, 0x62, 
-	0x6c, 0x75, 0x72, 0x4f, 0x75, 0x74, 0x22, 0x20, 0x69, 0x6e, 
-	0x3d, 0x22, 0x6f, 0x66, 0x66, 0x4f, 0x75, 0x74, 0x22, 0x20, 
-	0x73, 0x74, 0x64, 0x44, 0x65, 0x76, 0x69, 0x61, 0x74, 0x69, 
-	0x6f, 0x6e, 0x3d, 0x22, 0x34, 0x22, 0x2f, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x66, 0x65, 0x42, 0x6c, 0x65, 0x6e, 0x64, 0x20, 
-	0x69, 0x6e, 0x3d, 0x22, 0x53, 0x6f, 0x75, 0x72, 0x63, 0x65, 
-	0x47, 0x72, 0x61, 0x70, 0x68, 0x69, 0x63, 0x22, 0x20, 0x69, 
-	0x6e, 0x32, 0x3d, 0x22, 0x62, 0x6c, 0x75, 0x72, 0x4f, 0x75, 
-	0x74, 0x22, 0x20, 0x6d, 0x6f, 0x64, 0x65, 0x3d, 0x22, 0x6e, 
-	0x6f, 0x72, 0x6d, 0x61, 0x6c, 0x22, 0x2f, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x66, 
-	0x69, 0x6c, 0x74, 0x65, 0x72, 0x3e, 0xa, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x79, 0x6d, 
-	0x62, 0x6f, 0x6c, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x48, 0x6f, 
-	0x6d, 0x65, 0x49, 0x63, 0x6f, 0x6e, 0x22, 0x20, 0x76, 0x69, 
-	0x65, 0x77, 0x42, 0x6f, 0x78, 0x3d, 0x22, 0x30, 0x20, 0x30, 
-	0x20, 0x32, 0x30, 0x20, 0x31, 0x38, 0x22, 0x20, 0x70, 0x6f, 
-	0x69, 0x6e, 0x74, 0x65, 0x72, 0x2d, 0x65, 0x76, 0x65, 0x6e, 
-	0x74, 0x73, 0x3d, 0x22, 0x6e, 0x6f, 0x6e, 0x65, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x64, 0x65, 0x73, 0x63, 0x3e, 0x48, 
-	0x6f, 0x6d, 0x65, 0x49, 0x63, 0x6f, 0x6e, 0x20, 0x2d, 0x20, 
-	0x68, 0x6f, 0x75, 0x73, 0x65, 0x3c, 0x2f, 0x64, 0x65, 0x73, 
-	0x63, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x68, 0x6f, 
-	0x6d, 0x65, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x33, 0x2c, 
-	0x31, 0x38, 0x20, 0x76, 0x2d, 0x38, 0x20, 0x6c, 0x37, 0x2c, 
-	0x2d, 0x36, 0x20, 0x6c, 0x37, 0x2c, 0x36, 0x20, 0x76, 0x38, 
-	0x20, 0x68, 0x2d, 0x35, 0x20, 0x76, 0x2d, 0x36, 0x20, 0x68, 
-	0x2d, 0x34, 0x20, 0x76, 0x36, 0x20, 0x7a, 0x22, 0x20, 0x66, 
-	0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x62, 0x6c, 0x61, 0x63, 0x6b, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 
-	0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x68, 
-	0x6f, 0x6d, 0x65, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x30, 
-	0x2c, 0x31, 0x30, 0x20, 0x6c, 0x31, 0x30, 0x2d, 0x38, 0x2e, 
-	0x35, 0x20, 0x6c, 0x31, 0x30, 0x2c, 0x38, 0x2e, 0x35, 0x22, 
-	0x20, 0x73, 0x74, 0x72, 0x6f, 0x6b, 0x65, 0x2d, 0x77, 0x69, 
-	0x64, 0x74, 0x68, 0x3d, 0x22, 0x31, 0x2e, 0x35, 0x22, 0x20, 
-	0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x6e, 0x6f, 0x6e, 0x65, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 
-	0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x68, 
-	0x6f, 0x6d, 0x65, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x31, 
-	0x35, 0x2c, 0x33, 0x20, 0x76, 0x32, 0x2e, 0x38, 0x20, 0x6c, 
-	0x31, 0x2c, 0x2e, 0x38, 0x20, 0x76, 0x2d, 0x33, 0x2e, 0x36, 
-	0x20, 0x7a, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x73, 0x79, 0x6d, 0x62, 
-	0x6f, 0x6c, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x73, 0x79, 0x6d, 0x62, 0x6f, 0x6c, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x4a, 0x6f, 0x67, 0x52, 0x6f, 
-	0x73, 0x65, 0x22, 0x20, 0x76, 0x69, 0x65, 0x77, 0x42, 0x6f, 
-	0x78, 0x3d, 0x22, 0x32, 0x30, 0x20, 0x2d, 0x31, 0x30, 0x20, 
-	0x32, 0x36, 0x30, 0x20, 0x32, 0x36, 0x30, 0x22, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x48, 
-	0x6f, 0x6d, 0x65, 0x41, 0x6c, 0x6c, 0x22, 0x20, 0x6f, 0x6e, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x72, 
-	0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x53, 
-	0x69, 0x6c, 0x65, 0x6e, 0x74, 0x28, 0x27, 0x47, 0x32, 0x38, 
-	0x27, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 
-	0x3d, 0x22, 0x4d, 0x31, 0x30, 0x20, 0x31, 0x38, 0x32, 0x2e, 
-	0x35, 0x20, 0x68, 0x2d, 0x31, 0x30, 0x20, 0x76, 0x35, 0x37, 
-	0x2e, 0x35, 0x20, 0x68, 0x35, 0x37, 0x2e, 0x35, 0x20, 0x76, 
-	0x2d, 0x31, 0x30, 0x20, 0x61, 0x20, 0x31, 0x32, 0x35, 0x2c, 
-	0x31, 0x32, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 
-	0x2d, 0x34, 0x37, 0x2e, 0x35, 0x20, 0x2d, 0x34, 0x37, 0x2e, 
-	0x35, 0x20, 0x5a, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 
-	0x22, 0x23, 0x66, 0x30, 0x66, 0x30, 0x66, 0x30, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 
-	0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 
-	0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 
-	0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 
-	0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 
-	0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x75, 0x73, 0x65, 0x20, 0x78, 
-	0x3d, 0x22, 0x33, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x32, 0x31, 
-	0x37, 0x22, 0x20, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3d, 0x22, 
-	0x32, 0x30, 0x22, 0x20, 0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 
-	0x3d, 0x22, 0x31, 0x38, 0x22, 0x20, 0x78, 0x6c, 0x69, 0x6e, 
-	0x6b, 0x3a, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x23, 0x48, 
-	0x6f, 0x6d, 0x65, 0x49, 0x63, 0x6f, 0x6e, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x48, 0x6f, 
-	0x6d, 0x65, 0x58, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x72, 0x75, 0x6e, 0x43, 
-	0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x53, 0x69, 0x6c, 0x65, 
-	0x6e, 0x74, 0x28, 0x27, 0x47, 0x32, 0x38, 0x20, 0x58, 0x30, 
-	0x27, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 
-	0x3d, 0x22, 0x4d, 0x31, 0x30, 0x20, 0x35, 0x37, 0x2e, 0x35, 
-	0x30, 0x20, 0x68, 0x2d, 0x31, 0x30, 0x20, 0x76, 0x2d, 0x35, 
-	0x37, 0x2e, 0x35, 0x20, 0x68, 0x35, 0x37, 0x2e, 0x35, 0x20, 
-	0x76, 0x31, 0x30, 0x20, 0x61, 0x20, 0x31, 0x32, 0x35, 0x2c, 
-	0x31, 0x32, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 
-	0x2d, 0x34, 0x37, 0x2e, 0x35, 0x20, 0x34, 0x37, 0x2e, 0x35, 
-	0x20, 0x5a, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 
-	0x4b, 0x68, 0x61, 0x6b, 0x69, 0x22, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 
-	0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 
-	0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 
-	0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 
-	0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 
-	0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 
-	0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 
-	0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x75, 0x73, 0x65, 0x20, 0x78, 0x3d, 0x22, 0x33, 
-	0x22, 0x20, 0x79, 0x3d, 0x22, 0x35, 0x22, 0x20, 0x77, 0x69, 
-	0x64, 0x74, 0x68, 0x3d, 0x22, 0x32, 0x30, 0x22, 0x20, 0x68, 
-	0x65, 0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 0x31, 0x38, 0x22, 
-	0x20, 0x78, 0x6c, 0x69, 0x6e, 0x6b, 0x3a, 0x68, 0x72, 0x65, 
-	0x66, 0x3d, 0x22, 0x23, 0x48, 0x6f, 0x6d, 0x65, 0x49, 0x63, 
-	0x6f, 0x6e, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 
-	0x22, 0x32, 0x35, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x32, 0x30, 
-	0x22, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x68, 
-	0x6f, 0x6d, 0x65, 0x22, 0x3e, 0x20, 0x58, 0x20, 0x3c, 0x2f, 
-	0x74, 0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x48, 0x6f, 0x6d, 0x65, 0x59, 0x22, 0x20, 0x6f, 
-	0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 
-	0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x53, 0x69, 0x6c, 0x65, 0x6e, 0x74, 0x28, 0x27, 0x47, 0x32, 
-	0x38, 0x20, 0x59, 0x30, 0x27, 0x29, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 
-	0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x32, 0x33, 0x30, 
-	0x20, 0x35, 0x37, 0x2e, 0x35, 0x30, 0x20, 0x68, 0x31, 0x30, 
-	0x20, 0x76, 0x2d, 0x35, 0x37, 0x2e, 0x35, 0x20, 0x68, 0x2d, 
-	0x35, 0x37, 0x2e, 0x35, 0x20, 0x76, 0x31, 0x30, 0x20, 0x61, 
-	0x20, 0x31, 0x32, 0x35, 0x2c, 0x31, 0x32, 0x35, 0x20, 0x30, 
-	0x20, 0x30, 0x2c, 0x31, 0x20, 0x34, 0x37, 0x2e, 0x35, 0x20, 
-	0x34, 0x37, 0x2e, 0x35, 0x20, 0x7a, 0x22, 0x20, 0x66, 0x69, 
-	0x6c, 0x6c, 0x3d, 0x22, 0x53, 0x74, 0x65, 0x65, 0x6c, 0x42, 
-	0x6c, 0x75, 0x65, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 
-	0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 
-	0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 
-	0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 
-	0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 
-	0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 
-	0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 
-	0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x75, 0x73, 0x65, 0x20, 0x78, 0x3d, 0x22, 0x32, 0x31, 0x37, 
-	0x22, 0x20, 0x79, 0x3d, 0x22, 0x35, 0x22, 0x20, 0x77, 0x69, 
-	0x64, 0x74, 0x68, 0x3d, 0x22, 0x32, 0x30, 0x22, 0x20, 0x68, 
-	0x65, 0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 0x31, 0x38, 0x22, 
-	0x20, 0x78, 0x6c, 0x69, 0x6e, 0x6b, 0x3a, 0x68, 0x72, 0x65, 
-	0x66, 0x3d, 0x22, 0x23, 0x48, 0x6f, 0x6d, 0x65, 0x49, 0x63, 
-	0x6f, 0x6e, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 
-	0x22, 0x32, 0x30, 0x32, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x32, 
-	0x30, 0x22, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x68, 0x6f, 0x6d, 0x65, 0x22, 0x3e, 0x20, 0x59, 0x20, 0x3c, 
-	0x2f, 0x74, 0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x2f, 0x67, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 
-	0x69, 0x64, 0x3d, 0x22, 0x48, 0x6f, 0x6d, 0x65, 0x5a, 0x22, 
-	0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 
-	0x3d, 0x22, 0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 
-	0x6e, 0x64, 0x53, 0x69, 0x6c, 0x65, 0x6e, 0x74, 0x28, 0x27, 
-	0x47, 0x32, 0x38, 0x20, 0x5a, 0x30, 0x27, 0x29, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 
-	0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x32, 
-	0x33, 0x30, 0x20, 0x31, 0x38, 0x32, 0x2e, 0x35, 0x20, 0x68, 
-	0x31, 0x30, 0x20, 0x76, 0x35, 0x37, 0x2e, 0x35, 0x20, 0x68, 
-	0x2d, 0x35, 0x37, 0x2e, 0x35, 0x20, 0x76, 0x2d, 0x31, 0x30, 
-	0x20, 0x61, 0x20, 0x31, 0x32, 0x35, 0x2c, 0x31, 0x32, 0x35, 
-	0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x34, 0x37, 0x2e, 
-	0x35, 0x20, 0x2d, 0x34, 0x37, 0x2e, 0x35, 0x20, 0x7a, 0x22, 
-	0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x44, 0x61, 0x72, 
-	0x6b, 0x53, 0x65, 0x61, 0x47, 0x72, 0x65, 0x65, 0x6e, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 
-	0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 
-	0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 
-	0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 
-	0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 
-	0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 
-	0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x75, 0x73, 0x65, 0x20, 
-	0x78, 0x3d, 0x22, 0x32, 0x31, 0x37, 0x22, 0x20, 0x79, 0x3d, 
-	0x22, 0x32, 0x31, 0x37, 0x22, 0x20, 0x77, 0x69, 0x64, 0x74, 
-	0x68, 0x3d, 0x22, 0x32, 0x30, 0x22, 0x20, 0x68, 0x65, 0x69, 
-	0x67, 0x68, 0x74, 0x3d, 0x22, 0x31, 0x38, 0x22, 0x20, 0x78, 
-	0x6c, 0x69, 0x6e, 0x6b, 0x3a, 0x68, 0x72, 0x65, 0x66, 0x3d, 
-	0x22, 0x23, 0x48, 0x6f, 0x6d, 0x65, 0x49, 0x63, 0x6f, 0x6e, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 0x22, 0x32, 
-	0x30, 0x32, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x32, 0x33, 0x32, 
-	0x22, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x68, 
-	0x6f, 0x6d, 0x65, 0x22, 0x3e, 0x20, 0x5a, 0x20, 0x3c, 0x2f, 
-	0x74, 0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 
-	0x64, 0x3d, 0x22, 0x4a, 0x6f, 0x67, 0x31, 0x30, 0x30, 0x22, 
-	0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x63, 0x30, 
-	0x63, 0x30, 0x63, 0x30, 0x22, 0x20, 0x63, 0x6c, 0x61, 0x73, 
-	0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x59, 0x2b, 0x31, 0x30, 0x30, 0x22, 0x20, 0x6f, 
-	0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 
-	0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 
-	0x28, 0x27, 0x59, 0x31, 0x30, 0x30, 0x27, 0x29, 0x22, 0x20, 
-	0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 
-	0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 
-	0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 
-	0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 
-	0x64, 0x3d, 0x22, 0x4d, 0x2d, 0x36, 0x30, 0x20, 0x2d, 0x36, 
-	0x37, 0x2e, 0x30, 0x37, 0x20, 0x4c, 0x2d, 0x37, 0x35, 0x2e, 
-	0x39, 0x33, 0x2c, 0x2d, 0x38, 0x33, 0x20, 0x41, 0x31, 0x31, 
-	0x32, 0x2e, 0x35, 0x2c, 0x31, 0x31, 0x32, 0x2e, 0x35, 0x20, 
-	0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x37, 0x35, 0x2c, 0x2d, 
-	0x38, 0x33, 0x20, 0x4c, 0x36, 0x30, 0x2c, 0x2d, 0x36, 0x37, 
-	0x2e, 0x30, 0x37, 0x20, 0x41, 0x39, 0x30, 0x2c, 0x39, 0x30, 
-	0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x2d, 0x36, 0x30, 
-	0x2e, 0x30, 0x30, 0x2c, 0x2d, 0x36, 0x37, 0x2e, 0x30, 0x37, 
-	0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 
-	0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 
-	0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 
-	0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 
-	0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 
-	0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x20, 
-	0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2b, 0x31, 0x30, 0x30, 
-	0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 
-	0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 
-	0x69, 0x63, 0x6b, 0x28, 0x27, 0x58, 0x31, 0x30, 0x30, 0x27, 
-	0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 
-	0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 
-	0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 
-	0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 
-	0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x36, 0x37, 0x2e, 
-	0x30, 0x37, 0x2c, 0x2d, 0x36, 0x30, 0x20, 0x4c, 0x38, 0x33, 
-	0x2c, 0x2d, 0x37, 0x35, 0x2e, 0x39, 0x33, 0x20, 0x41, 0x31, 
-	0x31, 0x32, 0x2e, 0x35, 0x2c, 0x31, 0x31, 0x32, 0x2e, 0x35, 
-	0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x38, 0x33, 0x2c, 
-	0x37, 0x35, 0x2e, 0x39, 0x33, 0x20, 0x4c, 0x36, 0x37, 0x2e, 
-	0x30, 0x37, 0x2c, 0x36, 0x30, 0x20, 0x41, 0x39, 0x30, 0x2c, 
-	0x39, 0x30, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x36, 
-	0x37, 0x2e, 0x30, 0x37, 0x2c, 0x2d, 0x36, 0x30, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 
-	0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 
-	0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 
-	0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 
-	0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 
-	0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 
-	0x59, 0x2d, 0x31, 0x30, 0x30, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 
-	0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 
-	0x59, 0x2d, 0x31, 0x30, 0x30, 0x27, 0x29, 0x22, 0x20, 0x74, 
-	0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 
-	0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 
-	0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 
-	0x3d, 0x22, 0x4d, 0x2d, 0x36, 0x30, 0x2c, 0x36, 0x37, 0x2e, 
-	0x30, 0x37, 0x20, 0x4c, 0x2d, 0x37, 0x35, 0x2e, 0x39, 0x33, 
-	0x2c, 0x38, 0x33, 0x20, 0x41, 0x31, 0x31, 0x32, 0x2e, 0x35, 
-	0x2c, 0x31, 0x31, 0x32, 0x2e, 0x35, 0x20, 0x30, 0x20, 0x30, 
-	0x2c, 0x30, 0x20, 0x37, 0x35, 0x2c, 0x38, 0x33, 0x20, 0x4c, 
-	0x36, 0x30, 0x2c, 0x36, 0x37, 0x2e, 0x30, 0x37, 0x20, 0x41, 
-	0x39, 0x30, 0x2c, 0x39, 0x30, 0x20, 0x30, 0x20, 0x30, 0x2c, 
-	0x31, 0x20, 0x2d, 0x36, 0x30, 0x2e, 0x30, 0x30, 0x2c, 0x36, 
-	0x37, 0x2e, 0x30, 0x37, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 
-	0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 
-	0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 
-	0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 
-	0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 
-	0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 
-	0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 
-	0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 
-	0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2d, 
-	0x31, 0x30, 0x30, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 
-	0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 0x58, 0x2d, 
-	0x31, 0x30, 0x30, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 
-	0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 
-	0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 
-	0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 
-	0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 
-	0x4d, 0x2d, 0x36, 0x37, 0x2e, 0x30, 0x37, 0x2c, 0x2d, 0x36, 
-	0x30, 0x20, 0x4c, 0x2d, 0x38, 0x33, 0x2c, 0x2d, 0x37, 0x35, 
-	0x2e, 0x39, 0x33, 0x20, 0x41, 0x31, 0x31, 0x32, 0x2e, 0x35, 
-	0x2c, 0x31, 0x31, 0x32, 0x2e, 0x35, 0x20, 0x30, 0x20, 0x30, 
-	0x2c, 0x30, 0x20, 0x2d, 0x38, 0x33, 0x2c, 0x37, 0x35, 0x2e, 
-	0x39, 0x33, 0x20, 0x4c, 0x2d, 0x36, 0x37, 0x2e, 0x30, 0x37, 
-	0x2c, 0x36, 0x30, 0x20, 0x41, 0x39, 0x30, 0x2c, 0x39, 0x30, 
-	0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x2d, 0x36, 0x37, 
-	0x2e, 0x30, 0x37, 0x2c, 0x2d, 0x36, 0x30, 0x20, 0x7a, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 
-	0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 
-	0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 
-	0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 
-	0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 
-	0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 
-	0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 
-	0x69, 0x64, 0x3d, 0x22, 0x4a, 0x6f, 0x67, 0x31, 0x30, 0x22, 
-	0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x64, 0x30, 
-	0x64, 0x30, 0x64, 0x30, 0x22, 0x3e, 0xa, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x59, 0x2b, 0x31, 0x30, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 
-	0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 
-	0x59, 0x31, 0x30, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 
-	0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 
-	0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 
-	0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 
-	0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 
-	0x4d, 0x2d, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 0x2d, 0x35, 
-	0x31, 0x2e, 0x31, 0x33, 0x20, 0x4c, 0x2d, 0x36, 0x30, 0x2c, 
-	0x2d, 0x36, 0x37, 0x2e, 0x30, 0x37, 0x20, 0x41, 0x39, 0x30, 
-	0x2c, 0x39, 0x30, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 
-	0x36, 0x30, 0x2c, 0x2d, 0x36, 0x37, 0x20, 0x4c, 0x34, 0x34, 
-	0x2e, 0x30, 0x36, 0x2c, 0x2d, 0x35, 0x31, 0x2e, 0x31, 0x33, 
-	0x20, 0x41, 0x36, 0x37, 0x2e, 0x35, 0x2c, 0x36, 0x37, 0x2e, 
-	0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x2d, 0x34, 
-	0x34, 0x2e, 0x30, 0x36, 0x2c, 0x2d, 0x35, 0x31, 0x2e, 0x31, 
-	0x33, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 
-	0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 
-	0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 
-	0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 
-	0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 
-	0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 
-	0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 
-	0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2b, 0x31, 0x30, 0x22, 
-	0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 
-	0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 
-	0x63, 0x6b, 0x28, 0x27, 0x58, 0x31, 0x30, 0x27, 0x29, 0x22, 
-	0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 
-	0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 
-	0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 
-	0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 
-	0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 
-	0x20, 0x64, 0x3d, 0x22, 0x4d, 0x35, 0x31, 0x2e, 0x31, 0x33, 
-	0x20, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 0x4c, 0x36, 0x37, 
-	0x2e, 0x30, 0x37, 0x2c, 0x36, 0x30, 0x20, 0x41, 0x39, 0x30, 
-	0x2c, 0x39, 0x30, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 
-	0x36, 0x37, 0x2e, 0x30, 0x37, 0x2c, 0x2d, 0x36, 0x30, 0x20, 
-	0x4c, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x2c, 0x2d, 0x34, 0x34, 
-	0x2e, 0x30, 0x36, 0x20, 0x41, 0x36, 0x37, 0x2e, 0x35, 0x2c, 
-	0x36, 0x37, 0x2e, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 
-	0x20, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x2c, 0x34, 0x34, 0x2e, 
-	0x30, 0x36, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 
-	0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 
-	0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 
-	0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 
-	0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 
-	0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x59, 0x2d, 0x31, 0x30, 
-	0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 
-	0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 
-	0x69, 0x63, 0x6b, 0x28, 0x27, 0x59, 0x2d, 0x31, 0x30, 0x27, 
-	0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 
-	0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 
-	0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 
-	0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 
-	0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x2d, 0x34, 0x34, 
-	0x2e, 0x30, 0x36, 0x20, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x20, 
-	0x4c, 0x2d, 0x36, 0x30, 0x2c, 0x36, 0x37, 0x2e, 0x30, 0x37, 
-	0x20, 0x41, 0x39, 0x30, 0x2c, 0x39, 0x30, 0x20, 0x30, 0x20, 
-	0x30, 0x2c, 0x30, 0x20, 0x36, 0x30, 0x2c, 0x36, 0x37, 0x20, 
-	0x4c, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x2c, 0x35, 0x31, 0x2e, 
-	0x31, 0x33, 0x20, 0x41, 0x36, 0x37, 0x2e, 0x35, 0x2c, 0x36, 
-	0x37, 0x2e, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 
-	0x2d, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x2c, 0x35, 0x31, 0x2e, 
-	0x31, 0x33, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 
-	0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 
-	0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 
-	0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 
-	0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 
-	0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2d, 0x31, 0x30, 
-	0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 
-	0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 
-	0x69, 0x63, 0x6b, 0x28, 0x27, 0x58, 0x2d, 0x31, 0x30, 0x27, 
-	0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 
-	0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 
-	0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 
-	0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 
-	0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x2d, 0x35, 0x31, 
-	0x2e, 0x31, 0x33, 0x20, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 
-	0x4c, 0x2d, 0x36, 0x37, 0x2e, 0x30, 0x37, 0x2c, 0x36, 0x30, 
-	0x20, 0x41, 0x39, 0x30, 0x2c, 0x39, 0x30, 0x20, 0x30, 0x20, 
-	0x30, 0x2c, 0x31, 0x20, 0x2d, 0x36, 0x37, 0x2e, 0x30, 0x37, 
-	0x2c, 0x2d, 0x36, 0x30, 0x20, 0x4c, 0x2d, 0x35, 0x31, 0x2e, 
-	0x31, 0x33, 0x2c, 0x2d, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 
-	0x41, 0x36, 0x37, 0x2e, 0x35, 0x2c, 0x36, 0x37, 0x2e, 0x35, 
-	0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x2d, 0x35, 0x31, 
-	0x2e, 0x31, 0x33, 0x2c, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 
-	0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 
-	0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 
-	0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 
-	0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 
-	0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 
-	0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 
-	0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x4a, 0x6f, 0x67, 
-	0x31, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 
-	0x65, 0x30, 0x65, 0x30, 0x65, 0x30, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x59, 0x2b, 0x31, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 
-	0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 
-	0x59, 0x31, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 
-	0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 
-	0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 
-	0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 
-	0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 
-	0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 
-	0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 0x2d, 0x33, 0x35, 
-	0x2e, 0x31, 0x36, 0x20, 0x4c, 0x2d, 0x34, 0x34, 0x2e, 0x30, 
-	0x36, 0x2c, 0x2d, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x20, 0x41, 
-	0x36, 0x37, 0x2e, 0x35, 0x2c, 0x36, 0x37, 0x2e, 0x35, 0x20, 
-	0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x34, 0x34, 0x2e, 0x30, 
-	0x36, 0x2c, 0x2d, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x20, 0x4c, 
-	0x32, 0x38, 0x2e, 0x30, 0x39, 0x2c, 0x2d, 0x33, 0x35, 0x2e, 
-	0x31, 0x36, 0x20, 0x41, 0x34, 0x35, 0x2c, 0x34, 0x35, 0x20, 
-	0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x2d, 0x32, 0x38, 0x2e, 
-	0x30, 0x39, 0x2c, 0x2d, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x20, 
-	0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 
-	0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 
-	0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 
-	0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 
-	0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 
-	0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 
-	0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 
-	0x64, 0x3d, 0x22, 0x58, 0x2b, 0x31, 0x22, 0x20, 0x6f, 0x6e, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 
-	0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 
-	0x27, 0x58, 0x31, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 
-	0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 
-	0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 
-	0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 
-	0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 
-	0x4d, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x20, 0x2d, 0x32, 0x38, 
-	0x2e, 0x30, 0x39, 0x20, 0x4c, 0x35, 0x31, 0x2e, 0x31, 0x33, 
-	0x2c, 0x2d, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 0x41, 0x36, 
-	0x37, 0x2e, 0x35, 0x2c, 0x36, 0x37, 0x2e, 0x30, 0x35, 0x20, 
-	0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x35, 0x31, 0x2e, 0x31, 
-	0x33, 0x2c, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 0x4c, 0x33, 
-	0x35, 0x2e, 0x31, 0x36, 0x2c, 0x32, 0x38, 0x2e, 0x30, 0x39, 
-	0x20, 0x41, 0x34, 0x35, 0x2c, 0x34, 0x35, 0x20, 0x30, 0x20, 
-	0x30, 0x2c, 0x30, 0x20, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x2c, 
-	0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 0x7a, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 
-	0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 
-	0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 
-	0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 
-	0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 
-	0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 
-	0x59, 0x2d, 0x31, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 
-	0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 0x59, 0x2d, 
-	0x31, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 
-	0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 
-	0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 
-	0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 
-	0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x2d, 
-	0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 0x33, 0x35, 0x2e, 0x31, 
-	0x36, 0x20, 0x4c, 0x2d, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x2c, 
-	0x35, 0x31, 0x2e, 0x31, 0x33, 0x20, 0x41, 0x36, 0x37, 0x2e, 
-	0x35, 0x2c, 0x36, 0x37, 0x2e, 0x35, 0x20, 0x30, 0x20, 0x30, 
-	0x2c, 0x30, 0x20, 0x34, 0x34, 0x2e, 0x30, 0x36, 0x2c, 0x35, 
-	0x31, 0x2e, 0x31, 0x33, 0x20, 0x4c, 0x32, 0x38, 0x2e, 0x30, 
-	0x39, 0x2c, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x20, 0x41, 0x34, 
-	0x35, 0x2c, 0x34, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 
-	0x20, 0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x2c, 0x33, 0x35, 
-	0x2e, 0x31, 0x36, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 
-	0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 
-	0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 
-	0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 
-	0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 
-	0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 
-	0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 
-	0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2d, 0x31, 
-	0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 
-	0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 
-	0x69, 0x63, 0x6b, 0x28, 0x27, 0x58, 0x2d, 0x31, 0x27, 0x29, 
-	0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72, 
-	0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 0x61, 
-	0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 0x30, 
-	0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 
-	0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 
-	0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x2d, 0x33, 0x35, 0x2e, 
-	0x31, 0x36, 0x20, 0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 
-	0x4c, 0x2d, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x2c, 0x2d, 0x34, 
-	0x34, 0x2e, 0x30, 0x36, 0x20, 0x41, 0x36, 0x37, 0x2e, 0x35, 
-	0x2c, 0x36, 0x37, 0x2e, 0x30, 0x35, 0x20, 0x30, 0x20, 0x30, 
-	0x2c, 0x30, 0x20, 0x2d, 0x35, 0x31, 0x2e, 0x31, 0x33, 0x2c, 
-	0x34, 0x34, 0x2e, 0x30, 0x36, 0x20, 0x4c, 0x2d, 0x33, 0x35, 
-	0x2e, 0x31, 0x36, 0x2c, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 
-	0x41, 0x34, 0x35, 0x2c, 0x34, 0x35, 0x20, 0x30, 0x20, 0x30, 
-	0x2c, 0x31, 0x20, 0x2d, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x2c, 
-	0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 0x7a, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 
-	0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 
-	0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 
-	0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 
-	0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 
-	0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x2f, 0x67, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 
-	0x69, 0x64, 0x3d, 0x22, 0x4a, 0x6f, 0x67, 0x30, 0x5f, 0x31, 
-	0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x66, 
-	0x30, 0x66, 0x30, 0x66, 0x30, 0x22, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x59, 0x2b, 0x30, 0x2e, 0x31, 0x22, 0x20, 0x6f, 0x6e, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 
-	0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 
-	0x27, 0x59, 0x30, 0x2e, 0x31, 0x27, 0x29, 0x22, 0x20, 0x74, 
-	0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 
-	0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 
-	0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 
-	0x3d, 0x22, 0x4d, 0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 
-	0x2d, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x20, 0x41, 0x34, 0x35, 
-	0x2c, 0x34, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 
-	0x32, 0x39, 0x2e, 0x30, 0x39, 0x2c, 0x2d, 0x33, 0x35, 0x2e, 
-	0x31, 0x36, 0x20, 0x4c, 0x30, 0x2c, 0x2d, 0x37, 0x2e, 0x30, 
-	0x37, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 
-	0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 
-	0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 
-	0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 
-	0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 
-	0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 
-	0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 
-	0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2b, 0x30, 0x5f, 0x31, 
-	0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 
-	0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 0x6c, 
-	0x69, 0x63, 0x6b, 0x28, 0x27, 0x58, 0x30, 0x2e, 0x31, 0x27, 
-	0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 
-	0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x6c, 
-	0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 0x31, 0x32, 
-	0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 
-	0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x33, 0x35, 0x2e, 
-	0x31, 0x36, 0x20, 0x2d, 0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 
-	0x41, 0x34, 0x35, 0x2c, 0x34, 0x35, 0x20, 0x30, 0x20, 0x30, 
-	0x2c, 0x31, 0x20, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x2c, 0x32, 
-	0x38, 0x2e, 0x30, 0x39, 0x20, 0x4c, 0x37, 0x2e, 0x30, 0x37, 
-	0x2c, 0x30, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 
-	0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 
-	0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 
-	0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 
-	0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 
-	0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x59, 0x2d, 0x30, 0x5f, 
-	0x31, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 
-	0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 0x59, 0x43, 
-	0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 0x59, 0x2d, 0x30, 0x2e, 
-	0x31, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 
-	0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 0x61, 0x6e, 
-	0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 0x30, 0x20, 
-	0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 
-	0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x2d, 
-	0x32, 0x38, 0x2e, 0x30, 0x39, 0x20, 0x33, 0x35, 0x2e, 0x31, 
-	0x36, 0x20, 0x41, 0x34, 0x35, 0x2c, 0x34, 0x35, 0x20, 0x30, 
-	0x20, 0x30, 0x2c, 0x30, 0x20, 0x32, 0x39, 0x2e, 0x30, 0x39, 
-	0x2c, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x20, 0x4c, 0x30, 0x2c, 
-	0x37, 0x2e, 0x30, 0x37, 0x20, 0x7a, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 
-	0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 
-	0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 
-	0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 
-	0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 
-	0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 
-	0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 
-	0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x70, 0x61, 
-	0x74, 0x68, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x58, 0x2d, 
-	0x30, 0x5f, 0x31, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 
-	0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x58, 
-	0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 0x58, 0x2d, 
-	0x30, 0x2e, 0x31, 0x27, 0x29, 0x22, 0x20, 0x74, 0x72, 0x61, 
-	0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x3d, 0x22, 0x74, 0x72, 
-	0x61, 0x6e, 0x73, 0x6c, 0x61, 0x74, 0x65, 0x28, 0x31, 0x32, 
-	0x30, 0x20, 0x31, 0x32, 0x30, 0x29, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 
-	0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 
-	0x4d, 0x2d, 0x33, 0x35, 0x2e, 0x31, 0x36, 0x20, 0x2d, 0x32, 
-	0x38, 0x2e, 0x30, 0x39, 0x20, 0x41, 0x34, 0x35, 0x2c, 0x34, 
-	0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x30, 0x20, 0x2d, 0x33, 
-	0x35, 0x2e, 0x31, 0x36, 0x2c, 0x32, 0x38, 0x2e, 0x30, 0x39, 
-	0x20, 0x4c, 0x2d, 0x37, 0x2e, 0x30, 0x37, 0x2c, 0x30, 0x20, 
-	0x7a, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 
-	0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 
-	0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 
-	0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 
-	0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 
-	0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 
-	0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x2f, 0x70, 0x61, 0x74, 0x68, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x52, 0x6f, 0x73, 
-	0x65, 0x53, 0x63, 0x61, 0x6c, 0x65, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x63, 0x69, 0x72, 0x63, 0x6c, 0x65, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x63, 
-	0x78, 0x3d, 0x22, 0x31, 0x34, 0x34, 0x22, 0x20, 0x63, 0x79, 
-	0x3d, 0x22, 0x39, 0x36, 0x22, 0x20, 0x72, 0x3d, 0x22, 0x39, 
-	0x2e, 0x35, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 0x69, 0x72, 
-	0x63, 0x6c, 0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 
-	0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x63, 0x78, 0x3d, 0x22, 
-	0x31, 0x35, 0x39, 0x2e, 0x35, 0x22, 0x20, 0x63, 0x79, 0x3d, 
-	0x22, 0x38, 0x30, 0x2e, 0x35, 0x22, 0x20, 0x72, 0x3d, 0x22, 
-	0x31, 0x30, 0x2e, 0x35, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 
-	0x69, 0x72, 0x63, 0x6c, 0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 
-	0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x63, 0x78, 
-	0x3d, 0x22, 0x31, 0x37, 0x35, 0x22, 0x20, 0x63, 0x79, 0x3d, 
-	0x22, 0x36, 0x35, 0x22, 0x20, 0x72, 0x3d, 0x22, 0x31, 0x32, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 0x69, 0x72, 0x63, 0x6c, 
-	0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 
-	0x63, 0x6c, 0x22, 0x20, 0x63, 0x78, 0x3d, 0x22, 0x31, 0x39, 
-	0x35, 0x22, 0x20, 0x63, 0x79, 0x3d, 0x22, 0x34, 0x35, 0x22, 
-	0x20, 0x72, 0x3d, 0x22, 0x31, 0x35, 0x22, 0x2f, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x63, 0x6c, 0x61, 0x73, 
-	0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x78, 0x3d, 
-	0x22, 0x31, 0x33, 0x37, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x39, 
-	0x39, 0x22, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x73, 0x69, 
-	0x7a, 0x65, 0x3d, 0x22, 0x31, 0x30, 0x22, 0x3e, 0x20, 0x30, 
-	0x2e, 0x31, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x78, 
-	0x3d, 0x22, 0x31, 0x35, 0x35, 0x22, 0x20, 0x79, 0x3d, 0x22, 
-	0x38, 0x35, 0x22, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x73, 
-	0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 0x34, 0x22, 0x3e, 0x20, 
-	0x31, 0x20, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x78, 
-	0x3d, 0x22, 0x31, 0x36, 0x36, 0x22, 0x20, 0x79, 0x3d, 0x22, 
-	0x37, 0x30, 0x22, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x73, 
-	0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 0x35, 0x22, 0x3e, 0x20, 
-	0x31, 0x30, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x78, 
-	0x3d, 0x22, 0x31, 0x38, 0x32, 0x22, 0x20, 0x79, 0x3d, 0x22, 
-	0x35, 0x30, 0x22, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x73, 
-	0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 0x35, 0x22, 0x3e, 0x20, 
-	0x31, 0x30, 0x30, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x44, 
-	0x65, 0x63, 0x6f, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x22, 
-	0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x2d, 0x65, 
-	0x76, 0x65, 0x6e, 0x74, 0x73, 0x3d, 0x22, 0x6e, 0x6f, 0x6e, 
-	0x65, 0x22, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x66, 
-	0x6f, 0x6e, 0x74, 0x2d, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 
-	0x3d, 0x22, 0x39, 0x30, 0x30, 0x22, 0x20, 0x66, 0x6f, 0x6e, 
-	0x74, 0x2d, 0x73, 0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 0x31, 
-	0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x2d, 0x6f, 0x70, 0x61, 
-	0x63, 0x69, 0x74, 0x79, 0x3d, 0x22, 0x2e, 0x36, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 
-	0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x31, 
-	0x32, 0x30, 0x2c, 0x32, 0x30, 0x20, 0x6c, 0x31, 0x37, 0x2c, 
-	0x31, 0x37, 0x20, 0x68, 0x2d, 0x31, 0x30, 0x20, 0x76, 0x31, 
-	0x31, 0x20, 0x68, 0x2d, 0x31, 0x34, 0x20, 0x76, 0x2d, 0x31, 
-	0x31, 0x20, 0x68, 0x2d, 0x31, 0x30, 0x20, 0x7a, 0x22, 0x20, 
-	0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x53, 0x74, 0x65, 0x65, 
-	0x6c, 0x42, 0x6c, 0x75, 0x65, 0x22, 0x2f, 0x3e, 0x20, 0x20, 
-	0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x20, 0x79, 0x20, 0x70, 0x6f, 
-	0x73, 0x20, 0x61, 0x72, 0x72, 0x6f, 0x77, 0x20, 0x2d, 0x2d, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 
-	0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 
-	0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 
-	0x31, 0x32, 0x30, 0x2c, 0x32, 0x32, 0x30, 0x20, 0x6c, 0x31, 
-	0x37, 0x2c, 0x2d, 0x31, 0x37, 0x20, 0x68, 0x2d, 0x31, 0x30, 
-	0x20, 0x76, 0x2d, 0x31, 0x31, 0x20, 0x68, 0x2d, 0x31, 0x34, 
-	0x20, 0x76, 0x31, 0x31, 0x20, 0x68, 0x2d, 0x31, 0x30, 0x20, 
-	0x7a, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x53, 
-	0x74, 0x65, 0x65, 0x6c, 0x42, 0x6c, 0x75, 0x65, 0x22, 0x2f, 
-	0x3e, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x20, 0x79, 0x20, 0x6e, 
-	0x65, 0x67, 0x20, 0x61, 0x72, 0x72, 0x6f, 0x77, 0x20, 0x2d, 
-	0x2d, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 
-	0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 
-	0x4d, 0x32, 0x30, 0x2c, 0x31, 0x32, 0x30, 0x20, 0x6c, 0x31, 
-	0x37, 0x2c, 0x31, 0x37, 0x20, 0x76, 0x2d, 0x31, 0x30, 0x20, 
-	0x68, 0x31, 0x31, 0x20, 0x76, 0x2d, 0x31, 0x34, 0x20, 0x68, 
-	0x2d, 0x31, 0x31, 0x20, 0x76, 0x2d, 0x31, 0x30, 0x20, 0x7a, 
-	0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x4b, 0x68, 
-	0x61, 0x6b, 0x69, 0x22, 0x2f, 0x3e, 0x20, 0x3c, 0x21, 0x2d, 
-	0x2d, 0x20, 0x78, 0x20, 0x6e, 0x65, 0x67, 0x20, 0x61, 0x72, 
-	0x72, 0x6f, 0x77, 0x20, 0x2d, 0x2d, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 
-	0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 
-	0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x32, 0x32, 0x30, 0x2c, 
-	0x31, 0x32, 0x30, 0x20, 0x6c, 0x2d, 0x31, 0x37, 0x2c, 0x2d, 
-	0x31, 0x37, 0x20, 0x76, 0x31, 0x30, 0x20, 0x68, 0x2d, 0x31, 
-	0x31, 0x20, 0x76, 0x31, 0x34, 0x20, 0x68, 0x31, 0x31, 0x20, 
-	0x76, 0x31, 0x30, 0x20, 0x7a, 0x22, 0x20, 0x66, 0x69, 0x6c, 
-	0x6c, 0x3d, 0x22, 0x4b, 0x68, 0x61, 0x6b, 0x69, 0x22, 0x2f, 
-	0x3e, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x20, 0x78, 0x20, 0x70, 
-	0x6f, 0x73, 0x20, 0x61, 0x72, 0x72, 0x6f, 0x77, 0x20, 0x2d, 
-	0x2d, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 0x22, 0x31, 0x31, 
-	0x33, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x33, 0x37, 0x22, 0x20, 
-	0x3e, 0x20, 0x2b, 0x59, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 
-	0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 0x22, 0x31, 0x31, 
-	0x33, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x32, 0x31, 0x32, 0x22, 
-	0x3e, 0x20, 0x2d, 0x59, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 
-	0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 0x22, 0x32, 0x37, 
-	0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 0x32, 0x34, 0x22, 0x3e, 
-	0x20, 0x2d, 0x58, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 
-	0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 0x22, 0x31, 0x39, 0x36, 
-	0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 0x32, 0x34, 0x22, 0x3e, 
-	0x20, 0x2b, 0x58, 0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x73, 0x79, 0x6d, 0x62, 0x6f, 0x6c, 0x3e, 0xa, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x79, 
-	0x6d, 0x62, 0x6f, 0x6c, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x4a, 
-	0x6f, 0x67, 0x42, 0x61, 0x72, 0x22, 0x20, 0x76, 0x69, 0x65, 
-	0x77, 0x42, 0x6f, 0x78, 0x3d, 0x22, 0x32, 0x30, 0x20, 0x2d, 
-	0x31, 0x30, 0x20, 0x32, 0x36, 0x30, 0x20, 0x32, 0x36, 0x30, 
-	0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x64, 0x65, 0x73, 0x63, 
-	0x3e, 0x4a, 0x6f, 0x67, 0x42, 0x61, 0x72, 0x20, 0x2d, 0x20, 
-	0x5a, 0x20, 0x6a, 0x6f, 0x67, 0x67, 0x69, 0x6e, 0x67, 0x20, 
-	0x62, 0x61, 0x72, 0x3c, 0x2f, 0x64, 0x65, 0x73, 0x63, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 
-	0x2b, 0x5a, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 
-	0x23, 0x62, 0x30, 0x62, 0x30, 0x62, 0x30, 0x22, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 
-	0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 
-	0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x20, 0x4d, 0x35, 
-	0x2c, 0x30, 0x20, 0x68, 0x33, 0x30, 0x20, 0x61, 0x35, 0x2c, 
-	0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x35, 0x2c, 
-	0x35, 0x20, 0x76, 0x32, 0x37, 0x20, 0x68, 0x2d, 0x34, 0x30, 
-	0x20, 0x76, 0x2d, 0x32, 0x37, 0x20, 0x61, 0x35, 0x2c, 0x35, 
-	0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x35, 0x2c, 0x2d, 
-	0x35, 0x20, 0x7a, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 
-	0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 
-	0x20, 0x64, 0x3d, 0x22, 0x4d, 0x32, 0x30, 0x2c, 0x32, 0x20, 
-	0x6c, 0x31, 0x37, 0x2c, 0x31, 0x37, 0x20, 0x68, 0x2d, 0x31, 
-	0x30, 0x20, 0x76, 0x31, 0x31, 0x20, 0x68, 0x2d, 0x31, 0x34, 
-	0x20, 0x76, 0x2d, 0x31, 0x31, 0x20, 0x68, 0x2d, 0x31, 0x30, 
-	0x20, 0x7a, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 
-	0x44, 0x61, 0x72, 0x6b, 0x53, 0x65, 0x61, 0x47, 0x72, 0x65, 
-	0x65, 0x6e, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x78, 0x3d, 
-	0x22, 0x31, 0x31, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 0x38, 
-	0x22, 0x20, 0x66, 0x6f, 0x6e, 0x74, 0x2d, 0x73, 0x69, 0x7a, 
-	0x65, 0x3d, 0x22, 0x31, 0x32, 0x22, 0x3e, 0x20, 0x2b, 0x5a, 
-	0x20, 0x3c, 0x2f, 0x74, 0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x2d, 0x5a, 0x22, 0x20, 0x66, 
-	0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x62, 0x30, 0x62, 0x30, 
-	0x62, 0x30, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x70, 0x61, 0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 
-	0x3d, 0x22, 0x20, 0x4d, 0x30, 0x2c, 0x32, 0x30, 0x38, 0x20, 
-	0x68, 0x34, 0x30, 0x20, 0x76, 0x32, 0x37, 0x20, 0x61, 0x35, 
-	0x2c, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 0x2d, 
-	0x35, 0x2c, 0x35, 0x20, 0x68, 0x2d, 0x33, 0x30, 0x20, 0x61, 
-	0x35, 0x2c, 0x35, 0x20, 0x30, 0x20, 0x30, 0x2c, 0x31, 0x20, 
-	0x2d, 0x35, 0x2c, 0x2d, 0x35, 0x20, 0x7a, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x70, 0x61, 
-	0x74, 0x68, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x73, 0x74, 0x64, 0x22, 0x20, 0x64, 0x3d, 0x22, 0x4d, 0x32, 
-	0x30, 0x2c, 0x32, 0x33, 0x38, 0x20, 0x6c, 0x2d, 0x31, 0x37, 
-	0x2c, 0x2d, 0x31, 0x37, 0x20, 0x68, 0x31, 0x30, 0x20, 0x76, 
-	0x2d, 0x31, 0x31, 0x20, 0x68, 0x31, 0x34, 0x20, 0x76, 0x31, 
-	0x31, 0x20, 0x68, 0x31, 0x30, 0x20, 0x7a, 0x22, 0x20, 0x66, 
-	0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x44, 0x61, 0x72, 0x6b, 0x53, 
-	0x65, 0x61, 0x47, 0x72, 0x65, 0x65, 0x6e, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x65, 
-	0x78, 0x74, 0x20, 0x78, 0x3d, 0x22, 0x31, 0x33, 0x22, 0x20, 
-	0x79, 0x3d, 0x22, 0x32, 0x33, 0x30, 0x22, 0x20, 0x66, 0x6f, 
-	0x6e, 0x74, 0x2d, 0x73, 0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 
-	0x32, 0x22, 0x3e, 0x20, 0x2d, 0x5a, 0x20, 0x3c, 0x2f, 0x74, 
-	0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x5a, 0x2b, 0x31, 0x30, 0x22, 0x20, 0x66, 0x69, 0x6c, 
-	0x6c, 0x3d, 0x22, 0x23, 0x64, 0x30, 0x64, 0x30, 0x64, 0x30, 
-	0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 
-	0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x5a, 0x43, 0x6c, 0x69, 
-	0x63, 0x6b, 0x28, 0x27, 0x5a, 0x31, 0x30, 0x27, 0x29, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x72, 
-	0x65, 0x63, 0x74, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 
-	0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x78, 0x3d, 0x22, 0x30, 
-	0x22, 0x20, 0x79, 0x3d, 0x22, 0x33, 0x32, 0x22, 0x20, 0x77, 
-	0x69, 0x64, 0x74, 0x68, 0x3d, 0x22, 0x34, 0x30, 0x22, 0x20, 
-	0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 0x33, 0x30, 
-	0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 
-	0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 
-	0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 
-	0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 
-	0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 
-	0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 
-	0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 
-	0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x72, 0x65, 0x63, 0x74, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 0x69, 0x72, 
-	0x63, 0x6c, 0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 
-	0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x63, 0x78, 0x3d, 0x22, 
-	0x32, 0x30, 0x22, 0x20, 0x63, 0x79, 0x3d, 0x22, 0x34, 0x37, 
-	0x22, 0x20, 0x72, 0x3d, 0x22, 0x31, 0x33, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x65, 
-	0x78, 0x74, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 
-	0x73, 0x63, 0x6c, 0x22, 0x20, 0x78, 0x3d, 0x22, 0x39, 0x22, 
-	0x20, 0x79, 0x3d, 0x22, 0x35, 0x33, 0x22, 0x20, 0x66, 0x6f, 
-	0x6e, 0x74, 0x2d, 0x73, 0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 
-	0x38, 0x22, 0x3e, 0x20, 0x31, 0x30, 0x20, 0x3c, 0x2f, 0x74, 
-	0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x5a, 0x2b, 0x31, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 
-	0x3d, 0x22, 0x23, 0x65, 0x30, 0x65, 0x30, 0x65, 0x30, 0x22, 
-	0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 
-	0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x5a, 0x43, 0x6c, 0x69, 0x63, 
-	0x6b, 0x28, 0x27, 0x5a, 0x31, 0x27, 0x29, 0x22, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x72, 0x65, 0x63, 
-	0x74, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 
-	0x74, 0x64, 0x22, 0x20, 0x78, 0x3d, 0x22, 0x30, 0x22, 0x20, 
-	0x79, 0x3d, 0x22, 0x36, 0x32, 0x22, 0x20, 0x77, 0x69, 0x64, 
-	0x74, 0x68, 0x3d, 0x22, 0x34, 0x30, 0x22, 0x20, 0x68, 0x65, 
-	0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 0x32, 0x36, 0x22, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 
-	0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 
-	0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 
-	0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 
-	0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 
-	0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x72, 0x65, 0x63, 0x74, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 0x69, 0x72, 0x63, 0x6c, 
-	0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 
-	0x63, 0x6c, 0x22, 0x20, 0x63, 0x78, 0x3d, 0x22, 0x32, 0x30, 
-	0x22, 0x20, 0x63, 0x79, 0x3d, 0x22, 0x37, 0x35, 0x22, 0x20, 
-	0x72, 0x3d, 0x22, 0x31, 0x31, 0x22, 0x2f, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 
-	0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x63, 
-	0x6c, 0x22, 0x20, 0x78, 0x3d, 0x22, 0x31, 0x35, 0x22, 0x20, 
-	0x79, 0x3d, 0x22, 0x38, 0x31, 0x2e, 0x35, 0x22, 0x20, 0x66, 
-	0x6f, 0x6e, 0x74, 0x2d, 0x73, 0x69, 0x7a, 0x65, 0x3d, 0x22, 
-	0x31, 0x38, 0x22, 0x3e, 0x20, 0x31, 0x20, 0x3c, 0x2f, 0x74, 
-	0x65, 0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x5a, 0x2b, 0x30, 0x2e, 0x31, 0x22, 0x20, 0x66, 0x69, 
-	0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x66, 0x30, 0x66, 0x30, 0x66, 
-	0x30, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 
-	0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x5a, 0x43, 0x6c, 
-	0x69, 0x63, 0x6b, 0x28, 0x27, 0x5a, 0x30, 0x2e, 0x31, 0x27, 
-	0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x72, 0x65, 0x63, 0x74, 0x20, 0x63, 0x6c, 0x61, 0x73, 
-	0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x78, 0x3d, 
-	0x22, 0x30, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x38, 0x38, 0x22, 
-	0x20, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3d, 0x22, 0x34, 0x30, 
-	0x22, 0x20, 0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 
-	0x32, 0x34, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 
-	0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 
-	0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 
-	0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 
-	0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 
-	0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x72, 0x65, 0x63, 0x74, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 
-	0x69, 0x72, 0x63, 0x6c, 0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 
-	0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x63, 0x78, 
-	0x3d, 0x22, 0x32, 0x30, 0x22, 0x20, 0x63, 0x79, 0x3d, 0x22, 
-	0x31, 0x30, 0x30, 0x22, 0x20, 0x72, 0x3d, 0x22, 0x39, 0x2e, 
-	0x35, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x74, 0x65, 0x78, 0x74, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x63, 0x6c, 0x22, 0x20, 0x78, 
-	0x3d, 0x22, 0x31, 0x33, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 
-	0x30, 0x33, 0x2e, 0x35, 0x22, 0x20, 0x66, 0x6f, 0x6e, 0x74, 
-	0x2d, 0x73, 0x69, 0x7a, 0x65, 0x3d, 0x22, 0x31, 0x30, 0x22, 
-	0x3e, 0x20, 0x30, 0x2e, 0x31, 0x20, 0x3c, 0x2f, 0x74, 0x65, 
-	0x78, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 
-	0x5a, 0x2d, 0x31, 0x30, 0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 
-	0x3d, 0x22, 0x23, 0x64, 0x30, 0x64, 0x30, 0x64, 0x30, 0x22, 
-	0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 
-	0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x5a, 0x43, 0x6c, 0x69, 0x63, 
-	0x6b, 0x28, 0x27, 0x5a, 0x2d, 0x31, 0x30, 0x27, 0x29, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x72, 
-	0x65, 0x63, 0x74, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 
-	0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x78, 0x3d, 0x22, 0x30, 
-	0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 0x37, 0x38, 0x22, 0x20, 
-	0x77, 0x69, 0x64, 0x74, 0x68, 0x3d, 0x22, 0x34, 0x30, 0x22, 
-	0x20, 0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 0x3d, 0x22, 0x33, 
-	0x30, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 0x65, 0x74, 0x20, 0x61, 
-	0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x65, 0x4e, 0x61, 
-	0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x6c, 0x22, 0x20, 
-	0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 
-	0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x3d, 0x22, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 0x65, 0x72, 0x22, 0x20, 
-	0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 
-	0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x72, 0x65, 0x63, 0x74, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x5a, 0x2d, 0x31, 
-	0x22, 0x20, 0x66, 0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x65, 
-	0x30, 0x65, 0x30, 0x65, 0x30, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 
-	0x67, 0x5a, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 0x5a, 
-	0x2d, 0x31, 0x27, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x72, 0x65, 0x63, 0x74, 0x20, 0x63, 
-	0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 
-	0x20, 0x78, 0x3d, 0x22, 0x30, 0x22, 0x20, 0x79, 0x3d, 0x22, 
-	0x31, 0x35, 0x32, 0x22, 0x20, 0x77, 0x69, 0x64, 0x74, 0x68, 
-	0x3d, 0x22, 0x34, 0x30, 0x22, 0x20, 0x68, 0x65, 0x69, 0x67, 
-	0x68, 0x74, 0x3d, 0x22, 0x32, 0x36, 0x22, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x73, 0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 
-	0x75, 0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 
-	0x69, 0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 
-	0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 
-	0x69, 0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 
-	0x76, 0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 
-	0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x72, 0x65, 0x63, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x5a, 0x2d, 0x30, 0x5f, 0x31, 0x22, 0x20, 0x66, 
-	0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x66, 0x30, 0x66, 0x30, 
-	0x66, 0x30, 0x22, 0x20, 0x6f, 0x6e, 0x6d, 0x6f, 0x75, 0x73, 
-	0x65, 0x75, 0x70, 0x3d, 0x22, 0x6a, 0x6f, 0x67, 0x5a, 0x43, 
-	0x6c, 0x69, 0x63, 0x6b, 0x28, 0x27, 0x5a, 0x2d, 0x30, 0x2e, 
-	0x31, 0x27, 0x29, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x72, 0x65, 0x63, 0x74, 0x20, 0x63, 0x6c, 
-	0x61, 0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 
-	0x78, 0x3d, 0x22, 0x30, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 
-	0x32, 0x38, 0x22, 0x20, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3d, 
-	0x22, 0x34, 0x30, 0x22, 0x20, 0x68, 0x65, 0x69, 0x67, 0x68, 
-	0x74, 0x3d, 0x22, 0x32, 0x34, 0x22, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x73, 
-	0x65, 0x74, 0x20, 0x61, 0x74, 0x74, 0x72, 0x69, 0x62, 0x75, 
-	0x74, 0x65, 0x4e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 
-	0x6c, 0x6c, 0x22, 0x20, 0x74, 0x6f, 0x3d, 0x22, 0x6f, 0x72, 
-	0x61, 0x6e, 0x67, 0x65, 0x22, 0x20, 0x62, 0x65, 0x67, 0x69, 
-	0x6e, 0x3d, 0x22, 0x6d, 0x6f, 0x75, 0x73, 0x65, 0x6f, 0x76, 
-	0x65, 0x72, 0x22, 0x20, 0x65, 0x6e, 0x64, 0x3d, 0x22, 0x6d, 
-	0x6f, 0x75, 0x73, 0x65, 0x6f, 0x75, 0x74, 0x22, 0x2f, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x72, 
-	0x65, 0x63, 0x74, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x67, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x67, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x5a, 0x53, 0x70, 0x61, 0x63, 0x65, 0x22, 0x20, 0x66, 
-	0x69, 0x6c, 0x6c, 0x3d, 0x22, 0x23, 0x30, 0x30, 0x30, 0x30, 
-	0x30, 0x30, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x72, 0x65, 0x63, 0x74, 0x20, 0x63, 0x6c, 0x61, 
-	0x73, 0x73, 0x3d, 0x22, 0x73, 0x74, 0x64, 0x22, 0x20, 0x78, 
-	0x3d, 0x22, 0x30, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x31, 0x31, 
-	0x32, 0x22, 0x20, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3d, 0x22, 
-	0x34, 0x30, 0x22, 0x20, 0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 
-	0x3d, 0x22, 0x31, 0x36, 0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x67, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x73, 0x79, 0x6d, 0x62, 0x6f, 
-	0x6c, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x73, 0x79, 0x6d, 0x62, 0x6f, 0x6c, 0x20, 
-	0x69, 0x64, 0x3d, 0x22, 0x50, 0x72, 0x69, 0x6e, 0x74, 0x65, 
-	0x72, 0x43, 0x74, 0x6c, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x75, 0x73, 0x65, 0x20, 0x78, 0x3d, 0x22, 0x30, 0x22, 0x20, 
-	0x79, 0x3d, 0x22, 0x30, 0x22, 0x20, 0x78, 0x6c, 0x69, 0x6e, 
-	0x6b, 0x3a, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x23, 0x4a, 
-	0x6f, 0x67, 0x52, 0x6f, 0x73, 0x65, 0x22, 0x2f, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x75, 0x73, 0x65, 0x20, 0x78, 0x3d, 0x22, 
-	0x32, 0x36, 0x30, 0x22, 0x20, 0x79, 0x3d, 0x22, 0x30, 0x22, 
-	0x20, 0x78, 0x6c, 0x69, 0x6e, 0x6b, 0x3a, 0x68, 0x72, 0x65, 
-	0x66, 0x3d, 0x22, 0x23, 0x4a, 0x6f, 0x67, 0x42, 0x61, 0x72, 
-	0x22, 0x2f, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x2f, 0x73, 0x79, 0x6d, 0x62, 0x6f, 0x6c, 
-	0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x64, 
-	0x65, 0x66, 0x73, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x75, 0x73, 0x65, 0x20, 0x78, 0x3d, 0x22, 0x30, 0x22, 
-	0x20, 0x79, 0x3d, 0x22, 0x30, 0x22, 0x20, 0x78, 0x6c, 0x69, 
-	0x6e, 0x6b, 0x3a, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x23, 
-	0x50, 0x72, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x43, 0x74, 0x6c, 
-	0x22, 0x2f, 0x3e, 0xa, 0xa, 0x20, 0x20, 0x3c, 0x2f, 0x73, 
-	0x76, 0x67, 0x3e, 0xa, 0xa, 0x3c, 0x62, 0x72, 0x20, 0x2f, 
-	0x3e, 0xa, 0x3c, 0x74, 0x61, 0x62, 0x6c, 0x65, 0x3e, 0xa, 
-	0x3c, 0x74, 0x72, 0x3e, 0xa, 0x20, 0x20, 0x3c, 0x74, 0x64, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x61, 0x62, 
-	0x6c, 0x65, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x74, 0x72, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x74, 0x64, 0x20, 0x73, 0x74, 0x79, 
-	0x6c, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x2d, 0x61, 
-	0x6c, 0x69, 0x67, 0x6e, 0x3a, 0x72, 0x69, 0x67, 0x68, 0x74, 
-	0x22, 0x3e, 0x48, 0x65, 0x61, 0x74, 0x3a, 0x3c, 0x2f, 0x74, 
-	0x64, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x74, 0x64, 0x3e, 0x3c, 0x62, 0x75, 0x74, 0x74, 
-	0x6f, 0x6e, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x68, 0x65, 0x61, 
-	0x74, 0x5f, 0x6f, 0x66, 0x66, 0x22, 0x20, 0x6f, 0x6e, 0x63, 
-	0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 0x68, 0x65, 0x61, 0x74, 
-	0x4f, 0x66, 0x66, 0x28, 0x65, 0x76, 0x65, 0x6e, 0x74, 0x29, 
-	0x22, 0x3e, 0x4f, 0x66, 0x66, 0x3c, 0x2f, 0x62, 0x75, 0x74, 
-	0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x2f, 0x74, 0x64, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 
-	0x64, 0x3e, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 
-	0x79, 0x70, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x68, 0x65, 0x61, 0x74, 0x5f, 
-	0x76, 0x61, 0x6c, 0x75, 0x65, 0x22, 0x20, 0x73, 0x69, 0x7a, 
-	0x65, 0x3d, 0x33, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x3d, 
-	0x22, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 0x34, 0x30, 0x70, 
-	0x78, 0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x30, 
-	0x3e, 0x3c, 0x2f, 0x74, 0x64, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x64, 0x3e, 0x3c, 
-	0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x68, 0x65, 0x61, 0x74, 0x5f, 0x73, 0x65, 0x74, 0x22, 
-	0x20, 0x6f, 0x6e, 0x63, 0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 
-	0x68, 0x65, 0x61, 0x74, 0x53, 0x65, 0x74, 0x28, 0x65, 0x76, 
-	0x65, 0x6e, 0x74, 0x29, 0x22, 0x3e, 0x53, 0x65, 0x74, 0x3c, 
-	0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x2f, 
-	0x74, 0x64, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x3c, 0x2f, 0x74, 0x72, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x74, 0x72, 0x3e, 0xa, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x64, 0x20, 0x73, 
-	0x74, 0x79, 0x6c, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 
-	0x2d, 0x61, 0x6c, 0x69, 0x67, 0x6e, 0x3a, 0x72, 0x69, 0x67, 
-	0x68, 0x74, 0x22, 0x3e, 0x42, 0x65, 0x64, 0x3a, 0x3c, 0x2f, 
-	0x74, 0x64, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x3c, 0x74, 0x64, 0x3e, 0x3c, 0x62, 0x75, 0x74, 
-	0x74, 0x6f, 0x6e, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x62, 0x65, 
-	0x64, 0x5f, 0x6f, 0x66, 0x66, 0x22, 0x20, 0x6f, 0x6e, 0x63, 
-	0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 0x68, 0x65, 0x61, 0x74, 
-	0x4f, 0x66, 0x66, 0x28, 0x65, 0x76, 0x65, 0x6e, 0x74, 0x29, 
-	0x22, 0x3e, 0x4f, 0x66, 0x66, 0x3c, 0x2f, 0x62, 0x75, 0x74, 
-	0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x2f, 0x74, 0x64, 0x3e, 0xa, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 
-	0x64, 0x3e, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 
-	0x79, 0x70, 0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x62, 0x65, 0x64, 0x5f, 0x76, 
-	0x61, 0x6c, 0x75, 0x65, 0x22, 0x20, 0x73, 0x69, 0x7a, 0x65, 
-	0x3d, 0x33, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x3d, 0x22, 
-	0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 0x34, 0x30, 0x70, 0x78, 
-	0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x30, 0x3e, 
-	0x3c, 0x2f, 0x74, 0x64, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x3c, 0x74, 0x64, 0x3e, 0x3c, 0x62, 
-	0x75, 0x74, 0x74, 0x6f, 0x6e, 0x20, 0x69, 0x64, 0x3d, 0x22, 
-	0x62, 0x65, 0x64, 0x5f, 0x73, 0x65, 0x74, 0x22, 0x20, 0x6f, 
-	0x6e, 0x63, 0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 0x68, 0x65, 
-	0x61, 0x74, 0x53, 0x65, 0x74, 0x28, 0x65, 0x76, 0x65, 0x6e, 
-	0x74, 0x29, 0x22, 0x3e, 0x53, 0x65, 0x74, 0x3c, 0x2f, 0x62, 
-	0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x2f, 0x74, 0x64, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x74, 0x72, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 
-	0x74, 0x61, 0x62, 0x6c, 0x65, 0x3e, 0xa, 0x20, 0x20, 0x3c, 
-	0x2f, 0x74, 0x64, 0x3e, 0xa, 0x20, 0x20, 0x3c, 0x74, 0x64, 
-	0x20, 0x76, 0x61, 0x6c, 0x69, 0x67, 0x6e, 0x3d, 0x22, 0x74, 
-	0x6f, 0x70, 0x22, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x3c, 
-	0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x67, 0x65, 0x74, 0x5f, 0x74, 0x65, 0x6d, 0x70, 0x65, 
-	0x72, 0x61, 0x74, 0x75, 0x72, 0x65, 0x22, 0x20, 0x6f, 0x6e, 
-	0x63, 0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 0x67, 0x65, 0x74, 
-	0x54, 0x65, 0x6d, 0x70, 0x65, 0x72, 0x61, 0x74, 0x75, 0x72, 
-	0x65, 0x28, 0x29, 0x22, 0x3e, 0x47, 0x65, 0x74, 0x20, 0x54, 
-	0x65, 0x6d, 0x70, 0x65, 0x72, 0x61, 0x74, 0x75, 0x72, 0x65, 
-	0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0xa, 
-	0x20, 0x20, 0x3c, 0x2f, 0x74, 0x64, 0x3e, 0xa, 0x3c, 0x2f, 
-	0x74, 0x72, 0x3e, 0xa, 0x3c, 0x2f, 0x74, 0x61, 0x62, 0x6c, 
-	0x65, 0x3e, 0xa, 0x3c, 0x62, 0x72, 0x2f, 0x3e, 0xa, 0xa, 
-	0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 0x22, 
-	0x20, 0x6f, 0x6e, 0x63, 0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 
-	0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 0x28, 0x65, 0x76, 
-	0x65, 0x6e, 0x74, 0x29, 0x22, 0x3e, 0x45, 0x78, 0x74, 0x72, 
-	0x75, 0x64, 0x65, 0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 
-	0x6e, 0x3e, 0xa, 0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x72, 0x65, 0x76, 0x65, 0x72, 
-	0x73, 0x65, 0x22, 0x20, 0x6f, 0x6e, 0x63, 0x6c, 0x69, 0x63, 
-	0x6b, 0x3d, 0x22, 0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 
-	0x28, 0x65, 0x76, 0x65, 0x6e, 0x74, 0x29, 0x22, 0x3e, 0x52, 
-	0x65, 0x76, 0x65, 0x72, 0x73, 0x65, 0x3c, 0x2f, 0x62, 0x75, 
-	0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 0xa, 
-	0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 
-	0x65, 0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x69, 
-	0x64, 0x3d, 0x22, 0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 
-	0x5f, 0x6c, 0x65, 0x6e, 0x67, 0x74, 0x68, 0x22, 0x20, 0x76, 
-	0x61, 0x6c, 0x75, 0x65, 0x3d, 0x35, 0x20, 0x73, 0x69, 0x7a, 
-	0x65, 0x3d, 0x33, 0x20, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x3d, 
-	0x22, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 0x33, 0x35, 0x70, 
-	0x78, 0x22, 0x3e, 0xa, 0x6d, 0x6d, 0x20, 0x40, 0xa, 0x3c, 
-	0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 
-	0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x69, 0x64, 
-	0x3d, 0x22, 0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 0x5f, 
-	0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x22, 0x20, 
-	0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x31, 0x30, 0x30, 0x20, 
-	0x73, 0x69, 0x7a, 0x65, 0x3d, 0x33, 0x20, 0x73, 0x74, 0x79, 
-	0x6c, 0x65, 0x3d, 0x22, 0x77, 0x69, 0x64, 0x74, 0x68, 0x3a, 
-	0x34, 0x30, 0x70, 0x78, 0x22, 0x3e, 0xa, 0x6d, 0x6d, 0x2f, 
-	0x6d, 0x69, 0x6e, 0xa, 0xa, 0x3c, 0x68, 0x32, 0x3e, 0x43, 
-	0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x73, 0x3c, 0x2f, 0x68, 
-	0x32, 0x3e, 0xa, 0x3c, 0x66, 0x6f, 0x72, 0x6d, 0x20, 0x61, 
-	0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3d, 0x22, 0x2f, 0x63, 0x6f, 
-	0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x22, 0x20, 0x69, 0x64, 0x3d, 
-	0x22, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x46, 0x6f, 
-	0x72, 0x6d, 0x22, 0x3e, 0xa, 0x9, 0x9, 0x3c, 0x69, 0x6e, 
-	0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 
-	0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x6e, 0x61, 0x6d, 0x65, 
-	0x3d, 0x22, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x54, 
-	0x65, 0x78, 0x74, 0x22, 0x20, 0x70, 0x6c, 0x61, 0x63, 0x65, 
-	0x68, 0x6f, 0x6c, 0x64, 0x65, 0x72, 0x3d, 0x22, 0x53, 0x65, 
-	0x6e, 0x64, 0x20, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x2e, 0x2e, 0x2e, 0x22, 0x3e, 0xa, 0x9, 0x9, 0x3c, 0x69, 
-	0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 
-	0x22, 0x73, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x22, 0x20, 0x76, 
-	0x61, 0x6c, 0x75, 0x65, 0x3d, 0x22, 0x53, 0x65, 0x6e, 0x64, 
-	0x22, 0x3e, 0xa, 0x3c, 0x2f, 0x66, 0x6f, 0x72, 0x6d, 0x3e, 
-	0xa, 0x3c, 0x21, 0x2d, 0x2d, 0x20, 0x74, 0x68, 0x65, 0x20, 
-	0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x20, 0x6f, 0x66, 0x20, 
-	0x74, 0x68, 0x65, 0x20, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 
-	0x64, 0x20, 0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65, 0x20, 
-	0x72, 0x65, 0x6e, 0x64, 0x65, 0x72, 0x65, 0x64, 0x20, 0x69, 
-	0x6e, 0x73, 0x69, 0x64, 0x65, 0x20, 0x74, 0x68, 0x69, 0x73, 
-	0x20, 0x64, 0x69, 0x76, 0x20, 0x2d, 0x2d, 0x3e, 0xa, 0x3c, 
-	0x64, 0x69, 0x76, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x72, 0x65, 
-	0x73, 0x75, 0x6c, 0x74, 0x22, 0x3e, 0x3c, 0x2f, 0x64, 0x69, 
-	0x76, 0x3e, 0xa, 0x3c, 0x73, 0x63, 0x72, 0x69, 0x70, 0x74, 
-	0x3e, 0xa, 0x9, 0x2f, 0x2f, 0x20, 0x41, 0x74, 0x74, 0x61, 
-	0x63, 0x68, 0x20, 0x61, 0x20, 0x73, 0x75, 0x62, 0x6d, 0x69, 
-	0x74, 0x20, 0x68, 0x61, 0x6e, 0x64, 0x6c, 0x65, 0x72, 0x20, 
-	0x74, 0x6f, 0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x6f, 0x72, 
-	0x6d, 0xa, 0x9, 0x24, 0x28, 0x20, 0x22, 0x23, 0x63, 0x6f, 
-	0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x46, 0x6f, 0x72, 0x6d, 0x22, 
-	0x20, 0x29, 0x2e, 0x73, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x28, 
-	0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x20, 
-	0x65, 0x76, 0x65, 0x6e, 0x74, 0x20, 0x29, 0x20, 0x7b, 0xa, 
-	0x9, 0x9, 0x2f, 0x2f, 0x20, 0x53, 0x74, 0x6f, 0x70, 0x20, 
-	0x66, 0x6f, 0x72, 0x6d, 0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 
-	0x73, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x74, 0x69, 0x6e, 0x67, 
-	0x20, 0x6e, 0x6f, 0x72, 0x6d, 0x61, 0x6c, 0x6c, 0x79, 0xa, 
-	0x9, 0x9, 0x65, 0x76, 0x65, 0x6e, 0x74, 0x2e, 0x70, 0x72, 
-	0x65, 0x76, 0x65, 0x6e, 0x74, 0x44, 0x65, 0x66, 0x61, 0x75, 
-	0x6c, 0x74, 0x28, 0x29, 0x3b, 0xa, 0x9, 0x9, 0x2f, 0x2f, 
-	0x20, 0x47, 0x65, 0x74, 0x20, 0x73, 0x6f, 0x6d, 0x65, 0x20, 
-	0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x20, 0x66, 0x72, 0x6f, 
-	0x6d, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x73, 
-	0x20, 0x6f, 0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 
-	0x67, 0x65, 0x3a, 0xa, 0x9, 0x9, 0x76, 0x61, 0x72, 0x20, 
-	0x24, 0x66, 0x6f, 0x72, 0x6d, 0x20, 0x3d, 0x20, 0x24, 0x28, 
-	0x20, 0x74, 0x68, 0x69, 0x73, 0x20, 0x29, 0x3b, 0xa, 0x9, 
-	0x9, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x20, 0x3d, 
-	0x20, 0x24, 0x66, 0x6f, 0x72, 0x6d, 0x2e, 0x66, 0x69, 0x6e, 
-	0x64, 0x28, 0x20, 0x22, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x5b, 
-	0x6e, 0x61, 0x6d, 0x65, 0x3d, 0x27, 0x63, 0x6f, 0x6d, 0x6d, 
-	0x61, 0x6e, 0x64, 0x54, 0x65, 0x78, 0x74, 0x27, 0x5d, 0x22, 
-	0x20, 0x29, 0x2e, 0x76, 0x61, 0x6c, 0x28, 0x29, 0x3b, 0xa, 
-	0x9, 0x9, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x20, 
-	0x2b, 0x3d, 0x20, 0x22, 0x5c, 0x6e, 0x22, 0x3b, 0xa, 0x9, 
-	0x9, 0x75, 0x72, 0x6c, 0x20, 0x3d, 0x20, 0x24, 0x66, 0x6f, 
-	0x72, 0x6d, 0x2e, 0x61, 0x74, 0x74, 0x72, 0x28, 0x20, 0x22, 
-	0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x22, 0x20, 0x29, 0x3b, 
-	0xa, 0x9, 0x9, 0x2f, 0x2f, 0x20, 0x53, 0x65, 0x6e, 0x64, 
-	0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x61, 0x74, 0x61, 0x20, 
-	0x75, 0x73, 0x69, 0x6e, 0x67, 0x20, 0x70, 0x6f, 0x73, 0x74, 
-	0xa, 0x9, 0x9, 0x76, 0x61, 0x72, 0x20, 0x70, 0x6f, 0x73, 
-	0x74, 0x69, 0x6e, 0x67, 0x20, 0x3d, 0x20, 0x24, 0x2e, 0x70, 
-	0x6f, 0x73, 0x74, 0x28, 0x20, 0x75, 0x72, 0x6c, 0x2c, 0x20, 
-	0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x20, 0x29, 0x3b, 
-	0xa, 0x9, 0x9, 0x2f, 0x2f, 0x20, 0x50, 0x75, 0x74, 0x20, 
-	0x74, 0x68, 0x65, 0x20, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 
-	0x73, 0x20, 0x69, 0x6e, 0x20, 0x61, 0x20, 0x64, 0x69, 0x76, 
-	0xa, 0x9, 0x9, 0x70, 0x6f, 0x73, 0x74, 0x69, 0x6e, 0x67, 
-	0x2e, 0x64, 0x6f, 0x6e, 0x65, 0x28, 0x66, 0x75, 0x6e, 0x63, 
-	0x74, 0x69, 0x6f, 0x6e, 0x28, 0x20, 0x64, 0x61, 0x74, 0x61, 
-	0x20, 0x29, 0x20, 0x7b, 0xa, 0x9, 0x9, 0x9, 0x24, 0x28, 
-	0x20, 0x22, 0x23, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x22, 
-	0x20, 0x29, 0x2e, 0x65, 0x6d, 0x70, 0x74, 0x79, 0x28, 0x29, 
-	0x3b, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x24, 0x2e, 0x65, 0x61, 
-	0x63, 0x68, 0x28, 0x64, 0x61, 0x74, 0x61, 0x2e, 0x73, 0x70, 
-	0x6c, 0x69, 0x74, 0x28, 0x27, 0x5c, 0x6e, 0x27, 0x29, 0x2c, 
-	0x20, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 
-	0x69, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x20, 0x7b, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x24, 0x28, 0x20, 
-	0x22, 0x23, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x22, 0x20, 
-	0x29, 0x2e, 0x61, 0x70, 0x70, 0x65, 0x6e, 0x64, 0x28, 0x20, 
-	0x74, 0x68, 0x69, 0x73, 0x20, 0x2b, 0x20, 0x27, 0x3c, 0x62, 
-	0x72, 0x2f, 0x3e, 0x27, 0x20, 0x29, 0x3b, 0xa, 0x20, 0x20, 
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x20, 0x7d, 0x29, 0x3b, 0xa, 0x9, 0x9, 0x7d, 0x29, 
-	0x3b, 0xa, 0x9, 0x7d, 0x29, 0x3b, 0xa, 0x3c, 0x2f, 0x73, 
-	0x63, 0x72, 0x69, 0x70, 0x74, 0x3e, 0xa, 0xa, 0x3c, 0x68, 
-	0x32, 0x3e, 0x20, 0x55, 0x70, 0x6c, 0x6f, 0x61, 0x64, 0x20, 
-	0x46, 0x69, 0x6c, 0x65, 0x20, 0x3c, 0x2f, 0x68, 0x32, 0x3e, 
-	0xa, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 
-	0x70, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x65, 0x22, 0x20, 
-	0x69, 0x64, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x65, 0x73, 0x22, 
-	0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 
-	0x65, 0x73, 0x5b, 0x5d, 0x22, 0x20, 0x6f, 0x6e, 0x63, 0x68, 
-	0x61, 0x6e, 0x67, 0x65, 0x3d, 0x22, 0x75, 0x70, 0x6c, 0x6f, 
-	0x61, 0x64, 0x28, 0x29, 0x3b, 0x22, 0x3e, 0xa, 0xa, 0x3c, 
-	0x68, 0x33, 0x3e, 0x55, 0x70, 0x6c, 0x6f, 0x61, 0x64, 0x69, 
-	0x6e, 0x67, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x28, 0x73, 0x29, 
-	0x3c, 0x2f, 0x68, 0x33, 0x3e, 0xa, 0x3c, 0x6f, 0x75, 0x74, 
-	0x70, 0x75, 0x74, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x6c, 0x69, 
-	0x73, 0x74, 0x22, 0x3e, 0x3c, 0x2f, 0x6f, 0x75, 0x74, 0x70, 
-	0x75, 0x74, 0x3e, 0xa, 0x3c, 0x64, 0x69, 0x76, 0x20, 0x69, 
-	0x64, 0x3d, 0x22, 0x70, 0x72, 0x6f, 0x67, 0x72, 0x65, 0x73, 
-	0x73, 0x22, 0x3e, 0x3c, 0x2f, 0x64, 0x69, 0x76, 0x3e, 0xa, 
-	0x3c, 0x64, 0x69, 0x76, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x75, 
-	0x70, 0x6c, 0x6f, 0x61, 0x64, 0x72, 0x65, 0x73, 0x75, 0x6c, 
-	0x74, 0x22, 0x3e, 0x3c, 0x2f, 0x64, 0x69, 0x76, 0x3e, 0xa, 
-	0x3c, 0x73, 0x63, 0x72, 0x69, 0x70, 0x74, 0x3e, 0xa, 0x20, 
-	0x20, 0x64, 0x6f, 0x63, 0x75, 0x6d, 0x65, 0x6e, 0x74, 0x2e, 
-	0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 
-	0x42, 0x79, 0x49, 0x64, 0x28, 0x27, 0x66, 0x69, 0x6c, 0x65, 
-	0x73, 0x27, 0x29, 0x2e, 0x61, 0x64, 0x64, 0x45, 0x76, 0x65, 
-	0x6e, 0x74, 0x4c, 0x69, 0x73, 0x74, 0x65, 0x6e, 0x65, 0x72, 
-	0x28, 0x27, 0x63, 0x68, 0x61, 0x6e, 0x67, 0x65, 0x27, 0x2c, 
-	0x20, 0x68, 0x61, 0x6e, 0x64, 0x6c, 0x65, 0x46, 0x69, 0x6c, 
-	0x65, 0x53, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x2c, 0x20, 0x66, 
-	0x61, 0x6c, 0x73, 0x65, 0x29, 0x3b, 0xa, 0x3c, 0x2f, 0x73, 
-	0x63, 0x72, 0x69, 0x70, 0x74, 0x3e, 0xa, 0xa, 0x3c, 0x68, 
-	0x32, 0x3e, 0x50, 0x72, 0x69, 0x6e, 0x74, 0x61, 0x62, 0x6c, 
-	0x65, 0x20, 0x46, 0x69, 0x6c, 0x65, 0x20, 0x6c, 0x69, 0x73, 
-	0x74, 0x20, 0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x20, 
-	0x69, 0x64, 0x3d, 0x22, 0x72, 0x65, 0x66, 0x72, 0x65, 0x73, 
-	0x68, 0x46, 0x69, 0x6c, 0x65, 0x73, 0x22, 0x20, 0x6f, 0x6e, 
-	0x63, 0x6c, 0x69, 0x63, 0x6b, 0x3d, 0x22, 0x72, 0x65, 0x66, 
-	0x72, 0x65, 0x73, 0x68, 0x46, 0x69, 0x6c, 0x65, 0x73, 0x28, 
-	0x29, 0x22, 0x3e, 0x52, 0x65, 0x66, 0x72, 0x65, 0x73, 0x68, 
-	0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 0x3e, 0x20, 
-	0x3c, 0x2f, 0x68, 0x32, 0x3e, 0xa, 0x3c, 0x62, 0x72, 0x2f, 
-	0x3e, 0xa, 0x3c, 0x74, 0x61, 0x62, 0x6c, 0x65, 0x20, 0x69, 
-	0x64, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x65, 0x4c, 0x69, 0x73, 
-	0x74, 0x22, 0x3e, 0xa, 0x3c, 0x2f, 0x74, 0x61, 0x62, 0x6c, 
-	0x65, 0x3e, 0xa, 0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x70, 0x72, 0x6f, 0x67, 0x72, 
-	0x65, 0x73, 0x73, 0x22, 0x20, 0x6f, 0x6e, 0x63, 0x6c, 0x69, 
-	0x63, 0x6b, 0x3d, 0x22, 0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 
-	0x6d, 0x61, 0x6e, 0x64, 0x28, 0x27, 0x70, 0x72, 0x6f, 0x67, 
-	0x72, 0x65, 0x73, 0x73, 0x27, 0x2c, 0x20, 0x66, 0x61, 0x6c, 
-	0x73, 0x65, 0x29, 0x22, 0x3e, 0x50, 0x72, 0x6f, 0x67, 0x72, 
-	0x65, 0x73, 0x73, 0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 0x6f, 
-	0x6e, 0x3e, 0xa, 0x3c, 0x62, 0x75, 0x74, 0x74, 0x6f, 0x6e, 
-	0x20, 0x69, 0x64, 0x3d, 0x22, 0x61, 0x62, 0x6f, 0x72, 0x74, 
-	0x22, 0x20, 0x6f, 0x6e, 0x63, 0x6c, 0x69, 0x63, 0x6b, 0x3d, 
-	0x22, 0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 
-	0x64, 0x28, 0x27, 0x61, 0x62, 0x6f, 0x72, 0x74, 0x27, 0x2c, 
-	0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x29, 0x22, 0x3e, 0x41, 
-	0x62, 0x6f, 0x72, 0x74, 0x3c, 0x2f, 0x62, 0x75, 0x74, 0x74, 
-	0x6f, 0x6e, 0x3e, 0xa, 0xa, 0x3c, 0x2f, 0x62, 0x6f, 0x64, 
-	0x79, 0x3e, 0xa, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 
-	0xa, 0};
+static const unsigned char data_functions_js[] = {
+	/* /functions.js */
+	0x2f, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x2e, 0x6a, 0x73, 0,
+	0x1f, 0x8b, 0x8, 00, 00, 00, 00, 00, 00, 0xff, 
+	0xa5, 0x56, 0x6d, 0x6f, 0xdb, 0x36, 0x10, 0xfe, 0x2b, 0x1a, 
+	0x97, 0x2d, 0x64, 0xad, 0xc8, 0x76, 0xd1, 0x2, 0x6d, 0x64, 
+	0x25, 0x68, 0xb2, 0xa6, 0x1d, 0x16, 0xaf, 0x45, 0x9d, 0x62, 
+	0xdd, 0x92, 0x20, 0xa0, 0xa4, 0x93, 0xc4, 0x44, 0x16, 0x3d, 
+	0x8a, 0x4a, 0xea, 0xc6, 0xfe, 0xef, 0x3b, 0x52, 0x92, 0xe3, 
+	0xd7, 0xbd, 0x60, 0xc8, 0x87, 0xc8, 0xf7, 0xfa, 0xdc, 0xf1, 
+	0xb9, 0x23, 0x93, 0xaa, 0x88, 0xb4, 0x90, 0x85, 0xa3, 0xaa, 
+	0xe2, 0x54, 0x8e, 0xc7, 0xbc, 0x88, 0x69, 0xec, 0x86, 0xec, 
+	0xf1, 0x9e, 0x2b, 0x87, 0x7, 0x7b, 0x94, 0x7c, 0x1f, 0xd5, 
+	0xe2, 0x33, 0xa9, 0xc6, 0x84, 0xf9, 0x71, 0x27, 0x20, 0x57, 
+	0x5, 0xf1, 0x2b, 0x95, 0x7, 0xe1, 0x31, 0xe9, 0x36, 0xda, 
+	0x9b, 0x52, 0xe4, 0x50, 0x68, 0x72, 0xb8, 0x90, 0x10, 0xdf, 
+	0x84, 0x88, 0x82, 0x3d, 0x6f, 0x22, 0x4b, 0x4d, 0xd1, 0xde, 
+	0x8d, 0x99, 0x2f, 0x12, 0xfa, 0x1d, 0x46, 0x8f, 0xbc, 0x58, 
+	0x16, 0x40, 0x93, 0x26, 0x3b, 0x5, 0xf6, 0x68, 0x52, 0x29, 
+	0x28, 0xab, 0x5c, 0x13, 0xe6, 0xc1, 0x78, 0xa2, 0xa7, 0x94, 
+	0xf9, 0x7b, 0x1e, 0xf0, 0x28, 0xa3, 0xe0, 0x95, 0x93, 0x5c, 
+	0x68, 0x6a, 0x32, 0x33, 0x77, 0xe1, 0x95, 0xac, 0x79, 0xf1, 
+	0xc9, 0x4, 0x10, 0xbf, 0xce, 0x44, 0xd9, 0x21, 0x83, 0x50, 
+	0x75, 0x8f, 0x8, 0x9b, 0x9b, 0xbf, 0x79, 0xb2, 0x59, 0xe6, 
+	0xc8, 0x2, 0xa6, 0x9c, 0x3d, 0x2e, 0x95, 0xce, 0x5d, 0xad, 
+	0x2a, 0x60, 0xdb, 0xec, 0x4f, 0x79, 0x9e, 0x87, 0x3c, 0xba, 
+	0xa3, 0x11, 0xd6, 0x61, 0xdb, 0x13, 0x6, 0x4b, 0xc5, 0x46, 
+	0x4d, 0x5f, 0x9a, 0xbe, 0xd5, 0x45, 0x87, 0xae, 0x31, 0x7e, 
+	0x8a, 0x76, 0x2b, 0xd3, 0x2f, 0xbf, 0x9f, 0xe6, 0x2, 0xa3, 
+	0xac, 0xe6, 0x25, 0xef, 0x5e, 0xf7, 0x9d, 0x77, 0x3d, 0x87, 
+	0x74, 0x78, 0x87, 0x38, 0x67, 0xa4, 0x13, 0xcb, 0xa8, 0x1a, 
+	0x23, 0x3e, 0x2f, 0x5, 0xfd, 0x36, 0x7, 0xf3, 0x79, 0x32, 
+	0xfd, 0x19, 0xd, 0xbf, 0x4e, 0x6f, 0xee, 0x21, 0x97, 0x91, 
+	0xd0, 0x53, 0xac, 0xf8, 0x9e, 0xe7, 0x15, 0xa0, 0xc7, 0xbb, 
+	0xd7, 0x3d, 0xb2, 0xe, 0x1d, 0x93, 0xfd, 0xf1, 0xff, 0x72, 
+	0x7d, 0xfb, 0xb7, 0xa9, 0xe0, 0x2b, 0xa, 0x62, 0xa0, 0xa9, 
+	0x1b, 0xbb, 0x51, 0xdd, 0x9c, 0x24, 0xd8, 0x19, 0xb6, 0xb1, 
+	0xbe, 0xc1, 0xfe, 0xa7, 0x3a, 0x6b, 0x43, 0xdb, 0xce, 0xc1, 
+	0x3f, 0x7b, 0xad, 0x43, 0xb2, 0x7e, 0x59, 0x40, 0x53, 0x2f, 
+	0xaa, 0x94, 0x42, 0xf3, 0xb, 0xae, 0xd0, 0xd7, 0x13, 0x71, 
+	0x10, 0xb4, 0x4e, 0x84, 0x1d, 0xf7, 0xf, 0xf, 0xfa, 0xfe, 
+	0x96, 0x2e, 0xbc, 0x25, 0x1d, 0x9a, 0x3c, 0xcb, 0x58, 0xdd, 
+	0x8a, 0x5d, 0x5, 0x8e, 0xa5, 0x96, 0xaa, 0xfc, 0x90, 0x24, 
+	0xeb, 0xbd, 0x1c, 0xf6, 0x5f, 0x6d, 0x18, 0x67, 0xc0, 0xf5, 
+	0x8, 0x34, 0x8d, 0x5a, 0x9a, 0xd0, 0x68, 0x1b, 0x36, 0x63, 
+	0x76, 0x53, 0x82, 0x36, 0xe0, 0x7a, 0x2f, 0xe, 0xfb, 0x2f, 
+	0x7a, 0xd, 0x79, 0x68, 0x18, 0x4, 0x28, 0x61, 0xc7, 0x3b, 
+	0x7b, 0x61, 0x5d, 0x6d, 0xf5, 0x6d, 0x17, 0xe, 0x77, 0xda, 
+	0x86, 0x10, 0xaf, 0x9a, 0xae, 0x74, 0x61, 0x48, 0x3a, 0x21, 
+	0xd6, 0x3c, 0x42, 0x32, 0x6c, 0x2b, 0xc3, 0x54, 0xbc, 0x58, 
+	0x6, 0x34, 0xdc, 0x59, 0x86, 0x4c, 0x92, 0xa5, 0x32, 0xd6, 
+	0x12, 0x18, 0x9a, 0x8d, 0x36, 0x7b, 0x8a, 0x11, 0x2e, 0x70, 
+	0xce, 0x41, 0x71, 0x5d, 0x29, 0xa0, 0xeb, 0x7d, 0xed, 0xbd, 
+	0x24, 0x6e, 0xc2, 0xf3, 0x72, 0x5, 0x12, 0xea, 0x72, 0x38, 
+	0xc3, 0xc9, 0x1d, 0x41, 0xe, 0x91, 0x9d, 0x5e, 0x83, 0x2d, 
+	0xe, 0xb8, 0xa7, 0x6b, 0x4c, 0x9, 0x2a, 0x4b, 0xbf, 0xee, 
+	0xfb, 0xe5, 0xb5, 0x9f, 0x48, 0x45, 0xeb, 0x3d, 0xd4, 0x73, 
+	0xc1, 0x47, 0x7a, 0x5d, 0x46, 0xd7, 0x38, 0xab, 0x1d, 0xf6, 
+	0x18, 0x7a, 0x93, 0xaa, 0xcc, 0x28, 0x19, 0xe4, 0xe2, 0x68, 
+	0x50, 0x6a, 0x25, 0x8b, 0xf4, 0x88, 0xb8, 0x50, 0x46, 0x7c, 
+	0x2, 0xb8, 0x70, 0xa, 0x3e, 0x6, 0xe6, 0x92, 0x41, 0xb7, 
+	0x51, 0x39, 0x14, 0x95, 0x9e, 0x9e, 0x4e, 0x60, 0x36, 0x23, 
+	0x45, 0x97, 0x13, 0x97, 0x30, 0xe7, 0xc0, 0x31, 0xc2, 0x52, 
+	0x7c, 0x3, 0x97, 0x38, 0xe1, 0x54, 0x43, 0xe9, 0x3a, 0x39, 
+	0x2f, 0x35, 0xf2, 0x25, 0x16, 0x89, 0x80, 0xf8, 0xd0, 0x1a, 
+	0x18, 0xd1, 0xb0, 0x91, 0xfc, 0xc4, 0x35, 0x1c, 0x6f, 0x8a, 
+	0x3c, 0x2d, 0xcf, 0x65, 0xc4, 0x73, 0x30, 0x3f, 0x46, 0x5a, 
+	0x89, 0x22, 0xa5, 0xec, 0xb0, 0x49, 0x34, 0xe8, 0x22, 0x46, 
+	0x5c, 0x65, 0x3b, 0xcf, 0x38, 0x17, 0xa5, 0xd9, 0x7f, 0xa2, 
+	0x28, 0x40, 0xbd, 0xbf, 0x18, 0x9e, 0x7, 0x64, 0x50, 0xe5, 
+	0x47, 0x78, 0xb4, 0xde, 0xad, 0x14, 0x5, 0x25, 0x4, 0xe9, 
+	0x3d, 0xe8, 0x1a, 0xd1, 0x53, 0x2f, 0xab, 0x49, 0x2e, 0x79, 
+	0x4c, 0xeb, 0x15, 0x3a, 0x51, 0x32, 0xc5, 0x35, 0x5a, 0x2e, 
+	0xaf, 0x5e, 0x14, 0xd7, 0x36, 0x1b, 0x5b, 0xb9, 0xee, 0xee, 
+	0x4e, 0x34, 0xf6, 0x8, 0xd0, 0xdc, 0xfe, 0xbf, 0xec, 0x5d, 
+	0x37, 0xb4, 0x2e, 0xe0, 0xc1, 0x31, 0x47, 0xf7, 0x9, 0x78, 
+	0xc, 0xa, 0xc3, 0x70, 0x4f, 0xe1, 0xe7, 0x9b, 0xf2, 0x44, 
+	0x14, 0x5c, 0x4d, 0x9b, 0xa2, 0x43, 0x23, 0x97, 0x85, 0xc9, 
+	0x8b, 0xbb, 0x3c, 0x58, 0xec, 0x7a, 0x1c, 0xa6, 0xaf, 0x99, 
+	0xb2, 0x41, 0xbe, 0xc, 0xcf, 0xdf, 0x6b, 0x3d, 0xf9, 0x4, 
+	0x7f, 0x56, 0x80, 0x4b, 0x96, 0xf9, 0xa8, 0xf0, 0x24, 0xae, 
+	0x7e, 0x4a, 0x3e, 0x7e, 0x18, 0x5d, 0x60, 0xc3, 0x6a, 0xdc, 
+	0xd, 0xe3, 0xac, 0x1a, 0xe7, 0xac, 0xb1, 0x7f, 0x5f, 0xa7, 
+	0x27, 0x5f, 0xe, 0xc, 0x18, 0x73, 0xcc, 0xc4, 0xd, 0xeb, 
+	0xe3, 0xf6, 0x57, 0x23, 0x7b, 0xd8, 0x15, 0x2d, 0xcd, 0x91, 
+	0x7b, 0xe3, 0xe9, 0x8, 0xd1, 0xb4, 0x50, 0x9f, 0x50, 0xdd, 
+	0xd5, 0xfc, 0xcb, 0x2c, 0xae, 0x37, 0x4a, 0xf1, 0xe9, 0x49, 
+	0x95, 0x24, 0x18, 0xfe, 0xce, 0xab, 0xb7, 0x5b, 0xdd, 0xac, 
+	0xc4, 0xea, 0x3f, 0x8b, 0x42, 0xbf, 0xb2, 0x46, 0x34, 0x73, 
+	0x7b, 0x6c, 0xc1, 0xcd, 0x34, 0xe8, 0xf9, 0xe9, 0xa0, 0xf5, 
+	0xf0, 0x53, 0xc3, 0xce, 0xe4, 0x32, 0xbd, 0xe, 0x30, 0x4a, 
+	0x94, 0x71, 0x75, 0x2a, 0x63, 0x78, 0xa3, 0x69, 0xca, 0x7e, 
+	0x7c, 0xfe, 0xf2, 0x25, 0x9b, 0xe3, 0x15, 0x6a, 0x30, 0xc9, 
+	0xc4, 0x79, 0x10, 0x45, 0x2c, 0x1f, 0xbc, 0x93, 0x5c, 0xe2, 
+	0xc6, 0x20, 0x2d, 0x28, 0x52, 0x63, 0x2, 0x9b, 0xd3, 0xe8, 
+	0xe8, 0x65, 0x76, 0xcd, 0xe6, 0x80, 0xa3, 0x64, 0x15, 0xb7, 
+	0x56, 0x41, 0x1b, 0xe7, 0xa1, 0xfc, 0x66, 0x6c, 0x4e, 0x2a, 
+	0x91, 0x63, 0x5b, 0x66, 0xb3, 0x46, 0xfc, 0x1b, 0x84, 0xbf, 
+	0x8, 0xbd, 0x4d, 0xb3, 0x24, 0x63, 0xd8, 0xfb, 0xdb, 0xf6, 
+	0xd6, 0x6d, 0x4a, 0x85, 0xe0, 0xd6, 0x10, 0xc2, 0xe6, 0x65, 
+	0x73, 0x73, 0x15, 0x63, 0xef, 0x51, 0x8d, 0x63, 0xec, 0xd7, 
+	0xa3, 0x6a, 0x8e, 0xa3, 0x3e, 0xa0, 0xd9, 0xc, 0xbf, 0xfd, 
+	0xd8, 0xe3, 0x71, 0xfc, 0xf6, 0x1e, 0xe9, 0x73, 0x8e, 0x34, 
+	0x86, 0xc2, 0x1c, 0xce, 0x82, 0x8f, 0x4f, 0x97, 0xbd, 0x68, 
+	0xef, 0x15, 0x61, 0xee, 0x56, 0x61, 0x64, 0xb3, 0x99, 0xf0, 
+	0x2c, 0x51, 0xe2, 0xe6, 0x12, 0x10, 0x38, 0x46, 0x9a, 0xe7, 
+	0x23, 0x1c, 0x48, 0xa3, 0xb3, 0x3f, 0xfc, 0xba, 0xc5, 0x43, 
+	0xae, 0x33, 0x4f, 0xc9, 0xa, 0xa1, 0xd0, 0xa4, 0x9b, 0xb1, 
+	0x67, 0xfd, 0x5e, 0xaf, 0x26, 0xf9, 0x26, 0xf7, 0xdb, 0x92, 
+	0x1a, 0x1e, 0x41, 0x8c, 0x77, 0x65, 0xda, 0x21, 0x3f, 0x98, 
+	0xd7, 0x44, 0x4d, 0xb6, 0xc2, 0x30, 0x77, 0x5a, 0x6a, 0x1c, 
+	0x56, 0x3c, 0xa1, 0x22, 0x85, 0x27, 0x4a, 0xb0, 0x47, 0x3c, 
+	0x20, 0x63, 0x64, 0x4d, 0x46, 0xc6, 0x24, 0x8, 0x5e, 0x2c, 
+	0xa4, 0xc6, 0xa7, 0x2a, 0x83, 0xe0, 0x39, 0xa6, 0x7f, 0xdc, 
+	0x3d, 0x63, 0xb, 0x8, 0x9f, 0x5b, 0x8, 0x1f, 0xee, 0x48, 
+	0x73, 0x88, 0xff, 0xc5, 0xeb, 0x8c, 0x23, 0xc9, 0x63, 0xf4, 
+	0x9c, 0xcf, 0x2d, 0xf2, 0x55, 0x22, 0xe3, 0xc5, 0xd4, 0xac, 
+	0xcd, 0x3a, 0xd2, 0xf2, 0x4b, 0x69, 0x92, 0xf3, 0xa9, 0x99, 
+	0x90, 0xd5, 0x1b, 0xaf, 0x79, 0x35, 0x11, 0xa3, 0x75, 0xba, 
+	0x65, 0xdc, 0xc5, 0xf5, 0xbe, 0xfc, 0x5c, 0x82, 0x4, 0x23, 
+	0x65, 0xc6, 0xaf, 0xc4, 0x4e, 0xfc, 0xed, 0x8a, 0x38, 0xdf, 
+	0x58, 0x5a, 0xc4, 0xdf, 0xf2, 0xdc, 0x22, 0xc3, 0xe7, 0xbd, 
+	0x25, 0x1a, 0x20, 0x9a, 0xe6, 0x51, 0xc8, 0xb7, 0x3f, 0xa, 
+	0xa3, 0x96, 0xfe, 0x96, 0x7b, 0xb8, 0x54, 0xc6, 0xd4, 0x3e, 
+	0x3b, 0x71, 0x88, 0xb9, 0x46, 0xb7, 0xee, 0x95, 0x97, 0xd2, 
+	0x8, 0x47, 0x8a, 0x1d, 0xef, 0x75, 0x59, 0x7b, 0x7f, 0xfc, 
+	0xb, 0xa4, 0xd, 0x91, 0x62, 0x44, 0x5c, 0x82, 0xd2, 0x9f, 
+	0xe4, 0x3, 0x3d, 0xe8, 0xb7, 0xcb, 0x30, 0x6d, 0xa4, 0xa7, 
+	0x90, 0xe7, 0xb4, 0xd7, 0x4e, 0xfd, 0x22, 0x6a, 0x84, 0x64, 
+	0xd0, 0x70, 0x81, 0xcf, 0x91, 0x5f, 0x31, 0x33, 0xe, 0x83, 
+	0x1f, 0x36, 0x67, 0x75, 0x9a, 0xe1, 0x28, 0xe1, 0x4b, 0xd6, 
+	0x5f, 0x8b, 0xd1, 0x37, 0x26, 0x4b, 0xbd, 0xb9, 0x1c, 0x70, 
+	0x27, 0xc3, 0xf6, 0x6, 0xfb, 0xb7, 0xfc, 0x9e, 0x97, 0x91, 
+	0x12, 0x13, 0x7d, 0x78, 0x2f, 0x45, 0x6c, 0xb2, 0xed, 0x3b, 
+	0xb2, 0x88, 0xcc, 0x53, 0x2f, 0xd8, 0x5f, 0x1c, 0xdb, 0x15, 
+	0xb1, 0xcf, 0x99, 0x2b, 0x4, 0xbe, 0x7f, 0xf4, 0x11, 0xa5, 
+	0x83, 0x2e, 0x3f, 0xba, 0x26, 0x73, 0xfb, 0x20, 0xf6, 0xff, 
+	0x2, 0xe9, 0x88, 0x74, 0x92, 0xf8, 0xb, 00, 00, 0};
+
+static const char headers_functions_js[] = "Content-Type: application/javascript\r\nContent-Encoding: gzip\r\nETag: \"0971f80e58e70d55\"\r\nLast-Modified: Mon, 15 Jun 2020 18:06:39 GMT\r\nCache-Control: no-cache\r\n\r\n";
+static const char etag_functions_js[] = "\"0971f80e58e70d55\"";
+static const char modified_functions_js[] = "Mon, 15 Jun 2020 18:06:39 GMT";
 
 static const unsigned char data_404_html[] = {
 	/* /404.html */
 	0x2f, 0x34, 0x30, 0x34, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
-	0x3c, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0xa, 0x20, 0x20, 0x3c, 
-	0x62, 0x6f, 0x64, 0x79, 0x20, 0x62, 0x67, 0x63, 0x6f, 0x6c, 
-	0x6f, 0x72, 0x3d, 0x22, 0x77, 0x68, 0x69, 0x74, 0x65, 0x22, 
-	0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x63, 0x65, 0x6e, 
-	0x74, 0x65, 0x72, 0x3e, 0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 
-	0x20, 0x3c, 0x68, 0x31, 0x3e, 0x34, 0x30, 0x34, 0x20, 0x2d, 
-	0x20, 0x66, 0x69, 0x6c, 0x65, 0x20, 0x6e, 0x6f, 0x74, 0x20, 
-	0x66, 0x6f, 0x75, 0x6e, 0x64, 0x3c, 0x2f, 0x68, 0x31, 0x3e, 
-	0xa, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x68, 0x33, 
-	0x3e, 0x47, 0x6f, 0x20, 0x3c, 0x61, 0x20, 0x68, 0x72, 0x65, 
-	0x66, 0x3d, 0x22, 0x2f, 0x22, 0x3e, 0x68, 0x65, 0x72, 0x65, 
-	0x3c, 0x2f, 0x61, 0x3e, 0x20, 0x69, 0x6e, 0x73, 0x74, 0x65, 
-	0x61, 0x64, 0x2e, 0x3c, 0x2f, 0x68, 0x33, 0x3e, 0xa, 0x20, 
-	0x20, 0x20, 0x20, 0x3c, 0x2f, 0x63, 0x65, 0x6e, 0x74, 0x65, 
-	0x72, 0x3e, 0xa, 0x20, 0x20, 0x3c, 0x2f, 0x62, 0x6f, 0x64, 
-	0x79, 0x3e, 0xa, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 
-	0xa, 0};
+	0x1f, 0x8b, 0x8, 00, 00, 00, 00, 00, 00, 0xff, 
+	0x45, 0x8e, 0x41, 0xe, 0xc2, 0x30, 0xc, 0x4, 0xef, 0x7d, 
+	0x85, 0x95, 0x3b, 0x4, 0xd4, 0x1e, 0x5d, 0x5f, 0x79, 0x47, 
+	0xda, 0x38, 0x38, 0x52, 0x88, 0xa5, 0x60, 0x54, 0xf1, 0x7b, 
+	0x52, 0x40, 0x70, 0x1c, 0xcd, 0x48, 0xbb, 0x28, 0x76, 0x2b, 
+	0x34, 00, 0xe0, 0xa2, 0xf1, 0x9, 0xcb, 0x75, 0xd5, 0xa2, 
+	0x6d, 0x76, 0x9b, 0x64, 0x63, 0xb7, 0x8b, 0xae, 0x56, 0xae, 
+	0xc6, 0xed, 0x3, 0x1d, 0xe5, 0x4c, 0xd3, 0x69, 0x82, 0x3, 
+	0xa4, 0x5c, 0x18, 0xaa, 0x1a, 0x24, 0x7d, 0xd4, 0x88, 0xbe, 
+	0x8b, 0x5f, 0x33, 0xd2, 0x45, 0x1, 0x3, 0x48, 0xe3, 0x34, 
+	0x3b, 0xef, 0x48, 0xb8, 0x31, 0xfa, 0x40, 0x90, 0xeb, 0xdd, 
+	0x38, 0xc4, 0x63, 0xef, 0xc7, 0xef, 0x80, 0xff, 0x2f, 0xa0, 
+	0xdf, 0x8f, 0xd0, 0xd0, 0xed, 0xfb, 0xd9, 0xb, 0x96, 0x6d, 
+	0x7f, 0xc7, 0xa1, 00, 00, 00, 0};
 
-static const unsigned char data_functions_js[] = {
-	/* /functions.js */
-	0x2f, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x2e, 0x6a, 0x73, 0,
-	0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x72, 
-	0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x28, 
-	0x64, 0x2c, 0x62, 0x29, 0x7b, 0x76, 0x61, 0x72, 0x20, 0x61, 
-	0x3d, 0x24, 0x28, 0x22, 0x23, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 
-	0x6e, 0x64, 0x46, 0x6f, 0x72, 0x6d, 0x22, 0x29, 0x3b, 0x64, 
-	0x2b, 0x3d, 0x22, 0x5c, 0x6e, 0x22, 0x3b, 0x75, 0x72, 0x6c, 
-	0x3d, 0x62, 0x3f, 0x22, 0x2f, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 
-	0x6e, 0x64, 0x5f, 0x73, 0x69, 0x6c, 0x65, 0x6e, 0x74, 0x22, 
-	0x3a, 0x22, 0x2f, 0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x22, 0x3b, 0x76, 0x61, 0x72, 0x20, 0x63, 0x3d, 0x24, 0x2e, 
-	0x70, 0x6f, 0x73, 0x74, 0x28, 0x75, 0x72, 0x6c, 0x2c, 0x64, 
-	0x29, 0x3b, 0x69, 0x66, 0x28, 0x21, 0x62, 0x29, 0x7b, 0x63, 
-	0x2e, 0x64, 0x6f, 0x6e, 0x65, 0x28, 0x66, 0x75, 0x6e, 0x63, 
-	0x74, 0x69, 0x6f, 0x6e, 0x28, 0x65, 0x29, 0x7b, 0x24, 0x28, 
-	0x22, 0x23, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x22, 0x29, 
-	0x2e, 0x65, 0x6d, 0x70, 0x74, 0x79, 0x28, 0x29, 0x3b, 0x24, 
-	0x2e, 0x65, 0x61, 0x63, 0x68, 0x28, 0x65, 0x2e, 0x73, 0x70, 
-	0x6c, 0x69, 0x74, 0x28, 0x22, 0x5c, 0x6e, 0x22, 0x29, 0x2c, 
-	0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x66, 
-	0x29, 0x7b, 0x24, 0x28, 0x22, 0x23, 0x72, 0x65, 0x73, 0x75, 
-	0x6c, 0x74, 0x22, 0x29, 0x2e, 0x61, 0x70, 0x70, 0x65, 0x6e, 
-	0x64, 0x28, 0x74, 0x68, 0x69, 0x73, 0x2b, 0x22, 0x3c, 0x62, 
-	0x72, 0x2f, 0x3e, 0x22, 0x29, 0x7d, 0x29, 0x7d, 0x29, 0x7d, 
-	0x7d, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 
-	0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x53, 0x69, 0x6c, 0x65, 0x6e, 0x74, 0x28, 0x61, 0x29, 0x7b, 
-	0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x28, 0x61, 0x2c, 0x74, 0x72, 0x75, 0x65, 0x29, 0x7d, 0x66, 
-	0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x72, 0x75, 
-	0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x43, 0x61, 
-	0x6c, 0x6c, 0x62, 0x61, 0x63, 0x6b, 0x28, 0x63, 0x2c, 0x64, 
-	0x29, 0x7b, 0x76, 0x61, 0x72, 0x20, 0x62, 0x3d, 0x22, 0x2f, 
-	0x63, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x22, 0x3b, 0x63, 
-	0x2b, 0x3d, 0x22, 0x5c, 0x6e, 0x22, 0x3b, 0x76, 0x61, 0x72, 
-	0x20, 0x61, 0x3d, 0x24, 0x2e, 0x70, 0x6f, 0x73, 0x74, 0x28, 
-	0x62, 0x2c, 0x63, 0x2c, 0x64, 0x29, 0x7d, 0x66, 0x75, 0x6e, 
-	0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x6a, 0x6f, 0x67, 0x58, 
-	0x59, 0x43, 0x6c, 0x69, 0x63, 0x6b, 0x28, 0x61, 0x29, 0x7b, 
-	0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x28, 0x22, 0x47, 0x39, 0x31, 0x20, 0x47, 0x30, 0x20, 0x22, 
-	0x2b, 0x61, 0x2b, 0x22, 0x20, 0x46, 0x22, 0x2b, 0x64, 0x6f, 
-	0x63, 0x75, 0x6d, 0x65, 0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 
-	0x45, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 
-	0x64, 0x28, 0x22, 0x78, 0x79, 0x5f, 0x76, 0x65, 0x6c, 0x6f, 
-	0x63, 0x69, 0x74, 0x79, 0x22, 0x29, 0x2e, 0x76, 0x61, 0x6c, 
-	0x75, 0x65, 0x2b, 0x22, 0x20, 0x47, 0x39, 0x30, 0x22, 0x2c, 
-	0x74, 0x72, 0x75, 0x65, 0x29, 0x7d, 0x66, 0x75, 0x6e, 0x63, 
-	0x74, 0x69, 0x6f, 0x6e, 0x20, 0x6a, 0x6f, 0x67, 0x5a, 0x43, 
-	0x6c, 0x69, 0x63, 0x6b, 0x28, 0x61, 0x29, 0x7b, 0x72, 0x75, 
-	0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x28, 0x22, 
-	0x47, 0x39, 0x31, 0x20, 0x47, 0x30, 0x20, 0x22, 0x2b, 0x61, 
-	0x2b, 0x22, 0x20, 0x46, 0x22, 0x2b, 0x64, 0x6f, 0x63, 0x75, 
-	0x6d, 0x65, 0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 
-	0x65, 0x6d, 0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 
-	0x22, 0x7a, 0x5f, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
-	0x79, 0x22, 0x29, 0x2e, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2b, 
-	0x22, 0x20, 0x47, 0x39, 0x30, 0x22, 0x2c, 0x74, 0x72, 0x75, 
-	0x65, 0x29, 0x7d, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 
-	0x6e, 0x20, 0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 0x28, 
-	0x67, 0x2c, 0x64, 0x2c, 0x63, 0x29, 0x7b, 0x76, 0x61, 0x72, 
-	0x20, 0x66, 0x3d, 0x64, 0x6f, 0x63, 0x75, 0x6d, 0x65, 0x6e, 
-	0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 0x6d, 0x65, 
-	0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 0x22, 0x65, 0x78, 
-	0x74, 0x72, 0x75, 0x64, 0x65, 0x5f, 0x6c, 0x65, 0x6e, 0x67, 
-	0x74, 0x68, 0x22, 0x29, 0x2e, 0x76, 0x61, 0x6c, 0x75, 0x65, 
-	0x3b, 0x76, 0x61, 0x72, 0x20, 0x65, 0x3d, 0x64, 0x6f, 0x63, 
-	0x75, 0x6d, 0x65, 0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 
-	0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 
-	0x28, 0x22, 0x65, 0x78, 0x74, 0x72, 0x75, 0x64, 0x65, 0x5f, 
-	0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x22, 0x29, 
-	0x2e, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3b, 0x76, 0x61, 0x72, 
-	0x20, 0x68, 0x3d, 0x28, 0x67, 0x2e, 0x63, 0x75, 0x72, 0x72, 
-	0x65, 0x6e, 0x74, 0x54, 0x61, 0x72, 0x67, 0x65, 0x74, 0x2e, 
-	0x69, 0x64, 0x3d, 0x3d, 0x22, 0x65, 0x78, 0x74, 0x72, 0x75, 
-	0x64, 0x65, 0x22, 0x29, 0x3f, 0x31, 0x3a, 0x2d, 0x31, 0x3b, 
-	0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x28, 0x22, 0x47, 0x39, 0x31, 0x20, 0x47, 0x30, 0x20, 0x45, 
-	0x22, 0x2b, 0x28, 0x66, 0x2a, 0x68, 0x29, 0x2b, 0x22, 0x20, 
-	0x46, 0x22, 0x2b, 0x65, 0x2b, 0x22, 0x20, 0x47, 0x39, 0x30, 
-	0x22, 0x2c, 0x74, 0x72, 0x75, 0x65, 0x29, 0x7d, 0x66, 0x75, 
-	0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x6d, 0x6f, 0x74, 
-	0x6f, 0x72, 0x73, 0x4f, 0x66, 0x66, 0x28, 0x61, 0x29, 0x7b, 
-	0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 
-	0x28, 0x22, 0x4d, 0x31, 0x38, 0x22, 0x2c, 0x74, 0x72, 0x75, 
-	0x65, 0x29, 0x7d, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 
-	0x6e, 0x20, 0x68, 0x65, 0x61, 0x74, 0x53, 0x65, 0x74, 0x28, 
-	0x63, 0x29, 0x7b, 0x76, 0x61, 0x72, 0x20, 0x62, 0x3d, 0x28, 
-	0x63, 0x2e, 0x63, 0x75, 0x72, 0x72, 0x65, 0x6e, 0x74, 0x54, 
-	0x61, 0x72, 0x67, 0x65, 0x74, 0x2e, 0x69, 0x64, 0x3d, 0x3d, 
-	0x22, 0x68, 0x65, 0x61, 0x74, 0x5f, 0x73, 0x65, 0x74, 0x22, 
-	0x29, 0x3f, 0x31, 0x30, 0x34, 0x3a, 0x31, 0x34, 0x30, 0x3b, 
-	0x76, 0x61, 0x72, 0x20, 0x61, 0x3d, 0x28, 0x62, 0x3d, 0x3d, 
-	0x31, 0x30, 0x34, 0x29, 0x3f, 0x64, 0x6f, 0x63, 0x75, 0x6d, 
-	0x65, 0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 
-	0x6d, 0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 0x22, 
-	0x68, 0x65, 0x61, 0x74, 0x5f, 0x76, 0x61, 0x6c, 0x75, 0x65, 
-	0x22, 0x29, 0x2e, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3a, 0x64, 
-	0x6f, 0x63, 0x75, 0x6d, 0x65, 0x6e, 0x74, 0x2e, 0x67, 0x65, 
-	0x74, 0x45, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x42, 0x79, 
-	0x49, 0x64, 0x28, 0x22, 0x62, 0x65, 0x64, 0x5f, 0x76, 0x61, 
-	0x6c, 0x75, 0x65, 0x22, 0x29, 0x2e, 0x76, 0x61, 0x6c, 0x75, 
-	0x65, 0x3b, 0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 
-	0x6e, 0x64, 0x28, 0x22, 0x4d, 0x22, 0x2b, 0x62, 0x2b, 0x22, 
-	0x20, 0x53, 0x22, 0x2b, 0x61, 0x2c, 0x74, 0x72, 0x75, 0x65, 
-	0x29, 0x7d, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
-	0x20, 0x68, 0x65, 0x61, 0x74, 0x4f, 0x66, 0x66, 0x28, 0x62, 
-	0x29, 0x7b, 0x76, 0x61, 0x72, 0x20, 0x61, 0x3d, 0x28, 0x62, 
-	0x2e, 0x63, 0x75, 0x72, 0x72, 0x65, 0x6e, 0x74, 0x54, 0x61, 
-	0x72, 0x67, 0x65, 0x74, 0x2e, 0x69, 0x64, 0x3d, 0x3d, 0x22, 
-	0x68, 0x65, 0x61, 0x74, 0x5f, 0x6f, 0x66, 0x66, 0x22, 0x29, 
-	0x3f, 0x31, 0x30, 0x34, 0x3a, 0x31, 0x34, 0x30, 0x3b, 0x72, 
-	0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x28, 
-	0x22, 0x4d, 0x22, 0x2b, 0x61, 0x2b, 0x22, 0x20, 0x53, 0x30, 
-	0x22, 0x2c, 0x74, 0x72, 0x75, 0x65, 0x29, 0x7d, 0x66, 0x75, 
-	0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x67, 0x65, 0x74, 
-	0x54, 0x65, 0x6d, 0x70, 0x65, 0x72, 0x61, 0x74, 0x75, 0x72, 
-	0x65, 0x28, 0x29, 0x7b, 0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 
-	0x6d, 0x61, 0x6e, 0x64, 0x28, 0x22, 0x4d, 0x31, 0x30, 0x35, 
-	0x22, 0x2c, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x29, 0x7d, 0x66, 
-	0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x68, 0x61, 
-	0x6e, 0x64, 0x6c, 0x65, 0x46, 0x69, 0x6c, 0x65, 0x53, 0x65, 
-	0x6c, 0x65, 0x63, 0x74, 0x28, 0x61, 0x29, 0x7b, 0x76, 0x61, 
-	0x72, 0x20, 0x64, 0x3d, 0x61, 0x2e, 0x74, 0x61, 0x72, 0x67, 
-	0x65, 0x74, 0x2e, 0x66, 0x69, 0x6c, 0x65, 0x73, 0x3b, 0x76, 
-	0x61, 0x72, 0x20, 0x62, 0x3d, 0x5b, 0x5d, 0x3b, 0x66, 0x6f, 
-	0x72, 0x28, 0x76, 0x61, 0x72, 0x20, 0x63, 0x3d, 0x30, 0x2c, 
-	0x65, 0x3b, 0x65, 0x3d, 0x64, 0x5b, 0x63, 0x5d, 0x3b, 0x63, 
-	0x2b, 0x2b, 0x29, 0x7b, 0x62, 0x2e, 0x70, 0x75, 0x73, 0x68, 
-	0x28, 0x22, 0x3c, 0x6c, 0x69, 0x3e, 0x3c, 0x73, 0x74, 0x72, 
-	0x6f, 0x6e, 0x67, 0x3e, 0x22, 0x2c, 0x65, 0x73, 0x63, 0x61, 
-	0x70, 0x65, 0x28, 0x65, 0x2e, 0x6e, 0x61, 0x6d, 0x65, 0x29, 
-	0x2c, 0x22, 0x3c, 0x2f, 0x73, 0x74, 0x72, 0x6f, 0x6e, 0x67, 
-	0x3e, 0x20, 0x28, 0x22, 0x2c, 0x65, 0x2e, 0x74, 0x79, 0x70, 
-	0x65, 0x7c, 0x7c, 0x22, 0x6e, 0x2f, 0x61, 0x22, 0x2c, 0x22, 
-	0x29, 0x20, 0x2d, 0x20, 0x22, 0x2c, 0x65, 0x2e, 0x73, 0x69, 
-	0x7a, 0x65, 0x2c, 0x22, 0x20, 0x62, 0x79, 0x74, 0x65, 0x73, 
-	0x2c, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x20, 0x6d, 0x6f, 0x64, 
-	0x69, 0x66, 0x69, 0x65, 0x64, 0x3a, 0x20, 0x22, 0x2c, 0x65, 
-	0x2e, 0x6c, 0x61, 0x73, 0x74, 0x4d, 0x6f, 0x64, 0x69, 0x66, 
-	0x69, 0x65, 0x64, 0x44, 0x61, 0x74, 0x65, 0x3f, 0x65, 0x2e, 
-	0x6c, 0x61, 0x73, 0x74, 0x4d, 0x6f, 0x64, 0x69, 0x66, 0x69, 
-	0x65, 0x64, 0x44, 0x61, 0x74, 0x65, 0x2e, 0x74, 0x6f, 0x4c, 
-	0x6f, 0x63, 0x61, 0x6c, 0x65, 0x44, 0x61, 0x74, 0x65, 0x53, 
-	0x74, 0x72, 0x69, 0x6e, 0x67, 0x28, 0x29, 0x3a, 0x22, 0x6e, 
-	0x2f, 0x61, 0x22, 0x2c, 0x22, 0x3c, 0x2f, 0x6c, 0x69, 0x3e, 
-	0x22, 0x29, 0x7d, 0x64, 0x6f, 0x63, 0x75, 0x6d, 0x65, 0x6e, 
-	0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 0x6d, 0x65, 
-	0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 0x22, 0x6c, 0x69, 
-	0x73, 0x74, 0x22, 0x29, 0x2e, 0x69, 0x6e, 0x6e, 0x65, 0x72, 
-	0x48, 0x54, 0x4d, 0x4c, 0x3d, 0x22, 0x3c, 0x75, 0x6c, 0x3e, 
-	0x22, 0x2b, 0x62, 0x2e, 0x6a, 0x6f, 0x69, 0x6e, 0x28, 0x22, 
-	0x22, 0x29, 0x2b, 0x22, 0x3c, 0x2f, 0x75, 0x6c, 0x3e, 0x22, 
-	0x7d, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 
-	0x75, 0x70, 0x6c, 0x6f, 0x61, 0x64, 0x28, 0x29, 0x7b, 0x24, 
-	0x28, 0x22, 0x23, 0x70, 0x72, 0x6f, 0x67, 0x72, 0x65, 0x73, 
-	0x73, 0x22, 0x29, 0x2e, 0x65, 0x6d, 0x70, 0x74, 0x79, 0x28, 
-	0x29, 0x3b, 0x24, 0x28, 0x22, 0x23, 0x75, 0x70, 0x6c, 0x6f, 
-	0x61, 0x64, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x22, 0x29, 
-	0x2e, 0x65, 0x6d, 0x70, 0x74, 0x79, 0x28, 0x29, 0x3b, 0x76, 
-	0x61, 0x72, 0x20, 0x62, 0x3d, 0x64, 0x6f, 0x63, 0x75, 0x6d, 
-	0x65, 0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 
-	0x6d, 0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 0x22, 
-	0x66, 0x69, 0x6c, 0x65, 0x73, 0x22, 0x29, 0x2e, 0x66, 0x69, 
-	0x6c, 0x65, 0x73, 0x5b, 0x30, 0x5d, 0x3b, 0x76, 0x61, 0x72, 
-	0x20, 0x61, 0x3d, 0x6e, 0x65, 0x77, 0x20, 0x46, 0x69, 0x6c, 
-	0x65, 0x52, 0x65, 0x61, 0x64, 0x65, 0x72, 0x28, 0x29, 0x3b, 
-	0x61, 0x2e, 0x72, 0x65, 0x61, 0x64, 0x41, 0x73, 0x42, 0x69, 
-	0x6e, 0x61, 0x72, 0x79, 0x53, 0x74, 0x72, 0x69, 0x6e, 0x67, 
-	0x28, 0x62, 0x29, 0x3b, 0x61, 0x2e, 0x6f, 0x6e, 0x6c, 0x6f, 
-	0x61, 0x64, 0x65, 0x6e, 0x64, 0x3d, 0x66, 0x75, 0x6e, 0x63, 
-	0x74, 0x69, 0x6f, 0x6e, 0x28, 0x63, 0x29, 0x7b, 0x78, 0x68, 
-	0x72, 0x3d, 0x6e, 0x65, 0x77, 0x20, 0x58, 0x4d, 0x4c, 0x48, 
-	0x74, 0x74, 0x70, 0x52, 0x65, 0x71, 0x75, 0x65, 0x73, 0x74, 
-	0x28, 0x29, 0x3b, 0x78, 0x68, 0x72, 0x2e, 0x6f, 0x70, 0x65, 
-	0x6e, 0x28, 0x22, 0x50, 0x4f, 0x53, 0x54, 0x22, 0x2c, 0x22, 
-	0x75, 0x70, 0x6c, 0x6f, 0x61, 0x64, 0x22, 0x2c, 0x74, 0x72, 
-	0x75, 0x65, 0x29, 0x3b, 0x78, 0x68, 0x72, 0x2e, 0x73, 0x65, 
-	0x74, 0x52, 0x65, 0x71, 0x75, 0x65, 0x73, 0x74, 0x48, 0x65, 
-	0x61, 0x64, 0x65, 0x72, 0x28, 0x22, 0x58, 0x2d, 0x46, 0x69, 
-	0x6c, 0x65, 0x6e, 0x61, 0x6d, 0x65, 0x22, 0x2c, 0x62, 0x2e, 
-	0x6e, 0x61, 0x6d, 0x65, 0x29, 0x3b, 0x58, 0x4d, 0x4c, 0x48, 
-	0x74, 0x74, 0x70, 0x52, 0x65, 0x71, 0x75, 0x65, 0x73, 0x74, 
-	0x2e, 0x70, 0x72, 0x6f, 0x74, 0x6f, 0x74, 0x79, 0x70, 0x65, 
-	0x2e, 0x6d, 0x79, 0x53, 0x65, 0x6e, 0x64, 0x41, 0x73, 0x42, 
-	0x69, 0x6e, 0x61, 0x72, 0x79, 0x3d, 0x66, 0x75, 0x6e, 0x63, 
-	0x74, 0x69, 0x6f, 0x6e, 0x28, 0x6b, 0x29, 0x7b, 0x76, 0x61, 
-	0x72, 0x20, 0x68, 0x3d, 0x6e, 0x65, 0x77, 0x20, 0x41, 0x72, 
-	0x72, 0x61, 0x79, 0x42, 0x75, 0x66, 0x66, 0x65, 0x72, 0x28, 
-	0x6b, 0x2e, 0x6c, 0x65, 0x6e, 0x67, 0x74, 0x68, 0x29, 0x3b, 
-	0x76, 0x61, 0x72, 0x20, 0x66, 0x3d, 0x6e, 0x65, 0x77, 0x20, 
-	0x55, 0x69, 0x6e, 0x74, 0x38, 0x41, 0x72, 0x72, 0x61, 0x79, 
-	0x28, 0x68, 0x2c, 0x30, 0x29, 0x3b, 0x66, 0x6f, 0x72, 0x28, 
-	0x76, 0x61, 0x72, 0x20, 0x67, 0x3d, 0x30, 0x3b, 0x67, 0x3c, 
-	0x6b, 0x2e, 0x6c, 0x65, 0x6e, 0x67, 0x74, 0x68, 0x3b, 0x67, 
-	0x2b, 0x2b, 0x29, 0x7b, 0x66, 0x5b, 0x67, 0x5d, 0x3d, 0x28, 
-	0x6b, 0x2e, 0x63, 0x68, 0x61, 0x72, 0x43, 0x6f, 0x64, 0x65, 
-	0x41, 0x74, 0x28, 0x67, 0x29, 0x26, 0x32, 0x35, 0x35, 0x29, 
-	0x7d, 0x69, 0x66, 0x28, 0x74, 0x79, 0x70, 0x65, 0x6f, 0x66, 
-	0x20, 0x77, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x2e, 0x42, 0x6c, 
-	0x6f, 0x62, 0x3d, 0x3d, 0x22, 0x66, 0x75, 0x6e, 0x63, 0x74, 
-	0x69, 0x6f, 0x6e, 0x22, 0x29, 0x7b, 0x76, 0x61, 0x72, 0x20, 
-	0x65, 0x3d, 0x6e, 0x65, 0x77, 0x20, 0x42, 0x6c, 0x6f, 0x62, 
-	0x28, 0x5b, 0x68, 0x5d, 0x29, 0x7d, 0x65, 0x6c, 0x73, 0x65, 
-	0x7b, 0x76, 0x61, 0x72, 0x20, 0x6a, 0x3d, 0x6e, 0x65, 0x77, 
-	0x20, 0x28, 0x77, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x2e, 0x4d, 
-	0x6f, 0x7a, 0x42, 0x6c, 0x6f, 0x62, 0x42, 0x75, 0x69, 0x6c, 
-	0x64, 0x65, 0x72, 0x7c, 0x7c, 0x77, 0x69, 0x6e, 0x64, 0x6f, 
-	0x77, 0x2e, 0x57, 0x65, 0x62, 0x4b, 0x69, 0x74, 0x42, 0x6c, 
-	0x6f, 0x62, 0x42, 0x75, 0x69, 0x6c, 0x64, 0x65, 0x72, 0x7c, 
-	0x7c, 0x77, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x2e, 0x42, 0x6c, 
-	0x6f, 0x62, 0x42, 0x75, 0x69, 0x6c, 0x64, 0x65, 0x72, 0x29, 
-	0x28, 0x29, 0x3b, 0x6a, 0x2e, 0x61, 0x70, 0x70, 0x65, 0x6e, 
-	0x64, 0x28, 0x68, 0x29, 0x3b, 0x76, 0x61, 0x72, 0x20, 0x65, 
-	0x3d, 0x6a, 0x2e, 0x67, 0x65, 0x74, 0x42, 0x6c, 0x6f, 0x62, 
-	0x28, 0x29, 0x7d, 0x74, 0x68, 0x69, 0x73, 0x2e, 0x73, 0x65, 
-	0x6e, 0x64, 0x28, 0x65, 0x29, 0x7d, 0x3b, 0x76, 0x61, 0x72, 
-	0x20, 0x64, 0x3d, 0x78, 0x68, 0x72, 0x2e, 0x75, 0x70, 0x6c, 
-	0x6f, 0x61, 0x64, 0x7c, 0x7c, 0x78, 0x68, 0x72, 0x3b, 0x64, 
-	0x2e, 0x61, 0x64, 0x64, 0x45, 0x76, 0x65, 0x6e, 0x74, 0x4c, 
-	0x69, 0x73, 0x74, 0x65, 0x6e, 0x65, 0x72, 0x28, 0x22, 0x70, 
-	0x72, 0x6f, 0x67, 0x72, 0x65, 0x73, 0x73, 0x22, 0x2c, 0x66, 
-	0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x69, 0x29, 
-	0x7b, 0x76, 0x61, 0x72, 0x20, 0x66, 0x3d, 0x69, 0x2e, 0x70, 
-	0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x7c, 0x7c, 0x69, 
-	0x2e, 0x6c, 0x6f, 0x61, 0x64, 0x65, 0x64, 0x3b, 0x76, 0x61, 
-	0x72, 0x20, 0x68, 0x3d, 0x69, 0x2e, 0x74, 0x6f, 0x74, 0x61, 
-	0x6c, 0x53, 0x69, 0x7a, 0x65, 0x7c, 0x7c, 0x69, 0x2e, 0x74, 
-	0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x76, 0x61, 0x72, 0x20, 0x67, 
-	0x3d, 0x4d, 0x61, 0x74, 0x68, 0x2e, 0x72, 0x6f, 0x75, 0x6e, 
-	0x64, 0x28, 0x28, 0x66, 0x2f, 0x68, 0x29, 0x2a, 0x31, 0x30, 
-	0x30, 0x29, 0x3b, 0x24, 0x28, 0x22, 0x23, 0x70, 0x72, 0x6f, 
-	0x67, 0x72, 0x65, 0x73, 0x73, 0x22, 0x29, 0x2e, 0x65, 0x6d, 
-	0x70, 0x74, 0x79, 0x28, 0x29, 0x2e, 0x61, 0x70, 0x70, 0x65, 
-	0x6e, 0x64, 0x28, 0x22, 0x75, 0x70, 0x6c, 0x6f, 0x61, 0x64, 
-	0x65, 0x64, 0x20, 0x22, 0x2b, 0x67, 0x2b, 0x22, 0x25, 0x22, 
-	0x29, 0x7d, 0x29, 0x3b, 0x78, 0x68, 0x72, 0x2e, 0x6f, 0x6e, 
-	0x72, 0x65, 0x61, 0x64, 0x79, 0x73, 0x74, 0x61, 0x74, 0x65, 
-	0x63, 0x68, 0x61, 0x6e, 0x67, 0x65, 0x3d, 0x66, 0x75, 0x6e, 
-	0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x29, 0x7b, 0x69, 0x66, 
-	0x28, 0x78, 0x68, 0x72, 0x2e, 0x72, 0x65, 0x61, 0x64, 0x79, 
-	0x53, 0x74, 0x61, 0x74, 0x65, 0x3d, 0x3d, 0x34, 0x29, 0x7b, 
-	0x69, 0x66, 0x28, 0x78, 0x68, 0x72, 0x2e, 0x73, 0x74, 0x61, 
-	0x74, 0x75, 0x73, 0x3d, 0x3d, 0x32, 0x30, 0x30, 0x29, 0x7b, 
-	0x24, 0x28, 0x22, 0x23, 0x75, 0x70, 0x6c, 0x6f, 0x61, 0x64, 
-	0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x22, 0x29, 0x2e, 0x65, 
-	0x6d, 0x70, 0x74, 0x79, 0x28, 0x29, 0x2e, 0x61, 0x70, 0x70, 
-	0x65, 0x6e, 0x64, 0x28, 0x22, 0x55, 0x70, 0x6c, 0x6f, 0x61, 
-	0x64, 0x65, 0x64, 0x20, 0x4f, 0x6b, 0x22, 0x29, 0x7d, 0x65, 
-	0x6c, 0x73, 0x65, 0x7b, 0x24, 0x28, 0x22, 0x23, 0x75, 0x70, 
-	0x6c, 0x6f, 0x61, 0x64, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 
-	0x22, 0x29, 0x2e, 0x65, 0x6d, 0x70, 0x74, 0x79, 0x28, 0x29, 
-	0x2e, 0x61, 0x70, 0x70, 0x65, 0x6e, 0x64, 0x28, 0x22, 0x55, 
-	0x70, 0x6c, 0x6f, 0x61, 0x64, 0x65, 0x64, 0x20, 0x46, 0x61, 
-	0x69, 0x6c, 0x65, 0x64, 0x22, 0x29, 0x7d, 0x7d, 0x7d, 0x3b, 
-	0x78, 0x68, 0x72, 0x2e, 0x6d, 0x79, 0x53, 0x65, 0x6e, 0x64, 
-	0x41, 0x73, 0x42, 0x69, 0x6e, 0x61, 0x72, 0x79, 0x28, 0x63, 
-	0x2e, 0x74, 0x61, 0x72, 0x67, 0x65, 0x74, 0x2e, 0x72, 0x65, 
-	0x73, 0x75, 0x6c, 0x74, 0x29, 0x7d, 0x7d, 0x66, 0x75, 0x6e, 
-	0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x70, 0x6c, 0x61, 0x79, 
-	0x46, 0x69, 0x6c, 0x65, 0x28, 0x61, 0x29, 0x7b, 0x72, 0x75, 
-	0x6e, 0x43, 0x6f, 0x6d, 0x6d, 0x61, 0x6e, 0x64, 0x53, 0x69, 
-	0x6c, 0x65, 0x6e, 0x74, 0x28, 0x22, 0x70, 0x6c, 0x61, 0x79, 
-	0x20, 0x2f, 0x73, 0x64, 0x2f, 0x22, 0x2b, 0x61, 0x29, 0x7d, 
-	0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x72, 
-	0x65, 0x66, 0x72, 0x65, 0x73, 0x68, 0x46, 0x69, 0x6c, 0x65, 
-	0x73, 0x28, 0x29, 0x7b, 0x64, 0x6f, 0x63, 0x75, 0x6d, 0x65, 
-	0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 0x6d, 
-	0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 0x22, 0x66, 
-	0x69, 0x6c, 0x65, 0x4c, 0x69, 0x73, 0x74, 0x22, 0x29, 0x2e, 
-	0x69, 0x6e, 0x6e, 0x65, 0x72, 0x48, 0x54, 0x4d, 0x4c, 0x3d, 
-	0x22, 0x22, 0x3b, 0x72, 0x75, 0x6e, 0x43, 0x6f, 0x6d, 0x6d, 
-	0x61, 0x6e, 0x64, 0x43, 0x61, 0x6c, 0x6c, 0x62, 0x61, 0x63, 
-	0x6b, 0x28, 0x22, 0x4d, 0x32, 0x30, 0x22, 0x2c, 0x66, 0x75, 
-	0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x61, 0x29, 0x7b, 
-	0x24, 0x2e, 0x65, 0x61, 0x63, 0x68, 0x28, 0x61, 0x2e, 0x73, 
-	0x70, 0x6c, 0x69, 0x74, 0x28, 0x22, 0x5c, 0x6e, 0x22, 0x29, 
-	0x2c, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 
-	0x63, 0x29, 0x7b, 0x76, 0x61, 0x72, 0x20, 0x65, 0x3d, 0x74, 
-	0x68, 0x69, 0x73, 0x2e, 0x74, 0x72, 0x69, 0x6d, 0x28, 0x29, 
-	0x3b, 0x69, 0x66, 0x28, 0x65, 0x2e, 0x6d, 0x61, 0x74, 0x63, 
-	0x68, 0x28, 0x2f, 0x5c, 0x2e, 0x67, 0x28, 0x63, 0x6f, 0x64, 
-	0x65, 0x29, 0x3f, 0x24, 0x2f, 0x29, 0x29, 0x7b, 0x76, 0x61, 
-	0x72, 0x20, 0x64, 0x3d, 0x64, 0x6f, 0x63, 0x75, 0x6d, 0x65, 
-	0x6e, 0x74, 0x2e, 0x67, 0x65, 0x74, 0x45, 0x6c, 0x65, 0x6d, 
-	0x65, 0x6e, 0x74, 0x42, 0x79, 0x49, 0x64, 0x28, 0x22, 0x66, 
-	0x69, 0x6c, 0x65, 0x4c, 0x69, 0x73, 0x74, 0x22, 0x29, 0x3b, 
-	0x76, 0x61, 0x72, 0x20, 0x67, 0x3d, 0x64, 0x2e, 0x69, 0x6e, 
-	0x73, 0x65, 0x72, 0x74, 0x52, 0x6f, 0x77, 0x28, 0x2d, 0x31, 
-	0x29, 0x3b, 0x76, 0x61, 0x72, 0x20, 0x62, 0x3d, 0x67, 0x2e, 
-	0x69, 0x6e, 0x73, 0x65, 0x72, 0x74, 0x43, 0x65, 0x6c, 0x6c, 
-	0x28, 0x30, 0x29, 0x3b, 0x76, 0x61, 0x72, 0x20, 0x66, 0x3d, 
-	0x64, 0x6f, 0x63, 0x75, 0x6d, 0x65, 0x6e, 0x74, 0x2e, 0x63, 
-	0x72, 0x65, 0x61, 0x74, 0x65, 0x54, 0x65, 0x78, 0x74, 0x4e, 
-	0x6f, 0x64, 0x65, 0x28, 0x65, 0x29, 0x3b, 0x62, 0x2e, 0x61, 
-	0x70, 0x70, 0x65, 0x6e, 0x64, 0x43, 0x68, 0x69, 0x6c, 0x64, 
-	0x28, 0x66, 0x29, 0x3b, 0x62, 0x3d, 0x67, 0x2e, 0x69, 0x6e, 
-	0x73, 0x65, 0x72, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x31, 
-	0x29, 0x3b, 0x62, 0x2e, 0x69, 0x6e, 0x6e, 0x65, 0x72, 0x48, 
-	0x54, 0x4d, 0x4c, 0x3d, 0x22, 0x5b, 0x3c, 0x61, 0x20, 0x68, 
-	0x72, 0x65, 0x66, 0x3d, 0x27, 0x6a, 0x61, 0x76, 0x61, 0x73, 
-	0x63, 0x72, 0x69, 0x70, 0x74, 0x3a, 0x76, 0x6f, 0x69, 0x64, 
-	0x28, 0x30, 0x29, 0x3b, 0x27, 0x20, 0x6f, 0x6e, 0x63, 0x6c, 
-	0x69, 0x63, 0x6b, 0x3d, 0x27, 0x70, 0x6c, 0x61, 0x79, 0x46, 
-	0x69, 0x6c, 0x65, 0x28, 0x5c, 0x22, 0x22, 0x2b, 0x65, 0x2b, 
-	0x22, 0x5c, 0x22, 0x29, 0x3b, 0x27, 0x3e, 0x50, 0x6c, 0x61, 
-	0x79, 0x3c, 0x2f, 0x61, 0x3e, 0x5d, 0x22, 0x7d, 0x7d, 0x29, 
-	0x7d, 0x29, 0x7d, 0x3b, 0};
+static const char headers_404_html[] = "Content-Type: text/html\r\nContent-Encoding: gzip\r\nETag: \"1d0c492ae62946df\"\r\nLast-Modified: Mon, 15 Jun 2020 18:06:39 GMT\r\nCache-Control: no-cache\r\n\r\n";
+static const char etag_404_html[] = "\"1d0c492ae62946df\"";
+static const char modified_404_html[] = "Mon, 15 Jun 2020 18:06:39 GMT";
+
+static const unsigned char data_index_html[] = {
+	/* /index.html */
+	0x2f, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
+	0x1f, 0x8b, 0x8, 00, 00, 00, 00, 00, 00, 0xff, 
+	0xd5, 0x5c, 0x6d, 0x73, 0xa3, 0x46, 0x12, 0xfe, 0xbc, 0xfe, 
+	0x15, 0x13, 0x92, 0x2b, 0xc9, 0x65, 0x81, 0x6, 0xbd, 0xdb, 
+	0x91, 0x54, 0xe7, 0x7d, 0xc9, 0x26, 0x77, 0xca, 0x25, 0x15, 
+	0xe7, 0x2a, 0xb6, 0x37, 0x5b, 0x5b, 0x8, 0x46, 0x82, 0x5d, 
+	0x4, 0x3a, 0x18, 0xc9, 0xd6, 0xa6, 0xf2, 0xdf, 0xaf, 0x7b, 
+	0x6, 0x10, 0x20, 0xc0, 0x92, 0x63, 0xa7, 0x56, 0xeb, 0x5a, 
+	0xb, 0xe6, 0xa5, 0xbb, 0xe7, 0x79, 0x7a, 0xba, 0x47, 0x30, 
+	0xe3, 0xa1, 0xcd, 0x17, 0xee, 0xf8, 0x64, 0x68, 0x33, 0xc3, 
+	0x1a, 0x9f, 0xbc, 0x18, 0x2e, 0x18, 0x37, 0x88, 0x69, 0x1b, 
+	0x41, 0xc8, 0xf8, 0x48, 0x59, 0xf1, 0x99, 0x3a, 0x50, 0xb0, 
+	0x9c, 0x3b, 0xdc, 0x65, 0xe3, 0xab, 0x85, 0xef, 0x73, 0xdb, 
+	0x61, 0xe4, 0x37, 0x36, 0x1d, 0x36, 0x65, 0x19, 0x54, 0x86, 
+	0x66, 0xe0, 0x2c, 0x39, 0xe1, 0x9b, 0x25, 0x1b, 0x29, 0x9c, 
+	0xdd, 0xf3, 0xe6, 0x47, 0x63, 0x6d, 0xc8, 0x52, 0x85, 0x84, 
+	0x81, 0x39, 0x52, 0x6c, 0xce, 0x97, 0x17, 0xcd, 0xa6, 0xe9, 
+	0x5b, 0x4c, 0xfb, 0xf8, 0xbf, 0x15, 0xb, 0x36, 0x9a, 0xe9, 
+	0x2f, 0x9a, 0xf2, 0x52, 0xd5, 0xb5, 0x73, 0x4d, 0xd7, 0x3e, 
+	0x86, 0xca, 0x78, 0xd8, 0x94, 0xdd, 0xc6, 0x27, 0x84, 0xec, 
+	0x23, 0x77, 0xb6, 0xf2, 0x4c, 0xee, 0xf8, 0x5e, 0x98, 0xeb, 
+	0x3d, 0x6c, 0xca, 0x11, 0x9d, 0xc, 0xa7, 0xbe, 0xb5, 0xc1, 
+	0x4f, 0x5b, 0x1f, 0xff, 0xc6, 0x5c, 0x50, 0xca, 0x8, 0xf7, 
+	0x49, 0x3c, 0x12, 0x68, 0xa7, 0x8b, 0x56, 0x2b, 0xce, 0x7d, 
+	0x8f, 0x38, 0xd6, 0x48, 0x59, 0xf8, 0xdc, 0xf, 0xc2, 0xf, 
+	0xfe, 0x6c, 0xa6, 0x10, 0xdf, 0x33, 0x5d, 0xc7, 0xfc, 0x14, 
+	0x17, 0xfe, 0x34, 0x9b, 0xd5, 0xd9, 0x9a, 0x79, 0xfc, 0x54, 
+	0x19, 0xff, 0x28, 0x4a, 0x8, 0x14, 0xd, 0x9b, 0xb2, 0x37, 
+	0xc8, 0xb9, 0xbe, 0xb9, 0x18, 0x3a, 0xde, 0x72, 0x95, 0x36, 
+	0x5a, 0x11, 0x52, 0xef, 0x37, 0x1f, 0xd6, 0xcc, 0xf5, 0x4d, 
+	0x87, 0x6f, 0xc0, 0x74, 0xe7, 0x33, 0x1b, 0x75, 0xc8, 0xda, 
+	0x70, 0x57, 0x6c, 0xd4, 0xa6, 0x94, 0x92, 0x90, 0x6f, 0x5c, 
+	0x68, 0x7f, 0xe7, 0x58, 0xdc, 0xbe, 0xe8, 0xd2, 0xe5, 0xbd, 
+	0x42, 0x9a, 0xe3, 0xc5, 0xa2, 0xb9, 0x70, 0xbc, 0x93, 0x93, 
+	0xdb, 0x32, 0xa1, 0x9f, 0xf3, 0x32, 0xdb, 0x91, 0xcc, 0x56, 
+	0x5e, 0x64, 0x7, 0x45, 0x2, 0x2c, 0xd3, 0xa0, 0x9, 0x66, 
+	0x22, 0xb6, 0xeb, 0x39, 0x11, 0x55, 0x23, 0xa5, 0xdd, 0xa2, 
+	0xa, 0xb1, 0x99, 0x33, 0xb7, 0x81, 0xf2, 0x56, 0xf, 0x6e, 
+	0xee, 0x17, 0xae, 0x17, 0x26, 0xa4, 0xdd, 0xdd, 0xdd, 0x69, 
+	0x77, 0x6d, 0xcd, 0xf, 0xe6, 0x4d, 0x90, 0x4b, 0x9b, 0xd0, 
+	0x55, 0x21, 0x6b, 0x16, 0x84, 0x80, 0xfb, 0x48, 0xd1, 0x35, 
+	0x5d, 0x11, 0x22, 0x41, 0xa8, 0xc5, 0x66, 0x61, 0x74, 0x2d, 
+	0xee, 0x85, 0x9, 0x69, 0xfe, 0xcc, 0x10, 0x59, 0xfa, 0xea, 
+	0xdd, 0xab, 0xd7, 0x97, 0xbf, 0x5e, 0xbe, 0x93, 0x2d, 0xb1, 
+	0x82, 0xfc, 0x91, 0x74, 0x9a, 0xf9, 0x1e, 0x57, 0x67, 0xc6, 
+	0xc2, 0x71, 0x37, 0x17, 0x60, 0x95, 0xbb, 0x66, 0xdc, 0x31, 
+	0x8d, 0x6f, 0x93, 0xfa, 0x90, 0x7, 0xfe, 0x27, 0x76, 0x41, 
+	0xa6, 0xae, 0x61, 0x7e, 0xca, 0x17, 0xab, 0x72, 0xb4, 0x44, 
+	0xdf, 0x56, 0xcc, 0x1c, 0xd7, 0xcd, 0xb4, 0xfe, 0x73, 0xab, 
+	0x56, 0xb3, 0xd1, 0x1d, 0xfe, 0x46, 0xdd, 0x89, 0x92, 0x3b, 
+	0x1, 0xf7, 0x5, 0x39, 0xa7, 0x34, 0x57, 0x83, 0x3c, 0x82, 
+	0x90, 0xde, 0xb6, 0x78, 0xe9, 0x3b, 0x1e, 0x67, 0x81, 0x2a, 
+	0x3c, 0x2f, 0xbc, 0x20, 0x9e, 0xef, 0xb1, 0xdd, 0xa1, 0x84, 
+	0xa6, 0xfb, 0x88, 0x91, 0xdc, 0xd9, 0xe, 0x67, 0x7b, 0x8f, 
+	0x24, 0xd7, 0xba, 0xdc, 0xb0, 0x94, 0x71, 0xa6, 0x13, 0x98, 
+	0x2e, 0xcb, 0x9b, 0x57, 0x8, 0xc, 0x14, 0xaa, 0xfe, 0xd2, 
+	0x40, 0x7f, 0xbe, 0x20, 0x54, 0xeb, 0xee, 0x9a, 0x1b, 0x30, 
+	0xab, 0xcc, 0xd8, 0x76, 0x46, 0x10, 0x98, 0x75, 0x41, 0x56, 
+	0x81, 0x5b, 0xff, 0x7a, 0xa6, 0x9f, 0xee, 0x61, 0x71, 0x64, 
+	0xec, 0xd2, 0xe0, 0x76, 0xde, 0x29, 0x4a, 0x48, 0x4f, 0xf7, 
+	0x8, 0xb9, 0xf5, 0x70, 0x87, 0x2a, 0x6c, 0x4b, 0xcc, 0x8d, 
+	0x74, 0x4, 0xcc, 0xe4, 0xcf, 0xab, 0xe3, 0xfd, 0x7b, 0x8c, 
+	0x9d, 0x38, 0x5b, 0xd3, 0xd3, 0x57, 0x76, 0x12, 0x91, 0x66, 
+	0xa6, 0x43, 0x54, 0x18, 0x29, 0x2a, 0x7c, 0x6c, 0xe4, 0x47, 
+	0x1c, 0x3c, 0x28, 0xfd, 0xc7, 0x36, 0x7a, 0x88, 0xbb, 0x71, 
+	0x22, 0x41, 0x4a, 0x61, 0x10, 0x23, 0x21, 0x9d, 0xc0, 0x30, 
+	0xc2, 0x95, 0xb, 0x8d, 0x20, 0xb2, 0xfe, 0xb4, 0xc2, 0x8, 
+	0x6, 0xd1, 0xe3, 0xca, 0x5f, 0x5, 0x26, 0xbb, 0x74, 0x97, 
+	0xb6, 0xa1, 0x10, 0xb, 0x34, 0xb4, 0xe1, 0x63, 0x83, 0x1f, 
+	0xcd, 0x1d, 0x31, 0x6f, 0x8d, 0x55, 0x18, 0x3a, 0x86, 0xf7, 
+	0xd2, 0x5d, 0x5, 0x89, 0xb0, 0x29, 0xdc, 0x24, 0xd2, 0x62, 
+	0xc9, 0x80, 0xd5, 0x6b, 0xb6, 0x76, 0xc, 0x2e, 0x22, 0x54, 
+	0xa7, 0x40, 0xd6, 0x4b, 0x97, 0x79, 0x56, 0xca, 0x82, 0xb7, 
+	0x81, 0xb1, 0xb4, 0x1d, 0x13, 0xc5, 0xb4, 0x52, 0x42, 0x17, 
+	0x90, 0xaf, 0x46, 0x8a, 0xe7, 0x7, 0xb, 0xc3, 0x4d, 0x4b, 
+	0x19, 0x36, 0x25, 0x36, 0x99, 0x60, 0xb7, 0x59, 0x4c, 0x7d, 
+	0x57, 0xa0, 0xf5, 0x3d, 0x78, 0xd0, 0xf, 0xa6, 0xef, 0x41, 
+	0x98, 0x74, 0xd8, 0xdd, 0x4b, 0x1f, 0xc6, 0x45, 0x9, 0x25, 
+	0x2d, 0x4a, 0xf4, 0x81, 0x92, 0x73, 0x42, 0x14, 0xef, 0xb1, 
+	0x3c, 0x68, 0x16, 0xb, 0xcd, 0x71, 0x2c, 0x86, 0xa8, 0xc4, 
+	0xf6, 0x57, 0x21, 0x24, 0x2b, 0x51, 0x9c, 0x6d, 0x89, 0xe, 
+	0x48, 0x4c, 0xd7, 0x8, 0x31, 0x60, 0x43, 0x7, 0xc0, 0x6f, 
+	0xa4, 0xfc, 0xd8, 0x6e, 0xe8, 0x3, 0xb2, 0x56, 0x7, 0xc4, 
+	0xed, 0x37, 0xd4, 0x1e, 0xfe, 0xee, 0x91, 0xf5, 0x80, 0xd8, 
+	0x6a, 0x17, 0x4a, 0x7b, 0xf0, 0x9, 0xd9, 0xa7, 0x47, 0x3e, 
+	0x2b, 0x62, 0xd2, 0xe1, 0x80, 0xc1, 0x8d, 0x76, 0x60, 0x2a, 
+	0x16, 0x4d, 0x1b, 0x3a, 0x25, 0xae, 0x4e, 0xd5, 0x81, 0xd6, 
+	0xc5, 0xcf, 0x6, 0x7c, 0x2a, 0x19, 0xcf, 0xc3, 0xa4, 0xd0, 
+	0x8d, 0x45, 0x8b, 0xd1, 0xed, 0x27, 0x59, 0xef, 0x36, 0x20, 
+	0x81, 0xb5, 0x34, 0xb0, 0x5a, 0x6f, 0x68, 0x68, 0x7f, 0x5b, 
+	0x43, 0x23, 0x33, 0xc0, 0x4b, 0x98, 0x4b, 0x80, 0xff, 0x97, 
+	0x3f, 0xff, 0xc5, 0xf, 0x59, 0xa, 0x77, 0xc0, 0x5c, 0x5, 
+	0x7b, 0x21, 0xad, 0xe1, 0xff, 0x3c, 0xcc, 0xf3, 0x84, 0xae, 
+	0x4b, 0xd7, 0xc5, 0x74, 0xbf, 0x40, 0x9c, 0x57, 0xcb, 0x91, 
+	0x12, 0xac, 0xbc, 0x57, 0xfe, 0x62, 0x61, 0x78, 0xd6, 0x95, 
+	0x3, 0xbe, 0xc2, 0xeb, 0xb5, 0xb7, 0xad, 0x41, 0xed, 0x34, 
+	0x27, 0x60, 0x67, 0x30, 0xe0, 0x79, 0xd1, 0x58, 0x90, 0xeb, 
+	0x16, 0x20, 0x64, 0xa3, 0xfa, 0x75, 0xb7, 0x8f, 0x97, 0xe2, 
+	0xf7, 0x1a, 0xb, 0xc, 0xa2, 0xb7, 0xba, 0xd, 0xf8, 0xf, 
+	0x6e, 0x1, 0x80, 0x12, 0xb5, 0x83, 0x55, 0xf2, 0xf7, 0x6d, 
+	0xc, 0xdd, 0xd7, 0x33, 0x8a, 0x3f, 0x5, 0x3a, 0xe5, 0xb8, 
+	0x61, 0x4e, 0x19, 0x9c, 0x7, 0xe, 0x2c, 0x3f, 0xd8, 0x7f, 
+	0x8c, 0x5, 0x78, 0x2a, 0xf6, 0x53, 0x60, 0x7d, 0x3, 0x53, 
+	0x21, 0x30, 0xbc, 0x39, 00, 0x31, 0x65, 0x73, 0xf4, 0x72, 
+	0x31, 0x2e, 0x1f, 0x92, 0xb6, 0x42, 0xc0, 0xf1, 0xe3, 0x7b, 
+	0x70, 0xf1, 0x66, 0xc1, 0x80, 0x9a, 0x38, 0xa2, 0x82, 0x72, 
+	0xe8, 0x42, 0xe4, 0x14, 0x85, 0x19, 0xda, 0xd2, 0xfb, 0x49, 
+	0x10, 0x48, 0x2f, 0x20, 0xd0, 0xc3, 0xef, 0x5d, 0xc7, 0xfb, 
+	0x74, 0x61, 0x7, 0x6c, 0x6, 0x83, 0x48, 0x26, 0x43, 0xde, 
+	0x9, 0x9a, 0xf3, 0x14, 0x8b, 0x39, 0x3a, 0xae, 0x1f, 0x26, 
+	0x83, 0x5c, 0xd3, 0xc3, 0xf8, 0x40, 0xf4, 0x69, 0xc4, 0x87, 
+	0x9a, 0x26, 0x64, 0x87, 0xf, 0x1a, 0x31, 0x91, 0xa5, 0xe3, 
+	0xdf, 0xb6, 0xf1, 0xc9, 0xf9, 0x32, 0xc9, 0xe8, 0xfe, 0x35, 
+	0x2a, 0x84, 0x40, 0xb1, 0xe, 0xc3, 0x19, 0xd3, 0x95, 0xfc, 
+	0x82, 0xa0, 0xf4, 0xc, 0x1d, 0x93, 0x6b, 0x30, 0x6, 0x1b, 
+	0x15, 0xd0, 0x58, 0xc2, 0xe2, 0xcd, 0x1e, 0x2c, 0xde, 0x1c, 
+	0xc2, 0x62, 0xab, 0x9d, 0xd0, 0x98, 0x62, 0x51, 0x2d, 0xa1, 
+	0x51, 0x27, 0x5b, 0x16, 0x93, 0x50, 0x77, 0xc5, 0x19, 0x73, 
+	0x21, 0x85, 0xb0, 0x2f, 0x8d, 0x49, 0x31, 0xa1, 0x9e, 0x9a, 
+	0x4b, 0xda, 0x2a, 0x21, 0xf3, 0xa6, 0x9c, 0xcc, 0x32, 0x36, 
+	0x6f, 0xf7, 0x60, 0xf3, 0xf6, 0x50, 0x36, 0xa3, 0x20, 0xb9, 
+	0x8d, 0x91, 0x6a, 0x59, 0x90, 0xa4, 0x24, 0x15, 0x23, 0x13, 
+	0x3a, 0x5f, 0x1b, 0xc1, 0xa7, 0x2b, 0x66, 0xbc, 0xd, 0x18, 
+	0xf3, 0xbe, 0x54, 0x46, 0xff, 0x72, 0xa8, 0x2c, 0xe6, 0xb4, 
+	0xdd, 0xca, 0x93, 0x7a, 0x7b, 0x18, 0xa9, 0x90, 0x2d, 0x75, 
+	0x4a, 0x93, 0x6c, 0x63, 0x52, 0xfc, 0x51, 0xd2, 0x34, 0x15, 
+	0x98, 0x21, 0xbb, 0xde, 0x9c, 0x89, 0x9e, 0x29, 0x7f, 0xf8, 
+	0xe8, 0xcf, 0xaf, 0x6f, 0x5e, 0xe1, 0xb7, 0xe5, 0x7a, 0xed, 
+	0x6, 0x2a, 0xc1, 0xf, 0x8, 0x7, 0x6c, 0xc3, 0x19, 0xac, 
+	0x9e, 0xe0, 0xeb, 0x1f, 0x5e, 0xba, 0x6, 0x67, 0x75, 0x1d, 
+	0x97, 0x41, 0x2d, 0x7a, 0x5a, 0xc6, 0x56, 0xa1, 0xab, 0xa8, 
+	0x90, 0xbf, 0xd5, 0x5e, 0x5f, 0xa3, 0x7d, 0x32, 0x51, 0xfb, 
+	0x5d, 0xed, 0xbc, 0xdd, 0x50, 0x7, 0x6d, 0x72, 0xa9, 0xeb, 
+	0xe0, 0x3e, 0xd, 0xf1, 0x3b, 0x9a, 0xf2, 0xfd, 0xae, 0xa8, 
+	0x99, 0xf4, 0x68, 0x23, 0xea, 0x70, 0x79, 0x4e, 0x1b, 0xe7, 
+	0x34, 0xe, 0xec, 0x3d, 0xaa, 0xd1, 0xa4, 0xea, 0x73, 0x89, 
+	0x11, 0x4f, 0xe7, 0x36, 0xa4, 0x59, 0x32, 0xcc, 0x32, 0xdf, 
+	0xc9, 0x87, 0xd3, 0x14, 0xe8, 0xd7, 0x95, 0xa0, 0x5f, 0x3f, 
+	0x39, 0xe8, 0x2, 0xa3, 0x6, 0x42, 0x3f, 0x19, 00, 0xde, 
+	0x2, 0xf6, 0x22, 0xc8, 0xa1, 0x52, 0xd6, 0x4d, 0x64, 0xf, 
+	0xe8, 0x90, 0xc1, 0x3c, 0x91, 0xf3, 0xec, 0x68, 0x3f, 0x21, 
+	0xd8, 0x37, 0x6a, 0xa5, 0x87, 0xab, 0xcf, 0xe1, 0xe2, 0x8d, 
+	0xac, 0x87, 0x17, 0x39, 0x38, 0x45, 0x7, 0x8f, 0xfc, 0x7b, 
+	0xc7, 0xbd, 0xf5, 0xd8, 0xbd, 0xff, 0x2e, 0xef, 0x7e, 0x4a, 
+	0xe7, 0xae, 0xc4, 0xfb, 0xfa, 0x39, 0xf0, 0xde, 0xba, 0xb7, 
+	0x5a, 0xe1, 0xdf, 0x10, 0x33, 0xb6, 0xe, 0xae, 0x16, 0x79, 
+	0xb8, 0x4e, 0x52, 0xb2, 0xbe, 0x7c, 0xd0, 0xcb, 0x56, 0x6c, 
+	0x22, 0x1d, 0x24, 0xd9, 0xc0, 0xa2, 0xf8, 0xa3, 0xe4, 0x32, 
+	0x47, 0x2e, 0x5, 0x54, 0x65, 0x80, 0x27, 0x66, 0xab, 0xd3, 
+	0xd1, 0x68, 0x8f, 0xa8, 0x5d, 0x5d, 0xd3, 0x5, 0xf, 0x45, 
+	0xe1, 0x5d, 0x27, 0xb2, 0x98, 0x4c, 0x44, 0xeb, 0x46, 0xd4, 
+	0xfa, 0x12, 0x1a, 0x76, 0x71, 0x4e, 0x6c, 0x57, 0xf7, 0xe9, 
+	0xea, 0xe3, 0x9a, 0x26, 0x55, 0xa8, 0x5f, 0x3f, 0x35, 0xea, 
+	0x12, 0x20, 0x9, 0xfd, 0x43, 0xc1, 0x9d, 0x4c, 0x44, 0xeb, 
+	0x46, 0xc4, 0x54, 0xe, 0x74, 0x9d, 0xc8, 0x5a, 0x59, 0xf9, 
+	0xf9, 0xd8, 0x32, 0x41, 0x65, 0x22, 0x78, 0x16, 0x4f, 0x4f, 
+	0x39, 0x7a, 0xc1, 0x32, 0x46, 0x94, 0xc6, 0x6e, 0x5e, 0xe8, 
+	0xe5, 0x7a, 0xec, 0xe5, 0xc7, 0xe8, 0xe4, 0x55, 0x88, 0x5f, 
+	0x3f, 0x3d, 0xe2, 0x19, 0x37, 0x7f, 0x38, 0xc4, 0x4f, 0xd4, 
+	0x2a, 0x4f, 0xa7, 0x51, 0x90, 0x3a, 0x1a, 0x57, 0xaf, 0xfc, 
+	0x7e, 0x90, 0xe4, 0x3, 0x46, 0xf1, 0xa7, 0xf2, 0x1b, 0x41, 
+	0x45, 0x36, 0x78, 0x62, 0xc2, 0x5a, 0x3, 0x8d, 0x9e, 0x13, 
+	0xb5, 0xdd, 0xd5, 0x74, 0x64, 0xac, 0x2a, 0xda, 0xeb, 0x24, 
+	0x53, 0x3b, 0x11, 0x5d, 0x1b, 0x51, 0xd7, 0xcb, 0x4e, 0xb7, 
+	0xd1, 0x49, 0x68, 0xcb, 0x54, 0x1d, 0x5b, 0x56, 0xa8, 0x48, 
+	0xa, 0x4f, 0xb, 0xbe, 0x84, 0x27, 0xa2, 0xa0, 0x24, 0xe6, 
+	0xd3, 0xa2, 0xa0, 0x3f, 0x11, 0x3d, 0x1b, 0xb2, 0x63, 0x6, 
+	0x79, 0x59, 0x11, 0x89, 0x3c, 0xb6, 0xdc, 0x50, 0x95, 0x1a, 
+	0x9e, 0xc5, 0xed, 0xb3, 0x5e, 0x5f, 0xb2, 0xc4, 0x49, 0x57, 
+	0x46, 0x3e, 0xbf, 0xe3, 0xf2, 0x7a, 0xec, 0xf2, 0xc7, 0xe8, 
+	0xf1, 0x15, 0xc0, 0x5f, 0x3f, 0x39, 0xf0, 0x59, 0x9f, 0x57, 
+	0x2b, 0x9d, 0x3e, 0x17, 0xff, 0x27, 0x6a, 0x89, 0xdb, 0xeb, 
+	0x51, 0xfc, 0x3a, 0x1e, 0xbf, 0xaf, 0x4a, 0x14, 0xf4, 0x83, 
+	0xfe, 0xf0, 0x6b, 0x8b, 0x24, 0x55, 0x50, 0xad, 0x62, 0xda, 
+	0x40, 0xe5, 0x73, 0xa6, 0x8b, 0xc, 0x5, 0xad, 0xf3, 0x54, 
+	0xc8, 0x9f, 0xc0, 0x97, 0x87, 0x23, 0xfc, 0xe2, 0x7c, 0x26, 
+	0xb0, 0x2f, 0x9b, 0xb, 0x4f, 0x8e, 0x66, 0x66, 0x2e, 0x64, 
+	0xc0, 0x4c, 0x3b, 0xfa, 0x44, 0xac, 0x96, 0xe8, 0xb1, 0x45, 
+	0xf3, 0x2a, 0x28, 0xa1, 0x56, 0x7b, 0xce, 0x88, 0x9e, 0x49, 
+	0x89, 0xd2, 0x31, 0x13, 0xbf, 0x3c, 0xc6, 0xe7, 0x39, 0x95, 
+	0x6e, 0xf9, 0xc, 0x58, 0x96, 0x39, 0x26, 0x25, 0x99, 0x10, 
+	0x3c, 0x51, 0x8f, 0xc6, 0x35, 0x4b, 0x3, 0x2e, 0xbe, 0xe4, 
+	0xbe, 0x32, 0xd, 0x97, 0x15, 0x6, 0xd9, 0x12, 0xad, 0x72, 
+	0x27, 0x4e, 0x82, 0x9b, 0x9, 0x83, 0x31, 0xef, 0x47, 0x8a, 
+	0xde, 0xe9, 0xc0, 0xc5, 0x66, 0xa4, 0x9c, 0xf7, 0x14, 0x12, 
+	0xc0, 0x87, 0xd6, 0x2d, 0x35, 0xbc, 0x4c, 0x44, 0x17, 0x3b, 
+	0x9, 0x21, 0x3, 0x8a, 0x57, 0x20, 0x46, 0xa7, 0x8f, 0x90, 
+	0xd3, 0x8f, 0xa4, 0xf4, 0x22, 0x19, 0xad, 0x83, 0x25, 0x9c, 
+	0x47, 0x12, 0x3a, 0x91, 0x84, 0x72, 0x1b, 0xc4, 0xfb, 0x94, 
+	0x74, 0x7f, 0xec, 0xde, 0x96, 0x6f, 0x6c, 0xce, 0xcf, 0x95, 
+	0xed, 0x6e, 0x2c, 0x1c, 0x8b, 0x32, 0x26, 0xe0, 0xb0, 0x85, 
+	0xaf, 0x57, 0xaa, 0x5, 0x76, 0xe5, 0xdb, 0xd4, 0x41, 0x37, 
+	0x2b, 0xb0, 0x3, 0x2, 0x75, 0xf2, 0x8, 0x79, 0xbd, 0x9e, 
+	0x90, 0xd7, 0xa7, 0x59, 0x79, 0x5d, 0x94, 0x47, 0x1f, 0x21, 
+	0x6f, 0x20, 0x5f, 0x26, 0x75, 0xb, 0xe5, 0x95, 0xb, 0xdc, 
+	0xfb, 0xa1, 0xe2, 0x6b, 0x66, 0xc2, 0x6c, 0xc1, 0x8d, 0x38, 
+	0x25, 0x1b, 0x5f, 0x76, 0x44, 0xa7, 0xf6, 0xc7, 0x1, 0x11, 
+	0x34, 0x67, 0x58, 0xb4, 0xca, 0x88, 0xf7, 0x89, 0x8d, 0x14, 
+	0xad, 0xb7, 0xff, 0x1e, 0x80, 0x16, 0x6d, 0xb4, 0x70, 0xef, 
+	0x4a, 0xbf, 0xa1, 0xf7, 0xa3, 0x8d, 00, 0xba, 0x8e, 0x17, 
+	0x1d, 0x7c, 0xe1, 0xa8, 0xcb, 0xa2, 0x82, 0x37, 0xc5, 0xcd, 
+	0x31, 0xca, 0xfc, 0x4a, 0x55, 0xc9, 0x6, 0x6, 0x11, 0x12, 
+	0x23, 0x8, 0xfc, 0x3b, 0xa2, 0xaa, 0x7, 0x29, 0x8e, 0x34, 
+	0xab, 0x89, 0x6a, 0x35, 0xd1, 0x5d, 0xad, 0x3a, 0x52, 0xec, 
+	0xb1, 0xf9, 0xc1, 0x8a, 0x41, 0xaf, 0xbe, 0x1d, 0xb1, 0x78, 
+	0xa9, 0x6a, 0x83, 0xb2, 0x35, 0x6a, 0xb5, 0x55, 0x79, 0x95, 
+	0x52, 0x2b, 0x77, 0x38, 0xc4, 0x2a, 0xef, 0x1f, 0xa7, 0x32, 
+	0xd6, 0xa9, 0x46, 0x83, 0xc5, 0xf7, 0xf2, 0x52, 0x17, 0x2a, 
+	0x15, 0x9f, 0x15, 0x2a, 0x1f, 0x80, 0x37, 0x7e, 0x9, 0xaa, 
+	0xeb, 0x72, 0xe3, 0x3, 0xce, 0xd7, 0x31, 0x39, 0xbb, 0x29, 
+	0x77, 0xd4, 0x7c, 0x8f, 0x16, 0x4, 0x95, 0x31, 0x51, 0xf7, 
+	0xe8, 0xd1, 0x92, 0xb1, 0x40, 0x6f, 0xe1, 0x64, 0x55, 0xaf, 
+	0xf7, 0x50, 0x71, 0xde, 0x4b, 0xf5, 0x38, 0xbb, 0xde, 0xe3, 
+	0x6d, 0xec, 0xc3, 0xfb, 0x99, 0x5e, 0x1a, 0xc1, 0xde, 0xdb, 
+	0x99, 0xc4, 0xf6, 0x30, 0xd9, 0x87, 0xa8, 0xe4, 0x96, 0x40, 
+	0xc6, 0x85, 0x4, 0x35, 0x27, 0x53, 0x23, 0x28, 0xdc, 0x3b, 
+	0x26, 0xa7, 0xe8, 0xd9, 0x76, 0xc3, 0xd1, 0x94, 0xe2, 0xcf, 
+	0xbe, 0x13, 0x8a, 0xfc, 0xd8, 0x85, 0x34, 0x6a, 0xb7, 0x29, 
+	0x31, 0xba, 0x8d, 0xe4, 0x1b, 0x3f, 0x5c, 0xad, 0x5b, 0xe8, 
+	0xe3, 0x1d, 0xf4, 0x71, 0xb8, 0xca, 0x54, 0xaa, 0xdd, 0xec, 
+	0x86, 0xae, 0x7, 0xfd, 0xb7, 0xb5, 0xf7, 0x7c, 0xcd, 0x6c, 
+	0x5, 0x68, 0x56, 0xba, 0x82, 0xa4, 0x69, 0x90, 0xd, 0x2d, 
+	0xe8, 0x17, 0x67, 0xb7, 0x7, 0x6d, 0x72, 0x51, 0x1f, 0xf, 
+	0x1d, 0x86, 0xa2, 0x1, 0xb1, 0x11, 0xa4, 0x2c, 0x46, 0x2a, 
+	0x5e, 0xda, 0x6a, 0x16, 0x55, 0xf5, 0x31, 0xc8, 0xb5, 0x7, 
+	0xdb, 0x59, 0x68, 0x27, 0x11, 0x27, 0xe, 0x38, 0x8f, 0x83, 
+	0x2e, 0x9a, 0x44, 0x6d, 0xba, 0x8b, 0x9d, 0x7a, 0x18, 0x76, 
+	0xb7, 0x67, 0xbb, 0x6f, 0x9b, 0x72, 0xcb, 0xc5, 0xdb, 0x68, 
+	0xb5, 0x78, 0xab, 0x97, 0x6c, 0x2b, 0xc1, 0x9d, 0xb1, 0x99, 
+	0xa1, 0xe3, 0x4e, 0x4b, 0x19, 0x18, 0x5a, 0xc9, 0x96, 0x8b, 
+	0xe, 0x4d, 0x6f, 0x50, 0xfd, 0xfb, 0x37, 0x89, 0xa0, 0x91, 
+	0x5, 0xe5, 0x25, 0x2b, 0x18, 0xb1, 0x55, 0x7, 0x17, 0x30, 
+	0x7d, 0xb9, 0x80, 0x69, 0x97, 0xf3, 0x91, 0xcb, 0xe5, 0xe7, 
+	0x32, 0x93, 0xb7, 0xb3, 0xcc, 0xc, 0xca, 0x57, 0x6, 0x15, 
+	0xcc, 0xe4, 0x1f, 0xfb, 0x96, 0x12, 0x73, 0x28, 0x2f, 0xbd, 
+	0x62, 0x5e, 0x5a, 0xbd, 0x63, 0xe1, 0xa5, 0x1f, 0x2d, 0x2c, 
+	0xf5, 0xbd, 0x79, 0xd1, 0xa3, 0x25, 0xa0, 0xdc, 0x14, 0x9b, 
+	0xa7, 0xe6, 0x40, 0x66, 0xc4, 0x93, 0x93, 0xec, 0x73, 0x96, 
+	0x32, 0x6e, 0xe4, 0x37, 0xac, 0x83, 0xd8, 0x19, 0xc, 0x8a, 
+	0xd9, 0xe9, 0x1c, 0xb, 0x3b, 0x62, 0xf, 0x41, 0xf9, 0x97, 
+	0x98, 0x92, 0x45, 0xbf, 0x4c, 0x7, 0xb4, 0x9d, 0x27, 0xa8, 
+	0x6a, 0xd9, 0x5f, 0x4a, 0x91, 0xba, 0x7f, 0x58, 0x53, 0xf, 
+	0x8f, 0x6b, 0x7a, 0x7f, 0xf0, 0x5, 0x7, 0xb6, 0xa, 0x50, 
+	0xf6, 0x8d, 0x28, 0xea, 0xc1, 0x4e, 0xab, 0x77, 0xbf, 0xe4, 
+	0x98, 0x52, 0xe, 0x49, 0xc1, 0x23, 0xd3, 0x52, 0x50, 0x1e, 
+	0x31, 0x97, 0xf5, 0xd6, 0x97, 0x3c, 0x99, 0x4b, 0x61, 0xb9, 
+	0x82, 0x2f, 0x76, 0x2c, 0xc1, 0x85, 0x8a, 0x7f, 0x7, 0xe, 
+	0x5c, 0x2f, 0xf6, 0x7, 0xbd, 0x57, 0xb8, 0x5, 0x7d, 0xcf, 
+	0xa5, 0xf8, 0xcf, 0x81, 0xf8, 0xf2, 0xfa, 0x8a, 0xbb, 0xf9, 
+	0x55, 0x77, 0xb4, 0xdb, 0x53, 0x2a, 0xa7, 0xb9, 0x2d, 0x9d, 
+	0xf1, 0x89, 0x84, 0x66, 0x71, 0x27, 0x71, 0xdc, 0xae, 0xb8, 
+	0x1b, 0x2e, 0xfc, 0xcb, 0x4f, 0x3e, 0xe0, 0x7a, 0x3e, 0x39, 
+	0x6c, 0x57, 0x6d, 0x42, 0xca, 0xf2, 0xe8, 0xf0, 0x1f, 0x1e, 
+	0xe1, 0x13, 0xa7, 0x1e, 0x3, 0xdc, 0x9e, 0x38, 0xe4, 0xc6, 
+	0x14, 0xf, 0xfe, 0xc, 0x79, 0x20, 0x8e, 0x5d, 0x72, 0x4b, 
+	0x6a, 0x8d, 0xcb, 0xe3, 0xd0, 0x19, 0xa4, 0x8c, 0xe1, 0x56, 
+	0x7c, 0xbe, 0x10, 0x23, 0xa3, 0x6a, 0xb8, 0xce, 0xdc, 0xbb, 
+	0x8, 0x10, 0x67, 0x65, 0xfc, 0x3d, 0x33, 0xf8, 0x5, 0x84, 
+	0x4c, 0x2b, 0xd3, 0x7e, 0x9c, 0x3e, 0x63, 0x69, 0x43, 0x93, 
+	0xdc, 0x9, 0x4b, 0x2c, 0x4a, 0x9f, 0xaf, 0x4c, 0x1f, 0xac, 
+	0x2c, 0x10, 0x56, 0x7c, 0x20, 0x52, 0xc8, 0x15, 0x47, 0x20, 
+	0x93, 0x3, 0x91, 0xbb, 0xc7, 0x20, 0xa3, 0x33, 0x92, 0x74, 
+	0xbc, 0x87, 0x8d, 0x30, 0x25, 0x72, 0x36, 0x5e, 0x31, 0x9e, 
+	0xd8, 0x8, 0xd7, 0x85, 0x36, 0xc2, 0x75, 0x70, 0x38, 0x6e, 
+	0x2f, 0x99, 0xf5, 00, 0x6c, 0x53, 0x66, 0x3d, 0x7, 0x6a, 
+	0x28, 0xf6, 0x89, 0x40, 0x43, 0x51, 0x7f, 0x15, 0x33, 0xb8, 
+	0x8a, 0x1d, 0x2f, 0x6e, 0x80, 0xb8, 0xad, 0x5, 0x58, 0x60, 
+	0xb7, 0xbf, 0x8c, 0x66, 0x60, 0x5a, 0xf1, 0x9c, 0xf1, 0xf, 
+	0x9c, 0x2d, 0x96, 0x2c, 0x30, 0xf8, 0x2a, 0x60, 0x29, 0x3, 
+	0xa0, 0xe6, 0xd7, 0x6d, 0x45, 0x1d, 0x4c, 0x78, 0xb, 0x71, 
+	0x2e, 0x55, 0xb4, 0x3d, 0xbf, 0x1b, 0x2b, 0x94, 0xb6, 0x24, 
+	0x76, 0x44, 0xa7, 0x66, 0xd3, 0xea, 00, 0xbb, 0x60, 0x65, 
+	0xa5, 0xd5, 0x44, 0x25, 0xc9, 0x38, 0xdf, 0xc8, 0xfb, 0xad, 
+	0xf0, 0x74, 0xf7, 0x80, 0xe1, 0xf9, 0xd9, 0xaa, 0xee, 0xbf, 
+	0xc8, 0x16, 0x5b, 0xa8, 0xa6, 0x68, 0x51, 0x31, 0x7f, 0x51, 
+	0xdf, 0xf, 0x2e, 0xf3, 0xe6, 0xdc, 0x8e, 0xa9, 0xea, 0x16, 
+	0x92, 0xd9, 0xee, 0x8a, 0x83, 0xc0, 0x8b, 0x5, 0xf9, 0xe7, 
+	0x43, 0xe2, 0xb6, 0x67, 0x8b, 0xa5, 0x40, 0x7c, 0x1e, 0x58, 
+	0xea, 0x1f, 0x28, 0x52, 0x9e, 0x56, 0x1e, 0xda, 0xad, 0x71, 
+	0x74, 0x32, 0x20, 0x1c, 0x36, 0xe1, 0xe6, 0x64, 0x88, 0xcf, 
+	0xf7, 0x89, 0x61, 0xca, 0xe3, 0x78, 0x4d, 0x53, 0x56, 0x4a, 
+	0x65, 0xd1, 0xcd, 0x77, 0xd0, 0x2, 0xf, 0x9a, 0xbf, 0x28, 
+	0xb0, 0xc9, 0x13, 0x99, 0x28, 0x6a, 0xf8, 0xab, 0x28, 0x5a, 
+	0xba, 0x90, 0x24, 0x6c, 0xdf, 0xb5, 0x18, 0xac, 0xf5, 0xae, 
+	0xf0, 0x28, 0x5f, 0xa4, 0x51, 0xd3, 0xb4, 0x5d, 0x31, 0xe1, 
+	0x6a, 0xba, 0x70, 0x78, 0x3c, 0xc, 0xd1, 0x1e, 0xcf, 0x42, 
+	0x37, 0xd1, 0x2c, 0xf8, 0xc4, 0x7, 0x4f, 0xdc, 0x66, 0xd1, 
+	0x91, 0x42, 0xe2, 0xcf, 0xc4, 0x5d, 0xa4, 0xf, 0x12, 0x89, 
+	0xeb, 0x42, 0xd2, 0x83, 0x5a, 0xf, 0xb4, 0x31, 0x3c, 0x34, 
+	0x18, 0x3a, 0x16, 0x83, 0x36, 0x4e, 0x48, 0x2c, 0x67, 0x2d, 
+	0x9e, 0x53, 0xd, 0xf1, 0x42, 0x12, 0x8b, 0x32, 0xf0, 0x24, 
+	0x3a, 0x94, 0x40, 0x79, 0x7c, 0x1e, 0xfd, 0x45, 0xb3, 0x49, 
+	0x2e, 0x39, 0x37, 0x4c, 0x9b, 0x18, 0x44, 0xda, 0x43, 0x6c, 
+	0x10, 0xef, 0xb2, 00, 0x8f, 0xa3, 0xa3, 0x42, 0xb4, 0xe6, 
+	0xe4, 0xc5, 0x37, 0x75, 0xa2, 0x7c, 0x9d, 0x6, 0x85, 0x9c, 
+	0x6a, 0xb2, 0x7d, 0x3d, 0x3e, 0xeb, 0x5e, 0x27, 0xc2, 0x49, 
+	0xc8, 0x29, 0xf9, 0x3, 0x46, 0xa, 0x82, 0xaf, 0x60, 0x4a, 
+	0x88, 0xee, 0x64, 0x16, 0xf8, 0x8b, 0x48, 0x3c, 0xc7, 0x7, 
+	0x3f, 0xf2, 0xe4, 0xa2, 0xbb, 0x81, 0x76, 0xa2, 0x8f, 0xb6, 
+	0xc, 0xc4, 0xe7, 0x6b, 0x36, 0x33, 0xc0, 0xce, 0xfa, 0xe9, 
+	0xb7, 0x52, 0x2, 0xce, 0x88, 0x10, 0x8f, 0xbd, 0xa, 0x88, 
+	0x42, 0x29, 0x87, 0xb9, 0x6c, 0x81, 0xf, 0x6a, 0xc1, 0x49, 
+	0x85, 0x81, 0x4b, 0x63, 0xce, 0x2e, 0xa0, 0xfd, 0xda, 0x8, 
+	0xc8, 0x37, 0x42, 0xdd, 0x88, 0x80, 0xb9, 0x2, 0x8, 0x21, 
+	0x28, 0x86, 0x6c, 0x24, 0xab, 0xb5, 0x99, 0xe3, 0x59, 0x30, 
+	0x1c, 0x41, 0xc5, 0x3b, 0xc1, 0x62, 0x2d, 0xc5, 0x62, 0xed, 
+	0x3d, 0x8e, 0xd, 0x14, 0xd6, 0x33, 0x9d, 0xcf, 0x46, 0x44, 
+	0xf9, 0xdd, 0x53, 0xb0, 0x68, 0x15, 0xb8, 0x89, 0x2c, 0x5c, 
+	0x97, 0x80, 0x2c, 0xe9, 0x44, 0xa, 0x89, 0xd, 0x17, 0xdc, 
+	0xa3, 0x71, 0x96, 0xc1, 0xd, 0xb2, 0xa, 0x71, 0xd0, 0x4b, 
+	0x3f, 0xe4, 0x91, 0x99, 0x78, 0x89, 0x45, 0x20, 0x45, 0xc3, 
+	0xeb, 0x3a, 0x1e, 0x80, 0x6d, 0x24, 0xdc, 0xc6, 0x52, 0x7e, 
+	0x46, 0x57, 0x49, 0x3c, 0x20, 0x4, 0x8a, 0x81, 0x25, 0x20, 
+	0x10, 0x6a, 0x23, 0x9, 0x9a, 0xe5, 0x7b, 0x2c, 0xc5, 0x80, 
+	0x50, 0x27, 0x9, 0x90, 0x94, 0x45, 0xc4, 0xc3, 0x88, 0x20, 
+	0xb0, 0xf0, 0x4d, 0x3d, 0x75, 0xc2, 0x56, 0xfe, 0xfb, 0x46, 
+	0x63, 0xc0, 0x7e, 0x1d, 0x3b, 0x6a, 0xe1, 0xd2, 0x5, 0x3e, 
+	0x6b, 0xbf, 0x7b, 0xb5, 0xd3, 0x6, 0x49, 0x84, 0x2, 0x5a, 
+	0xec, 0xfe, 0x34, 0x75, 0xc8, 0x37, 0xd5, 0x39, 0xab, 0xc2, 
+	0x58, 0x2e, 0x19, 0x42, 0x2b, 0xa0, 0x3f, 0x23, 0x35, 0x11, 
+	0xa0, 0x6a, 0x64, 0x47, 0xe7, 0x9f, 0x62, 0x80, 0xe2, 0x37, 
+	0xfe, 0xda, 0xfe, 0x79, 0x4, 0x31, 0x49, 0xc9, 0x7f, 0x97, 
+	0xae, 0x6f, 0x58, 0xe4, 0x3b, 0x7, 0xbe, 0x50, 0x45, 0x33, 
+	0x35, 0x3d, 0x6d, 0x60, 0x9, 0xc6, 0xe4, 0x24, 0xc5, 0xab, 
+	0x30, 0x9e, 0x88, 0xe2, 0xe6, 0xdd, 0x7b, 0x11, 0xbb, 0x6c, 
+	0x5c, 0x13, 0x8e, 0x94, 0x95, 0x10, 0x4, 0x63, 0x56, 0x84, 
+	0xe8, 0xf6, 0x58, 0x4a, 0x46, 0xe4, 0xb1, 0x75, 0x3d, 0x3c, 
+	0x5, 0xf1, 0x6d, 0x10, 0xf, 0xb, 0x44, 0x94, 0x8f, 0x32, 
+	0x5d, 0x27, 0x14, 0xf3, 0x44, 0x16, 0xa5, 0xa6, 0xd0, 0x32, 
+	0xf0, 0xe7, 0x30, 0xd4, 0x70, 0x3b, 0x89, 0xe2, 0x1a, 0xa9, 
+	0xa6, 0x6c, 0x8a, 0x11, 0x62, 0xf9, 0xe6, 0xa, 0x3d, 0x56, 
+	0x83, 0x90, 0xff, 0x46, 0x3a, 0xef, 0xcb, 0xcd, 0xf, 0x56, 
+	0xbd, 0x26, 0x4c, 0xae, 0x1, 0x6e, 0x96, 0xf5, 0x6, 0xdd, 
+	0x7f, 0x2, 0xba, 0x99, 0xc7, 0x82, 0x7a, 0x4d, 0x8e, 0xa0, 
+	0xd6, 0x88, 0x26, 0x23, 0x42, 0x71, 0x5, 0x7e, 0x6f, 0x72, 
+	0xe0, 0xc5, 0x70, 0x43, 0xb6, 0x8b, 0x9a, 0x58, 0x4d, 0x61, 
+	0x5e, 0x90, 0xb8, 0xe1, 0x30, 0x48, 0x36, 0xb4, 0xcf, 0xc0, 
+	0x42, 0xfb, 0x3b, 0x9, 0x59, 0x12, 0xdf, 0xd3, 0xc5, 0x75, 
+	0x11, 0xdf, 0xc5, 0x7d, 0x12, 0xdf, 0x63, 0x2, 0x44, 0xaa, 
+	0x91, 0x2b, 0xaf, 0x4, 0xfa, 0x89, 0x80, 0x2a, 0x9d, 0x8f, 
+	0xb6, 0xea, 0x12, 0xb4, 0x52, 0xaa, 0x92, 0x93, 0x59, 0xf5, 
+	0x5a, 0x5c, 0x5d, 0x8b, 0xc7, 0xa3, 0xc0, 00, 0x64, 0x51, 
+	0x71, 0x66, 0x32, 0xa6, 0x7e, 0xc0, 0x4b, 0x84, 0x89, 0xba, 
+	0x94, 0xa4, 0x4b, 0xbc, 0x4f, 0xfd, 0xf5, 0xb, 0xb8, 0x14, 
+	0x7f, 0x6c, 0x3, 0x86, 0x22, 0xfe, 0xaa, 0xc8, 0xff, 0x1, 
+	0xc9, 0x49, 0xac, 0x95, 0x5d, 0x44, 00, 00, 0};
+
+static const char headers_index_html[] = "Content-Type: text/html\r\nContent-Encoding: gzip\r\nETag: \"abe6a63557bfb0c2\"\r\nLast-Modified: Mon, 15 Jun 2020 18:06:39 GMT\r\nCache-Control: no-cache\r\n\r\n";
+static const char etag_index_html[] = "\"abe6a63557bfb0c2\"";
+static const char modified_index_html[] = "Mon, 15 Jun 2020 18:06:39 GMT";
 
-const struct httpd_fsdata_file file_index_html[] = {{NULL, data_index_html, data_index_html + 12, sizeof(data_index_html) - 13}};
+const struct httpd_fsdata_file file_functions_js[] = {{NULL, data_functions_js, data_functions_js + 14, sizeof(data_functions_js) - 15, headers_functions_js, etag_functions_js, modified_functions_js}};
 
-const struct httpd_fsdata_file file_404_html[] = {{file_index_html, data_404_html, data_404_html + 10, sizeof(data_404_html) - 11}};
+const struct httpd_fsdata_file file_404_html[] = {{file_functions_js, data_404_html, data_404_html + 10, sizeof(data_404_html) - 11, headers_404_html, etag_404_html, modified_404_html}};
 
-const struct httpd_fsdata_file file_functions_js[] = {{file_404_html, data_functions_js, data_functions_js + 14, sizeof(data_functions_js) - 15}};
+const struct httpd_fsdata_file file_index_html[] = {{file_404_html, data_index_html, data_index_html + 12, sizeof(data_index_html) - 13, headers_index_html, etag_index_html, modified_index_html}};
 
-#define HTTPD_FS_ROOT file_functions_js
+#define HTTPD_FS_ROOT file_index_html
 
 #define HTTPD_FS_NUMFILES 3
@@ -76,6 +76,8 @@
 #include "CallbackStream.h"
 
 #include "c-fifo.h"
+#include "upload.h"
+#include "clock.h"
 
 #define STATE_WAITING 0
 #define STATE_HEADERS 1
@@ -141,43 +143,42 @@ static void create_callback_stream(struct httpd_state *s)
     s->pstream = new_callback_stream(command_result, s);
 }
 
-// Used to save files to SDCARD during upload
-static FILE *fd;
-static char *output_filename = NULL;
-static int file_cnt = 0;
-static int open_file(const char *fn)
+// Used to save files to SDCARD during upload, only one connection can be uploading at a time
+static struct upload_state upload;
+static clock_time_t upload_start;
+
+static int open_file(struct httpd_state *s)
 {
-    if (output_filename != NULL) free(output_filename);
-    output_filename = malloc(strlen(fn) + 5);
-    strcpy(output_filename, "/sd/");
-    strcat(output_filename, fn);
-    fd = fopen(output_filename, "w");
-    if (fd == NULL) {
-        free(output_filename);
-        output_filename = NULL;
-        return 0;
-    }
+    // the path is only taken over by the upload if it is not already busy with another connection's file
+    char path[sizeof(s->upload_name) + 4];
+    strcpy(path, "/sd/");
+    strcat(path, s->upload_name);
+    if (!upload_open(&upload, path, s)) return 0;
+    upload_start = clock_time();
     return 1;
 }
 
-static int close_file()
+static void fail_file(void)
 {
-    free(output_filename);
-    output_filename = NULL;
-    fclose(fd);
-    return 1;
+    upload_abort(&upload);
 }
 
-static int save_file(uint8_t *buf, unsigned int len)
+static int close_file(struct httpd_state *s)
 {
-    if (fwrite(buf, 1, len, fd) == len) {
-        file_cnt += len;
-        return 1;
-
-    } else {
-        close_file();
+    int ok = upload_close(&upload);
+    s->upload_size = upload.total;
+    s->upload_time = (clock_time() - upload_start) * 1000 / CLOCK_SECOND;
+    s->upload_crc = upload_crc(&upload);
+    if (!ok) {
+        remove(upload.path);
         return 0;
     }
+    if (s->has_checksum && s->checksum != s->upload_crc) {
+        DEBUG_PRINTF("checksum mismatch, got %08lX expected %08lX\n", s->upload_crc, s->checksum);
+        remove(upload.path);
+        return 2;
+    }
+    return 1;
 }
 
 static int fs_open(struct httpd_state *s)
@@ -291,7 +292,11 @@ static PT_THREAD(send_headers_3(struct httpd_state *s, const char *statushdr, ch
     PSOCK_SEND_STR(&s->sout, statushdr);
     PSOCK_SEND_STR(&s->sout, http_header_all);
 
-    if (send_content_type) {
+    if (send_content_type && s->fd == NULL && s->file.headers != NULL) {
+        // built in files have their content type, encoding and cache headers made when the web pages are built
+        PSOCK_SEND_STR(&s->sout, s->file.headers);
+
+    } else if (send_content_type) {
         ptr = strrchr(s->filename, ISO_period);
         if (ptr == NULL) {
             PSOCK_SEND_STR(&s->sout, http_content_type_plain); // http_content_type_binary);
@@ -327,7 +332,12 @@ PT_THREAD(handle_output(struct httpd_state *s))
         PSOCK_SEND_STR(&s->sout, "OK\r\n");
     }
     else if (s->method == POST) {
-        if (strcmp(s->filename, "/command") == 0) {
+        if (s->command_failed && (strcmp(s->filename, "/command") == 0 || strcmp(s->filename, "/command_silent") == 0)) {
+            DEBUG_PRINTF("Command post failed, queue was full\n");
+            PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_503));
+            PSOCK_SEND_STR(&s->sout, "FAILED\r\n");
+
+        } else if (strcmp(s->filename, "/command") == 0) {
             DEBUG_PRINTF("Executed command post\n");
             PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_200));
             // send response as we get it
@@ -342,9 +352,18 @@ PT_THREAD(handle_output(struct httpd_state *s))
             if (s->uploadok == 0) {
                 PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_503));
                 PSOCK_SEND_STR(&s->sout, "FAILED\r\n");
+            } else if (s->uploadok == 2) {
+                PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_503));
+                snprintf(s->inputbuf, sizeof(s->inputbuf), "FAILED checksum %08lX expected %08lX\r\n", (unsigned long)s->upload_crc, (unsigned long)s->checksum);
+                PSOCK_SEND_STR(&s->sout, s->inputbuf);
             } else {
                 PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_200));
-                PSOCK_SEND_STR(&s->sout, "OK\r\n");
+                // the size, time, rate and checksum are there for the client to check and log
+                snprintf(s->inputbuf, sizeof(s->inputbuf), "OK %lu bytes %lu ms %lu KB/s crc32 %08lX\r\n",
+                         (unsigned long)s->upload_size, (unsigned long)s->upload_time,
+                         (unsigned long)(s->upload_time > 0 ? s->upload_size / s->upload_time * 1000 / 1024 : 0),
+                         (unsigned long)s->upload_crc);
+                PSOCK_SEND_STR(&s->sout, s->inputbuf);
             }
 
         } else {
@@ -370,15 +389,10 @@ PT_THREAD(handle_output(struct httpd_state *s))
             PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_404));
             PT_WAIT_THREAD(&s->outputpt, send_file(s));
 
-        } else if (s->cache_page) {
-            if (s->fd != NULL) {
-                // if it was an sd file then we need to close it
-                fclose(s->fd);
-                s->fd = NULL;
-            }
-            // tell it it has not changed
+        } else if (s->cache_page && s->fd == NULL) {
+            // tell it it has not changed, only built in files have an etag so files on the sdcard are always sent
             DEBUG_PRINTF("304 Not Modified\n");
-            PT_WAIT_THREAD(&s->outputpt, send_headers_3(s, http_header_304, 0));
+            PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_304));
 
         } else {
             DEBUG_PRINTF("sending file %s\n", s->filename);
@@ -426,7 +440,7 @@ static PT_THREAD(handle_uploaded_data(struct httpd_state *s, uint8_t *buf, int l
     DEBUG_PRINTF("Uploading file: %s, %d\n", s->upload_name, s->content_length);
 
     // The body is the raw data to be stored to the file
-    if (!open_file(s->upload_name)) {
+    if (!open_file(s)) {
         DEBUG_PRINTF("failed to open file\n");
         s->uploadok = 0;
         PT_EXIT(&s->inputpt);
@@ -436,8 +450,9 @@ static PT_THREAD(handle_uploaded_data(struct httpd_state *s, uint8_t *buf, int l
 
     if (len > 0) {
         // write the first part of the buffer
-        if (!save_file(buf, len)) {
+        if (!upload_write(&upload, buf, len)) {
             DEBUG_PRINTF("initial write failed\n");
+            fail_file();
             s->uploadok = 0;
             PT_EXIT(&s->inputpt);
         }
@@ -456,8 +471,9 @@ static PT_THREAD(handle_uploaded_data(struct httpd_state *s, uint8_t *buf, int l
         //DEBUG_PRINTF("read %d bytes of data\n", readlen);
 
         if (readlen > 0) {
-            if (!save_file(readptr, readlen)) {
+            if (!upload_write(&upload, readptr, readlen)) {
                 DEBUG_PRINTF("write failed\n");
+                fail_file();
                 s->uploadok = 0;
                 PT_EXIT(&s->inputpt);
             }
@@ -465,9 +481,8 @@ static PT_THREAD(handle_uploaded_data(struct httpd_state *s, uint8_t *buf, int l
         }
     }
 
-    close_file();
-    s->uploadok = 1;
-    DEBUG_PRINTF("finished upload\n");
+    s->uploadok = close_file(s);
+    DEBUG_PRINTF("finished upload %d, %lu bytes in %lu ms\n", s->uploadok, s->upload_size, s->upload_time);
 
     PT_END(&s->inputpt);
 }
@@ -506,12 +521,16 @@ PT_THREAD(handle_input(struct httpd_state *s))
     }
 
     DEBUG_PRINTF("filename: %s\n", s->filename);
+    // the body of these is fed to the command queue, so the receive window has to be kept to what it can take
+    s->command_post = s->method == POST && (strcmp(s->filename, "/command") == 0 || strcmp(s->filename, "/command_silent") == 0);
 
     /*  httpd_log_file(uip_conn->ripaddr, s->filename);*/
 
     s->state = STATE_HEADERS;
     s->content_length = 0;
     s->cache_page = 0;
+    s->has_checksum = 0;
+    s->command_failed = 0;
     while (1) {
         if (s->state == STATE_HEADERS) {
             // read the headers of the request
@@ -545,9 +564,25 @@ PT_THREAD(handle_input(struct httpd_state *s))
                     strncpy(s->upload_name, &s->inputbuf[12], sizeof(s->upload_name) - 1);
                     DEBUG_PRINTF("Upload name= %s\n", s->upload_name);
 
-                } else if (strncmp(s->inputbuf, http_cache_control, sizeof(http_cache_control) - 1) == 0) {
+                } else if (strncmp(s->inputbuf, "X-Checksum: ", 11) == 0) {
+                    // optional CRC-32 of the uploaded file, as hex
                     s->inputbuf[PSOCK_DATALEN(&s->sin) - 2] = 0;
-                    s->cache_page = strncmp(http_no_cache, &s->inputbuf[sizeof(http_cache_control) - 1], sizeof(http_no_cache) - 1) != 0;
+                    s->checksum = strtoul(&s->inputbuf[12], NULL, 16);
+                    s->has_checksum = 1;
+
+                } else if (strncmp(s->inputbuf, http_if_none_match, sizeof(http_if_none_match) - 1) == 0) {
+                    // the browser already has a copy, if it is the one we have built in it need not be sent again
+                    s->inputbuf[PSOCK_DATALEN(&s->sin) - 2] = 0;
+                    if (s->method == GET && httpd_fs_open(s->filename, &s->file)) {
+                        s->cache_page = strcmp(s->file.etag, &s->inputbuf[sizeof(http_if_none_match) - 1]) == 0;
+                    }
+                    DEBUG_PRINTF("cache page= %d\n", s->cache_page);
+
+                } else if (strncmp(s->inputbuf, http_if_modified_since, sizeof(http_if_modified_since) - 1) == 0) {
+                    s->inputbuf[PSOCK_DATALEN(&s->sin) - 2] = 0;
+                    if (s->method == GET && httpd_fs_open(s->filename, &s->file)) {
+                        s->cache_page |= strcmp(s->file.modified, &s->inputbuf[sizeof(http_if_modified_since) - 1]) == 0;
+                    }
                     DEBUG_PRINTF("cache page= %d\n", s->cache_page);
                 }
             }
@@ -576,8 +611,21 @@ PT_THREAD(handle_input(struct httpd_state *s))
                     s->content_length -= PSOCK_DATALEN(&s->sin);
                     // stick the command  on the command queue, with this connections stream output
                     DEBUG_PRINTF("Adding command: %s, left: %d\n", s->inputbuf, s->content_length);
-                    network_add_command(s->inputbuf, s->pstream);
-                    s->command_count++; // count number of command lines we submit
+                    if(s->inputbuf[0] == 0 || s->command_failed) {
+                        // blank lines do nothing, and once a line has been lost the rest of the body is just read and discarded
+
+                    } else if(network_add_command(s->inputbuf, s->pstream)) {
+                        s->command_count++; // count number of command lines we submit
+
+                    } else {
+                        // no room for it, the whole request fails rather than running with a line missing
+                        DEBUG_PRINTF("Command queue full, dropped: %s\n", s->inputbuf);
+                        s->command_failed= 1;
+                    }
+                    // stop reading when the command queue is getting full, the rest of this segment still fits
+                    if(network_command_queue_full()) {
+                        uip_stop();
+                    }
                 }
                 DEBUG_PRINTF("Read body done\n");
                 s->state = STATE_OUTPUT;
@@ -639,9 +687,11 @@ httpd_appcall(void)
         /*    timer_set(&s->timer, CLOCK_SECOND * 100);*/
         s->timer = 0;
         s->fd = NULL;
+        s->file.headers = NULL;
         s->strbuf = NULL;
         s->fifo = NULL;
         s->pstream = NULL;
+        s->command_post = 0;
     }
 
     if (s == NULL) {
@@ -651,7 +701,14 @@ httpd_appcall(void)
     }
 
     // check for timeout on connection here so we can cleanup if we abort
-    if (uip_poll()) {
+    if (uip_poll() && uip_stopped(uip_conn)) {
+        // stopped waiting for the command queue to drain, which is not a timeout
+        s->timer = 0;
+        if (network_command_queue_has_room()) {
+            uip_restart();
+        }
+
+    } else if (uip_poll()) {
         ++s->timer;
         if (s->timer >= 20 * 2) { // we have a 0.5 second poll and we want 20 second timeout
             DEBUG_PRINTF("Timer expired, aborting\n");
@@ -663,7 +720,8 @@ httpd_appcall(void)
 
     if (uip_closed() || uip_aborted() || uip_timedout()) {
         DEBUG_PRINTF("Closing connection: %d\n", HTONS(uip_conn->rport));
-        if (s->fd != NULL) fclose(fd); // clean up
+        if (s->fd != NULL) fclose(s->fd); // clean up
+        if (upload.owner == s) fail_file(); // connection dropped part way through an upload
         if (s->strbuf != NULL) free(s->strbuf);
         if (s->pstream != NULL) {
             // free these if they were allocated
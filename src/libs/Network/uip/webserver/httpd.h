@@ -55,11 +55,18 @@ struct httpd_state {
   int content_length;
   uint16_t count;
   uint8_t uploadok;
+  uint8_t has_checksum;
+  uint32_t checksum;
+  uint32_t upload_size;
+  uint32_t upload_time;
+  uint32_t upload_crc;
   uint8_t upload_state;
   uint8_t cache_page;
   void *pstream;
   void *fifo;
   uint16_t command_count;
+  uint8_t command_failed;
+  uint8_t command_post;
 };
 
 #ifdef __cplusplus
@@ -1,5 +1,29 @@
 #!/usr/bin/perl
 
+# Builds httpd-fsdata2.h from the files in httpd-fs.
+# Text files are stored gzipped (served with Content-Encoding: gzip), and each file gets a
+# prebuilt block of response headers with its ETag and Last-Modified, so a browser that
+# already has it can be answered with a 304 Not Modified and nothing else
+
+use IO::Compress::Gzip qw(gzip $GzipError);
+use Digest::MD5 qw(md5_hex);
+use POSIX qw(strftime);
+
+%types = (
+    "html" => "text/html",
+    "htm"  => "text/html",
+    "css"  => "text/css",
+    "js"   => "application/javascript",
+    "png"  => "image/png",
+    "gif"  => "image/gif",
+    "jpg"  => "image/jpeg",
+    "ico"  => "image/x-icon",
+    "txt"  => "text/plain",
+);
+
+# these are already compressed
+%nogzip = ("png" => 1, "gif" => 1, "jpg" => 1);
+
 open(OUTPUT, "> httpd-fsdata2.h");
 
 chdir("httpd-fs");
@@ -21,12 +45,47 @@ foreach $file (@files) {
     }
 }
 
+sub c_string {
+    my $str = shift(@_);
+    $str =~ s/\\/\\\\/g;
+    $str =~ s/"/\\"/g;
+    $str =~ s/\r/\\r/g;
+    $str =~ s/\n/\\n/g;
+    return "\"$str\"";
+}
+
 foreach $file (@files) {
     if(-f $file) {
 
-	print "Adding file $file\n";
-
 	open(FILE, $file) || die "Could not open file $file\n";
+	binmode(FILE);
+	local $/;
+	$content = <FILE>;
+	close(FILE);
+
+	$mtime = (stat($file))[9];
+	($ext) = $file =~ /\.([^.\/]+)$/;
+	$ext = lc($ext);
+	$type = exists $types{$ext} ? $types{$ext} : "text/plain";
+
+	# the etag is taken from the original content so it stays the same whether or not it gets compressed
+	$etag = "\"" . substr(md5_hex($content), 0, 16) . "\"";
+	$modified = strftime("%a, %d %b %Y %H:%M:%S GMT", gmtime($mtime));
+
+	$headers = "Content-Type: $type\r\n";
+	if(!exists $nogzip{$ext}) {
+	    gzip(\$content => \$zipped, Minimal => 1, -Level => 9) or die "gzip failed: $GzipError\n";
+	    if(length($zipped) < length($content)) {
+		print "Adding file $file, gzipped " . length($content) . " to " . length($zipped) . " bytes\n";
+		$content = $zipped;
+		$headers .= "Content-Encoding: gzip\r\n";
+	    } else {
+		print "Adding file $file\n";
+	    }
+	} else {
+	    print "Adding file $file\n";
+	}
+	$headers .= "ETag: $etag\r\nLast-Modified: $modified\r\nCache-Control: no-cache\r\n\r\n";
 
 	$file =~ s-^-/-;
 	$fvar = $file;
@@ -42,11 +101,11 @@ foreach $file (@files) {
 
 
 	$i = 0;
-	while(read(FILE, $data, 1)) {
+	for($j = 0; $j < length($content); $j++) {
 	    if($i == 0) {
 		print(OUTPUT "\t");
 	    }
-	    printf(OUTPUT "%#02x, ", unpack("C", $data));
+	    printf(OUTPUT "%#02x, ", unpack("C", substr($content, $j, 1)));
 	    $i++;
 	    if($i == 10) {
 		print(OUTPUT "\n");
@@ -54,7 +113,11 @@ foreach $file (@files) {
 	    }
 	}
 	print(OUTPUT "0};\n\n");
-	close(FILE);
+
+	print(OUTPUT "static const char headers".$fvar."[] = " . c_string($headers) . ";\n");
+	print(OUTPUT "static const char etag".$fvar."[] = " . c_string($etag) . ";\n");
+	print(OUTPUT "static const char modified".$fvar."[] = " . c_string($modified) . ";\n\n");
+
 	push(@fvars, $fvar);
 	push(@pfiles, $file);
     }
@@ -71,7 +134,8 @@ for($i = 0; $i < @fvars; $i++) {
     }
     print(OUTPUT "const struct httpd_fsdata_file file".$fvar."[] = {{$prevfile, data$fvar, ");
     print(OUTPUT "data$fvar + ". (length($file) + 1) .", ");
-    print(OUTPUT "sizeof(data$fvar) - ". (length($file) + 2) ."}};\n\n"); # don't include the terminating nul
+    print(OUTPUT "sizeof(data$fvar) - ". (length($file) + 2) .", "); # don't include the terminating nul
+    print(OUTPUT "headers$fvar, etag$fvar, modified$fvar}};\n\n");
 }
 
 print(OUTPUT "#define HTTPD_FS_ROOT file$fvars[$i - 1]\n\n");
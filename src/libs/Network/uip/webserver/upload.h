@@ -0,0 +1,41 @@
+#ifndef _UPLOAD_H_
+#define _UPLOAD_H_
+
+// Writes an uploaded file to the sdcard, the network hands it whatever size chunks it receives
+// and they are gathered into a buffer that is written out in whole multi sector bursts.
+// It knows nothing about uIP so it can be fed from anything that produces chunks.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPLOAD_SECTOR_SIZE 512
+#define UPLOAD_BUFFER_SECTORS 8
+#define UPLOAD_PATH_SIZE 64
+
+struct upload_state {
+    FILE *fd;
+    char *buf;
+    unsigned int size;  // size of buf, a multiple of the sector size
+    unsigned int len;   // bytes waiting in buf
+    uint32_t total;     // bytes received so far
+    uint32_t crc;       // running CRC-32 of the data received
+    void *owner;        // the connection doing the upload
+    char path[UPLOAD_PATH_SIZE]; // the file being written, only set once the upload has been opened
+};
+
+int upload_open(struct upload_state *u, const char *fn, void *owner);
+int upload_write(struct upload_state *u, const uint8_t *data, unsigned int len);
+int upload_close(struct upload_state *u);
+void upload_abort(struct upload_state *u);
+uint32_t upload_crc(const struct upload_state *u);
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
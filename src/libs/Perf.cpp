@@ -0,0 +1,37 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Perf.h"
+
+#ifdef ENABLE_PERF
+namespace Perf {
+    const char * const isr_names[NUMBER_OF_ISRS] = {
+        "step tick",
+        "unstep tick",
+        "slow ticker",
+        "block finish",
+        "adc",
+    };
+    perf_counter_t isrs[NUMBER_OF_ISRS];
+    std::atomic<uint32_t> isr_cycles(0);
+
+    // start the cycle counter, it is only stopped by a reset
+    void init()
+    {
+        reset();
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    void reset()
+    {
+        for(auto &c : isrs) c.reset();
+    }
+}
+#endif
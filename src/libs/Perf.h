@@ -0,0 +1,65 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+// Optional cycle counting of the interrupts and the module event handlers, using the DWT cycle counter.
+// Build with ENABLE_PERF=1 to turn it on, otherwise it all compiles away. The results are shown by the perf shell command.
+
+struct perf_counter_t {
+    uint32_t calls;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+
+    void record(uint32_t cycles) {
+        calls++;
+        total += cycles;
+        if(cycles < min) min= cycles;
+        if(cycles > max) max= cycles;
+    }
+    void reset() { calls= 0; min= 0xFFFFFFFF; max= 0; total= 0; }
+};
+
+#ifdef ENABLE_PERF
+#include "LPC17xx.h"
+#include <atomic>
+
+namespace Perf {
+    enum ISR_ID {
+        STEP_TICK,
+        UNSTEP_TICK,
+        SLOW_TICK,
+        FINISH,
+        ADC_SAMPLE,
+        NUMBER_OF_ISRS
+    };
+    extern const char * const isr_names[NUMBER_OF_ISRS];
+    extern perf_counter_t isrs[NUMBER_OF_ISRS];
+    // all the cycles counted in the interrupts above, so they can be taken out of whatever they preempted
+    extern std::atomic<uint32_t> isr_cycles;
+
+    void init();
+    void reset();
+}
+
+// the count leaves out the counted interrupts that ran in between, but not any others
+#define PERF_START(v) uint32_t v= DWT->CYCCNT, v##_isr= Perf::isr_cycles
+#define PERF_END(counter, v) (counter).record(DWT->CYCCNT - (v) - (Perf::isr_cycles - v##_isr))
+#define PERF_ISR(id, v) do { \
+        uint32_t v##_own= DWT->CYCCNT - (v) - (Perf::isr_cycles - v##_isr); \
+        Perf::isrs[Perf::id].record(v##_own); \
+        Perf::isr_cycles += v##_own; \
+    } while(0)
+#else
+#define PERF_START(v)
+#define PERF_END(counter, v)
+#define PERF_ISR(id, v)
+#endif
@@ -2,12 +2,46 @@
 #include "PublicData.h"
 #include "PublicDataRequest.h"
 
+#include <algorithm>
+
+PublicData::table_t PublicData::getters;
+PublicData::table_t PublicData::setters;
+
+void PublicData::add_handler(table_t& table, uint16_t csa, uint16_t csb, handler_t handler)
+{
+    auto key_less= [](const handler_entry_t& e, uint32_t k) { return e.key < k; };
+    uint32_t key= ((uint32_t)csa << 16) | csb;
+    // after any others with the same key so they are called in the order they registered
+    table_t::iterator i= std::lower_bound(table.begin(), table.end(), key + 1, key_less);
+    table.insert(i, {key, handler});
+}
+
+// returns false if nothing has registered for csa, in which case the request needs to be broadcast
+bool PublicData::call_handlers(const table_t& table, uint16_t csa, uint16_t csb, PublicDataRequest *pdr)
+{
+    auto key_less= [](const handler_entry_t& e, uint32_t k) { return e.key < k; };
+    uint32_t first= (uint32_t)csa << 16;
+    table_t::const_iterator i= std::lower_bound(table.begin(), table.end(), first, key_less);
+    if(i == table.end() || (i->key >> 16) != csa) return false;
+
+    // the handlers for (csa, 0) come first and match any csb
+    for(; i != table.end() && i->key == first; ++i) i->handler(pdr);
+
+    if(csb != 0) {
+        uint32_t key= first | csb;
+        for(i= std::lower_bound(i, table.end(), key, key_less); i != table.end() && i->key == key; ++i) i->handler(pdr);
+    }
+    return true;
+}
+
 bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
     PublicDataRequest pdr(csa, csb, csc);
     // the caller may have created the storage for the returned data so we clear the flag,
     // if it gets set by the callee setting the data ptr that means the data is a pointer to a pointer and is set to a pointer to the returned data
     pdr.set_data_ptr(data, false);
-    THEKERNEL->call_event(ON_GET_PUBLIC_DATA, &pdr );
+    if(!call_handlers(getters, csa, csb, &pdr)) {
+        THEKERNEL->call_event(ON_GET_PUBLIC_DATA, &pdr );
+    }
     if(pdr.is_taken() && pdr.has_returned_data()) {
         // the callee set the returned data pointer
         *(void**)data= pdr.get_data_ptr();
@@ -18,6 +52,8 @@ bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data)
 bool PublicData::set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
     PublicDataRequest pdr(csa, csb, csc);
     pdr.set_data_ptr(data);
-    THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
+    if(!call_handlers(setters, csa, csb, &pdr)) {
+        THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
+    }
     return pdr.is_taken();
 }
@@ -8,6 +8,12 @@
 #ifndef PUBLICDATA_H
 #define PUBLICDATA_H
 
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+class PublicDataRequest;
+
 class PublicData {
     public:
         // there are two ways to get data from a module
@@ -23,6 +29,27 @@ class PublicData {
         static bool set_value(uint16_t csa, uint16_t csb, void *data) { return set_value(csa, csb, 0, data); }
         static bool set_value(uint16_t cs[3], void *data) { return set_value(cs[0], cs[1], cs[2], data); }
         static bool set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data);
+
+        // a module that provides data registers a handler for each (csa, csb) it answers, a csb of 0 matches any csb
+        // requests for a csa that has handlers go straight to the matching ones, several can share a key and all are called
+        // requests for a csa nobody has registered are broadcast as ON_GET_PUBLIC_DATA/ON_SET_PUBLIC_DATA to every module as before
+        using handler_t= std::function<void(PublicDataRequest *)>;
+        static void register_get(uint16_t csa, uint16_t csb, handler_t handler) { add_handler(getters, csa, csb, handler); }
+        static void register_set(uint16_t csa, uint16_t csb, handler_t handler) { add_handler(setters, csa, csb, handler); }
+
+    private:
+        struct handler_entry_t {
+            uint32_t key; // csa << 16 | csb
+            handler_t handler;
+        };
+        using table_t= std::vector<handler_entry_t>;
+
+        static void add_handler(table_t& table, uint16_t csa, uint16_t csb, handler_t handler);
+        static bool call_handlers(const table_t& table, uint16_t csa, uint16_t csb, PublicDataRequest *pdr);
+
+        // kept sorted by key
+        static table_t getters;
+        static table_t setters;
 };
 
 #endif
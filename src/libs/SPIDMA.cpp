@@ -0,0 +1,174 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SPIDMA.h"
+#include "GPDMA.h"
+#include "us_ticker_api.h"
+
+#define SSP_SR_RNE (1 << 2)
+#define SSP_DMACR_RXDMAE (1 << 0)
+#define SSP_DMACR_TXDMAE (1 << 1)
+
+// longer than the largest transfer takes at the slowest SPI clock
+#define DMA_TIMEOUT_US 500000
+
+// the DMA clocks out dma_fill when only receiving, and dumps the received bytes in dma_sink when only sending
+// both must be in AHB SRAM for the DMA to reach them
+static uint8_t dma_fill __attribute__ ((section ("AHBSRAM0")));
+static uint8_t dma_sink __attribute__ ((section ("AHBSRAM0")));
+
+volatile bool SPIDMA::ssp_busy[2]= {false, false};
+SPIDMA * volatile SPIDMA::ssp_owner[2]= {nullptr, nullptr};
+
+SPIDMA::SPIDMA(PinName mosi, PinName miso, PinName sclk) : mbed::SPI(mosi, miso, sclk)
+{
+    tx_ch = rx_ch = -1;
+    dma_setup = false;
+    if(_spi.spi == LPC_SSP0) {
+        ssp_index = 0;
+        tx_periph = GPDMA::SSP0_TX;
+        rx_periph = GPDMA::SSP0_RX;
+    } else {
+        ssp_index = 1;
+        tx_periph = GPDMA::SSP1_TX;
+        rx_periph = GPDMA::SSP1_RX;
+    }
+}
+
+SPIDMA::~SPIDMA()
+{
+    wait();
+    if(rx_ch >= 0) GPDMA::free_channel(rx_ch);
+    if(tx_ch >= 0) GPDMA::free_channel(tx_ch);
+}
+
+// channels are allocated on first use, the receive channel first so it gets the higher priority and the receive fifo can not overrun
+bool SPIDMA::setup_dma()
+{
+    if(!dma_setup) {
+        dma_setup = true;
+        rx_ch = GPDMA::alloc_channel([this](bool ok) { this->dma_done(ok); });
+        if(rx_ch >= 0) {
+            // the transmit channel only interrupts on an error, which would otherwise leave the receive channel waiting forever
+            tx_ch = GPDMA::alloc_channel([this](bool ok) { if(!ok) this->dma_done(false); });
+            if(tx_ch < 0) {
+                GPDMA::free_channel(rx_ch);
+                rx_ch = -1;
+            }
+        }
+    }
+    return rx_ch >= 0;
+}
+
+bool SPIDMA::can_dma(const void *buf, size_t len)
+{
+    return len > 1 && GPDMA::is_dma_memory(buf, len) && setup_dma();
+}
+
+// start one DMA transfer of upto GPDMA::CONTROL_SIZE_MAX bytes, a null tx sends dma_fill, a null rx discards what is received
+void SPIDMA::transfer(const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    wait();
+    aquire();
+
+    LPC_SSP_TypeDef *ssp = _spi.spi;
+
+    // empty the receive fifo and clear any overrun
+    while(ssp->SR & SSP_SR_RNE) (void)ssp->DR;
+    ssp->ICR = 3;
+
+    dma_fill = 0xFF;
+    ssp_owner[ssp_index] = this;
+    ssp_busy[ssp_index] = true;
+
+    const uint32_t control = len | GPDMA::CONTROL_SBSIZE_4 | GPDMA::CONTROL_DBSIZE_4 | GPDMA::CONTROL_SWIDTH_BYTE | GPDMA::CONTROL_DWIDTH_BYTE;
+    GPDMA::start(rx_ch, &ssp->DR, rx ? rx : &dma_sink, control | (rx ? GPDMA::CONTROL_DI : 0) | GPDMA::CONTROL_I,
+                 GPDMA::config_p2m((GPDMA::PERIPHERAL)rx_periph) | GPDMA::CONFIG_IE | GPDMA::CONFIG_ITC);
+    GPDMA::start(tx_ch, tx ? tx : &dma_fill, &ssp->DR, control | (tx ? GPDMA::CONTROL_SI : 0),
+                 GPDMA::config_m2p((GPDMA::PERIPHERAL)tx_periph) | GPDMA::CONFIG_IE);
+    ssp->DMACR = SSP_DMACR_RXDMAE | SSP_DMACR_TXDMAE;
+}
+
+// called from the DMA interrupt when the last byte has been received, so it has also been sent
+// or with ok false when either channel had an error or the transfer timed out
+void SPIDMA::dma_done(bool ok)
+{
+    _spi.spi->DMACR = 0;
+    if(!ok) {
+        GPDMA::stop(tx_ch);
+        GPDMA::stop(rx_ch);
+    }
+    ssp_busy[ssp_index] = false;
+    if(done_fnc) {
+        std::function<void()> fnc = done_fnc;
+        done_fnc = nullptr;
+        fnc();
+    }
+}
+
+void SPIDMA::wait()
+{
+    if(!ssp_busy[ssp_index]) return;
+
+    uint32_t start = us_ticker_read();
+    while(ssp_busy[ssp_index]) {
+        if(us_ticker_read() - start > DMA_TIMEOUT_US) {
+            // the transfer is stuck, abort it on behalf of whichever SPIDMA started it
+            __disable_irq();
+            SPIDMA *owner = ssp_owner[ssp_index];
+            if(ssp_busy[ssp_index] && owner != nullptr) owner->dma_done(false);
+            __enable_irq();
+            break;
+        }
+    }
+}
+
+void SPIDMA::write_block(const uint8_t *buf, size_t len)
+{
+    if(!can_dma(buf, len)) {
+        while(len-- > 0) {
+            write(*buf++);
+        }
+        return;
+    }
+
+    while(len > 0) {
+        size_t n = len > GPDMA::CONTROL_SIZE_MAX ? GPDMA::CONTROL_SIZE_MAX : len;
+        transfer(buf, nullptr, n);
+        buf += n;
+        len -= n;
+    }
+    wait();
+}
+
+void SPIDMA::read_block(uint8_t *buf, size_t len)
+{
+    if(!can_dma(buf, len)) {
+        while(len-- > 0) {
+            *buf++ = write(0xFF);
+        }
+        return;
+    }
+
+    while(len > 0) {
+        size_t n = len > GPDMA::CONTROL_SIZE_MAX ? GPDMA::CONTROL_SIZE_MAX : len;
+        transfer(nullptr, buf, n);
+        buf += n;
+        len -= n;
+    }
+    wait();
+}
+
+bool SPIDMA::start_write(const uint8_t *buf, size_t len, std::function<void()> done)
+{
+    if(len > GPDMA::CONTROL_SIZE_MAX || !can_dma(buf, len)) return false;
+
+    wait();
+    done_fnc = done;
+    transfer(buf, nullptr, len);
+    return true;
+}
@@ -0,0 +1,53 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mbed.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// An mbed SPI that can move blocks of data with the GPDMA instead of a byte at a time
+// Blocks that are not in AHB SRAM, or when no DMA channels are available, are sent a byte at a time as before
+class SPIDMA : public mbed::SPI {
+    public:
+        SPIDMA(PinName mosi, PinName miso, PinName sclk);
+        virtual ~SPIDMA();
+
+        // blocking transfers
+        // virtual so a unit test can stand in for the DMA and the device behind it
+        virtual void write_block(const uint8_t *buf, size_t len);
+        virtual void read_block(uint8_t *buf, size_t len);
+
+        // starts sending a block and returns straight away, done is called from the DMA interrupt once the last byte is on the wire
+        // returns false if it could not be done with DMA, in which case nothing has been sent
+        bool start_write(const uint8_t *buf, size_t len, std::function<void()> done);
+
+        // a transfer is in progress on this SSP, from this or another SPIDMA sharing it
+        bool busy() const { return ssp_busy[ssp_index]; }
+        // waits for it to finish, one that takes longer than DMA_TIMEOUT_US is aborted
+        virtual void wait();
+
+        virtual int write(int value) { wait(); return mbed::SPI::write(value); }
+
+    private:
+        bool setup_dma();
+        bool can_dma(const void *buf, size_t len);
+        void transfer(const uint8_t *tx, uint8_t *rx, size_t len);
+        void dma_done(bool ok);
+
+        std::function<void()> done_fnc;
+        int tx_ch, rx_ch;
+        uint8_t tx_periph, rx_periph;
+        uint8_t ssp_index;
+        bool dma_setup;
+
+        static volatile bool ssp_busy[2];
+        static SPIDMA * volatile ssp_owner[2];
+};
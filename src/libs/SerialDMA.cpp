@@ -0,0 +1,96 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "SerialDMA.h"
+#include "GPDMA.h"
+#include "platform_memory.h"
+
+#define UART_FCR_FIFO_ENABLE (1 << 0)
+#define UART_FCR_DMA_MODE    (1 << 3)
+#define UART_IER_RBR         (1 << 0)
+#define UART_LSR_THRE        (1 << 5)
+
+SerialDMA::SerialDMA(PinName tx, PinName rx) : mbed::Serial(tx, rx)
+{
+    lli = nullptr;
+    rx_buf = nullptr;
+    rx_size = 0;
+    rx_ch = -1;
+}
+
+SerialDMA::~SerialDMA()
+{
+    stop_rx();
+}
+
+bool SerialDMA::start_rx(char *buf, uint16_t size, uint16_t chunk, std::function<void()> chunk_done)
+{
+    if(rx_ch >= 0 || chunk == 0 || (size % chunk) != 0 || size / chunk > MAX_CHUNKS || !GPDMA::is_dma_memory(buf, size)) return false;
+
+    // the controller fetches the linked list items itself so they have to be in AHB SRAM too
+    int n= size / chunk;
+    GPDMA::LLI *l= (GPDMA::LLI *)AHB0.alloc(n * sizeof(GPDMA::LLI));
+    if(l == nullptr) return false;
+
+    chunk_done_fnc= chunk_done;
+    rx_ch= GPDMA::alloc_channel([this](bool ok) { if(chunk_done_fnc) chunk_done_fnc(); });
+    if(rx_ch < 0) {
+        AHB0.dealloc(l);
+        return false;
+    }
+
+    GPDMA::PERIPHERAL periph= (GPDMA::PERIPHERAL)(GPDMA::UART0_RX + 2 * _serial.index);
+    // request lines 8-15 are shared with the timer match outputs, select the UART
+    LPC_SC->DMAREQSEL &= ~(1 << (periph - 8));
+
+    uint32_t control= chunk | GPDMA::CONTROL_SBSIZE_1 | GPDMA::CONTROL_DBSIZE_1 | GPDMA::CONTROL_SWIDTH_BYTE | GPDMA::CONTROL_DWIDTH_BYTE | GPDMA::CONTROL_DI | GPDMA::CONTROL_I;
+    for (int i = 0; i < n; ++i) {
+        l[i].src= (uint32_t)&_serial.uart->RBR;
+        l[i].dst= (uint32_t)&buf[i * chunk];
+        l[i].next= (uint32_t)&l[(i + 1) % n]; // the last one links back to the first, so it never stops
+        l[i].control= control;
+    }
+
+    lli= l;
+    rx_buf= buf;
+    rx_size= size;
+
+    // no more receive interrupts, the FIFO asks for DMA as soon as it holds a character
+    _serial.uart->IER &= ~UART_IER_RBR;
+    _serial.uart->FCR= UART_FCR_FIFO_ENABLE | UART_FCR_DMA_MODE;
+
+    GPDMA::start(rx_ch, &_serial.uart->RBR, buf, control, GPDMA::config_p2m(periph) | GPDMA::CONFIG_IE | GPDMA::CONFIG_ITC, &l[1 % n]);
+    return true;
+}
+
+void SerialDMA::stop_rx()
+{
+    if(rx_ch < 0) return;
+    GPDMA::free_channel(rx_ch);
+    rx_ch= -1;
+    _serial.uart->FCR= UART_FCR_FIFO_ENABLE;
+    AHB0.dealloc(lli);
+    lli= nullptr;
+}
+
+uint16_t SerialDMA::rx_head() const
+{
+    // the destination address is updated as each character is moved, it sits on the end of the buffer for a moment before the wrap
+    uint32_t i= GPDMA::get_dst(rx_ch) - (uint32_t)rx_buf;
+    return i >= rx_size ? 0 : i;
+}
+
+bool SerialDMA::tx_fifo_empty() const
+{
+    return (_serial.uart->LSR & UART_LSR_THRE) != 0;
+}
+
+void SerialDMA::tx_fifo_put(char c)
+{
+    _serial.uart->THR= c;
+}
@@ -0,0 +1,47 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "mbed.h"
+
+#include <stdint.h>
+#include <functional>
+
+
+// An mbed Serial that can have the GPDMA receive into a circular buffer instead of interrupting on every character
+// The buffer is split into chunks, the DMA moves on to the next one by itself and calls chunk_done as each fills
+// It also gives direct access to the transmit FIFO so a transmit interrupt can refill it without waiting per character
+class SerialDMA : public mbed::Serial {
+    public:
+        SerialDMA(PinName tx, PinName rx);
+        virtual ~SerialDMA();
+
+        // buf must be in AHB SRAM, size a multiple of chunk and at most MAX_CHUNKS chunks
+        // chunk_done is called from the DMA interrupt, returns false if DMA could not be set up
+        bool start_rx(char *buf, uint16_t size, uint16_t chunk, std::function<void()> chunk_done);
+        void stop_rx();
+        bool rx_active() const { return rx_ch >= 0; }
+
+        // index in buf the DMA will write the next received character to
+        uint16_t rx_head() const;
+
+        // when the FIFO is empty up to TX_FIFO_SIZE characters can be put in it
+        bool tx_fifo_empty() const;
+        void tx_fifo_put(char c);
+
+        static const int MAX_CHUNKS= 8;
+        static const int TX_FIFO_SIZE= 16;
+
+    private:
+        std::function<void()> chunk_done_fnc;
+        void *lli;
+        char *rx_buf;
+        uint16_t rx_size;
+        int rx_ch;
+};
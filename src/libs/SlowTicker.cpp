@@ -15,9 +15,14 @@
 #include "Gcode.h"
 
 #include <mri.h>
+#include "Perf.h"
 
 // This module uses a Timer to periodically call hooks
 // Modules register with a function ( callback ) and a frequency, and we then call that function at the given frequency.
+// The timer runs free and the match register is set to when the next hook is due, so an interrupt only happens when there is
+// something to call, and it only touches the hooks that are due.
+
+#define HOUSEKEEPING_FREQUENCY 10
 
 SlowTicker* global_slow_ticker;
 
@@ -28,13 +33,19 @@ SlowTicker::SlowTicker(){
     ispbtn.from_string("2.10")->as_input()->pull_up();
 
     LPC_SC->PCONP |= (1 << 22);     // Power Ticker ON
-    LPC_TIM2->MCR = 3;              // Match on MR0, reset on MR0
+    LPC_TIM2->MCR = 1;              // Interrupt on MR0, keep counting
     // do not enable interrupt until setup is complete
-    LPC_TIM2->TCR = 0;              // Disable interrupt
+    LPC_TIM2->TCR = 2;              // Reset and hold the counter
+    LPC_TIM2->TCR = 0;
 
-    max_frequency = 5;  // initial max frequency is set to 5Hz
-    set_frequency(max_frequency);
+    counts_per_second = SystemCoreClock >> 2; // SystemCoreClock/4 = Timer increments in a second
+    busy_counts = max_counts = interrupt_count = call_count = 0;
+    last_busy_counts = last_max_counts = last_interrupt_count = last_call_count = 0;
+    flag_1s_count = 0;
     flag_1s_flag = 0;
+
+    // checks the ISP button and counts the seconds
+    attach(HOUSEKEEPING_FREQUENCY, this, &SlowTicker::housekeeping);
 }
 
 void SlowTicker::start()
@@ -47,37 +58,93 @@ void SlowTicker::on_module_loaded(){
     register_for_event(ON_IDLE);
 }
 
-// Set the base frequency we use for all sub-frequencies
-void SlowTicker::set_frequency( int frequency ){
-    this->interval = (SystemCoreClock >> 2) / frequency;   // SystemCoreClock/4 = Timer increments in a second
-    LPC_TIM2->MR0 = this->interval;
-    LPC_TIM2->TCR = 3;  // Reset
-    LPC_TIM2->TCR = 1;  // Reset
-    flag_1s_count= SystemCoreClock>>2;
+// the hook is first due one period from now
+void SlowTicker::add_hook(Hook *hook, uint32_t frequency)
+{
+    if(frequency == 0) frequency = 1;
+    hook->frequency = frequency;
+    hook->interval = counts_per_second / frequency;
+    hook->remainder = counts_per_second % frequency;
+    hook->error = 0;
+
+    // to avoid race conditions we must stop the interupts before updating this non thread safe heap
+    __disable_irq();
+    hook->due = LPC_TIM2->TC + hook->interval;
+    size_t i = this->hooks.size();
+    this->hooks.push_back(hook);
+    while(i > 0) {
+        size_t parent = (i - 1) / 2;
+        if((int32_t)(this->hooks[parent]->due - hook->due) <= 0) break;
+        this->hooks[i] = this->hooks[parent];
+        i = parent;
+    }
+    this->hooks[i] = hook;
+    if(i == 0) LPC_TIM2->MR0 = hook->due; // it is the next one due
+    __enable_irq();
+}
+
+// put the hook at i back in its place after its due time moved later
+void SlowTicker::sift_down(size_t i)
+{
+    size_t n = this->hooks.size();
+    Hook *hook = this->hooks[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if(child >= n) break;
+        if(child + 1 < n && (int32_t)(this->hooks[child + 1]->due - this->hooks[child]->due) < 0) child++;
+        if((int32_t)(hook->due - this->hooks[child]->due) <= 0) break;
+        this->hooks[i] = this->hooks[child];
+        i = child;
+    }
+    this->hooks[i] = hook;
 }
 
 // The actual interrupt being called by the timer, this is where work is done
 void SlowTicker::tick(){
-
-    // Call all hooks that need to be called
-    for (Hook* hook : this->hooks){
-        hook->countdown -= this->interval;
-        if (hook->countdown < 0)
-        {
-            hook->countdown += hook->interval;
+    uint32_t start = LPC_TIM2->TC;
+
+    for (;;) {
+        // Call all hooks that are due, the next one due is always at the top of the heap
+        Hook *hook = this->hooks[0];
+        if((int32_t)(hook->due - LPC_TIM2->TC) <= 0) {
+            hook->due += hook->interval;
+            hook->error += hook->remainder;
+            if(hook->error >= hook->frequency) {
+                hook->error -= hook->frequency;
+                hook->due++;
+            }
+            sift_down(0);
             hook->call();
+            call_count++;
+            continue;
         }
+
+        // wait for the next one, unless it became due while we were setting the match
+        LPC_TIM2->MR0 = hook->due;
+        if((int32_t)(hook->due - LPC_TIM2->TC) > 0) break;
     }
 
-    // deduct tick time from second counter
-    flag_1s_count -= this->interval;
+    uint32_t busy = LPC_TIM2->TC - start;
+    busy_counts += busy;
+    if(busy > max_counts) max_counts = busy;
+    interrupt_count++;
+}
+
+uint32_t SlowTicker::housekeeping(uint32_t)
+{
     // if a whole second has elapsed,
-    if (flag_1s_count < 0)
+    if (++flag_1s_count >= HOUSEKEEPING_FREQUENCY)
     {
-        // add a second to our counter
-        flag_1s_count += SystemCoreClock >> 2;
+        flag_1s_count = 0;
         // and set a flag for idle event to pick up
         flag_1s_flag++;
+
+        // latch the interrupt load for the last second
+        last_busy_counts = busy_counts;
+        last_max_counts = max_counts;
+        last_interrupt_count = interrupt_count;
+        last_call_count = call_count;
+        busy_counts = max_counts = interrupt_count = call_count = 0;
     }
 
     // Enter MRI mode if the ISP button is pressed
@@ -85,6 +152,21 @@ void SlowTicker::tick(){
     if (ispbtn.get() == 0)
         __debugbreak();
 
+    return 0;
+}
+
+SlowTicker::load_t SlowTicker::get_load() const
+{
+    uint32_t counts_per_us = counts_per_second / 1000000;
+    load_t l;
+    __disable_irq();
+    l.interrupts = last_interrupt_count;
+    l.calls = last_call_count;
+    l.busy_us = last_busy_counts / counts_per_us;
+    l.max_us = last_max_counts / counts_per_us;
+    l.hooks = this->hooks.size();
+    __enable_irq();
+    return l;
 }
 
 bool SlowTicker::flag_1s(){
@@ -123,9 +205,11 @@ void SlowTicker::on_idle(void*)
 }
 
 extern "C" void TIMER2_IRQHandler (void){
+    PERF_START(cycles);
     if((LPC_TIM2->IR >> 0) & 1){  // If interrupt register set for MR0
         LPC_TIM2->IR |= 1 << 0;   // Reset it
     }
     global_slow_ticker->tick();
+    PERF_ISR(SLOW_TICK, cycles);
 }
 
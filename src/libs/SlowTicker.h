@@ -15,6 +15,7 @@
 #include "libs/Pin.h"
 
 #include "system_LPC17xx.h" // for SystemCoreClock
+#include <vector>
 #include <math.h>
 
 class SlowTicker : public Module{
@@ -24,37 +25,43 @@ class SlowTicker : public Module{
         void on_module_loaded(void);
         void on_idle(void*);
         void start();
-        void set_frequency( int frequency );
         void tick();
         // For some reason this can't go in the .cpp, see :  http://mbed.org/forum/mbed/topic/2774/?page=1#comment-14221
         // TODO replace this with std::function()
         template<typename T> Hook* attach( uint32_t frequency, T *optr, uint32_t ( T::*fptr )( uint32_t ) ){
             Hook* hook = new Hook();
-            hook->interval = floorf((SystemCoreClock/4)/frequency);
             hook->attach(optr, fptr);
-            hook->countdown = hook->interval;
-
-            // to avoid race conditions we must stop the interupts before updating this non thread safe vector
-            __disable_irq();
-            if( frequency > this->max_frequency ){
-                this->max_frequency = frequency;
-                this->set_frequency(frequency);
-            }
-            this->hooks.push_back(hook);
-            __enable_irq();
+            add_hook(hook, frequency);
             return hook;
         }
 
+        // interrupt load over the last second
+        struct load_t {
+            uint32_t interrupts;
+            uint32_t calls;
+            uint32_t busy_us;
+            uint32_t max_us;
+            uint16_t hooks;
+        };
+        load_t get_load() const;
+
     private:
         bool flag_1s();
+        void add_hook(Hook *hook, uint32_t frequency);
+        void sift_down(size_t i);
+        uint32_t housekeeping(uint32_t);
 
+        // min-heap on due time, so each interrupt only looks at the hooks that are due
         std::vector<Hook*> hooks;
-        uint32_t max_frequency;
-        uint32_t interval;
+        uint32_t counts_per_second;
+
+        // interrupt load, counted in timer counts and latched once a second
+        uint32_t busy_counts, max_counts, interrupt_count, call_count;
+        uint32_t last_busy_counts, last_max_counts, last_interrupt_count, last_call_count;
 
         Pin ispbtn;
 protected:
-    int flag_1s_count;
+    uint8_t flag_1s_count;
     volatile int flag_1s_flag;
 };
 
@@ -19,6 +19,8 @@
 #include "system_LPC17xx.h" // mbed.h lib
 #include <math.h>
 #include <mri.h>
+#include "Perf.h"
+#include "Trace.h"
 
 #ifdef STEPTICKER_DEBUG_PIN
 // debug pins, only used if defined in src/makefile
@@ -106,21 +108,27 @@ void StepTicker::unstep_tick()
 
 extern "C" void TIMER1_IRQHandler (void)
 {
+    PERF_START(cycles);
     LPC_TIM1->IR |= 1 << 0;
     StepTicker::getInstance()->unstep_tick();
+    PERF_ISR(UNSTEP_TICK, cycles);
 }
 
 // The actual interrupt handler where we do all the work
 extern "C" void TIMER0_IRQHandler (void)
 {
+    PERF_START(cycles);
     // Reset interrupt register
     LPC_TIM0->IR |= 1 << 0;
     StepTicker::getInstance()->step_tick();
+    PERF_ISR(STEP_TICK, cycles);
 }
 
 extern "C" void PendSV_Handler(void)
 {
+    PERF_START(cycles);
     StepTicker::getInstance()->handle_finish();
+    PERF_ISR(FINISH, cycles);
 }
 
 // slightly lower priority than TIMER0, the whole end of block/start of block is done here allowing the timer to continue ticking
@@ -228,6 +236,7 @@ void StepTicker::step_tick (void)
         // get next block
         // do it here so there is no delay in ticks
         THECONVEYOR->block_finished();
+        Trace::record(Trace::BLOCK_FINISH);
 
         if(THECONVEYOR->get_next_block(&current_block)) { // returns false if no new block is available
             running= start_next_block(); // returns true if there is at least one motor with steps to issue
@@ -266,6 +275,7 @@ bool StepTicker::start_next_block()
 
     if(ok) {
         //SET_STEPTICKER_DEBUG_PIN(1);
+        Trace::record(Trace::BLOCK_START, current_block->total_move_ticks);
         return true;
 
     }else{
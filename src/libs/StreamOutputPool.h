@@ -10,9 +10,11 @@
 
 using namespace std;
 #include <set>
+#include <vector>
 #include <string>
 #include <cstdio>
 #include <cstdarg>
+#include <stdint.h>
 
 #include "libs/StreamOutput.h"
 
@@ -22,6 +24,8 @@ public:
     StreamOutputPool(){
     }
 
+    // printf() formats once and then comes here to hand the result to every stream
+    // each stream queues it in its own transmit buffer and decides what to do when that is full, see USBSerial::puts
     int puts(const char* s)
     {
         int r = 0;
@@ -42,10 +46,42 @@ public:
     void remove_stream(StreamOutput* stream)
     {
         this->streams.erase(stream);
+        set_auto_report(stream, 0, 0);
     }
 
+    bool has_stream(StreamOutput* stream) const
+    {
+        return this->streams.count(stream) > 0;
+    }
+
+    // a stream can ask to have reports pushed to it every period_ms, see AutoReport
+    // they are kept here so they go when the stream does
+    struct auto_report_t {
+        StreamOutput *stream;
+        uint16_t period_ms;
+        int32_t countdown_ms;
+        uint8_t what;
+    };
+
+    // a period of 0 stops the reports for that stream
+    void set_auto_report(StreamOutput* stream, uint16_t period_ms, uint8_t what)
+    {
+        for(vector<auto_report_t>::iterator i = this->auto_reports.begin(); i != this->auto_reports.end(); i++) {
+            if(i->stream == stream) {
+                this->auto_reports.erase(i);
+                break;
+            }
+        }
+        if(period_ms > 0) {
+            this->auto_reports.push_back({stream, period_ms, 0, what});
+        }
+    }
+
+    vector<auto_report_t>& get_auto_reports() { return this->auto_reports; }
+
 private:
     set<StreamOutput*> streams;
+    vector<auto_report_t> auto_reports;
 };
 
 #endif
@@ -0,0 +1,146 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Trace.h"
+#include "Kernel.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "StreamOutputPool.h"
+#include "platform_memory.h"
+#include "us_ticker_api.h"
+
+#include <stdio.h>
+
+#define trace_checksum          CHECKSUM("trace")
+#define enable_checksum         CHECKSUM("enable")
+#define buffer_size_checksum    CHECKSUM("buffer_size")
+#define dump_on_halt_checksum   CHECKSUM("dump_on_halt")
+
+#define TRACE_HALT_FILE "/sd/trace.bin"
+
+Trace *Trace::instance= nullptr;
+
+Trace::Trace()
+{
+    buffer= nullptr;
+    size= 0;
+    head= 0;
+    recording= false;
+    dump_on_halt= false;
+    dump_pending= false;
+}
+
+void Trace::on_module_loaded()
+{
+    if( !THEKERNEL->config->value( trace_checksum, enable_checksum )->by_default(false)->as_bool() ) {
+        delete this;
+        return;
+    }
+
+    // round down to a power of 2
+    uint32_t n= THEKERNEL->config->value( trace_checksum, buffer_size_checksum )->by_default(512)->as_int();
+    for (size= 16; size * 2 <= n; size *= 2) ;
+
+    buffer= (record_t *)AHB0.alloc(size * sizeof(record_t));
+    if(buffer == nullptr) {
+        THEKERNEL->streams->printf("Error: not enough memory for a trace buffer of %lu records\n", size);
+        delete this;
+        return;
+    }
+
+    dump_on_halt= THEKERNEL->config->value( trace_checksum, dump_on_halt_checksum )->by_default(true)->as_bool();
+
+    this->register_for_event(ON_HALT);
+    if(dump_on_halt) this->register_for_event(ON_MAIN_LOOP, 100000);
+    instance= this;
+    clear();
+}
+
+// may be called from any interrupt, if two record at the same time they each get their own slot
+void Trace::put(EVENT event, uint32_t arg)
+{
+    uint32_t i= head.fetch_add(1);
+    record_t &r= buffer[i & (size - 1)];
+    r.time_us= us_ticker_read();
+    r.event_arg= event | (arg << 8);
+}
+
+void Trace::clear()
+{
+    recording= false;
+    head= 0;
+    recording= true;
+}
+
+void Trace::on_halt(void *argument)
+{
+    // keep what led up to the halt, it is written out from the main loop so the other modules
+    // can turn off their heaters and outputs without waiting for the sdcard
+    if(argument == nullptr && dump_on_halt) {
+        recording= false;
+        dump_pending= true;
+    }
+}
+
+void Trace::on_main_loop(void *argument)
+{
+    if(dump_pending) {
+        dump_pending= false;
+        dump(TRACE_HALT_FILE, THEKERNEL->streams);
+    }
+}
+
+// the file is a header followed by the records in the order they were recorded, all little endian
+//   char magic[4] "SMTR", uint16_t version, uint16_t record size, uint32_t records in file, uint32_t records lost before them
+bool Trace::dump(const char *filename, StreamOutput *stream)
+{
+    FILE *fp= fopen(filename, "w");
+    if(fp == NULL) {
+        stream->printf("Could not open %s for writing\n", filename);
+        return false;
+    }
+
+    // stop recording while it is written out, so the oldest records are not overwritten under us
+    recording= false;
+    uint32_t total= head;
+    uint32_t n= total < size ? total : size;
+    uint32_t start= total - n;
+
+    struct {
+        char magic[4];
+        uint16_t version;
+        uint16_t record_size;
+        uint32_t count;
+        uint32_t lost;
+    } header= {{'S', 'M', 'T', 'R'}, 1, sizeof(record_t), n, start};
+    bool ok= fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    // in at most two runs as it may wrap
+    uint32_t first= start & (size - 1);
+    uint32_t run= (first + n > size) ? size - first : n;
+    if(ok && run > 0) ok= fwrite(&buffer[first], sizeof(record_t), run, fp) == run;
+    if(ok && n > run) ok= fwrite(&buffer[0], sizeof(record_t), n - run, fp) == n - run;
+
+    fclose(fp);
+    recording= true;
+
+    if(ok) {
+        stream->printf("Wrote %lu trace records to %s\n", n, filename);
+    } else {
+        stream->printf("Error writing trace to %s\n", filename);
+    }
+    return ok;
+}
+
+void Trace::status(StreamOutput *stream) const
+{
+    uint32_t total= head;
+    stream->printf("trace buffer: %lu records, %lu recorded, %lu held, %s\n", size, total, total < size ? total : size, recording ? "recording" : "paused");
+}
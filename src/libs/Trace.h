@@ -0,0 +1,62 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "Module.h"
+
+#include <stdint.h>
+#include <atomic>
+
+class StreamOutput;
+
+// Records timestamped events in a ring buffer so stalls and stutters can be looked at after the fact.
+// Trace::record() may be called from any interrupt, it does nothing unless trace.enable is set.
+// The buffer is written to SD by the trace shell command, or when a halt happens, and is decoded on the host by trace-decode.py
+class Trace : public Module {
+    public:
+        // the event numbers are in the file, add new ones to the end and to trace-decode.py
+        enum EVENT {
+            BLOCK_START= 1,  // arg is the block's total move ticks
+            BLOCK_FINISH,
+            QUEUE_DEPTH,     // arg is the number of blocks in the queue
+            LINE_RECEIVED,   // arg is the length of the line
+            HEATER_PWM,      // arg is the heater's pool index << 16 | pwm
+            HALT,            // arg is 1 for a halt, 0 when it is cleared
+        };
+
+        Trace();
+        void on_module_loaded();
+        void on_halt(void *argument);
+        void on_main_loop(void *argument);
+
+        static void record(EVENT event, uint32_t arg= 0) { if(instance != nullptr && instance->recording) instance->put(event, arg); }
+        static Trace *instance;
+
+        bool dump(const char *filename, StreamOutput *stream);
+        void clear();
+        void status(StreamOutput *stream) const;
+
+    private:
+        void put(EVENT event, uint32_t arg);
+
+        // 8 bytes per record, the arg is truncated to 24 bits
+        struct record_t {
+            uint32_t time_us;
+            uint32_t event_arg;
+        };
+        record_t *buffer;
+        uint32_t size; // must be a power of 2
+        std::atomic<uint32_t> head;
+
+        struct {
+            bool recording:1;
+            bool dump_on_halt:1;
+            bool dump_pending:1;
+        };
+};
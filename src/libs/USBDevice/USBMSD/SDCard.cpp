@@ -64,10 +64,11 @@
  * just always use the Standard Capacity cards with a block size of 512 bytes.
  * This is set with CMD16.
  *
- * You can read and write single blocks (CMD17, CMD25) or multiple blocks
- * (CMD18, CMD25). For simplicity, I'll just use single block accesses. When
- * the card gets a read command, it responds with a response token, and then
- * a data token or an error.
+ * You can read and write single blocks (CMD17, CMD24) or multiple blocks
+ * (CMD18, CMD25). Single block accesses are used when FatFs asks for one
+ * sector, multiple block accesses stream consecutive sectors without paying
+ * the command overhead for each one. When the card gets a read command, it
+ * responds with a response token, and then a data token or an error.
  *
  * SPI Command Format
  * ------------------
@@ -115,6 +116,18 @@
  * +------+---------+---------+- -  - -+---------+-----------+----------+
  * | 0xFE | data[0] | data[1] |        | data[n] | crc[15:8] | crc[7:0] |
  * +------+---------+---------+- -  - -+---------+-----------+----------+
+ *
+ * Multiple Block Read and Write
+ * -----------------------------
+ *
+ * After CMD18 the card sends data blocks (each with the 0xFE start token)
+ * until it is sent CMD12 STOP_TRANSMISSION, which is answered after a stuff
+ * byte with an R1b response.
+ *
+ * After CMD25 each block is sent with the 0xFC start token, and is answered
+ * with a data response token followed by busy. The transfer is ended by
+ * sending the 0xFD stop tran token, which is followed by busy. If a block
+ * is rejected the transfer is aborted with CMD12 instead.
  */
 
 #include <stdio.h>
@@ -125,15 +138,29 @@
 static const uint8_t OXFF = 0xFF;
 
 #define SD_COMMAND_TIMEOUT 5000
+#define SD_DATA_TIMEOUT    100000 // bytes clocked while waiting for a data token or for the card to be not busy
+
+#define SD_TOKEN_START_BLOCK       0xFE
+#define SD_TOKEN_START_MULTI_WRITE 0xFC
+#define SD_TOKEN_STOP_TRAN         0xFD
 
 SDCard::SDCard(PinName mosi, PinName miso, PinName sclk, PinName cs) :
-  _spi(mosi, miso, sclk), _cs(cs) {
+  SDCard(new SPIDMA(mosi, miso, sclk), cs) {
+    _spi_owned = &_spi;
+}
+
+SDCard::SDCard(SPIDMA *spi, PinName cs) :
+  _spi_owned(nullptr), _spi(*spi), _cs(cs) {
     _cs.output();
     _cs = 1;
     busyflag = false;
     _sectors = 0;
 }
 
+SDCard::~SDCard() {
+    delete _spi_owned;
+}
+
 #define R1_IDLE_STATE           (1 << 0)
 #define R1_ERASE_RESET          (1 << 1)
 #define R1_ILLEGAL_COMMAND      (1 << 2)
@@ -328,6 +355,101 @@ int SDCard::disk_read(char *buffer, uint32_t block_number)
     return 0;
 }
 
+int SDCard::disk_read_multi(char *buffer, uint32_t block_number, uint32_t count)
+{
+    if (count == 1)
+        return disk_read(buffer, block_number);
+
+    if (busyflag)
+        return 0;
+
+    busyflag = true;
+
+    if (cardtype == SDCARD_FAIL) {
+        busyflag = false;
+        return -1;
+    }
+
+    // set read address for multiple blocks (CMD18), card stays selected
+    if(_cmdx(SDCMD_READ_MULTIPLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+        _cs = 1;
+        _spi.write(0xFF);
+        busyflag = false;
+        return 1;
+    }
+
+    // receive the data blocks
+    int r = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (_read_block(buffer, 512) != 0) {
+            r = 1;
+            break;
+        }
+        buffer += 512;
+    }
+
+    // tell the card to stop sending blocks (CMD12)
+    if (_stop_transmission() != 0)
+        r = 1;
+
+    busyflag = false;
+
+    return r;
+}
+
+int SDCard::disk_write_multi(const char *buffer, uint32_t block_number, uint32_t count)
+{
+    if (count == 1)
+        return disk_write(buffer, block_number);
+
+    if (busyflag)
+        return 0;
+
+    busyflag = true;
+
+    if (cardtype == SDCARD_FAIL) {
+        busyflag = false;
+        return -1;
+    }
+
+    // set write address for multiple blocks (CMD25), card stays selected
+    if(_cmdx(SDCMD_WRITE_MULTIPLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+        _cs = 1;
+        _spi.write(0xFF);
+        busyflag = false;
+        return 1;
+    }
+
+    // send the data blocks
+    int r = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (_write_block(buffer, 512) != 0) {
+            r = 1;
+            break;
+        }
+        buffer += 512;
+    }
+
+    if (r != 0) {
+        // a block was rejected, the card expects CMD12 to abort the transfer rather than the stop tran token
+        _stop_transmission();
+
+    } else {
+        // end the transfer with the stop tran token, then wait for the card to finish programming
+        _spi.write(SD_TOKEN_STOP_TRAN);
+        _spi.write(0xFF);
+        if (!_wait_ready())
+            r = 1;
+
+        _cs = 1;
+        _spi.write(0xFF);
+    }
+
+    busyflag = false;
+
+    return r;
+}
+
 int SDCard::disk_status() { return (_sectors > 0)?0:1; }
 int SDCard::disk_sync() {
     // TODO: wait for DMA, wait for card not busy
@@ -346,6 +468,8 @@ SDCard::CARD_TYPE SDCard::card_type()
 // PRIVATE FUNCTIONS
 
 int SDCard::_cmd(int cmd, uint32_t arg) {
+    // a panel may share the SSP, it must finish its transfer before the card is selected
+    _spi.wait();
     _cs = 0;
 
     // send a command
@@ -370,6 +494,7 @@ int SDCard::_cmd(int cmd, uint32_t arg) {
     return -1; // timeout
 }
 int SDCard::_cmdx(int cmd, uint32_t arg) {
+    _spi.wait();
     _cs = 0;
 
     // send a command
@@ -394,6 +519,7 @@ int SDCard::_cmdx(int cmd, uint32_t arg) {
 
 
 int SDCard::_cmd58(uint32_t *ocr) {
+    _spi.wait();
     _cs = 0;
     int arg = 0;
 
@@ -425,6 +551,7 @@ int SDCard::_cmd58(uint32_t *ocr) {
 }
 
 int SDCard::_cmd8() {
+    _spi.wait();
     _cs = 0;
 
     // send a command
@@ -454,6 +581,7 @@ int SDCard::_cmd8() {
 }
 
 int SDCard::_read(char *buffer, int length) {
+    _spi.wait();
     _cs = 0;
 
     // read until start byte (0xFF)
@@ -467,10 +595,8 @@ int SDCard::_read(char *buffer, int length) {
 //
 //     iprintf("Got start byte, reading data\n");
 
-    // read data
-    for(int i=0; i<length; i++) {
-        buffer[i] = _spi.write(0xFF);
-    }
+    // read data, with DMA if the buffer is in AHB SRAM
+    _spi.read_block((uint8_t *)buffer, length);
     _spi.write(0xFF); // checksum
     _spi.write(0xFF);
 
@@ -480,15 +606,14 @@ int SDCard::_read(char *buffer, int length) {
 }
 
 int SDCard::_write(const char *buffer, int length) {
+    _spi.wait();
     _cs = 0;
 
     // indicate start of block
     _spi.write(0xFE);
 
-    // write the data
-    for(int i=0; i<length; i++) {
-        _spi.write(buffer[i]);
-    }
+    // write the data, with DMA if the buffer is in AHB SRAM
+    _spi.write_block((const uint8_t *)buffer, length);
 
     // write the checksum
     _spi.write(0xFF);
@@ -509,6 +634,84 @@ int SDCard::_write(const char *buffer, int length) {
     return 0;
 }
 
+// wait for the card to release busy (it holds the data line low while busy)
+bool SDCard::_wait_ready() {
+    for(int i=0; i<SD_DATA_TIMEOUT; i++) {
+        if(_spi.write(0xFF) == 0xFF)
+            return true;
+    }
+    return false;
+}
+
+// receive one data block of a multiple block read, the card is already selected
+int SDCard::_read_block(char *buffer, int length) {
+    // wait for the start token, anything else than 0xFF is an error token
+    int token = 0xFF;
+    for(int i=0; i<SD_DATA_TIMEOUT && token == 0xFF; i++) {
+        token = _spi.write(0xFF);
+    }
+    if(token != SD_TOKEN_START_BLOCK)
+        return 1;
+
+    // read data, with DMA if the buffer is in AHB SRAM
+    _spi.read_block((uint8_t *)buffer, length);
+    _spi.write(0xFF); // checksum
+    _spi.write(0xFF);
+
+    return 0;
+}
+
+// send one data block of a multiple block write, the card is already selected
+int SDCard::_write_block(const char *buffer, int length) {
+    // indicate start of block
+    _spi.write(SD_TOKEN_START_MULTI_WRITE);
+
+    // write the data, with DMA if the buffer is in AHB SRAM
+    _spi.write_block((const uint8_t *)buffer, length);
+
+    // write the checksum
+    _spi.write(0xFF);
+    _spi.write(0xFF);
+
+    // check the repsonse token
+    if((_spi.write(0xFF) & 0x1F) != 0x05)
+        return 1;
+
+    // wait for write to finish
+    return _wait_ready() ? 0 : 1;
+}
+
+// send CMD12 to end a multiple block read, or abort a failed multiple block write, and deselect the card
+int SDCard::_stop_transmission() {
+    _spi.write(0x40 | SDCMD_STOP_TRANSMISSION);
+    _spi.write(0x00);
+    _spi.write(0x00);
+    _spi.write(0x00);
+    _spi.write(0x00);
+    _spi.write(0x95);
+
+    // skip the stuff byte
+    _spi.write(0xFF);
+
+    // wait for the repsonse (response[7] == 0)
+    int response = -1;
+    for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
+        int r = _spi.write(0xFF);
+        if(!(r & 0x80)) {
+            response = r;
+            break;
+        }
+    }
+
+    // R1b, wait while the card is busy
+    if(!_wait_ready())
+        response = -1;
+
+    _cs = 1;
+    _spi.write(0xFF);
+    return response;
+}
+
 static int ext_bits(char *data, int msb, int lsb) {
     int bits = 0;
     int size = 1 + msb - lsb;
@@ -30,8 +30,7 @@
 
 #include "disk.h"
 #include "mbed.h"
-
-// #include "DMA.h"
+#include "SPIDMA.h"
 
 /** Access the filesystem on an SD Card using SPI
  *
@@ -59,7 +58,14 @@ public:
      * @param name The name used to access the virtual filesystem
      */
     SDCard(PinName, PinName, PinName, PinName);
-    virtual ~SDCard() {};
+
+    /** Create the File System for an SD Card on an existing SPI, used by the unit tests to drive a simulated card
+     *
+     * @param spi  SPI connected to the SD Card, it is not deleted with the SDCard
+     * @param cs   DigitalOut pin used as SD Card chip select
+     */
+    SDCard(SPIDMA *spi, PinName cs);
+    virtual ~SDCard();
 
     typedef enum {
         SDCARD_FAIL,
@@ -71,6 +77,8 @@ public:
     virtual int disk_initialize();
     virtual int disk_write(const char *buffer, uint32_t block_number);
     virtual int disk_read(char *buffer, uint32_t block_number);
+    virtual int disk_read_multi(char *buffer, uint32_t block_number, uint32_t count);
+    virtual int disk_write_multi(const char *buffer, uint32_t block_number, uint32_t count);
     virtual int disk_status();
     virtual int disk_sync();
     virtual uint32_t disk_sectors();
@@ -94,11 +102,16 @@ protected:
 
     int _read(char *buffer, int length);
     int _write(const char *buffer, int length);
+    int _read_block(char *buffer, int length);
+    int _write_block(const char *buffer, int length);
+    int _stop_transmission();
+    bool _wait_ready();
 
     uint32_t _sd_sectors();
     uint32_t _sectors;
 
-    mbed::SPI _spi;
+    SPIDMA *_spi_owned;
+    SPIDMA &_spi;
     GPIO _cs;
 
     volatile bool busyflag;
@@ -23,6 +23,40 @@ public:
      */
     virtual int disk_write(const char * data, uint32_t block) { return 0; };
 
+    /*
+     * read consecutive blocks, disks that can stream blocks should override this
+     *
+     * @param data pointer where will be stored read data, must hold count blocks
+     * @param block first block number
+     * @param count number of blocks to read
+     * @returns 0 if successful
+     */
+    virtual int disk_read_multi(char * data, uint32_t block, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            int r = disk_read(data, block + i);
+            if (r) return r;
+            data += 512;
+        }
+        return 0;
+    };
+
+    /*
+     * write consecutive blocks, disks that can stream blocks should override this
+     *
+     * @param data data to write, count blocks
+     * @param block first block number
+     * @param count number of blocks to write
+     * @returns 0 if successful
+     */
+    virtual int disk_write_multi(const char * data, uint32_t block, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            int r = disk_write(data, block + i);
+            if (r) return r;
+            data += 512;
+        }
+        return 0;
+    };
+
     /*
      * Disk initilization
      */
@@ -30,7 +30,7 @@ public:
         write = 0;
         read = 0;
         size = length;
-        buf = (uint8_t*) AHB0.alloc(size * sizeof(T));
+        buf = (T*) AHB0.alloc(size * sizeof(T));
     };
 
 	bool isFull() {
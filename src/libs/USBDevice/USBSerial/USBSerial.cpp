@@ -32,24 +32,38 @@
 
 #define iprintf(...) do { } while (0)
 
-USBSerial::USBSerial(USB *u): USBCDC(u), rxbuf(256), txbuf(128 + 8)
+// enough room to index a packet full of line terminators
+#define RX_LINES_SIZE (MAX_PACKET_SIZE_EPBULK + 16)
+
+// how long output waits for the host to make room before it is considered stalled
+#define TX_TIMEOUT_US 1000000
+
+USBSerial::USBSerial(USB *u): USBCDC(u), txbuf(512 + 8), rx_lines(RX_LINES_SIZE)
 {
     usb = u;
-    nl_in_rx = 0;
+    rx_ring = (char *)AHB0.alloc(RX_RING_SIZE);
+    rx_head = rx_tail = rx_line_start = 0;
     attach = attached = false;
     flush_to_nl = false;
-    halt_flag = false;
-    query_flag = false;
     last_char_was_cr = false;
+    tx_stalled = false;
+    tx_dropped = 0;
+    halt_call = query_call = nullptr;
 }
 
-bool USBSerial::ensure_tx_space(int space)
+// waits for room in txbuf until the given start time is TX_TIMEOUT_US old
+// once the host has not read anything for that long we stop waiting on it altogether, so a host that is not reading
+// costs one timeout and not one per line, until it has emptied txbuf again
+bool USBSerial::ensure_tx_space(int space, uint32_t start)
 {
-    // we need some kind of timeout here or it will hang if upstream stalls
-    uint32_t start = us_ticker_read();
+    if (tx_stalled) {
+        if (txbuf.available() > 0) return txbuf.free() >= space;
+        tx_stalled = false;
+    }
+
     while (txbuf.free() < space) {
-        if((us_ticker_read() - start) > 1000000) {
-            // 1 second timeout
+        if((us_ticker_read() - start) > TX_TIMEOUT_US) {
+            tx_stalled = true;
             return false;
         }
         usb->endpointSetInterrupt(CDC_BulkIn.bEndpointAddress, true);
@@ -62,46 +76,79 @@ int USBSerial::_putc(int c)
 {
     if (!attached)
         return 1;
-    if(ensure_tx_space(1)) {
+    if(ensure_tx_space(1, us_ticker_read())) {
         txbuf.queue(c);
+    } else {
+        tx_dropped++;
     }
 
     usb->endpointSetInterrupt(CDC_BulkIn.bEndpointAddress, true);
     return 1;
 }
 
+// raw character reads, used by upload, line terminators are returned as \n
 int USBSerial::_getc()
 {
     if (!attached)
         return 0;
-    uint8_t c = 0;
-    setled(4, 1); while (rxbuf.isEmpty()); setled(4, 0);
-    rxbuf.dequeue(&c);
-    if (rxbuf.free() == MAX_PACKET_SIZE_EPBULK) {
-        usb->endpointSetInterrupt(CDC_BulkOut.bEndpointAddress, true);
-        iprintf("rxbuf has room for another packet, interrupt enabled\n");
-    } else if ((rxbuf.free() < MAX_PACKET_SIZE_EPBULK) && (nl_in_rx == 0)) {
-        // handle potential deadlock where a short line, and the beginning of a very long line are bundled in one usb packet
-        rxbuf.flush();
-        flush_to_nl = true;
-
+    setled(4, 1); while (rx_available() == 0); setled(4, 0);
+    uint16_t tail = rx_tail;
+    char c = rx_ring[tail];
+    rx_tail = (tail + 1) & (RX_RING_SIZE - 1);
+    if (c == '\n') {
+        // keep the line index in step
+        uint16_t end;
+        rx_lines.dequeue(&end);
+    }
+    if (rx_free() >= MAX_PACKET_SIZE_EPBULK) {
         usb->endpointSetInterrupt(CDC_BulkOut.bEndpointAddress, true);
         iprintf("rxbuf has room for another packet, interrupt enabled\n");
     }
-    if (nl_in_rx > 0)
-        if (c == '\n' || c == '\r')
-            nl_in_rx--;
 
     return c;
 }
 
+void USBSerial::rx_flush()
+{
+    __disable_irq();
+    rx_tail = rx_line_start = rx_head;
+    rx_lines.flush();
+    __enable_irq();
+}
+
+// a ring holding nothing but a partial line too long for it can never be consumed, so to avoid a deadlock it is
+// dumped and we keep flushing to the next newline, returns true if it was dumped.
+// must not be interrupted by USBEvent_EPOut
+bool USBSerial::rx_drop_long_line()
+{
+    if (rx_free() >= MAX_PACKET_SIZE_EPBULK || !rx_lines.isEmpty())
+        return false;
+
+    flush_to_nl = true;
+    rx_head = rx_line_start = rx_tail;
+    return true;
+}
+
 int USBSerial::puts(const char *str)
 {
+    int n = strlen(str);
     if (!attached)
-        return strlen(str);
+        return n;
+
+    // a status report that does not fit is dropped rather than waited for, the host will ask again and get a fresher one
+    if (*str == '<' && txbuf.free() < n) {
+        tx_dropped++;
+        return n;
+    }
+
+    // anything else waits for room, for at most one timeout for the whole message
+    uint32_t start = us_ticker_read();
     int i = 0;
     while (*str) {
-        if(!ensure_tx_space(1)) break;
+        if(!ensure_tx_space(1, start)) {
+            tx_dropped++;
+            break;
+        }
         txbuf.queue(*str);
         if ((txbuf.available() % 64) == 0)
             usb->endpointSetInterrupt(CDC_BulkIn.bEndpointAddress, true);
@@ -178,7 +225,10 @@ bool USBSerial::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
     if (bEP != CDC_BulkOut.bEndpointAddress)
         return false;
 
-    if (rxbuf.free() < MAX_PACKET_SIZE_EPBULK) {
+    // the main loop may have taken the complete lines and left only a line that is too long
+    rx_drop_long_line();
+
+    if (rx_free() < MAX_PACKET_SIZE_EPBULK || rx_lines.free() < MAX_PACKET_SIZE_EPBULK) {
 //         usb->endpointSetInterrupt(bEP, false);
         return false;
     }
@@ -186,26 +236,27 @@ bool USBSerial::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
     uint8_t c[MAX_PACKET_SIZE_EPBULK];
     uint32_t size = 64;
 
-    //we read the packet received and put it on the circular buffer
+    //we read the packet received and put it straight into the ring, there is room for all of it
     readEP(c, &size);
     iprintf("Read %ld bytes:\n\t", size);
+    uint16_t head = rx_head;
     for (uint8_t i = 0; i < size; i++) {
         char b= c[i];
 
-        // handle backspace and delete by deleting the last character in the buffer if there is one
+        // handle backspace and delete by deleting the last character of the line being received if there is one
         if(b == 0x08 || b == 0x7F) {
-            if(!rxbuf.isEmpty()) rxbuf.pop();
+            if(head != rx_line_start) head = (head - 1) & (RX_RING_SIZE - 1);
             continue;
         }
 
         if(b == 'X' - 'A' + 1) { // ^X
             //THEKERNEL->set_feed_hold(false); // required to free stuff up
-            halt_flag = true;
+            if(halt_call != nullptr) halt_call->raise();
             continue;
         }
 
         if(b == '?') { // ?
-            query_flag = true;
+            if(query_call != nullptr) query_call->raise();
             continue;
         }
 
@@ -229,44 +280,29 @@ bool USBSerial::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
 
         last_char_was_cr = (b=='\r');
 
-        if (flush_to_nl == false)
-            rxbuf.queue(b);
-
-        // if (b >= 32 && b < 128)
-        // {
-        //     iprintf("%c", b);
-        // }
-        // else
-        // {
-        //     iprintf("\\x%02X", b);
-        // }
-
         if (b == '\n' || b == '\r') {
-            if (flush_to_nl)
+            if (flush_to_nl) {
                 flush_to_nl = false;
-            else
-                nl_in_rx++;
-        } else if (rxbuf.isFull() && (nl_in_rx == 0)) {
-            // to avoid a deadlock with very long lines, we must dump the buffer
-            // and continue flushing to the next newline
-            rxbuf.flush();
-            flush_to_nl = true;
+            } else {
+                // index the end of the line
+                rx_lines.queue(head);
+                rx_ring[head] = '\n';
+                head = (head + 1) & (RX_RING_SIZE - 1);
+            }
+            rx_line_start = head;
+
+        } else if (flush_to_nl == false) {
+            rx_ring[head] = b;
+            head = (head + 1) & (RX_RING_SIZE - 1);
         }
     }
-    iprintf("\nQueued, %d empty\n", rxbuf.free());
+    rx_head = head;
+    iprintf("\nQueued, %d empty\n", rx_free());
 
-    if (rxbuf.free() < MAX_PACKET_SIZE_EPBULK) {
+    if (rx_free() < MAX_PACKET_SIZE_EPBULK) {
         // if buffer is full, stall endpoint, do not accept more data
-        r = false;
-
-        if (nl_in_rx == 0) {
-            // we have to check for long line deadlock here too
-            flush_to_nl = true;
-            rxbuf.flush();
-
-            // and since our buffer is empty, we can accept more data
-            r = true;
-        }
+        // unless it was full of a line that is too long, then it has been dumped and we can accept more data
+        r = rx_drop_long_line();
     }
 
     usb->readStart(CDC_BulkOut.bEndpointAddress, MAX_PACKET_SIZE_EPBULK);
@@ -276,39 +312,40 @@ bool USBSerial::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
 
 uint8_t USBSerial::available()
 {
-    return rxbuf.available();
+    uint16_t n = rx_available();
+    return n > 255 ? 255 : n;
 }
 
 bool USBSerial::ready()
 {
-    return rxbuf.available();
+    return rx_available() > 0;
 }
 
 void USBSerial::on_module_loaded()
 {
+    // the realtime commands must not be lost however busy the main loop is
+    halt_call= THEKERNEL->pending_call<USBSerial, &USBSerial::handle_halt>(this);
+    query_call= THEKERNEL->pending_call<USBSerial, &USBSerial::handle_query>(this);
     this->register_for_event(ON_MAIN_LOOP);
-    this->register_for_event(ON_IDLE);
 }
 
-void USBSerial::on_idle(void *argument)
+// the realtime commands are deferred from the USB interrupt
+void USBSerial::handle_halt(uint32_t)
 {
-    if(halt_flag) {
-        halt_flag = false;
-        THEKERNEL->call_event(ON_HALT, nullptr);
-        if(THEKERNEL->is_grbl_mode()) {
-            puts("ALARM: Abort during cycle\r\n");
-        } else {
-            puts("HALTED, M999 or $X to exit HALT state\r\n");
-        }
-        rxbuf.flush(); // flush the recieve buffer, hopefully upstream has stopped sending
-        nl_in_rx = 0;
-    }
-
-    if(query_flag) {
-        query_flag = false;
-        puts(THEKERNEL->get_query_string().c_str());
+    THEKERNEL->call_event(ON_HALT, nullptr);
+    if(THEKERNEL->is_grbl_mode()) {
+        puts("ALARM: Abort during cycle\r\n");
+    } else {
+        puts("HALTED, M999 or $X to exit HALT state\r\n");
     }
+    rx_flush(); // flush the recieve buffer, hopefully upstream has stopped sending
+}
 
+void USBSerial::handle_query(uint32_t)
+{
+    char buf[Kernel::QUERY_STRING_SIZE];
+    THEKERNEL->get_query_string(buf, sizeof(buf));
+    puts(buf);
 }
 
 void USBSerial::on_main_loop(void *argument)
@@ -331,29 +368,44 @@ void USBSerial::on_main_loop(void *argument)
             attached = false;
             THEKERNEL->streams->remove_stream(this);
             txbuf.flush();
-            rxbuf.flush();
-            nl_in_rx = 0;
+            tx_stalled = false;
+            rx_flush();
         }
     }
 
     // if we are in feed hold we do not process anything
     //if(THEKERNEL->get_feed_hold()) return;
 
-    if (nl_in_rx) {
-        string received;
-        while (available()) {
-            char c = _getc();
-            if( c == '\n' || c == '\r') {
-                struct SerialMessage message;
-                message.message = received;
-                message.stream = this;
-                iprintf("USBSerial Received: %s\n", message.message.c_str());
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
-                return;
-            } else {
-                received += c;
-            }
+    // hand over every complete line, each is copied out of the ring in one go (or two if it wraps)
+    uint16_t end;
+    while (rx_lines.dequeue(&end)) {
+        struct SerialMessage message;
+        uint16_t tail = rx_tail;
+        if (end >= tail) {
+            message.message.assign(&rx_ring[tail], end - tail);
+        } else {
+            message.message.assign(&rx_ring[tail], RX_RING_SIZE - tail);
+            message.message.append(rx_ring, end);
         }
+        rx_tail = (end + 1) & (RX_RING_SIZE - 1);
+        message.stream = this;
+
+        if (rx_free() >= MAX_PACKET_SIZE_EPBULK) {
+            usb->endpointSetInterrupt(CDC_BulkOut.bEndpointAddress, true);
+        }
+
+        iprintf("USBSerial Received: %s\n", message.message.c_str());
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
+        if (THEKERNEL->is_halted()) break;
+    }
+
+    // the endpoint was stalled with complete lines in the ring, if what is left behind them is a line too long
+    // for the ring it never makes room for another packet, so it is dumped here instead
+    __disable_irq();
+    bool dropped = rx_drop_long_line();
+    __enable_irq();
+    if (dropped) {
+        usb->endpointSetInterrupt(CDC_BulkOut.bEndpointAddress, true);
     }
 }
 
@@ -24,6 +24,7 @@
 #include "CircBuffer.h"
 
 #include "Module.h"
+#include "Kernel.h"
 #include "StreamOutput.h"
 
 class USBSerial_Receiver {
@@ -44,12 +45,13 @@ public:
 
     uint16_t writeBlock(const uint8_t * buf, uint16_t size);
 
-    CircBuffer<uint8_t> rxbuf;
+    // number of writes that were cut short or dropped because the host was not reading
+    uint32_t get_tx_dropped() const { return tx_dropped; }
+
     CircBuffer<uint8_t> txbuf;
 
     void on_module_loaded(void);
     void on_main_loop(void *);
-    void on_idle(void *);
 
 protected:
 //     virtual bool EpCallback(uint8_t, uint8_t);
@@ -61,18 +63,29 @@ protected:
     virtual void on_attach(void);
     virtual void on_detach(void);
 
-    bool ensure_tx_space(int);
+    bool ensure_tx_space(int space, uint32_t start);
+
+    uint16_t rx_available() const { return (rx_head - rx_tail) & (RX_RING_SIZE - 1); }
+    uint16_t rx_free() const { return RX_RING_SIZE - 1 - rx_available(); }
+    void rx_flush();
+    bool rx_drop_long_line();
 
-    // keep track of number of newlines in the buffer
-    // this makes it trivial to detect if there's a new line available
-    volatile int nl_in_rx;
+    void handle_query(uint32_t);
+    void handle_halt(uint32_t);
+
+    // received bytes are written straight into this ring by the USB interrupt, line terminators are stored as \n
+    // and the position of each one is queued in rx_lines, so the main loop can take a whole line at a time
+    static const uint16_t RX_RING_SIZE = 512; // must be a power of 2
+    char *rx_ring;
+    volatile uint16_t rx_head;       // written by the interrupt
+    volatile uint16_t rx_tail;       // written by the main loop
+    uint16_t rx_line_start;          // start of the partial line being received, only used by the interrupt
+    CircBuffer<uint16_t> rx_lines;
 
 
     volatile struct {
         volatile bool attach:1;
         bool attached:1;
-        bool halt_flag:1;
-        bool query_flag:1;
         bool last_char_was_cr:1;
         // if we receive a line that's longer than the buffer, to avoid a deadlock
         // we must flush the buffer.
@@ -82,8 +95,14 @@ protected:
         bool flush_to_nl:1;
     };
 
+    // the host has not been reading, do not wait on it until txbuf has drained
+    bool tx_stalled;
+    uint32_t tx_dropped;
+
 private:
     USB *usb;
+    Kernel::PendingCall *halt_call;
+    Kernel::PendingCall *query_call;
 //     mbed::FunctionPointer rx;
 };
 
@@ -15,6 +15,7 @@
 #include <cstring>
 #include <stdio.h>
 #include <cstdlib>
+#include <cmath>
 
 #include "mbed.h"
 
@@ -254,6 +255,52 @@ int append_parameters(char *buf, std::vector<std::pair<char,float>> params, size
     return n;
 }
 
+// writes v with the given number of decimals (0 to 6), the same as snprintf("%1.*f") would but without going through printf
+// returns the number of characters written not counting the terminating \0
+size_t format_fixed(char *buf, size_t bufsize, float v, int decimals)
+{
+    static const uint32_t pow10[]= {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if(decimals < 0) decimals= 0;
+    if(decimals > 6) decimals= 6;
+
+    // a float times a power of ten up to 10^6 is exact as a double, so this rounds exactly as printf does, ties to even
+    double scaled= fabs((double)v) * pow10[decimals];
+    if(bufsize < 20 || !(scaled < 4294967295.0)) {
+        // too big, not a number, or not enough room to not have to check as we go
+        if(bufsize == 0) return 0;
+        int n= snprintf(buf, bufsize, "%1.*f", decimals, v);
+        if(n < 0) n= 0;
+        return (size_t)n >= bufsize ? bufsize - 1 : n;
+    }
+
+    uint32_t i= scaled;
+    double frac= scaled - i;
+    if(frac > 0.5 || (frac == 0.5 && (i & 1))) i++;
+    uint32_t ip= i / pow10[decimals];
+    uint32_t fp= i % pow10[decimals];
+
+    char tmp[10];
+    int nt= 0;
+    do {
+        tmp[nt++]= '0' + (ip % 10);
+        ip /= 10;
+    } while(ip > 0);
+
+    char *p= buf;
+    if(std::signbit(v)) *p++= '-';
+    while(nt > 0) *p++= tmp[--nt];
+    if(decimals > 0) {
+        *p++= '.';
+        for (int k = decimals - 1; k >= 0; --k) {
+            p[k]= '0' + (fp % 10);
+            fp /= 10;
+        }
+        p += decimals;
+    }
+    *p= '\0';
+    return p - buf;
+}
+
 string wcs2gcode(int wcs) {
     string str= "G5";
     str.append(1, std::min(wcs, 5) + '4');
@@ -272,6 +319,6 @@ void safe_delay_us(uint32_t dus)
 {
     uint32_t start = us_ticker_read();
     while ((us_ticker_read() - start) < dus) {
-        THEKERNEL->call_event(ON_IDLE);
+        THEKERNEL->yield();
     }
 }
@@ -28,6 +28,7 @@
 #include "modules/utils/player/Player.h"
 #include "modules/utils/killbutton/KillButton.h"
 #include "modules/utils/PlayLed/PlayLed.h"
+#include "modules/utils/autoreport/AutoReport.h"
 #include "modules/utils/panel/Panel.h"
 #include "libs/Network/uip/Network.h"
 #include "Config.h"
@@ -50,16 +51,19 @@
 #include "libs/USBDevice/USBSerial/USBSerial.h"
 #include "libs/USBDevice/DFU.h"
 #include "libs/SDFAT.h"
+#include "libs/DiskCache.h"
 #include "StreamOutputPool.h"
 #include "ToolManager.h"
 
 #include "libs/Watchdog.h"
+#include "libs/Trace.h"
 
 #include "version.h"
 #include "system_LPC17xx.h"
 #include "platform_memory.h"
 
 #include "mbed.h"
+#include "us_ticker_api.h"
 
 #define second_usb_serial_enable_checksum  CHECKSUM("second_usb_serial_enable")
 #define disable_msd_checksum  CHECKSUM("msd_disable")
@@ -72,15 +76,18 @@ SDCard sd  __attribute__ ((section ("AHBSRAM0"))) (P0_9, P0_8, P0_7, P0_6);
 //SDCard sd(P0_18, P0_17, P0_15, P0_16);  // this selects SPI0 as the sdcard
 //SDCard sd(P0_18, P0_17, P0_15, P2_8);  // this selects SPI0 as the sdcard witrh a different sd select
 
+// FatFs and USBMSD share a small sector cache in front of the sdcard
+DiskCache sdcache __attribute__ ((section ("AHBSRAM0"))) (&sd);
+
 USB u __attribute__ ((section ("AHBSRAM0")));
 USBSerial usbserial __attribute__ ((section ("AHBSRAM0"))) (&u);
 #ifndef DISABLEMSD
-USBMSD msc __attribute__ ((section ("AHBSRAM0"))) (&u, &sd);
+USBMSD msc __attribute__ ((section ("AHBSRAM0"))) (&u, &sdcache);
 #else
 USBMSD *msc= NULL;
 #endif
 
-SDFAT mounter __attribute__ ((section ("AHBSRAM0"))) ("sd", &sd);
+SDFAT mounter __attribute__ ((section ("AHBSRAM0"))) ("sd", &sdcache);
 
 GPIO leds[5] = {
     GPIO(P1_18),
@@ -103,7 +110,9 @@ void init() {
     kernel->streams->printf("Smoothie Running @%ldMHz\r\n", SystemCoreClock / 1000000);
     SimpleShell::version_command("", kernel->streams);
 
-    bool sdok= (sd.disk_initialize() == 0);
+    uint32_t start= us_ticker_read();
+    bool sdok= (sdcache.disk_initialize() == 0);
+    kernel->boot_step("sd mount", start);
     if(!sdok) kernel->streams->printf("SDCard failed to initialize\r\n");
 
     #ifdef NONETWORK
@@ -117,7 +126,7 @@ void init() {
         size_t n= sizeof(USBMSD);
         void *v = AHB0.alloc(n);
         memset(v, 0, n); // clear the allocated memory
-        msc= new(v) USBMSD(&u, &sd); // allocate object using zeroed memory
+        msc= new(v) USBMSD(&u, &sdcache); // allocate object using zeroed memory
     }else{
         msc= NULL;
         kernel->streams->printf("MSD is disabled\r\n");
@@ -125,102 +134,121 @@ void init() {
 #endif
 
     // Create and add main modules
-    kernel->add_module( new(AHB0) Player() );
+    kernel->add_module( new(AHB0) Player(), "player" );
 
-    kernel->add_module( new(AHB0) CurrentControl() );
-    kernel->add_module( new(AHB0) KillButton() );
-    kernel->add_module( new(AHB0) PlayLed() );
+    kernel->add_module( new(AHB0) CurrentControl(), "current control" );
+    kernel->add_module( new(AHB0) KillButton(), "kill button" );
+    kernel->add_module( new(AHB0) PlayLed(), "play led" );
+    kernel->add_module( new(AHB0) AutoReport(), "auto report" );
+    kernel->add_module( new(AHB0) Trace(), "trace" );
 
     // these modules can be completely disabled in the Makefile by adding to EXCLUDE_MODULES
     #ifndef NO_TOOLS_SWITCH
+    start= us_ticker_read();
     SwitchPool *sp= new SwitchPool();
     sp->load_tools();
     delete sp;
+    kernel->boot_step("switches", start);
     #endif
     #ifndef NO_TOOLS_EXTRUDER
     // NOTE this must be done first before Temperature control so ToolManager can handle Tn before temperaturecontrol module does
+    start= us_ticker_read();
     ExtruderMaker *em= new ExtruderMaker();
     em->load_tools();
     delete em;
+    kernel->boot_step("extruders", start);
     #endif
     #ifndef NO_TOOLS_TEMPERATURECONTROL
     // Note order is important here must be after extruder so Tn as a parameter will get executed first
+    start= us_ticker_read();
     TemperatureControlPool *tp= new TemperatureControlPool();
     tp->load_tools();
     delete tp;
+    kernel->boot_step("temperature controls", start);
     #endif
     #ifndef NO_TOOLS_ENDSTOPS
-    kernel->add_module( new(AHB0) Endstops() );
+    kernel->add_module( new(AHB0) Endstops(), "endstops" );
     #endif
     #ifndef NO_TOOLS_LASER
-    kernel->add_module( new Laser() );
+    kernel->add_module( new Laser(), "laser" );
     #endif
     #ifndef NO_TOOLS_SPINDLE
+    start= us_ticker_read();
     SpindleMaker *sm= new SpindleMaker();
     sm->load_spindle();
     delete sm;
+    kernel->boot_step("spindle", start);
     //kernel->add_module( new(AHB0) Spindle() );
     #endif
     #ifndef NO_UTILS_PANEL
-    kernel->add_module( new(AHB0) Panel() );
+    kernel->add_module( new(AHB0) Panel(), "panel" );
     #endif
     #ifndef NO_TOOLS_ZPROBE
-    kernel->add_module( new(AHB0) ZProbe() );
+    kernel->add_module( new(AHB0) ZProbe(), "zprobe" );
     #endif
     #ifndef NO_TOOLS_SCARACAL
-    kernel->add_module( new(AHB0) SCARAcal() );
+    kernel->add_module( new(AHB0) SCARAcal(), "scaracal" );
     #endif
     #ifndef NO_TOOLS_ROTARYDELTACALIBRATION
-    kernel->add_module( new(AHB0) RotaryDeltaCalibration() );
+    kernel->add_module( new(AHB0) RotaryDeltaCalibration(), "rotary delta calibration" );
     #endif
     #ifndef NONETWORK
-    kernel->add_module( new Network() );
+    kernel->add_module( new Network(), "network" );
     #endif
     #ifndef NO_TOOLS_TEMPERATURESWITCH
     // Must be loaded after TemperatureControl
-    kernel->add_module( new(AHB0) TemperatureSwitch() );
+    kernel->add_module( new(AHB0) TemperatureSwitch(), "temperature switch" );
     #endif
     #ifndef NO_TOOLS_DRILLINGCYCLES
-    kernel->add_module( new(AHB0) Drillingcycles() );
+    kernel->add_module( new(AHB0) Drillingcycles(), "drilling cycles" );
     #endif
     #ifndef NO_TOOLS_FILAMENTDETECTOR
-    kernel->add_module( new(AHB0) FilamentDetector() );
+    kernel->add_module( new(AHB0) FilamentDetector(), "filament detector" );
     #endif
     #ifndef NO_UTILS_MOTORDRIVERCONTROL
-    kernel->add_module( new MotorDriverControl(0) );
+    kernel->add_module( new MotorDriverControl(0), "motor driver control" );
     #endif
     // Create and initialize USB stuff
+    start= us_ticker_read();
     u.init();
 
 #ifdef DISABLEMSD
     if(sdok && msc != NULL){
+        msc->set_module_name("usb msd");
         kernel->add_module( msc );
     }
 #else
+    msc.set_module_name("usb msd");
     kernel->add_module( &msc );
 #endif
 
+    usbserial.set_module_name("usb serial");
     kernel->add_module( &usbserial );
     if( kernel->config->value( second_usb_serial_enable_checksum )->by_default(false)->as_bool() ){
-        kernel->add_module( new(AHB0) USBSerial(&u) );
+        USBSerial *usbserial2= new(AHB0) USBSerial(&u);
+        usbserial2->set_module_name("usb serial 2");
+        kernel->add_module( usbserial2 );
     }
 
     if( kernel->config->value( dfu_enable_checksum )->by_default(false)->as_bool() ){
-        kernel->add_module( new(AHB0) DFU(&u));
+        DFU *dfu= new(AHB0) DFU(&u);
+        dfu->set_module_name("dfu");
+        kernel->add_module( dfu );
     }
+    kernel->boot_step("usb", start);
 
     // 10 second watchdog timeout (or config as seconds)
     float t= kernel->config->value( watchdog_timeout_checksum )->by_default(10.0F)->as_number();
     if(t > 0.1F) {
         // NOTE setting WDT_RESET with the current bootloader would leave it in DFU mode which would be suboptimal
-        kernel->add_module( new Watchdog(t*1000000, WDT_MRI)); // WDT_RESET));
+        kernel->add_module( new Watchdog(t*1000000, WDT_MRI), "watchdog"); // WDT_RESET));
         kernel->streams->printf("Watchdog enabled for %f seconds\n", t);
     }else{
         kernel->streams->printf("WARNING Watchdog is disabled\n");
     }
 
 
-    kernel->add_module( &u );
+    kernel->add_module( &u, "usb start" );
 
     // memory before cache is cleared
     //SimpleShell::print_mem(kernel->streams);
@@ -235,6 +263,7 @@ void init() {
     }
 
     if(sdok) {
+        start= us_ticker_read();
         // load config override file if present
         // NOTE only Mxxx commands that set values should be put in this file. The file is generated by M500
         FILE *fp= fopen(kernel->config_override_filename(), "r");
@@ -250,12 +279,16 @@ void init() {
             kernel->streams->printf("config override file executed\n");
             fclose(fp);
         }
+        kernel->boot_step("config override", start);
     }
 
     // start the timers and interrupts
     THEKERNEL->conveyor->start(THEROBOT->get_number_registered_motors());
     THEKERNEL->step_ticker->start();
     THEKERNEL->slow_ticker->start();
+
+    // anything left to do is done from the main loop
+    THEKERNEL->boot_ready();
 }
 
 int main()
@@ -26,6 +26,7 @@
 #include "utils.h"
 #include "LPC17xx.h"
 #include "version.h"
+#include "Trace.h"
 
 #define panel_display_message_checksum CHECKSUM("display_message")
 #define panel_checksum             CHECKSUM("panel")
@@ -57,6 +58,7 @@ void GcodeDispatch::on_console_line_received(void *line)
 {
     SerialMessage new_message = *static_cast<SerialMessage *>(line);
     string possible_command = new_message.message;
+    Trace::record(Trace::LINE_RECEIVED, possible_command.size());
 
     int ln = 0;
     int cs = 0;
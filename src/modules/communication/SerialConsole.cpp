@@ -16,22 +16,65 @@ using std::string;
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
+#include "libs/platform_memory.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+
+#define uart0_checksum             CHECKSUM("uart0")
+#define dma_receive_checksum       CHECKSUM("dma_receive")
+
+// MRI needs to see the characters when it shares the UART, so receiving with DMA is off by default then
+#if MRI_ENABLE != 0
+#define DMA_RECEIVE_DEFAULT false
+#else
+#define DMA_RECEIVE_DEFAULT true
+#endif
 
 // Serial reading module
 // Treats every received line as a command and passes it ( via event call ) to the command dispatcher.
 // The command dispatcher will then ask other modules if they can do something with it
 SerialConsole::SerialConsole( PinName rx_pin, PinName tx_pin, int baud_rate ){
-    this->serial = new mbed::Serial( rx_pin, tx_pin );
+    this->serial = new SerialDMA( rx_pin, tx_pin );
     this->serial->baud(baud_rate);
     this->last_char_was_cr= false;
+    this->rx_discard= false;
+    this->rx_line_start= 0;
+    this->rx_overflow= false;
+    this->dma_buf= nullptr;
+    this->dma_tail= 0;
+    this->dma_polling= false;
+    this->lines_received= 0;
+    this->lines_taken= 0;
+    this->tx_async= false;
+    this->halt_call= nullptr;
+    this->query_call= nullptr;
 }
 
 // Called when the module has just been loaded
 void SerialConsole::on_module_loaded() {
-    // We want to be called every time a new char is received
-    this->serial->attach(this, &SerialConsole::on_serial_char_received, mbed::Serial::RxIrq);
-    query_flag= false;
-    halt_flag= false;
+
+    // the realtime commands must not be lost however busy the main loop is
+    this->halt_call= THEKERNEL->pending_call<SerialConsole, &SerialConsole::handle_halt>(this);
+    this->query_call= THEKERNEL->pending_call<SerialConsole, &SerialConsole::handle_query>(this);
+
+    // Receiving with DMA means no interrupt per character
+    if(THEKERNEL->config->value(uart0_checksum, dma_receive_checksum)->by_default(DMA_RECEIVE_DEFAULT)->as_bool()) {
+        this->dma_buf= (char *)AHB0.alloc(DMA_RX_SIZE);
+        if(this->dma_buf != nullptr && !this->serial->start_rx(this->dma_buf, DMA_RX_SIZE, DMA_RX_CHUNK, [this]() { this->on_rx_dma(); })) {
+            AHB0.dealloc(this->dma_buf);
+            this->dma_buf= nullptr;
+        }
+    }
+
+    if(this->dma_buf == nullptr) {
+        // We want to be called every time a new char is received
+        this->serial->attach(this, &SerialConsole::on_serial_char_received, mbed::Serial::RxIrq);
+    }
+
+    // and every time the transmit FIFO empties, so output does not hold up the main loop
+    this->serial->attach(this, &SerialConsole::on_serial_tx_ready, mbed::Serial::TxIrq);
+    this->tx_async= true;
 
     // We only call the command dispatcher in the main loop, nowhere else
     this->register_for_event(ON_MAIN_LOOP);
@@ -44,51 +87,108 @@ void SerialConsole::on_module_loaded() {
 // Called on Serial::RxIrq interrupt, meaning we have received a char
 void SerialConsole::on_serial_char_received(){
     while(this->serial->readable()){
-        char received = this->serial->getc();
-        if(received == '?') {
-            query_flag= true;
-            continue;
-        }
-        if(received == 'X'-'A'+1) { // ^X
-            halt_flag= true;
-            continue;
-        }
-        if(received == '\n' && last_char_was_cr) {
-            // ignore the \n of a \r\n pair
-            last_char_was_cr= false;
-            continue;
-        }
-        last_char_was_cr= (received=='\r');
+        receive_char(this->serial->getc());
+    }
+}
+
+// Called from the DMA interrupt each time a chunk of the receive buffer has been filled
+void SerialConsole::on_rx_dma(){
+    poll_rx_dma();
+}
 
-        // convert CR to NL (for host OSs that don't send NL)
-        if( received == '\r' ){ received = '\n'; }
-        this->buffer.push_back(received);
+// Picks up whatever the DMA has received since last time, called from the DMA interrupt and from on_idle
+// polling from on_idle is what gets a partial chunk (and any realtime character in it) looked at without waiting for the chunk to fill
+void SerialConsole::poll_rx_dma(){
+    // the interrupt does not interfere if it comes in while on_idle is polling, the bytes it was called for will be picked up on the next one
+    if(this->dma_polling) return;
+    this->dma_polling= true;
+    uint16_t head= this->serial->rx_head();
+    while(this->dma_tail != head) {
+        receive_char(this->dma_buf[this->dma_tail]);
+        this->dma_tail= (this->dma_tail + 1) & (DMA_RX_SIZE - 1);
+    }
+    this->dma_polling= false;
+}
+
+void SerialConsole::receive_char(char received){
+    if(received == '?') {
+        if(query_call != nullptr) query_call->raise();
+        return;
+    }
+    if(received == 'X'-'A'+1) { // ^X
+        if(halt_call != nullptr) halt_call->raise();
+        return;
+    }
+    if(received == '\n' && last_char_was_cr) {
+        // ignore the \n of a \r\n pair
+        last_char_was_cr= false;
+        return;
+    }
+    last_char_was_cr= (received=='\r');
+
+    // convert CR to NL (for host OSs that don't send NL)
+    if( received == '\r' ){ received = '\n'; }
+
+    if(this->rx_discard) {
+        // dropping the rest of a line that did not fit
+        if(received == '\n') this->rx_discard= false;
+        return;
+    }
+
+    if(rx_full()) {
+        // the ring must never be overwritten, so drop what we have of this line and the rest of it as it arrives
+        // only complete lines are ever taken by the main loop so the partial line can be taken back here
+        this->buffer.head= this->rx_line_start;
+        this->rx_discard= (received != '\n');
+        this->rx_overflow= true;
+        return;
+    }
+
+    this->buffer.push_back(received);
+    if( received == '\n' ) {
+        this->rx_line_start= this->buffer.head;
+        this->lines_received++;
     }
 }
 
 void SerialConsole::on_idle(void * argument)
 {
-    if(query_flag) {
-        query_flag= false;
-        puts(THEKERNEL->get_query_string().c_str());
-    }
-    if(halt_flag) {
-        halt_flag= false;
-        THEKERNEL->call_event(ON_HALT, nullptr);
-        if(THEKERNEL->is_grbl_mode()) {
-            puts("ALARM: Abort during cycle\r\n");
-        } else {
-            puts("HALTED, M999 or $X to exit HALT state\r\n");
-        }
+    if(this->dma_buf != nullptr) poll_rx_dma();
+}
+
+// the realtime commands are deferred from the receive interrupt
+void SerialConsole::handle_query(uint32_t)
+{
+    char buf[Kernel::QUERY_STRING_SIZE];
+    THEKERNEL->get_query_string(buf, sizeof(buf));
+    puts(buf);
+}
+
+void SerialConsole::handle_halt(uint32_t)
+{
+    THEKERNEL->call_event(ON_HALT, nullptr);
+    if(THEKERNEL->is_grbl_mode()) {
+        puts("ALARM: Abort during cycle\r\n");
+    } else {
+        puts("HALTED, M999 or $X to exit HALT state\r\n");
     }
 }
 
 // Actual event calling must happen in the main loop because if it happens in the interrupt we will loose data
 void SerialConsole::on_main_loop(void * argument){
-    if( this->has_char('\n') ){
+    if(this->dma_buf != nullptr) poll_rx_dma();
+
+    if(this->rx_overflow) {
+        this->rx_overflow= false;
+        puts("error: line too long or receive buffer overflowed, line dropped\r\n");
+    }
+
+    if( this->lines_received != this->lines_taken ){
+        this->lines_taken++;
         string received;
         received.reserve(20);
-        while(1){
+        // never read past what has been received, even if the count and the data were to disagree
+        while(this->buffer.tail != this->buffer.head){
            char c;
            this->buffer.pop_front(c);
            if( c == '\n' ){
@@ -117,12 +217,54 @@ int SerialConsole::puts(const char* s)
 
 int SerialConsole::_putc(int c)
 {
-    return this->serial->putc(c);
+    if(!this->tx_async) {
+        return this->serial->putc(c);
+    }
+
+    // when the buffer is full we wait for room, the UART always drains so the wait is bounded by the baud rate
+    // refilling the FIFO here as well means this also works when called from an interrupt that masks the UART one
+    while(tx_full()) {
+        __disable_irq();
+        if(this->serial->tx_fifo_empty()) fill_tx_fifo();
+        __enable_irq();
+    }
+
+    __disable_irq();
+    if(this->txbuffer.head == this->txbuffer.tail && this->serial->tx_fifo_empty()) {
+        // nothing queued and the UART is idle so there will be no interrupt, start it off
+        this->serial->tx_fifo_put(c);
+    } else {
+        this->txbuffer.push_back(c);
+    }
+    __enable_irq();
+    return c;
+}
+
+// Called on Serial::TxIrq interrupt, meaning the transmit FIFO is empty
+void SerialConsole::on_serial_tx_ready()
+{
+    fill_tx_fifo();
+}
+
+void SerialConsole::fill_tx_fifo()
+{
+    for (int i = 0; i < SerialDMA::TX_FIFO_SIZE && this->txbuffer.head != this->txbuffer.tail; ++i) {
+        char c;
+        this->txbuffer.pop_front(c);
+        this->serial->tx_fifo_put(c);
+    }
 }
 
 int SerialConsole::_getc()
 {
-    return this->serial->getc();
+    // the receive interrupt or DMA owns the UART, so read what they have put in the buffer
+    while(this->buffer.size() == 0) {
+        if(this->dma_buf != nullptr) poll_rx_dma();
+    }
+    char c;
+    this->buffer.pop_front(c);
+    if( c == '\n' ) this->lines_taken++;
+    return c;
 }
 
 // Does the queue have a given char ?
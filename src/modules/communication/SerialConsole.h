@@ -9,7 +9,7 @@
 #define SERIALCONSOLE_H
 
 #include "libs/Module.h"
-#include "Serial.h" // mbed.h lib
+#include "libs/SerialDMA.h"
 #include "libs/Kernel.h"
 #include <vector>
 #include <string>
@@ -26,6 +26,8 @@ class SerialConsole : public Module, public StreamOutput {
 
         void on_module_loaded();
         void on_serial_char_received();
+        void on_rx_dma();
+        void on_serial_tx_ready();
         void on_main_loop(void * argument);
         void on_idle(void * argument);
         bool has_char(char letter);
@@ -36,13 +38,42 @@ class SerialConsole : public Module, public StreamOutput {
 
         //string receive_buffer;                 // Received chars are stored here until a newline character is received
         //vector<std::string> received_lines;    // Received lines are stored here until they are requested
-        RingBuffer<char,256> buffer;             // Receive buffer
-        mbed::Serial* serial;
+        static const int RX_SIZE= 256;           // must be a power of 2
+        RingBuffer<char,RX_SIZE> buffer;         // Receive buffer
+        SerialDMA* serial;
+
         struct {
-          bool query_flag:1;
-          bool halt_flag:1;
           bool last_char_was_cr:1;
+          bool rx_discard:1; // the line being received overflowed the buffer, drop it up to its end
         };
+
+    private:
+        void receive_char(char received);
+        void handle_query(uint32_t);
+        void handle_halt(uint32_t);
+        Kernel::PendingCall *halt_call;
+        Kernel::PendingCall *query_call;
+        void poll_rx_dma();
+        void fill_tx_fifo();
+        bool rx_full() const { return ((buffer.head + 1) & (RX_SIZE - 1)) == buffer.tail; }
+        int rx_line_start;                       // where the line being received starts in buffer
+        volatile bool rx_overflow;               // a line was dropped, reported from the main loop
+        bool tx_full() const { return ((txbuffer.head + 1) & (TX_SIZE - 1)) == txbuffer.tail; }
+
+        // output is queued here and sent from the transmit interrupt, once the module is loaded
+        static const int TX_SIZE= 256;           // must be a power of 2
+        RingBuffer<char,TX_SIZE> txbuffer;
+        bool tx_async;
+
+        // when receiving with DMA the characters land here, and are picked up by poll_rx_dma()
+        static const uint16_t DMA_RX_SIZE= 512;  // must be a power of 2
+        static const uint16_t DMA_RX_CHUNK= 128; // the DMA interrupts once per chunk
+        char *dma_buf;
+        uint16_t dma_tail;
+        volatile bool dma_polling;
+
+        volatile uint32_t lines_received;        // incremented as a newline is put in buffer
+        uint32_t lines_taken;                    // incremented as a newline is taken out of buffer
 };
 
 #endif
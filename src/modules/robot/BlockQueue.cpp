@@ -141,6 +141,16 @@ bool BlockQueue::is_full() const
     return r;
 }
 
+// number of blocks that can be produced before the queue is full
+unsigned int BlockQueue::free_count() const
+{
+    if (length == 0)
+        return 0;
+
+    unsigned int h = head_i, t = tail_i;
+    return (t > h) ? (t - h - 1) : (length - (h - t) - 1);
+}
+
 bool BlockQueue::is_empty() const
 {
     //__disable_irq();
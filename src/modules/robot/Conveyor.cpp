@@ -22,6 +22,7 @@
 #include "StepTicker.h"
 #include "Robot.h"
 #include "StepperMotor.h"
+#include "Trace.h"
 
 #include <functional>
 
@@ -135,13 +136,13 @@ void Conveyor::wait_for_idle(bool wait_for_motors)
     running = false; // stops on_idle calling check_queue
     while (!queue.is_empty()) {
         check_queue(true); // forces queue to be made available to stepticker
-        THEKERNEL->call_event(ON_IDLE, this);
+        THEKERNEL->yield();
     }
 
     if(wait_for_motors) {
         // now we wait for all motors to stop moving
         while(!is_idle()) {
-            THEKERNEL->call_event(ON_IDLE, this);
+            THEKERNEL->yield();
         }
     }
 
@@ -157,7 +158,7 @@ void Conveyor::queue_head_block()
     // upstream caller will block on this until there is room in the queue
     while (queue.is_full() && !THEKERNEL->is_halted()) {
         //check_queue();
-        THEKERNEL->call_event(ON_IDLE, this); // will call check_queue();
+        THEKERNEL->yield(); // will call check_queue();
     }
 
     if(THEKERNEL->is_halted()) {
@@ -168,6 +169,7 @@ void Conveyor::queue_head_block()
     }
 
     queue.produce_head();
+    Trace::record(Trace::QUEUE_DEPTH, queue_depth());
 
     // not sure if this is the correct place but we need to turn on the motors if they were not already on
     THEKERNEL->call_event(ON_ENABLE, (void*)1); // turn all enable pins on
@@ -233,6 +235,7 @@ void Conveyor::block_finished()
 {
     // we increment the isr_tail_i so we can get the next block
     queue.isr_tail_i= queue.next(queue.isr_tail_i);
+    Trace::record(Trace::QUEUE_DEPTH, queue_depth());
 }
 
 /*
@@ -25,6 +25,7 @@ public:
     void wait_for_idle(bool wait_for_motors=true);
     bool is_queue_empty() { return queue.is_empty(); };
     bool is_queue_full() { return queue.is_full(); };
+    unsigned int get_queue_free() const { return queue.free_count(); };
     bool is_idle() const;
 
     // returns next available block writes it to block and returns true
@@ -41,6 +42,8 @@ public:
 private:
     void check_queue(bool force= false);
     void queue_head_block(void);
+    // blocks queued that the step ticker has not finished yet
+    unsigned int queue_depth() const { return (queue.head_i + queue_size - queue.isr_tail_i) % queue_size; }
 
     using  Queue_t= BlockQueue;
     Queue_t queue;  // Queue of Blocks
@@ -497,7 +497,7 @@ void Robot::on_gcode_received(void *argument)
                     // wait for specified time
                     uint32_t start = us_ticker_read(); // mbed call
                     while ((us_ticker_read() - start) < delay_ms * 1000) {
-                        THEKERNEL->call_event(ON_IDLE, this);
+                        THEKERNEL->yield();
                         if(THEKERNEL->is_halted()) return;
                     }
                 }
@@ -1393,7 +1393,7 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
 
     // if we are in feed hold wait here until it is released, this means that even segmented lines will pause
     while(THEKERNEL->get_feed_hold()) {
-        THEKERNEL->call_event(ON_IDLE, this);
+        THEKERNEL->yield();
         // if we also got a HALT then break out of this
         if(THEKERNEL->is_halted()) return false;
     }
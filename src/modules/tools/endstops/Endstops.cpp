@@ -24,6 +24,7 @@
 #include "ConfigValue.h"
 #include "libs/StreamOutput.h"
 #include "PublicDataRequest.h"
+#include "PublicData.h"
 #include "EndstopsPublicAccess.h"
 #include "StreamOutputPool.h"
 #include "StepTicker.h"
@@ -107,8 +108,6 @@ enum STATES {
 Endstops::Endstops()
 {
     this->status = NOT_HOMING;
-    this->trigger_halt= false;
-    this->limits_activated= false;
 }
 
 void Endstops::on_module_loaded()
@@ -129,10 +128,12 @@ void Endstops::on_module_loaded()
     }
 
     register_for_event(ON_GCODE_RECEIVED);
-    register_for_event(ON_GET_PUBLIC_DATA);
-    register_for_event(ON_SET_PUBLIC_DATA);
-    register_for_event(ON_IDLE);
+    PublicData::register_get(endstops_checksum, 0, [this](PublicDataRequest *pdr) { this->on_get_public_data(pdr); });
+    PublicData::register_set(endstops_checksum, 0, [this](PublicDataRequest *pdr) { this->on_set_public_data(pdr); });
 
+    // a limit hit must get to on_halt however busy the main loop is
+    limit_hit_call= THEKERNEL->pending_call<Endstops, &Endstops::handle_limit_hit>(this);
+    limits_enabled_call= THEKERNEL->pending_call<Endstops, &Endstops::handle_limits_enabled>(this);
     THEKERNEL->slow_ticker->attach(1000, this, &Endstops::read_endstops);
 }
 
@@ -417,26 +418,26 @@ void Endstops::get_global_configs()
         this->park_after_home= false;
     }
 }
-void Endstops::on_idle(void*)
+// deferred from check_limits(), axis_dir is the axis that triggered in bits 0-2 and its direction in bit 3
+void Endstops::handle_limit_hit(uint32_t axis_dir)
 {
-    if(trigger_halt) {
-        trigger_halt= false;
-        char d= triggered_direction ? '-' : '+';
-        char a= triggered_axis < 3 ? 'X' + triggered_axis : 'A' + triggered_axis-3;
-        if(!THEKERNEL->is_grbl_mode()) {
-            THEKERNEL->streams->printf("Limit switch %c%c was hit\n", d, a);
-        }else{
-            THEKERNEL->streams->printf("ALARM: Hard limit %c%c\n", d, a);
-        }
-        THEKERNEL->streams->printf("// NOTICE limits are disabled until all have been cleared\n");
+    uint8_t axis= axis_dir & 7;
+    char d= (axis_dir & 8) ? '-' : '+';
+    char a= axis < 3 ? 'X' + axis : 'A' + axis-3;
+    if(!THEKERNEL->is_grbl_mode()) {
+        THEKERNEL->streams->printf("Limit switch %c%c was hit\n", d, a);
+    }else{
+        THEKERNEL->streams->printf("ALARM: Hard limit %c%c\n", d, a);
+    }
+    THEKERNEL->streams->printf("// NOTICE limits are disabled until all have been cleared\n");
 
-        // disables heaters and motors
-        THEKERNEL->call_event(ON_HALT, nullptr);
+    // disables heaters and motors
+    THEKERNEL->call_event(ON_HALT, nullptr);
+}
 
-    } else if(this->limits_activated) {
-        this->limits_activated= false;
-        THEKERNEL->streams->printf("// NOTICE hard limits are now enabled\n");
-    }
+void Endstops::handle_limits_enabled(uint32_t)
+{
+    THEKERNEL->streams->printf("// NOTICE hard limits are now enabled\n");
 }
 
 bool Endstops::debounced_get(Pin *pin)
@@ -560,7 +561,7 @@ void Endstops::check_limits()
         if(all_clear) {
             // clear the state
             this->status = NOT_HOMING;
-            this->limits_activated= true;
+            limits_enabled_call->raise();
         }
         return;
 
@@ -586,14 +587,12 @@ void Endstops::check_limits()
                 this->status = LIMIT_TRIGGERED;
                 i->debounce= 0;
 
-                // we cannot call on_halt here but must defer it to on_idle,
+                // we cannot call on_halt here but must defer it to the main loop,
                 // however we can stop incoming commands and stop all the motors here
                 THEKERNEL->immediate_halt();
-                trigger_halt= true;
-                // remember what axis triggered it (first one wins)
+                // pass on what axis triggered it (first one wins)
                 // TODO gives incorrect result on corexy need to use fk to figure it out
-                triggered_direction= STEPPER[m]->which_direction();
-                triggered_axis= m;
+                limit_hit_call->raise(m | (STEPPER[m]->which_direction() ? 8 : 0));
                 return;
             }
         }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "libs/Module.h"
+#include "libs/Kernel.h"
 #include "Pin.h"
 
 #include <bitset>
@@ -41,7 +42,10 @@ class Endstops : public Module{
         void set_homing_offset(Gcode* gcode);
         uint32_t read_endstops(uint32_t dummy);
         void handle_park();
-        void on_idle(void*);
+        void handle_limit_hit(uint32_t axis_dir);
+        void handle_limits_enabled(uint32_t);
+        Kernel::PendingCall *limit_hit_call;
+        Kernel::PendingCall *limits_enabled_call;
 
         // global settings
         float saved_position[3]{0}; // save G28 (in grbl mode)
@@ -98,9 +102,5 @@ class Endstops : public Module{
             bool move_to_origin_after_home:1;
             bool park_after_home:1;
             bool limit_enabled:1;
-            volatile bool trigger_halt:1;
-            volatile bool limits_activated:1;
-            uint8_t triggered_axis:3;
-            bool triggered_direction:1;
         };
 };
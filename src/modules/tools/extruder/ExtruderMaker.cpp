@@ -50,6 +50,7 @@ void ExtruderMaker::load_tools(){
     if(cnt > 1) {
         // ONLY do this if multitool enabled and more than one tool is defined
         toolmanager= new ToolManager();
+        toolmanager->set_module_name("tool manager");
         THEKERNEL->add_module( toolmanager );
 
     }else{
@@ -65,6 +66,7 @@ void ExtruderMaker::load_tools(){
 
             // Make a new extruder module
             Extruder* extruder = new Extruder(cs);
+            extruder->set_module_name("extruder");
 
             // Add the Extruder module to the kernel
             THEKERNEL->add_module( extruder );
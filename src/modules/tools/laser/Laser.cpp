@@ -23,6 +23,7 @@
 #include "Gcode.h"
 #include "PwmOut.h" // mbed.h lib
 #include "PublicDataRequest.h"
+#include "PublicData.h"
 
 #include <algorithm>
 
@@ -111,7 +112,7 @@ void Laser::on_module_loaded()
     this->register_for_event(ON_HALT);
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    PublicData::register_get(laser_checksum, 0, [this](PublicDataRequest *pdr) { this->on_get_public_data(pdr); });
 
     // no point in updating the power more than the PWM frequency, but not faster than 1KHz
     ms_per_tick = 1000 / std::min(1000UL, 1000000 / period);
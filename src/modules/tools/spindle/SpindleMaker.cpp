@@ -57,6 +57,7 @@ void SpindleMaker::load_spindle(){
     // Add the spindle if we successfully initialized one
     if( spindle != NULL) {
 
+        spindle->set_module_name("spindle");
         spindle->register_for_event(ON_GCODE_RECEIVED);
         if (!THEKERNEL->config->value(spindle_checksum, spindle_ignore_on_halt_checksum)->by_default(false)->as_bool()) {
             spindle->register_for_event(ON_HALT);
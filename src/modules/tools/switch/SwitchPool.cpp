@@ -28,6 +28,7 @@ void SwitchPool::load_tools()
         // If module is enabled
         if( THEKERNEL->config->value(switch_checksum, modules[i], enable_checksum )->as_bool() == true ) {
             Switch *controller = new Switch(modules[i]);
+            controller->set_module_name("switch");
             THEKERNEL->add_module(controller);
         }
     }
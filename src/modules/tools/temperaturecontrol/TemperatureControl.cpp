@@ -33,6 +33,7 @@
 #include "PT100_E3D.h"
 
 #include "MRI_Hooks.h"
+#include "Trace.h"
 
 #define UNDEFINED -1
 
@@ -96,13 +97,18 @@ void TemperatureControl::on_module_loaded()
 
     // Register for events
     this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_IDLE);
 
+    // public data requests are called directly rather than broadcast
+    auto get= [this](PublicDataRequest *pdr) { this->on_get_public_data(pdr); };
+    PublicData::register_get(temperature_control_checksum, pool_index_checksum, get);
+    PublicData::register_get(temperature_control_checksum, poll_controls_checksum, get);
+    PublicData::register_get(temperature_control_checksum, current_temperature_checksum, get);
+
     if(!this->readonly) {
         this->register_for_event(ON_SECOND_TICK);
-        this->register_for_event(ON_SET_PUBLIC_DATA);
         this->register_for_event(ON_HALT);
+        PublicData::register_set(temperature_control_checksum, this->name_checksum, [this](PublicDataRequest *pdr) { this->on_set_public_data(pdr); });
     }
 }
 
@@ -193,6 +199,7 @@ void TemperatureControl::load_config()
 
     // sigma-delta output modulation
     this->o = 0;
+    this->traced_o = 0;
 
     if(!this->readonly) {
         // used to enable bang bang control of heater
@@ -353,7 +360,7 @@ void TemperatureControl::on_gcode_received(void *argument)
 
                         this->waiting = true; // on_second_tick will announce temps
                         while ( get_temperature() < target_temperature ) {
-                            THEKERNEL->call_event(ON_IDLE, this);
+                            THEKERNEL->yield();
                             // check if ON_HALT was called (usually by kill button)
                             if(THEKERNEL->is_halted() || this->target_temperature == UNDEFINED) {
                                 THEKERNEL->streams->printf("Wait on temperature aborted by kill\n");
@@ -479,6 +486,11 @@ uint32_t TemperatureControl::thermistor_read_tick(uint32_t dummy)
         }
     }
 
+    if(this->o != traced_o) {
+        traced_o= this->o;
+        Trace::record(Trace::HEATER_PWM, (pool_index << 16) | (traced_o & 0xFFFF));
+    }
+
     last_reading = temperature;
     return 0;
 }
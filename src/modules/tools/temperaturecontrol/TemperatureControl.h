@@ -53,6 +53,7 @@ class TemperatureControl : public Module {
         TempSensor *sensor;
         float i_max;
         int o;
+        int traced_o; // the last o put in the trace
         float last_reading;
         float readings_per_second;
         Pwm  heater_pin;
@@ -29,6 +29,7 @@ void TemperatureControlPool::load_tools()
         // If module is enabled
         if( THEKERNEL->config->value(temperature_control_checksum, cs, enable_checksum )->as_bool() ) {
             TemperatureControl *controller = new TemperatureControl(cs, cnt++);
+            controller->set_module_name("temperature control");
             THEKERNEL->add_module(controller);
         }
     }
@@ -36,6 +37,7 @@ void TemperatureControlPool::load_tools()
     // no need to create one of these if no heaters defined
     if(cnt > 0) {
         PID_Autotuner *pidtuner = new PID_Autotuner();
+        pidtuner->set_module_name("pid autotuner");
         THEKERNEL->add_module( pidtuner );
     }
 }
@@ -641,7 +641,7 @@ bool CartGridStrategy::doProbe(Gcode *gc)
 
         while( !zprobe->getProbeStatus()) {
             if(THEKERNEL->is_halted()) return(false);
-            THEKERNEL->call_event(ON_IDLE);
+            THEKERNEL->yield();
         }
     }
 
@@ -285,7 +285,7 @@ bool DeltaCalibrationStrategy::calibrate_delta_endstops(Gcode *gcode)
         trimz += (mmx.first - t3z) * trimscale;
 
         // flush the output
-        THEKERNEL->call_event(ON_IDLE);
+        THEKERNEL->yield();
     }
 
     if((mmx.second - mmx.first) > target) {
@@ -381,7 +381,7 @@ bool DeltaCalibrationStrategy::calibrate_delta_radius(Gcode *gcode)
         zprobe->coordinated_move(NAN, NAN, bedht, zprobe->getFastFeedrate()); // move to absolute Z that is just above bed
 
         // flush the output
-        THEKERNEL->call_event(ON_IDLE);
+        THEKERNEL->yield();
     }
 
     if(!good) {
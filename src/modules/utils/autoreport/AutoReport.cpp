@@ -0,0 +1,124 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "AutoReport.h"
+#include "libs/Kernel.h"
+#include "libs/StreamOutputPool.h"
+#include "libs/StreamOutput.h"
+#include "SlowTicker.h"
+#include "Gcode.h"
+#include "PublicData.h"
+#include "TemperatureControlPublicAccess.h"
+
+#include <string>
+#include <vector>
+
+AutoReport::AutoReport()
+{
+    ticks= 0;
+    last_ticks= 0;
+}
+
+void AutoReport::on_module_loaded()
+{
+    this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_event(ON_IDLE, TICK_MS * 1000);
+
+    THEKERNEL->slow_ticker->attach(1000 / TICK_MS, this, &AutoReport::report_tick);
+}
+
+uint32_t AutoReport::report_tick(uint32_t)
+{
+    ticks++;
+    return 0;
+}
+
+// M155 S<seconds between reports, 0 stops them> P<what: 1 status, 2 temperatures, 3 both (default)>
+void AutoReport::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+    if(!gcode->has_m || gcode->m != 155) return;
+
+    if(!THEKERNEL->streams->has_stream(gcode->stream)) {
+        gcode->stream->printf("auto report is not available on this stream\n");
+        return;
+    }
+
+    if(!gcode->has_letter('S')) {
+        for(auto &r : THEKERNEL->streams->get_auto_reports()) {
+            if(r.stream == gcode->stream) {
+                gcode->stream->printf("auto report every %1.3f seconds P%d\n", r.period_ms / 1000.0F, r.what);
+                return;
+            }
+        }
+        gcode->stream->printf("auto report is off\n");
+        return;
+    }
+
+    float s= gcode->get_value('S');
+    uint8_t what= gcode->has_letter('P') ? gcode->get_int('P') : (REPORT_STATUS | REPORT_TEMPERATURES);
+    uint32_t period= 0;
+    if(s > 0) {
+        period= s * 1000;
+        if(period < TICK_MS) period= TICK_MS;
+        if(period > 60000) period= 60000;
+    }
+    THEKERNEL->streams->set_auto_report(gcode->stream, period, what);
+}
+
+void AutoReport::on_idle(void *argument)
+{
+    uint32_t t= ticks;
+    if(t == last_ticks) return;
+    int32_t elapsed= (t - last_ticks) * TICK_MS;
+    last_ticks= t;
+
+    std::vector<StreamOutputPool::auto_report_t> &reports= THEKERNEL->streams->get_auto_reports();
+    if(reports.empty()) return;
+
+    uint8_t due= 0;
+    for(auto &r : reports) {
+        r.countdown_ms -= elapsed;
+        if(r.countdown_ms <= 0) due |= r.what;
+    }
+    if(due == 0) return;
+
+    // build each report once for all the streams that want it
+    char status[Kernel::QUERY_STRING_SIZE];
+    status[0]= '\0';
+    if(due & REPORT_STATUS) {
+        THEKERNEL->get_query_string(status, sizeof(status));
+    }
+
+    std::string temperatures;
+
+    if(due & REPORT_TEMPERATURES) {
+        std::vector<struct pad_temperature> controllers;
+        if(PublicData::get_value(temperature_control_checksum, poll_controls_checksum, &controllers)) {
+            char buf[32];
+            for(auto &c : controllers) {
+                int n= snprintf(buf, sizeof(buf), "%s:%3.1f /%3.1f @%d ", c.designator.c_str(), c.current_temperature, c.target_temperature <= 0 ? 0.0F : c.target_temperature, c.pwm);
+                if(n > (int)sizeof(buf) - 1) n= sizeof(buf) - 1;
+                temperatures.append(buf, n);
+            }
+            if(!temperatures.empty()) temperatures.append("\n");
+        }
+    }
+
+    for(auto &r : reports) {
+        if(r.countdown_ms > 0) continue;
+
+        // if we fell behind do not try to catch up
+        r.countdown_ms += r.period_ms;
+        if(r.countdown_ms <= 0) r.countdown_ms= r.period_ms;
+
+        if((r.what & REPORT_STATUS) && status[0] != '\0') r.stream->puts(status);
+        if((r.what & REPORT_TEMPERATURES) && !temperatures.empty()) r.stream->puts(temperatures.c_str());
+    }
+
+}
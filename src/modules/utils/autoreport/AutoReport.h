@@ -0,0 +1,35 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "libs/Module.h"
+
+#include <stdint.h>
+
+// Pushes status and temperature reports to the streams that asked for them with M155, so hosts do not have to poll
+// The reports are built once per tick and the same text is sent to every stream that is due one
+class AutoReport : public Module {
+    public:
+        AutoReport();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+        void on_idle(void *argument);
+
+        // what goes in a report, the P parameter of M155
+        static const uint8_t REPORT_STATUS= 1;
+        static const uint8_t REPORT_TEMPERATURES= 2;
+
+    private:
+        uint32_t report_tick(uint32_t);
+
+        static const uint16_t TICK_MS= 10;
+        volatile uint32_t ticks;
+        uint32_t last_ticks;
+};
@@ -119,6 +119,16 @@ void Configurator::config_load_command( string parameters, StreamOutput *stream
         THEKERNEL->config->config_cache->dump(stream);
         THEKERNEL->config->config_cache_clear();
 
+    } else if(source == "stats") {
+        if(!THEKERNEL->config->has_boot_cache_stats()) {
+            stream->printf( "config cache has not been cleared since boot\n");
+            return;
+        }
+        const Config::cache_stats_t& s = THEKERNEL->config->get_boot_cache_stats();
+        stream->printf( "boot config cache: %lu entries loaded in %lu us\n", s.entries, s.load_us);
+        stream->printf( "%lu lookups in %lu us, %lu hash probes (%1.2f per lookup)\n",
+                        s.lookups, s.lookup_us, s.probes, s.lookups > 0 ? (float)s.probes / s.lookups : 0.0F);
+
     } else if(source == "checksum") {
         string key = shift_parameter(parameters);
         uint16_t cs[3];
@@ -126,7 +136,7 @@ void Configurator::config_load_command( string parameters, StreamOutput *stream
         stream->printf( "checksum of %s = %02X %02X %02X\n", key.c_str(), cs[0], cs[1], cs[2]);
 
     } else {
-        stream->printf( "unsupported option: must be one of load|unload|dump|checksum\n" );
+        stream->printf( "unsupported option: must be one of load|unload|dump|stats|checksum\n" );
     }
 }
 
@@ -185,8 +185,8 @@ bool MotorDriverControl::config_module(uint16_t cs)
 
     if( THEKERNEL->config->value(motor_driver_control_checksum, cs, alarm_checksum )->by_default(false)->as_bool() ) {
         halt_on_alarm= THEKERNEL->config->value(motor_driver_control_checksum, cs, halt_on_alarm_checksum )->by_default(false)->as_bool();
-        // enable alarm monitoring for the chip
-        this->register_for_event(ON_SECOND_TICK);
+        // enable alarm monitoring for the chip, it is not needed to get going so it starts once the machine is ready
+        THEKERNEL->late_init<MotorDriverControl, &MotorDriverControl::start_alarm_monitor>(this, "motor driver alarms");
     }
 
     THEKERNEL->streams->printf("MotorDriverControl INFO: configured motor %c (%d): as %s, cs: %04X\n", axis, id, chip==TMC2660?"TMC2660":chip==DRV8711?"DRV8711":"UNKNOWN", (spi_cs_pin.port_number<<8)|spi_cs_pin.pin);
@@ -194,6 +194,11 @@ bool MotorDriverControl::config_module(uint16_t cs)
     return true;
 }
 
+void MotorDriverControl::start_alarm_monitor(uint32_t)
+{
+    this->register_for_event(ON_SECOND_TICK);
+}
+
 // event to handle enable on/off, as it could be called in an ISR we schedule to turn the steppers on or off in ON_IDLE
 // This may cause the initial step to be missed if on-idle is delayed too much but we can't do SPI in an interrupt
 void MotorDriverControl::on_enable(void *argument)
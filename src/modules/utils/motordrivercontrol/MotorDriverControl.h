@@ -28,6 +28,7 @@ class MotorDriverControl : public Module {
 
     private:
         bool config_module(uint16_t cs);
+        void start_alarm_monitor(uint32_t);
         void initialize_chip(uint16_t cs);
         void set_current( uint32_t current );
         uint32_t set_microstep( uint32_t ms );
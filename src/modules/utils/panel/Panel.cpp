@@ -92,7 +92,6 @@ Panel::Panel()
     this->sd= nullptr;
     this->extmounter= nullptr;
     this->external_sd_enable= false;
-    this->in_idle= false;
     this->display_extruder= false;
     strcpy(this->playing_file, "Playing file");
 }
@@ -202,12 +201,17 @@ void Panel::on_module_loaded()
     this->display_extruder = THEKERNEL->config->value( panel_checksum, display_extruder_checksum )->by_default(false)->as_bool();
 
     // Register for events
-    this->register_for_event(ON_IDLE);
+    // 50Hz is plenty for the display. It is not run from the yield points as some screens send gcodes straight from
+    // on_idle, eg the value setters and the watch screen speed, which must not land in the middle of another command's wait
+    this->register_for_event(ON_IDLE, 20000, 0, false);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SET_PUBLIC_DATA);
 
     // Refresh timer
     THEKERNEL->slow_ticker->attach( 20, this, &Panel::refresh_tick );
+
+    // the lcd is not needed for motion so it is started once the machine is ready
+    THEKERNEL->late_init<Panel, &Panel::start>(this, "panel start");
 }
 
 // Enter a screen, we only care about it now
@@ -336,47 +340,48 @@ static const uint8_t ohw_logo_antipixel_bits[] = {
     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
 };
 
+// Initialise the lcd and show the splash screen
+void Panel::start(uint32_t)
+{
+    this->lcd->init();
+
+    Version v;
+    string build(v.get_build());
+    string date(v.get_build_date());
+    this->lcd->clear();
+    this->lcd->setCursor(0, 0); this->lcd->printf("Welcome to Smoothie");
+    this->lcd->setCursor(0, 1); this->lcd->printf("%s", build.substr(0, 20).c_str());
+    this->lcd->setCursor(0, 2); this->lcd->printf("%s", date.substr(0, 20).c_str());
+    this->lcd->setCursor(0, 3); this->lcd->printf("Please wait....");
+
+    if (this->lcd->hasGraphics()) {
+        this->lcd->bltGlyph(24, 40, ohw_logo_antipixel_width, ohw_logo_antipixel_height, ohw_logo_antipixel_bits);
+    }
+
+    this->lcd->on_refresh(true); // tell lcd to display now
+
+    // Default top screen
+    this->top_screen= new MainMenuScreen();
+    this->custom_screen->set_parent(this->top_screen);
+
+    // see if laser module is enabled
+    void *dummy;
+    this->laser_enabled= PublicData::get_value(laser_checksum, (void *)&dummy);
+
+    this->start_up = false;
+}
+
+// the scheduler will not call this again if any screens end up yielding
 void Panel::on_idle(void *argument)
 {
-    // avoid recursion if any screens end up calling ON_IDLE
-    if(in_idle) return;
-    in_idle= true;
     idle_processing();
-    in_idle= false;
 }
 // On idle things, we don't want to do shit in interrupts
 // don't queue gcodes in this
 void Panel::idle_processing()
 {
-    if (this->start_up) {
-        this->lcd->init();
-
-        Version v;
-        string build(v.get_build());
-        string date(v.get_build_date());
-        this->lcd->clear();
-        this->lcd->setCursor(0, 0); this->lcd->printf("Welcome to Smoothie");
-        this->lcd->setCursor(0, 1); this->lcd->printf("%s", build.substr(0, 20).c_str());
-        this->lcd->setCursor(0, 2); this->lcd->printf("%s", date.substr(0, 20).c_str());
-        this->lcd->setCursor(0, 3); this->lcd->printf("Please wait....");
-
-        if (this->lcd->hasGraphics()) {
-            this->lcd->bltGlyph(24, 40, ohw_logo_antipixel_width, ohw_logo_antipixel_height, ohw_logo_antipixel_bits);
-        }
-
-        this->lcd->on_refresh(true); // tell lcd to display now
-
-        // Default top screen
-        this->top_screen= new MainMenuScreen();
-        this->custom_screen->set_parent(this->top_screen);
-
-        // see if laser module is enabled
-        void *dummy;
-        this->laser_enabled= PublicData::get_value(laser_checksum, (void *)&dummy);
-
-        this->start_up = false;
-        return;
-    }
+    // nothing to do until start has been called
+    if (this->start_up) return;
 
     MainMenuScreen *mms= static_cast<MainMenuScreen*>(this->top_screen);
     // after being idle for a while switch to Watch screen
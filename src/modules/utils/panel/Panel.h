@@ -99,6 +99,7 @@ class Panel : public Module {
 
     private:
 
+        void start(uint32_t);
         void idle_processing();
         // external SD card
         bool mount_external_sd(bool on);
@@ -149,7 +150,6 @@ class Panel : public Module {
             bool control_value_changed:1;
             bool external_sd_enable:1;
             bool laser_enabled:1;
-            bool in_idle:1;
             bool display_extruder:1;
             volatile bool counter_changed:1;
             volatile bool click_changed:1;
@@ -99,7 +99,7 @@ ST7565::ST7565(uint8_t variant)
         mosi = P0_18; miso = P0_17; sclk = P0_15;
     }
 
-    this->spi = new mbed::SPI(mosi, miso, sclk);
+    this->spi = new SPIDMA(mosi, miso, sclk);
     this->spi->frequency(THEKERNEL->config->value(panel_checksum, spi_frequency_checksum)->by_default(1000000)->as_number()); //4Mhz freq, can try go a little lower
 
     //chip select
@@ -176,6 +176,7 @@ ST7565::~ST7565()
 //send commands to lcd
 void ST7565::send_commands(const unsigned char *buf, size_t size)
 {
+    spi->wait(); // for any data still being sent
     cs.set(0);
     if(a0.connected()) a0.set(0);
     while(size-- > 0) {
@@ -187,8 +188,13 @@ void ST7565::send_commands(const unsigned char *buf, size_t size)
 //send data to lcd
 void ST7565::send_data(const unsigned char *buf, size_t size)
 {
+    spi->wait(); // for any data still being sent
     cs.set(0);
     if(a0.connected()) a0.set(1);
+
+    // the framebuffer is in AHB0 so it can be sent with DMA, chip select is released from the DMA interrupt when it is done
+    if(spi->start_write(buf, size, [this]() { cs.set(1); if(a0.connected()) a0.set(0); })) return;
+
     while(size-- > 0) {
         spi->write(*buf++);
     }
@@ -11,6 +11,7 @@
 #include "LcdBase.h"
 #include "mbed.h"
 #include "libs/Pin.h"
+#include "SPIDMA.h"
 
 class ST7565: public LcdBase {
 public:
@@ -66,7 +67,7 @@ private:
 
     //buffer
     unsigned char *framebuffer;
-    mbed::SPI* spi;
+    SPIDMA* spi;
     Pin cs;
     Pin rst;
     Pin a0;
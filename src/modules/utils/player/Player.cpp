@@ -20,6 +20,7 @@
 #include "Config.h"
 #include "ConfigValue.h"
 #include "SDFAT.h"
+#include "platform_memory.h"
 
 #include "modules/robot/Conveyor.h"
 #include "DirHandle.h"
@@ -41,6 +42,11 @@
 #define after_suspend_gcode_checksum      CHECKSUM("after_suspend_gcode")
 #define before_resume_gcode_checksum      CHECKSUM("before_resume_gcode")
 #define leave_heaters_on_suspend_checksum CHECKSUM("leave_heaters_on_suspend")
+#define player_read_ahead_size_checksum   CHECKSUM("player_read_ahead_size")
+#define player_lines_per_loop_checksum    CHECKSUM("player_lines_per_loop")
+
+#define SECTOR_SIZE 512
+#define MAX_LINE_LENGTH 130 // lines upto 128 characters are allowed, anything longer is discarded
 
 extern SDFAT mounter;
 
@@ -54,6 +60,10 @@ Player::Player()
     this->suspended= false;
     this->suspend_loops= 0;
     this->abort_flag= false;
+    this->rbuf= nullptr;
+    this->rbuf_size= 0;
+    this->lines_per_loop= 1;
+    reset_read_ahead();
 }
 
 void Player::on_module_loaded()
@@ -61,9 +71,9 @@ void Player::on_module_loaded()
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
     this->register_for_event(ON_GCODE_RECEIVED);
+    PublicData::register_get(player_checksum, 0, [this](PublicDataRequest *pdr) { this->on_get_public_data(pdr); });
+    PublicData::register_set(player_checksum, 0, [this](PublicDataRequest *pdr) { this->on_set_public_data(pdr); });
     this->register_for_event(ON_HALT);
 
     this->on_boot_gcode = THEKERNEL->config->value(on_boot_gcode_checksum)->by_default("/sd/on_boot.gcode")->as_string();
@@ -74,6 +84,112 @@ void Player::on_module_loaded()
     std::replace( this->after_suspend_gcode.begin(), this->after_suspend_gcode.end(), '_', ' '); // replace _ with space
     std::replace( this->before_resume_gcode.begin(), this->before_resume_gcode.end(), '_', ' '); // replace _ with space
     this->leave_heaters_on = THEKERNEL->config->value(leave_heaters_on_suspend_checksum)->by_default(false)->as_bool();
+
+    // how many lines may be fed to the planner per main loop, also limited by the free space in the planner queue
+    int n = THEKERNEL->config->value(player_lines_per_loop_checksum)->by_default(4)->as_int();
+    this->lines_per_loop = (n < 1) ? 1 : (n > 255) ? 255 : n;
+
+    // the read ahead buffer is a whole number of sectors, with room for the partial line carried over between reads
+    size_t sz = THEKERNEL->config->value(player_read_ahead_size_checksum)->by_default(1024)->as_int();
+    if(sz < SECTOR_SIZE) sz = SECTOR_SIZE;
+    sz = (sz / SECTOR_SIZE) * SECTOR_SIZE;
+    this->rbuf = (char *)AHB0.alloc(sz + MAX_LINE_LENGTH);
+    if(this->rbuf == nullptr) {
+        // not enough room in AHB0 so use the main heap
+        this->rbuf = (char *)malloc(sz + MAX_LINE_LENGTH);
+    }
+    this->rbuf_size = (this->rbuf == nullptr) ? 0 : sz + MAX_LINE_LENGTH;
+}
+
+// called whenever a new file is opened
+void Player::reset_read_ahead()
+{
+    this->rbuf_head = this->rbuf_tail = 0;
+    this->rbuf_eof = false;
+    this->rbuf_discard = false;
+    this->lines_played = 0;
+    this->sd_wait_us = 0;
+
+    if(this->current_file_handler != nullptr) {
+        // we do our own buffering so the reads go straight to FatFs and whole sectors are read directly into our buffer
+        setvbuf(this->current_file_handler, NULL, _IONBF, 0);
+    }
+}
+
+// move the play position to the given byte offset in the file, the file keeps its cluster link map so this does not depend on the file size
+bool Player::seek_to(long pos)
+{
+    if(this->current_file_handler == nullptr || pos < 0 || (this->file_size > 0 && pos > this->file_size)) return false;
+    if(fseek(this->current_file_handler, pos, SEEK_SET) != 0) return false;
+
+    // throw away whatever was read ahead
+    this->rbuf_head = this->rbuf_tail = 0;
+    this->rbuf_eof = false;
+    this->rbuf_discard = false;
+    this->played_cnt = pos;
+    return true;
+}
+
+// files can only be played if the read ahead buffer could be allocated
+bool Player::can_play(StreamOutput *stream)
+{
+    if(this->rbuf != nullptr) return true;
+    stream->printf("error: no memory for the read ahead buffer, can not play files\r\n");
+    return false;
+}
+
+// get the next complete line from the read ahead buffer, refilling it from the file when needed
+// line points into the buffer and is only valid until the next call, len includes the line terminator
+// returns false at end of file
+bool Player::read_line(char*& line, size_t& len)
+{
+    for (;;) {
+        char *start = this->rbuf + this->rbuf_head;
+        size_t avail = this->rbuf_tail - this->rbuf_head;
+        char *nl = (char *)memchr(start, '\n', avail);
+
+        if(nl != nullptr) {
+            len = nl - start + 1;
+            this->rbuf_head += len;
+            if(this->rbuf_discard) {
+                // end of a long line we are discarding
+                this->rbuf_discard = false;
+                this->played_cnt += len;
+                continue;
+            }
+            line = start;
+            return true;
+        }
+
+        if(this->rbuf_eof) {
+            // last line may not have a terminating newline
+            this->rbuf_head = this->rbuf_tail;
+            if(avail == 0 || this->rbuf_discard) return false;
+            line = start;
+            len = avail;
+            return true;
+        }
+
+        if(avail >= MAX_LINE_LENGTH - 1) {
+            // discard long line
+            if(this->current_stream != nullptr) { this->current_stream->printf("Warning: Discarded long line\n"); }
+            this->rbuf_discard = true;
+            this->played_cnt += avail;
+            this->rbuf_head = this->rbuf_tail = 0;
+            continue;
+        }
+
+        // move the partial line to the start of the buffer and read as many whole sectors as will fit after it
+        if(avail > 0 && this->rbuf_head > 0) memmove(this->rbuf, start, avail);
+        this->rbuf_head = 0;
+        this->rbuf_tail = avail;
+        size_t n = ((this->rbuf_size - avail) / SECTOR_SIZE) * SECTOR_SIZE;
+        uint32_t t = us_ticker_read();
+        size_t r = fread(this->rbuf + avail, 1, n, this->current_file_handler);
+        this->sd_wait_us += us_ticker_read() - t;
+        this->rbuf_tail += r;
+        if(r < n) this->rbuf_eof = true;
+    }
 }
 
 // this can be called from on_idle so nothing downstream can call on_idle
@@ -133,6 +249,7 @@ void Player::on_gcode_received(void *argument)
                 fclose(this->current_file_handler);
             }
             this->current_file_handler = fopen( this->filename.c_str(), "r");
+            this->reset_read_ahead();
 
             if(this->current_file_handler == NULL) {
                 gcode->stream->printf("file.open failed: %s\r\n", this->filename.c_str());
@@ -156,7 +273,7 @@ void Player::on_gcode_received(void *argument)
             this->elapsed_secs = 0;
 
         } else if (gcode->m == 24) { // start print
-            if (this->current_file_handler != NULL) {
+            if (this->current_file_handler != NULL && can_play(gcode->stream)) {
                 this->playing_file = true;
                 // this would be a problem if the stream goes away before the file has finished,
                 // so we attach it to the kernel stream, however network connections from pronterface
@@ -168,7 +285,13 @@ void Player::on_gcode_received(void *argument)
             this->playing_file = false;
 
         } else if (gcode->m == 26) { // Reset print. Slightly different than M26 in Marlin and the rest
-            if(this->current_file_handler != NULL) {
+            if(this->current_file_handler != NULL && gcode->has_letter('S')) {
+                // set the SD position in bytes, as Marlin does
+                if(!this->seek_to(gcode->get_uint('S'))) {
+                    gcode->stream->printf("seek failed\r\n");
+                }
+
+            } else if(this->current_file_handler != NULL) {
                 string currentfn = this->filename.c_str();
                 unsigned long old_size = this->file_size;
 
@@ -178,6 +301,7 @@ void Player::on_gcode_received(void *argument)
                 if(!currentfn.empty()) {
                     // reload the last file opened
                     this->current_file_handler = fopen(currentfn.c_str() , "r");
+                    this->reset_read_ahead();
 
                     if(this->current_file_handler == NULL) {
                         gcode->stream->printf("file.open failed: %s\r\n", currentfn.c_str());
@@ -195,6 +319,8 @@ void Player::on_gcode_received(void *argument)
             progress_command("-b", gcode->stream);
 
         } else if (gcode->m == 32) { // select file and start print
+            if(!can_play(gcode->stream)) return;
+
             // Get filename
             this->filename = "/sd/" + args; // filename is whatever is in args including spaces
             this->current_stream = nullptr;
@@ -205,6 +331,8 @@ void Player::on_gcode_received(void *argument)
             }
 
             this->current_file_handler = fopen( this->filename.c_str(), "r");
+            this->reset_read_ahead();
+
             if(this->current_file_handler == NULL) {
                 gcode->stream->printf("file.open failed: %s\r\n", this->filename.c_str());
             } else {
@@ -289,11 +417,15 @@ void Player::play_command( string parameters, StreamOutput *stream )
         return;
     }
 
+    if(!can_play(stream)) return;
+
     if(this->current_file_handler != NULL) { // must have been a paused print
         fclose(this->current_file_handler);
     }
 
     this->current_file_handler = fopen( this->filename.c_str(), "r");
+    this->reset_read_ahead();
+
     if(this->current_file_handler == NULL) {
         stream->printf("File not found: %s\r\n", this->filename.c_str());
         return;
@@ -359,6 +491,9 @@ void Player::progress_command( string parameters, StreamOutput *stream )
             if(est > 0) {
                 stream->printf(", est time: %02lu:%02lu:%02lu",  est / 3600, (est % 3600) / 60, est % 60);
             }
+            if(this->elapsed_secs > 0) {
+                stream->printf(", lines/sec: %lu, sd wait: %lu ms", this->lines_played / this->elapsed_secs, (unsigned long)(this->sd_wait_us / 1000));
+            }
             stream->printf("\r\n");
         } else {
             stream->printf("SD printing byte %lu/%lu\r\n", played_cnt, file_size);
@@ -427,41 +562,33 @@ void Player::on_main_loop(void *argument)
             return;
         }
 
-        char buf[130]; // lines upto 128 characters are allowed, anything longer is discarded
-        bool discard = false;
-
-        while(fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
-            int len = strlen(buf);
-            if(len == 0) continue; // empty line? should not be possible
-            if(buf[len - 1] == '\n' || feof(this->current_file_handler)) {
-                if(discard) { // we are discarding a long line
-                    discard = false;
-                    continue;
-                }
-                if(len == 1) continue; // empty line
-                if(buf[len - 2] == '\r') {
-                    // \r\n terminated ignore \r
-                    len -=1;
-                    if(len == 1) continue; // empty line
-                }
-                if(this->current_stream != nullptr) {
-                    this->current_stream->printf("%s", buf);
-                }
+        // feed a batch of lines per main loop, but no more than the planner queue has room for
+        unsigned int budget = std::min((unsigned int)this->lines_per_loop, THECONVEYOR->get_queue_free());
+        if(budget == 0) budget = 1; // this one will wait for the queue to have enough room
+
+        char *line;
+        size_t len;
+        while(read_line(line, len)) {
+            this->played_cnt += len;
+            size_t n = len;
+            if(line[n - 1] == '\n') --n;
+            if(n > 0 && line[n - 1] == '\r') --n; // \r\n terminated ignore \r
+            if(n == 0) continue; // empty line
+
+            if(this->current_stream != nullptr) {
+                this->current_stream->printf("%.*s\n", (int)n, line);
+            }
 
-                struct SerialMessage message;
-                message.message.assign(buf, len-1); // we do not want to include the \n
-                message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
+            struct SerialMessage message;
+            message.message.assign(line, n); // we do not want to include the \n
+            message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
 
-                // waits for the queue to have enough room
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-                played_cnt += len;
-                return; // we feed one line per main loop
+            // waits for the queue to have enough room
+            THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+            this->lines_played++;
 
-            } else {
-                // discard long line
-                if(this->current_stream != nullptr) { this->current_stream->printf("Warning: Discarded long line\n"); }
-                discard = true;
-            }
+            // the line may have paused, suspended, aborted or halted the play
+            if(--budget == 0 || !this->playing_file || this->abort_flag || THEKERNEL->is_halted()) return;
         }
 
         this->playing_file = false;
@@ -667,7 +794,7 @@ void Player::resume_command(string parameters, StreamOutput *stream )
             if(timeup) stream->printf("\n");
 
             if(wait)
-                THEKERNEL->call_event(ON_IDLE, this);
+                THEKERNEL->yield();
 
             if(THEKERNEL->is_halted()) {
                 // abort temp wait and rest of resume
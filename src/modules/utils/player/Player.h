@@ -39,6 +39,10 @@ class Player : public Module {
         void resume_command( string parameters, StreamOutput* stream );
         string extract_options(string& args);
         void suspend_part2();
+        void reset_read_ahead();
+        bool can_play(StreamOutput *stream);
+        bool read_line(char*& line, size_t& len);
+        bool seek_to(long pos);
 
         string filename;
         string after_suspend_gcode;
@@ -51,6 +55,15 @@ class Player : public Module {
         long file_size;
         unsigned long played_cnt;
         unsigned long elapsed_secs;
+
+        // read ahead buffer, filled in sector sized chunks
+        char *rbuf;
+        size_t rbuf_size;
+        size_t rbuf_head; // next unconsumed byte
+        size_t rbuf_tail; // end of valid data
+        uint8_t lines_per_loop;
+        unsigned long lines_played;
+        uint64_t sd_wait_us; // time spent waiting on reads from the sd card
         float saved_position[3]; // only saves XYZ
         std::map<uint16_t, float> saved_temperatures;
         struct {
@@ -62,6 +75,8 @@ class Player : public Module {
             bool leave_heaters_on:1;
             bool override_leave_heaters_on:1;
             bool abort_flag:1;
+            bool rbuf_eof:1;
+            bool rbuf_discard:1;
             uint8_t suspend_loops:4;
         };
 };
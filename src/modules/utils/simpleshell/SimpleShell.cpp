@@ -13,6 +13,9 @@
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
+#include "libs/SlowTicker.h"
+#include "libs/Perf.h"
+#include "libs/Trace.h"
 #include "Conveyor.h"
 #include "DirHandle.h"
 #include "mri.h"
@@ -37,6 +40,8 @@
 #include "platform_memory.h"
 #include "SwitchPublicAccess.h"
 #include "SDFAT.h"
+#include "DiskCache.h"
+#include "libs/USBDevice/USBSerial/USBSerial.h"
 #include "Thermistor.h"
 #include "md5.h"
 #include "utils.h"
@@ -78,6 +83,10 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
     {"?",        SimpleShell::help_command},
     {"version",  SimpleShell::version_command},
     {"mem",      SimpleShell::mem_command},
+    {"tasks",    SimpleShell::tasks_command},
+    {"boot",     SimpleShell::boot_command},
+    {"perf",     SimpleShell::perf_command},
+    {"trace",    SimpleShell::trace_command},
     {"get",      SimpleShell::get_command},
     {"set_temp", SimpleShell::set_temp_command},
     {"switch",   SimpleShell::switch_command},
@@ -337,6 +346,8 @@ void SimpleShell::ls_command( string parameters, StreamOutput *stream )
 }
 
 extern SDFAT mounter;
+extern DiskCache sdcache;
+extern USBSerial usbserial;
 
 void SimpleShell::remount_command( string parameters, StreamOutput *stream )
 {
@@ -443,7 +454,7 @@ void SimpleShell::cat_command( string parameters, StreamOutput *stream )
             buffer.clear();
             if(linecnt > 80) linecnt = 0;
             // we need to kick things or they die
-            THEKERNEL->call_event(ON_IDLE);
+            THEKERNEL->yield();
         }
         if ( newlines == limit ) {
             break;
@@ -487,7 +498,7 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
     while(uploading) {
         if(!stream->ready()) {
             // we need to kick things or they die
-            THEKERNEL->call_event(ON_IDLE);
+            THEKERNEL->yield();
             continue;
         }
 
@@ -512,7 +523,7 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
             } else {
                 if ((cnt%1000) == 0) {
                     // we need to kick things or they die
-                    THEKERNEL->call_event(ON_IDLE);
+                    THEKERNEL->yield();
                 }
             }
         }
@@ -523,7 +534,7 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
         if(stream->ready()) {
             c= stream->_getc();
         }else{
-            THEKERNEL->call_event(ON_IDLE);
+            THEKERNEL->yield();
             c= 0;
         }
     } while(c != 4 && c != 26);
@@ -549,7 +560,7 @@ void SimpleShell::load_command( string parameters, StreamOutput *stream )
             Gcode *gcode = new Gcode(buf, &StreamOutput::NullStream);
             THEKERNEL->call_event(ON_GCODE_RECEIVED, gcode);
             delete gcode;
-            THEKERNEL->call_event(ON_IDLE);
+            THEKERNEL->yield();
         }
         stream->printf("config override file executed\n");
         fclose(fp);
@@ -607,6 +618,8 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
     stream->printf("Total Free RAM: %lu bytes\r\n", m + f);
 
     stream->printf("Free AHB0: %lu, AHB1: %lu\r\n", AHB0.free(), AHB1.free());
+    stream->printf("SD cache hits: %lu, misses: %lu\r\n", sdcache.get_hits(), sdcache.get_misses());
+    stream->printf("USB serial output dropped: %lu\r\n", usbserial.get_tx_dropped());
     if (verbose) {
         AHB0.debug(stream);
         AHB1.debug(stream);
@@ -615,6 +628,125 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
     stream->printf("Block size: %u bytes, Tickinfo size: %u bytes\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators);
 }
 
+// show how much time each main loop and idle task is taking
+void SimpleShell::tasks_command( string parameters, StreamOutput *stream)
+{
+    bool reset = shift_parameter( parameters ).find_first_of("Rr") != string::npos;
+    const char *names[]= {"main loop", "idle"};
+    const _EVENT_ENUM events[]= {ON_MAIN_LOOP, ON_IDLE};
+    uint64_t total= 0;
+    for (int e = 0; e < 2; ++e) {
+        for(auto &t : THEKERNEL->get_tasks(events[e])) total += t.total_us;
+    }
+
+    for (int e = 0; e < 2; ++e) {
+        stream->printf("%s tasks:\r\n", names[e]);
+        for(auto &t : THEKERNEL->get_tasks(events[e])) {
+            stream->printf(" %s: period %luus, budget %luus, calls %lu, avg %luus, max %luus, overruns %lu, %lu%%\r\n",
+                t.module->get_module_name(), t.period_us, t.budget_us, t.calls, t.calls ? (uint32_t)(t.total_us / t.calls) : 0, t.max_us, t.overruns,
+                total ? (uint32_t)(t.total_us * 100ULL / total) : 0);
+        }
+    }
+
+    const Kernel::deferred_stats_t &d = THEKERNEL->get_deferred_stats();
+    stream->printf("deferred calls: %lu, max latency %luus\r\n", d.calls, d.max_latency_us);
+
+    SlowTicker::load_t l = THEKERNEL->slow_ticker->get_load();
+    stream->printf("slow ticker: %u hooks, %lu interrupts/s, %lu calls/s, busy %luus/s (%lu.%lu%%), max %luus\r\n",
+        l.hooks, l.interrupts, l.calls, l.busy_us, l.busy_us / 10000, (l.busy_us / 1000) % 10, l.max_us);
+
+    if(reset) THEKERNEL->reset_task_stats();
+}
+
+// show how long each phase of the boot and each module took, and the inits done after the machine was ready
+void SimpleShell::boot_command( string parameters, StreamOutput *stream)
+{
+    auto ms= [](uint32_t us) { return us / 1000; };
+    auto tenths= [](uint32_t us) { return (us / 100) % 10; };
+    const std::vector<Kernel::boot_step_t> &steps= THEKERNEL->get_boot_steps();
+
+    stream->printf("boot:\r\n");
+    for(auto &s : steps) {
+        if(s.late) continue;
+        stream->printf(" %-24s at %6lu.%lums took %6lu.%lums\r\n", s.name, ms(s.start_us), tenths(s.start_us), ms(s.us), tenths(s.us));
+    }
+
+    uint32_t ready= THEKERNEL->get_ready_us();
+    stream->printf("ready at %lu.%lums\r\n", ms(ready), tenths(ready));
+
+    stream->printf("after ready:\r\n");
+    for(auto &s : steps) {
+        if(!s.late) continue;
+        stream->printf(" %-24s at %6lu.%lums took %6lu.%lums\r\n", s.name, ms(s.start_us), tenths(s.start_us), ms(s.us), tenths(s.us));
+    }
+}
+
+#ifdef ENABLE_PERF
+static void print_perf(StreamOutput *stream, const char *name, const Module *module, const perf_counter_t &c)
+{
+    if(c.calls == 0) return;
+    if(module != nullptr) {
+        stream->printf(" %s %s: calls %lu, cycles min %lu, avg %lu, max %lu\r\n", name, module->get_module_name(), c.calls, c.min, (uint32_t)(c.total / c.calls), c.max);
+    } else {
+        stream->printf(" %s: calls %lu, cycles min %lu, avg %lu, max %lu\r\n", name, c.calls, c.min, (uint32_t)(c.total / c.calls), c.max);
+    }
+}
+#endif
+
+// show the cycles used by each interrupt and each module's event handlers
+void SimpleShell::perf_command( string parameters, StreamOutput *stream)
+{
+#ifdef ENABLE_PERF
+    bool reset = shift_parameter( parameters ).find_first_of("Rr") != string::npos;
+    // in the same order as _EVENT_ENUM
+    static const char * const event_names[NUMBER_OF_DEFINED_EVENTS]= {
+        "main_loop", "console_line_received", "gcode_received", "idle", "second_tick",
+        "get_public_data", "set_public_data", "halt", "enable"
+    };
+
+    stream->printf("%lu cycles per us\r\n", SystemCoreClock / 1000000);
+    stream->printf("interrupts:\r\n");
+    for (int i = 0; i < Perf::NUMBER_OF_ISRS; ++i) {
+        print_perf(stream, Perf::isr_names[i], nullptr, Perf::isrs[i]);
+    }
+
+    stream->printf("event handlers (not counting the interrupts above, other interrupts that preempt them are included):\r\n");
+    for (int e = 0; e < NUMBER_OF_DEFINED_EVENTS; ++e) {
+        _EVENT_ENUM id = (_EVENT_ENUM)e;
+        if(id == ON_MAIN_LOOP || id == ON_IDLE) {
+            for(auto &t : THEKERNEL->get_tasks(id)) print_perf(stream, event_names[e], t.module, t.perf);
+        } else {
+            const std::vector<Module*> &hooks = THEKERNEL->get_hooks(id);
+            const std::vector<perf_counter_t> &perf = THEKERNEL->get_hook_perf(id);
+            for (size_t i = 0; i < hooks.size() && i < perf.size(); ++i) print_perf(stream, event_names[e], hooks[i], perf[i]);
+        }
+    }
+
+    if(reset) THEKERNEL->reset_perf();
+#else
+    stream->printf("perf is not enabled, build with ENABLE_PERF=1\r\n");
+#endif
+}
+
+// dump or clear the event trace
+void SimpleShell::trace_command( string parameters, StreamOutput *stream)
+{
+    if(Trace::instance == nullptr) {
+        stream->printf("trace is not enabled, set trace.enable true in config\r\n");
+        return;
+    }
+
+    string cmd = shift_parameter(parameters);
+    if(cmd == "dump") {
+        string filename = absolute_from_relative(parameters.empty() ? "/sd/trace.bin" : shift_parameter(parameters));
+        Trace::instance->dump(filename.c_str(), stream);
+    } else if(cmd == "clear") {
+        Trace::instance->clear();
+    } else {
+        Trace::instance->status(stream);
+    }
+}
+
 static uint32_t getDeviceType()
 {
 #define IAP_LOCATION 0x1FFF1FF1
@@ -886,7 +1018,9 @@ void SimpleShell::get_command( string parameters, StreamOutput *stream)
 
     } else if (what == "status") {
         // also ? on serial and usb
-        stream->printf("%s\n", THEKERNEL->get_query_string().c_str());
+        char buf[Kernel::QUERY_STRING_SIZE];
+        THEKERNEL->get_query_string(buf, sizeof(buf));
+        stream->printf("%s\n", buf);
 
     } else {
         stream->printf("error:unknown option %s\n", what.c_str());
@@ -1021,7 +1155,7 @@ void SimpleShell::md5sum_command( string parameters, StreamOutput *stream )
     do {
         size_t n= fread(buf, 1, sizeof buf, lp);
         if(n > 0) md5.update(buf, n);
-        THEKERNEL->call_event(ON_IDLE);
+        THEKERNEL->yield();
     } while(!feof(lp));
 
     stream->printf("%s %s\n", md5.finalize().hexdigest().c_str(), filename.c_str());
@@ -1327,6 +1461,10 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("Commands:\r\n");
     stream->printf("version\r\n");
     stream->printf("mem [-v]\r\n");
+    stream->printf("perf [-r] - show the cycles used by the interrupts and event handlers, -r resets them\r\n");
+    stream->printf("trace [dump [file]|clear] - write the event trace to a file (default /sd/trace.bin) or clear it\r\n");
+    stream->printf("boot - show the time taken by each phase of the boot and each module\r\n");
+    stream->printf("tasks [-r] - show the main loop and idle task times, deferred calls and the slow ticker load, -r resets the times\r\n");
     stream->printf("ls [-s] [folder]\r\n");
     stream->printf("cd folder\r\n");
     stream->printf("pwd\r\n");
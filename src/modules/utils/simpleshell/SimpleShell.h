@@ -55,6 +55,10 @@ private:
 
     static void switch_command(string parameters, StreamOutput *stream );
     static void mem_command(string parameters, StreamOutput *stream );
+    static void tasks_command(string parameters, StreamOutput *stream );
+    static void boot_command(string parameters, StreamOutput *stream );
+    static void perf_command(string parameters, StreamOutput *stream );
+    static void trace_command(string parameters, StreamOutput *stream );
 
     static void net_command( string parameters, StreamOutput *stream);
 
@@ -68,15 +68,19 @@ Kernel::Kernel(){
 }
 
 // Add a module to Kernel. We don't actually hold a list of modules we just call its on_module_loaded
-void Kernel::add_module(Module* module){
+void Kernel::add_module(Module* module, const char *name){
     module->on_module_loaded();
 }
 
 // Adds a hook for a given module and event
-void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod){
+void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod, uint32_t period_us, uint32_t budget_us, bool at_yield){
     this->hooks[id_event].push_back(mod);
 }
 
+void Kernel::yield(){
+    call_event(ON_IDLE);
+}
+
 static std::map<_EVENT_ENUM, std::function<void(void*)> > event_callbacks;
 
 // Call a specific event with an argument
@@ -0,0 +1,106 @@
+#include "MemoryPool.h"
+#include "StreamOutput.h"
+
+#include <string.h>
+
+#include "easyunit/test.h"
+
+// the pools are tested on their own memory so this does not disturb AHB0 or AHB1
+static const int pool_size= 8192;
+static uint8_t pool_mem[pool_size] __attribute__ ((aligned (4)));
+
+TEST(MemoryPoolTest,alloc_free)
+{
+    MemoryPool pool(pool_mem, pool_size);
+    int f= pool.free();
+    ASSERT_EQUALS_V(pool_size, f);
+    ASSERT_EQUALS_V(f, (int)pool.largest_free());
+
+    void *a= pool.alloc(1);
+    void *b= pool.alloc(100);
+    void *c= pool.alloc(1000);
+    ASSERT_TRUE(a != nullptr && b != nullptr && c != nullptr);
+    ASSERT_TRUE(pool.has(a) && pool.has(b) && pool.has(c));
+    ASSERT_EQUALS_V(0, ((int)((uint8_t*)a - pool_mem) & 3));
+    ASSERT_EQUALS_V(0, ((int)((uint8_t*)b - pool_mem) & 3));
+    ASSERT_TRUE((int)pool.free() < f);
+
+    // free them out of order, the neighbours should all be merged back into one block
+    pool.dealloc(b);
+    pool.dealloc(a);
+    pool.dealloc(c);
+    ASSERT_EQUALS_V(f, (int)pool.free());
+    ASSERT_EQUALS_V(f, (int)pool.largest_free());
+    ASSERT_TRUE(pool.get_high_water() >= 1100);
+
+    pool.debug(&StreamOutput::NullStream);
+}
+
+TEST(MemoryPoolTest,exhaust)
+{
+    MemoryPool pool(pool_mem, pool_size);
+
+    // a request that can't fit fails, and the whole pool can be had in one go
+    ASSERT_TRUE(pool.alloc(pool_size) == nullptr);
+    void *p= pool.alloc(pool_size - 4);
+    ASSERT_TRUE(p != nullptr);
+    ASSERT_EQUALS_V(0, (int)pool.free());
+    ASSERT_TRUE(pool.alloc(1) == nullptr);
+    pool.dealloc(p);
+
+    // fill it with small blocks then free every other one, the free memory is then all in small pieces
+    static void *blocks[pool_size / 16];
+    int n= 0;
+    while(n < pool_size / 16 && (blocks[n]= pool.alloc(12)) != nullptr) n++;
+    ASSERT_EQUALS_V(pool_size / 16, n);
+    for (int i = 0; i < n; i += 2) pool.dealloc(blocks[i]);
+    ASSERT_EQUALS_V(16, (int)pool.largest_free());
+    ASSERT_TRUE(pool.alloc(16) == nullptr);
+    p= pool.alloc(12);
+    ASSERT_TRUE(p != nullptr);
+    pool.dealloc(p);
+
+    for (int i = 1; i < n; i += 2) pool.dealloc(blocks[i]);
+    ASSERT_EQUALS_V(pool_size, (int)pool.free());
+    ASSERT_EQUALS_V(pool_size, (int)pool.largest_free());
+}
+
+TEST(MemoryPoolTest,stress)
+{
+    MemoryPool pool(pool_mem, pool_size);
+    const int nslots= 64;
+    uint8_t *slots[nslots];
+    size_t sizes[nslots];
+    memset(slots, 0, sizeof(slots));
+
+    // random allocs and frees, each block is filled with its own pattern which must still be there when it is freed
+    uint32_t seed= 12345;
+    auto rnd= [&seed]() { seed= seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+    for (int i = 0; i < 20000; ++i) {
+        int s= rnd() % nslots;
+        if(slots[s] == nullptr) {
+            size_t n= (rnd() & 1) ? rnd() % 32 + 1 : rnd() % 600 + 1;
+            slots[s]= (uint8_t *)pool.alloc(n);
+            if(slots[s] == nullptr) continue;
+            sizes[s]= n;
+            memset(slots[s], s, n);
+
+        } else {
+            for (size_t j = 0; j < sizes[s]; ++j) {
+                if(slots[s][j] != s) {
+                    FAIL_M("block was overwritten");
+                    return;
+                }
+            }
+            pool.dealloc(slots[s]);
+            slots[s]= nullptr;
+        }
+    }
+
+    for (int s = 0; s < nslots; ++s) {
+        if(slots[s] != nullptr) pool.dealloc(slots[s]);
+    }
+
+    ASSERT_EQUALS_V(pool_size, (int)pool.free());
+    ASSERT_EQUALS_V(pool_size, (int)pool.largest_free());
+}
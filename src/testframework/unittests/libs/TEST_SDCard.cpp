@@ -0,0 +1,246 @@
+#include "SDCard.h"
+#include "SPIDMA.h"
+
+#include <deque>
+#include <vector>
+#include <string.h>
+
+#include "easyunit/test.h"
+
+// a simulated SDHC card in SPI mode behind a fake SPI, it answers every byte clocked with what a card would send
+// the block transfers go a byte at a time through the card instead of through the DMA
+// constructing it sets up SSP0 on its usual pins, nothing is ever sent on them
+class FakeCard : public SPIDMA {
+    public:
+        static const int BLOCKS= 4;
+
+        FakeCard() : SPIDMA(P0_18, P0_17, P0_15)
+        {
+            state= IDLE;
+            cmd_len= 0;
+            block= 0;
+            rx_count= 0;
+            reject_block= -1;
+            stop_tokens= 0;
+            block_reads= block_writes= 0;
+            for (int i = 0; i < BLOCKS * 512; ++i) mem[i]= i * 7 + (i >> 9);
+        }
+
+        virtual int write(int value)
+        {
+            // what the card sends was decided before it sees the byte it is sent
+            if(out.empty() && state == READING) send_block();
+            int r= 0xFF;
+            if(!out.empty()) {
+                r= out.front();
+                out.pop_front();
+            }
+
+            if(cmd_len > 0) {
+                cmd[cmd_len++]= value;
+                if(cmd_len == 6) command();
+
+            } else if(state == RECEIVING) {
+                receive(value);
+
+            } else if(state == WRITING && (value == 0xFC || value == 0xFE)) {
+                // start of a data block
+                state= RECEIVING;
+                rx_count= 0;
+
+            } else if(state == WRITING && value == 0xFD) {
+                // stop tran token, then busy while the card finishes programming
+                stop_tokens++;
+                state= IDLE;
+                out.assign({0xFF, 0x00, 0x00});
+
+            } else if((value & 0xC0) == 0x40) {
+                cmd[0]= value;
+                cmd_len= 1;
+            }
+            return r;
+        }
+
+        virtual void read_block(uint8_t *buf, size_t len) { block_reads++; while(len-- > 0) *buf++= write(0xFF); }
+        virtual void write_block(const uint8_t *buf, size_t len) { block_writes++; while(len-- > 0) write(*buf++); }
+        virtual void wait() {}
+
+        uint8_t mem[BLOCKS * 512];
+        std::vector<int> cmds;  // every command the card received
+        int reject_block;       // block whose data is rejected with a write error, -1 for none
+        int stop_tokens;
+        int block_reads, block_writes;
+
+    private:
+        enum STATE { IDLE, READING, WRITING, RECEIVING };
+
+        void command()
+        {
+            int c= cmd[0] & 0x3F;
+            uint32_t arg= (cmd[1] << 24) | (cmd[2] << 16) | (cmd[3] << 8) | cmd[4];
+            cmd_len= 0;
+            cmds.push_back(c);
+
+            // the response follows one byte later
+            switch(c) {
+                case 0:  out.assign({0xFF, 0x01}); break;
+                case 8:  out.assign({0xFF, 0x01, 0x00, 0x00, 0x01, 0xAA}); break;
+                case 55: out.assign({0xFF, 0x01}); break;
+                case 41: out.assign({0xFF, 0x00}); break;
+                case 58: out.assign({0xFF, 0x00, 0xC0, 0xFF, 0x80, 0x00}); break; // powered up, high capacity
+                case 16: out.assign({0xFF, 0x00}); break;
+                case 9: {
+                    // a version 2 CSD with c_size 1023, which is 1024 * 1024 blocks
+                    uint8_t csd[16]= {0x40, 0, 0, 0, 0, 0, 0, 0x00, 0x03, 0xFF, 0, 0, 0, 0, 0, 0};
+                    out.assign({0xFF, 0x00, 0xFF, 0xFE});
+                    out.insert(out.end(), csd, csd + 16);
+                    out.insert(out.end(), {0xFF, 0xFF});
+                    break;
+                }
+                case 17:
+                    block= arg;
+                    out.assign({0xFF, 0x00});
+                    send_block();
+                    state= IDLE;
+                    break;
+                case 18:
+                    block= arg;
+                    out.assign({0xFF, 0x00});
+                    state= READING;
+                    break;
+                case 24:
+                case 25:
+                    block= arg;
+                    multi= c == 25;
+                    out.assign({0xFF, 0x00});
+                    state= WRITING;
+                    break;
+                case 12:
+                    // stuff byte, R1 then busy
+                    out.assign({0xFF, 0xFF, 0x00, 0x00, 0x00});
+                    state= IDLE;
+                    break;
+                default: out.assign({0xFF, 0x04}); break; // illegal command
+            }
+        }
+
+        void send_block()
+        {
+            out.insert(out.end(), {0xFF, 0xFE});
+            out.insert(out.end(), &mem[(block % BLOCKS) * 512], &mem[(block % BLOCKS) * 512] + 512);
+            out.insert(out.end(), {0xFF, 0xFF});
+            block++;
+        }
+
+        void receive(int value)
+        {
+            if(rx_count < 512) rx[rx_count]= value;
+            if(++rx_count < 514) return; // the data and the crc
+
+            if((int)block == reject_block) {
+                // write error, the card then waits for CMD12
+                out.assign({0x0D});
+                state= WRITING;
+                return;
+            }
+            memcpy(&mem[(block % BLOCKS) * 512], rx, 512);
+            block++;
+            out.assign({0x05, 0x00, 0x00});
+            state= multi ? WRITING : IDLE;
+        }
+
+        std::deque<uint8_t> out;
+        uint8_t cmd[6];
+        uint8_t rx[512];
+        uint32_t block;
+        int cmd_len;
+        int rx_count;
+        STATE state;
+        bool multi;
+};
+
+static char buf[3 * 512];
+
+TEST(SDCardTest,initialize)
+{
+    FakeCard card;
+    SDCard sd(&card, P0_16);
+
+    ASSERT_TRUE(sd.disk_initialize() == 0);
+    ASSERT_TRUE(sd.card_type() == SDCard::SDCARD_V2HC);
+    ASSERT_EQUALS_V(1024 * 1024, (int)sd.disk_sectors());
+}
+
+TEST(SDCardTest,read_multi)
+{
+    FakeCard card;
+    SDCard sd(&card, P0_16);
+    ASSERT_TRUE(sd.disk_initialize() == 0);
+
+    // three blocks are streamed with one CMD18 and ended with CMD12
+    card.cmds.clear();
+    card.block_reads= 0;
+    memset(buf, 0, sizeof(buf));
+    ASSERT_TRUE(sd.disk_read_multi(buf, 1, 3) == 0);
+    ASSERT_EQUALS_V(2, (int)card.cmds.size());
+    ASSERT_EQUALS_V(18, card.cmds[0]);
+    ASSERT_EQUALS_V(12, card.cmds[1]);
+    ASSERT_EQUALS_V(3, card.block_reads);
+    ASSERT_TRUE(memcmp(buf, &card.mem[512], 3 * 512) == 0);
+
+    // a single block is read with CMD17
+    card.cmds.clear();
+    ASSERT_TRUE(sd.disk_read_multi(buf, 0, 1) == 0);
+    ASSERT_EQUALS_V(1, (int)card.cmds.size());
+    ASSERT_EQUALS_V(17, card.cmds[0]);
+    ASSERT_TRUE(memcmp(buf, card.mem, 512) == 0);
+}
+
+TEST(SDCardTest,write_multi)
+{
+    FakeCard card;
+    SDCard sd(&card, P0_16);
+    ASSERT_TRUE(sd.disk_initialize() == 0);
+
+    // three blocks are streamed with one CMD25 and ended with the stop tran token
+    card.cmds.clear();
+    for (int i = 0; i < 3 * 512; ++i) buf[i]= i * 3;
+    ASSERT_TRUE(sd.disk_write_multi(buf, 0, 3) == 0);
+    ASSERT_EQUALS_V(1, (int)card.cmds.size());
+    ASSERT_EQUALS_V(25, card.cmds[0]);
+    ASSERT_EQUALS_V(1, card.stop_tokens);
+    ASSERT_EQUALS_V(3, card.block_writes);
+    ASSERT_TRUE(memcmp(buf, card.mem, 3 * 512) == 0);
+
+    // and the card is ready for the next command
+    card.cmds.clear();
+    ASSERT_TRUE(sd.disk_read_multi(buf, 0, 1) == 0);
+    ASSERT_EQUALS_V(17, card.cmds[0]);
+}
+
+TEST(SDCardTest,write_multi_rejected)
+{
+    FakeCard card;
+    SDCard sd(&card, P0_16);
+    ASSERT_TRUE(sd.disk_initialize() == 0);
+
+    // the card rejects the second block, the transfer is aborted with CMD12 and not the stop tran token
+    card.reject_block= 1;
+    card.cmds.clear();
+    uint8_t old[512];
+    memcpy(old, &card.mem[512], 512);
+    for (int i = 0; i < 3 * 512; ++i) buf[i]= i * 3;
+    ASSERT_TRUE(sd.disk_write_multi(buf, 0, 3) == 1);
+    ASSERT_EQUALS_V(2, (int)card.cmds.size());
+    ASSERT_EQUALS_V(25, card.cmds[0]);
+    ASSERT_EQUALS_V(12, card.cmds[1]);
+    ASSERT_EQUALS_V(0, card.stop_tokens);
+    ASSERT_EQUALS_V(2, card.block_writes);
+    ASSERT_TRUE(memcmp(buf, card.mem, 512) == 0);
+    ASSERT_TRUE(memcmp(old, &card.mem[512], 512) == 0);
+
+    // and the card is ready for the next command
+    card.cmds.clear();
+    ASSERT_TRUE(sd.disk_read_multi(buf, 0, 1) == 0);
+    ASSERT_EQUALS_V(17, card.cmds[0]);
+}
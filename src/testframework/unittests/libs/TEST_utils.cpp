@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "us_ticker_api.h"
+
 #include "easyunit/test.h"
 
 TEST(UtilsTest,split)
@@ -45,3 +47,47 @@ TEST(UtilsTest,append_parameters)
     ASSERT_TRUE(n == 24);
     ASSERT_TRUE(strcmp(buf, "X1.0000 Y2.0000 Z3.0000 ") == 0);
 }
+
+TEST(UtilsTest,format_fixed)
+{
+    char buf[32], ref[32];
+    const float values[]= {0, -0.0F, 1, -1, 0.5F, 2.5F, 1.23456F, -1.23456F, 123.4567F, -0.00001F, 99999.99999F, 1234567.0F, -250.125F};
+
+    for(float v : values) {
+        for (int d = 0; d <= 4; ++d) {
+            size_t n= format_fixed(buf, sizeof(buf), v, d);
+            snprintf(ref, sizeof(ref), "%1.*f", d, v);
+            //printf("%s - %s\n", buf, ref);
+            ASSERT_TRUE(n == strlen(ref));
+            ASSERT_TRUE(strcmp(buf, ref) == 0);
+        }
+    }
+
+    // too small a buffer truncates like snprintf
+    size_t n= format_fixed(buf, 4, 123.4567F, 4);
+    ASSERT_TRUE(n == 3);
+    ASSERT_TRUE(strcmp(buf, "123") == 0);
+}
+
+TEST(UtilsTest,format_fixed_speed)
+{
+    // a query string has about 10 numbers in it, so this is roughly the number of reports per second formatting alone allows
+    char buf[32];
+    const int iterations= 1000;
+
+    uint32_t start= us_ticker_read();
+    for (int i = 0; i < iterations; ++i) {
+        format_fixed(buf, sizeof(buf), i * 1.2345F, 4);
+    }
+    uint32_t fixed_us= us_ticker_read() - start;
+
+    start= us_ticker_read();
+    for (int i = 0; i < iterations; ++i) {
+        snprintf(buf, sizeof(buf), "%1.4f", i * 1.2345F);
+    }
+    uint32_t printf_us= us_ticker_read() - start;
+
+    printf("format_fixed: %lu us, snprintf: %lu us for %d numbers, about %lu vs %lu reports/sec\n",
+        fixed_us, printf_us, iterations, 100000000UL / (fixed_us ? fixed_us : 1), 100000000UL / (printf_us ? printf_us : 1));
+    ASSERT_TRUE(fixed_us < printf_us);
+}
@@ -0,0 +1,124 @@
+#!/usr/bin/env python
+"""\
+Decode an event trace written by Smoothie (trace dump, or /sd/trace.bin after a halt)
+
+Prints a timeline of the events, and a summary of where the planner queue ran dry
+"""
+
+from __future__ import print_function
+import sys
+import argparse
+import struct
+
+# must match Trace::EVENT in src/libs/Trace.h
+BLOCK_START = 1
+BLOCK_FINISH = 2
+QUEUE_DEPTH = 3
+LINE_RECEIVED = 4
+HEATER_PWM = 5
+HALT = 6
+
+names = {
+    BLOCK_START: 'block start',
+    BLOCK_FINISH: 'block finish',
+    QUEUE_DEPTH: 'queue depth',
+    LINE_RECEIVED: 'line received',
+    HEATER_PWM: 'heater pwm',
+    HALT: 'halt',
+}
+
+# Define command line argument interface
+parser = argparse.ArgumentParser(description='Decode a Smoothie event trace file.')
+parser.add_argument('trace_file', type=argparse.FileType('rb'), help='trace file copied from the sdcard')
+parser.add_argument('-c', '--csv', action='store_true', default=False, help='output the events as csv')
+parser.add_argument('-s', '--summary', action='store_true', default=False, help='only print the summary')
+parser.add_argument('-g', '--gap', type=float, default=10.0, help='report gaps between blocks longer than this many ms (default 10)')
+args = parser.parse_args()
+
+data = args.trace_file.read()
+if len(data) < 16 or data[0:4] != b'SMTR':
+    print('not a Smoothie trace file')
+    sys.exit(1)
+
+version, record_size, count, lost = struct.unpack('<HHII', data[4:16])
+if version != 1 or record_size != 8:
+    print('unsupported trace version {} record size {}'.format(version, record_size))
+    sys.exit(1)
+
+records = []
+for i in range(count):
+    off = 16 + i * 8
+    if off + 8 > len(data):
+        print('trace file is truncated, {} of {} records'.format(i, count))
+        break
+    t, ea = struct.unpack('<II', data[off:off + 8])
+    records.append((t, ea & 0xFF, ea >> 8))
+
+if not records:
+    print('trace is empty')
+    sys.exit(0)
+
+# the timestamps are a 32 bit microsecond counter, so unwrap them
+t0 = records[0][0]
+last = t0
+base = 0
+events = []
+for t, e, a in records:
+    if t < last and last - t > 0x80000000:
+        base += 1 << 32
+    last = t
+    events.append((base + t - t0, e, a))
+
+
+def describe(e, a):
+    if e == BLOCK_START:
+        return 'ticks {}'.format(a)
+    if e == QUEUE_DEPTH:
+        return '{} blocks'.format(a)
+    if e == LINE_RECEIVED:
+        return '{} chars'.format(a)
+    if e == HEATER_PWM:
+        return 'heater {} pwm {}'.format(a >> 16, a & 0xFFFF)
+    if e == HALT:
+        return 'asserted' if a else 'cleared'
+    return ''
+
+
+if not args.summary:
+    if args.csv:
+        print('time_us,event,arg')
+    prev = 0
+    for t, e, a in events:
+        if args.csv:
+            print('{},{},{}'.format(t, names.get(e, e), a))
+        else:
+            print('{:12.3f}ms {:+10d}us  {:<14} {}'.format(t / 1000.0, t - prev, names.get(e, 'unknown {}'.format(e)), describe(e, a)))
+        prev = t
+
+# summary
+print('')
+print('{} records over {:.3f}s, {} older records were lost'.format(len(events), events[-1][0] / 1000000.0, lost))
+
+blocks = sum(1 for ev in events if ev[1] == BLOCK_START)
+lines = sum(1 for ev in events if ev[1] == LINE_RECEIVED)
+halts = [ev[0] for ev in events if ev[1] == HALT and ev[2] == 1]
+depths = [ev[2] for ev in events if ev[1] == QUEUE_DEPTH]
+print('{} blocks, {} lines received'.format(blocks, lines))
+if depths:
+    print('queue depth min {}, max {}, average {:.1f}'.format(min(depths), max(depths), sum(depths) / float(len(depths))))
+
+# a gap between a block finishing and the next one starting means the motors stopped, when it happens mid job it is a stutter
+finish = None
+gaps = []
+for t, e, a in events:
+    if e == BLOCK_FINISH:
+        finish = t
+    elif e == BLOCK_START:
+        if finish is not None and (t - finish) / 1000.0 > args.gap:
+            gaps.append((finish, t - finish))
+        finish = None
+print('{} gaps between blocks longer than {}ms'.format(len(gaps), args.gap))
+for t, d in gaps:
+    print('  at {:.3f}ms stopped for {:.3f}ms'.format(t / 1000.0, d / 1000.0))
+for t in halts:
+    print('halt at {:.3f}ms'.format(t / 1000.0))